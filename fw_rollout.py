@@ -0,0 +1,493 @@
+#!/usr/bin/env python3
+"""
+ESP32-C6 Service Bench rack firmware rollout
+Spreads one firmware image over a rack of benches through their peer pull
+endpoint (POST /api/firmware/pull) instead of uploading it to each bench in
+turn. Every bench that holds the image serves it to one bench per round, so
+the number of sources doubles and the rack is done in about log2(N) rounds.
+
+The target is whatever the first bench (the seed) runs, or --sha. Benches of
+another project are left alone; a transfer whose hash does not match is
+retried from another source and the bad source is dropped. With --reboot the
+benches restart into the staged image once every bench has it.
+
+  fw_rollout.py 10.0.0.21 10.0.0.22 10.0.0.23 ...   roll out over real benches
+  fw_rollout.py --serve 8001 --version 1.4.0        one simulated bench on a port
+  fw_rollout.py --sim 12                            rack of simulated benches
+  fw_rollout.py --check                             simulated rack, exits 1 on failure
+"""
+
+import argparse
+import hashlib
+import http.client
+import http.server
+import json
+import math
+import random
+import sys
+import threading
+import time
+import urllib.parse
+
+CHUNK = 1024                 # FW_SHARE_CHUNK
+ATTEMPTS = 3                 # Per bench, each from another source
+PULL_TIMEOUT = 120           # Seconds one transfer may take
+
+
+def request(host, method, path, body=None, timeout=5):
+    conn = http.client.HTTPConnection(host, timeout=timeout)
+    try:
+        conn.request(method, path, body=json.dumps(body) if body is not None else None,
+                     headers={'Content-Type': 'application/json'} if body is not None else {})
+        resp = conn.getresponse()
+        return resp.status, resp.read()
+    finally:
+        conn.close()
+
+
+def firmware(host):
+    status, data = request(host, 'GET', '/api/firmware')
+    if status != 200:
+        raise OSError(f"{host}: GET /api/firmware answered {status}")
+    return json.loads(data)
+
+
+def holds(info, sha):
+    return any(info[slot] and info[slot]['sha256'] == sha for slot in ('running', 'staged'))
+
+
+def start_pull(host, peer, sha, reboot=False):
+    """None once the bench accepted, else why not"""
+    try:
+        status, data = request(host, 'POST', '/api/firmware/pull',
+                               {'peer': peer, 'sha256': sha, 'reboot': reboot})
+    except OSError as e:
+        return str(e)
+    return None if status == 200 else data.decode(errors='replace').strip() or f"HTTP {status}"
+
+
+def wait_pulls(hosts, timeout=PULL_TIMEOUT):
+    """Poll until no pull is running; a bench that reboots drops out of reach for a while"""
+    results = {}
+    end = time.monotonic() + timeout
+    while len(results) < len(hosts) and time.monotonic() < end:
+        for host in hosts:
+            if host in results:
+                continue
+            try:
+                info = firmware(host)
+            except (OSError, ValueError, http.client.HTTPException):
+                continue
+            if info['pull']['state'] != 'running':
+                results[host] = info
+        time.sleep(0.05)
+    return results
+
+
+def rollout(benches, sha=None, reboot=False, log=print):
+    """Returns (rounds, seconds, transfer_ms, failed, skipped)"""
+    started = time.monotonic()
+    infos = {b: firmware(b) for b in benches}
+    seed = infos[benches[0]]['running']
+    sha = sha or seed['sha256']
+    project = seed['project']
+
+    holders = [b for b in benches if holds(infos[b], sha)]
+    skipped = [b for b in benches if infos[b]['running']['project'] != project]
+    pending = [b for b in benches if b not in holders and b not in skipped]
+    log(f"📦 {project} {sha[:12]}: {len(holders)} holding, {len(pending)} to update, {len(skipped)} other project")
+    if not holders:
+        raise SystemExit(f"no bench holds {sha}")
+
+    attempts = {b: 0 for b in pending}
+    tried = {b: set() for b in pending}
+    failed, transfer_ms, rounds = [], [], 0
+    while pending:
+        rounds += 1
+        # One pull per source: a bench's single HTTP task streams to one peer at a time
+        pairs, free = {}, list(holders)
+        for bench in pending:
+            source = next((h for h in free if h not in tried[bench]), None)
+            if source is None:
+                continue
+            free.remove(source)
+            pairs[bench] = source
+        if not pairs:
+            failed += pending
+            break
+        for bench, source in list(pairs.items()):
+            error = start_pull(bench, source, sha)
+            if error:
+                log(f"   {bench}: refused pull from {source}: {error}")
+                del pairs[bench]
+                attempts[bench] += 1
+                tried[bench].add(source)
+        results = wait_pulls(list(pairs))
+
+        done, bad_sources = [], set()
+        for bench, source in pairs.items():
+            pull = results.get(bench, {}).get('pull', {'state': 'timeout', 'error': 'no answer'})
+            if pull['state'] in ('staged', 'current'):
+                done.append(bench)
+                if pull['state'] == 'staged' and pull['bytes']:
+                    transfer_ms.append(pull['elapsed_ms'])
+                continue
+            log(f"   {bench}: pull from {source} {pull['state']}: {pull['error']}")
+            attempts[bench] += 1
+            tried[bench].add(source)
+            if pull['error'] == 'hash mismatch':
+                bad_sources.add(source)
+        holders = [h for h in holders if h not in bad_sources] + done
+        for bench in list(pending):
+            if bench in done:
+                pending.remove(bench)
+            elif attempts[bench] >= ATTEMPTS:
+                pending.remove(bench)
+                failed.append(bench)
+        log(f"   round {rounds}: {len(done)} staged, {len(holders)} sources, {len(pending)} left"
+            + (f", dropped {', '.join(sorted(bad_sources))}" if bad_sources else ''))
+
+    if reboot:
+        activate([b for b in benches if b not in skipped and b not in failed], sha, log)
+    return rounds, time.monotonic() - started, transfer_ms, failed, skipped
+
+
+def activate(benches, sha, log=print):
+    """Restart benches that only have sha staged; a pull of a staged hash needs no peer traffic"""
+    staged = [b for b in benches if firmware(b)['running']['sha256'] != sha]
+    for bench in staged:
+        error = start_pull(bench, bench, sha, reboot=True)
+        if error:
+            log(f"   {bench}: reboot refused: {error}")
+    end = time.monotonic() + PULL_TIMEOUT
+    waiting = list(staged)
+    while waiting and time.monotonic() < end:
+        time.sleep(0.2)
+        for bench in list(waiting):
+            try:
+                if firmware(bench)['running']['sha256'] == sha:
+                    waiting.remove(bench)
+            except (OSError, ValueError, http.client.HTTPException):
+                pass
+    log(f"🔁 {len(staged) - len(waiting)} of {len(staged)} benches restarted into {sha[:12]}")
+    return not waiting
+
+
+def report(benches, result, log=print):
+    rounds, seconds, transfer_ms, failed, skipped = result
+    sequential = sum(transfer_ms) / 1000
+    log(f"✅ {len(transfer_ms)} transfers in {rounds} rounds, {seconds:.1f} s "
+        f"(one upload at a time: ~{sequential:.1f} s)")
+    if skipped:
+        log(f"   skipped (other project): {', '.join(skipped)}")
+    if failed:
+        log(f"❌ failed: {', '.join(failed)}")
+
+
+# ---------------------------------------------------------------------------
+# Simulated bench: the firmware endpoints of src/fw_share.cpp on a host port.
+# One request at a time, like the bench's single HTTP task.
+
+def make_image(project, version, size):
+    rng = random.Random(f"{project}/{version}")
+    return rng.randbytes(size)
+
+
+class SimBench:
+    def __init__(self, port=0, project='esp32c6-service-bench', version='1.0.0', size=96 * 1024,
+                 bandwidth=2_000_000, corrupt=False, bare_304=False):
+        self.project, self.bandwidth, self.corrupt = project, bandwidth, corrupt
+        self.bare_304 = bare_304     # Answers any If-None-Match with 304 and no ETag
+        self.running = self._image(version, make_image(project, version, size))
+        self.staged = None
+        self.lock = threading.Lock()
+        self.pull = {'state': 'idle', 'peer': '', 'bytes': 0, 'total': 0, 'elapsed_ms': 0, 'error': '', 'pulls': 0}
+        self.served = self.serve_aborts = 0
+        self.server = http.server.HTTPServer(('127.0.0.1', port), self._handler())
+        self.address = f"127.0.0.1:{self.server.server_port}"
+        self.thread = threading.Thread(target=self.server.serve_forever, daemon=True)
+
+    def _image(self, version, data):
+        return {'version': version, 'project': self.project, 'data': data,
+                'sha256': hashlib.sha256(data).hexdigest()}
+
+    def start(self):
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.server.shutdown()
+        self.server.server_close()
+
+    def describe(self, image):
+        return image and {k: image[k] for k in ('version', 'project', 'sha256')} | {'size': len(image['data'])}
+
+    def find(self, sha):
+        for image in (self.running, self.staged):
+            if image and (sha is None or image['sha256'] == sha):
+                return image
+        return None
+
+    def status(self):
+        with self.lock:
+            return {'running': self.describe(self.running), 'staged': self.describe(self.staged),
+                    'served': self.served, 'serve_aborts': self.serve_aborts, 'pull': dict(self.pull)}
+
+    def start_pull(self, peer, sha, reboot):
+        with self.lock:
+            if self.pull['state'] == 'running':
+                return 'ESP_ERR_INVALID_STATE'
+            self.pull.update(state='running', peer=peer, bytes=0, total=0, elapsed_ms=0, error='')
+        threading.Thread(target=self._run_pull, args=(peer, sha, reboot), daemon=True).start()
+        return None
+
+    def _finish(self, started, state, error=''):
+        with self.lock:
+            self.pull.update(state='failed' if error else state, error=error,
+                             elapsed_ms=int((time.monotonic() - started) * 1000))
+
+    def _run_pull(self, peer, sha, reboot):
+        started = time.monotonic()
+        if sha and sha == self.running['sha256']:
+            return self._finish(started, 'current')
+        if not (sha and self.staged and sha == self.staged['sha256']):
+            error, state = self._fetch(peer, sha)
+            self._finish(started, state, error)
+            if error:
+                return
+        else:
+            self._finish(started, 'staged')
+        if reboot and self.staged:
+            time.sleep(0.05)
+            with self.lock:
+                self.running, self.staged = self.staged, None
+
+    def _fetch(self, peer, sha):
+        """(error, state) following negotiate() in fw_share.cpp"""
+        ours = [self.running] + ([self.staged] if self.staged else [])
+        path = '/api/firmware/image' + (f"?sha256={sha}" if sha else '')
+        conn = http.client.HTTPConnection(peer, timeout=10)
+        try:
+            conn.request('GET', path, headers={'If-None-Match': ', '.join(f'"{i["sha256"]}"' for i in ours)})
+            resp = conn.getresponse()
+            etag = (resp.getheader('ETag') or '').strip('"')
+            if resp.status == 304:
+                # Only an ETag naming one of ours says what the peer matched
+                if sha and etag != sha:
+                    return 'bad peer response', 'failed'
+                if etag == self.running['sha256']:
+                    return None, 'current'
+                if self.staged and etag == self.staged['sha256']:
+                    return None, 'staged'
+                return 'bad peer response', 'failed'
+            if resp.status == 404:
+                return 'peer lacks the image', 'failed'
+            size = int(resp.getheader('X-Firmware-Size') or 0)
+            if resp.status != 200 or len(etag) != 64 or size == 0:
+                return 'bad peer response', 'failed'
+            if resp.getheader('X-Firmware-Project') != self.project:
+                return 'different project', 'failed'
+            if sha and etag != sha:
+                return 'peer sent another image', 'failed'
+            with self.lock:
+                self.staged = None
+                self.pull['total'] = size
+            digest, data = hashlib.sha256(), bytearray()
+            while len(data) < size:
+                piece = resp.read(min(CHUNK, size - len(data)))
+                if not piece:
+                    return 'peer hung up', 'failed'
+                digest.update(piece)
+                data += piece
+                with self.lock:
+                    self.pull['bytes'] = len(data)
+            if digest.hexdigest() != etag:
+                return 'hash mismatch', 'failed'
+            with self.lock:
+                self.staged = self._image(resp.getheader('X-Firmware-Version') or '?', bytes(data))
+                self.pull['pulls'] += 1
+            return None, 'staged'
+        except (OSError, http.client.HTTPException):
+            return 'peer unreachable', 'failed'
+        finally:
+            conn.close()
+
+    def _handler(self):
+        bench = self
+
+        class Handler(http.server.BaseHTTPRequestHandler):
+            def log_message(self, *args):
+                pass
+
+            def reply(self, status, body=b'', kind='application/json', headers=()):
+                self.send_response(status)
+                for key, value in headers:
+                    self.send_header(key, value)
+                self.send_header('Content-Type', kind)
+                self.send_header('Content-Length', str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def do_GET(self):
+                url = urllib.parse.urlsplit(self.path)
+                if url.path == '/api/firmware':
+                    return self.reply(200, json.dumps(bench.status()).encode())
+                if url.path != '/api/firmware/image':
+                    return self.reply(404, b'Not found', 'text/plain')
+                sha = urllib.parse.parse_qs(url.query).get('sha256', [None])[0]
+                image = bench.find(sha)
+                if image is None:
+                    return self.reply(404, b'No such image', 'text/plain')
+                etag = f'"{image["sha256"]}"'
+                headers = [('ETag', etag), ('X-Firmware-Version', image['version']),
+                           ('X-Firmware-Project', image['project']), ('X-Firmware-Size', str(len(image['data'])))]
+                if bench.bare_304 and self.headers.get('If-None-Match'):
+                    self.send_response(304)
+                    return self.end_headers()
+                if etag in (self.headers.get('If-None-Match') or ''):
+                    self.send_response(304)
+                    for key, value in headers:
+                        self.send_header(key, value)
+                    return self.end_headers()
+                data = bytearray(image['data'])
+                if bench.corrupt:
+                    data[len(data) // 2] ^= 0x01
+                self.send_response(200)
+                for key, value in headers:
+                    self.send_header(key, value)
+                self.send_header('Content-Type', 'application/octet-stream')
+                self.send_header('Content-Length', str(len(data)))
+                self.end_headers()
+                try:
+                    for offset in range(0, len(data), CHUNK):
+                        self.wfile.write(data[offset:offset + CHUNK])
+                        time.sleep(CHUNK / bench.bandwidth)
+                    with bench.lock:
+                        bench.served += 1
+                except OSError:
+                    with bench.lock:
+                        bench.serve_aborts += 1
+
+            def do_POST(self):
+                if self.path != '/api/firmware/pull':
+                    return self.reply(404, b'Not found', 'text/plain')
+                try:
+                    body = json.loads(self.rfile.read(int(self.headers.get('Content-Length') or 0)))
+                    peer = body['peer']
+                except (ValueError, KeyError):
+                    return self.reply(400, b'Expected peer and optional sha256', 'text/plain')
+                error = bench.start_pull(peer, body.get('sha256'), bool(body.get('reboot')))
+                if error:
+                    return self.reply(400, error.encode(), 'text/plain')
+                self.reply(200, b'{"state":"running"}')
+
+        return Handler
+
+
+def sim_rack(count, version_old='1.0.0', version_new='1.1.0', **kw):
+    """Seed on the new version, everyone else on the old one"""
+    return [SimBench(version=version_new if i == 0 else version_old, **kw).start() for i in range(count)]
+
+
+def check():
+    """15 benches: a seed, one already current, one current that serves corrupt
+    bytes, one of another project and eleven to update"""
+    count = 15
+    rack = sim_rack(count)
+    rack[1] = SimBench(version='1.1.0').start()
+    rack[2] = SimBench(version='1.1.0', corrupt=True).start()
+    rack[3] = SimBench(version='1.0.0', project='other-bench').start()
+    benches = [b.address for b in rack]
+    bare = SimBench(version='1.1.0', bare_304=True).start()
+    target = rack[0].running['sha256']
+    other = rack[3].running['sha256']
+    ok = True
+
+    def expect(name, cond):
+        nonlocal ok
+        ok &= bool(cond)
+        print(f"  {name}: {'PASS' if cond else 'FAIL'}")
+
+    try:
+        # Negotiation: a bench pulling what it runs transfers nothing
+        start_pull(benches[1], benches[0], None)
+        pull = wait_pulls([benches[1]])[benches[1]]['pull']
+        expect('304 when the peer runs our image', pull['state'] == 'current' and pull['bytes'] == 0)
+        start_pull(benches[3], benches[0], None)
+        pull = wait_pulls([benches[3]])[benches[3]]['pull']
+        expect('other project refused', pull['state'] == 'failed' and pull['error'] == 'different project')
+        start_pull(benches[4], bare.address, None, reboot=True)
+        info = wait_pulls([benches[4]])[benches[4]]
+        expect('304 without an ETag of ours is an error, no reboot',
+               info['pull']['state'] == 'failed' and info['pull']['error'] == 'bad peer response'
+               and info['staged'] is None and info['running']['sha256'] != target)
+
+        lines = []
+
+        def log(line):
+            lines.append(line)
+            print('  ' + line)
+
+        result = rollout(benches, reboot=True, log=log)
+        report(benches, result, log=log)
+        rounds, _, transfer_ms, failed, skipped = result
+        infos = [firmware(b) for b in benches]
+        expect('every bench runs the target',
+               all(info['running']['sha256'] == target for i, info in enumerate(infos) if i != 3))
+        expect('other project untouched', skipped == [benches[3]] and infos[3]['running']['sha256'] == other)
+        expect('no bench failed', not failed)
+        bound = math.ceil(math.log2(count)) + 1
+        expect(f'{rounds} rounds <= {bound}', rounds <= bound)
+        expect('corrupt source detected and dropped', any('hash mismatch' in line for line in lines)
+               and any(f'dropped {benches[2]}' in line for line in lines))
+        expect('one transfer per updated bench', len(transfer_ms) == count - 4)
+
+        again = rollout(benches, log=lambda s: None)
+        expect('second rollout is a no-op', again[0] == 0 and not again[2])
+    finally:
+        for bench in rack + [bare]:
+            bench.stop()
+    print('PASS' if ok else 'FAIL')
+    return 0 if ok else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('benches', nargs='*', help='bench addresses, host[:port]; the first is the seed')
+    parser.add_argument('--sha', help='roll out this image hash instead of what the seed runs')
+    parser.add_argument('--reboot', action='store_true', help='restart benches into the image when done')
+    parser.add_argument('--serve', type=int, metavar='PORT', help='run one simulated bench')
+    parser.add_argument('--sim', type=int, metavar='N', help='roll out over N simulated benches')
+    parser.add_argument('--version', default='1.0.0', help='simulated bench firmware version')
+    parser.add_argument('--project', default='esp32c6-service-bench', help='simulated bench project')
+    parser.add_argument('--image-kb', type=int, default=900, help='simulated image size')
+    parser.add_argument('--bandwidth-kb', type=int, default=200, help='simulated stream rate per bench, KB/s')
+    parser.add_argument('--check', action='store_true', help='simulated rack self-test, exits 1 on failure')
+    args = parser.parse_args()
+
+    if args.check:
+        return check()
+    sim = dict(size=args.image_kb * 1024, bandwidth=args.bandwidth_kb * 1024)
+    if args.serve is not None:
+        bench = SimBench(args.serve, project=args.project, version=args.version, **sim)
+        print(f"🔌 simulated bench {args.project} {args.version} "
+              f"{bench.running['sha256'][:12]} on {bench.address}")
+        bench.server.serve_forever()
+        return 0
+    rack = []
+    if args.sim:
+        rack = sim_rack(args.sim, **sim)
+        args.benches = [b.address for b in rack]
+    if not args.benches:
+        parser.error('no benches given')
+    try:
+        result = rollout(args.benches, args.sha, args.reboot)
+        report(args.benches, result)
+    finally:
+        for bench in rack:
+            bench.stop()
+    return 1 if result[3] else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,181 @@
+// Checks of src/battery_fit.cpp against synthetic traces with known answers.
+// A pack with ohmic resistance R0 and one RC polarization branch (R1, tau) is
+// loaded through a current that ramps like an ESC spinning up, and sampled
+// the way the IR test does it: 1.12 ms conversions averaged over their
+// window, the duty edge somewhere inside one PWM period. The fit has to
+// recover R0, R1 and tau for the load step and the release; clean and noisy
+// traces, and traces it must refuse (too short, no baseline, step too small).
+//
+// Build:  g++ -O2 -Isrc host/battery_fit_test.cpp src/battery_fit.cpp -o battery_fit_test
+// Run:    ./battery_fit_test          # exits 1 on the first fit outside its tolerance
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "battery_fit.h"
+
+#define CONVERSION_US 1120
+#define SIM_DT_US     10
+#define MAX_SAMPLES   3072
+
+struct pack_t {
+    double ocv_mv;
+    double r0_mohm;
+    double r1_mohm;
+    double tau_ms;
+};
+
+struct trace_case_t {
+    const char *name;
+    pack_t pack;
+    double low_ma, high_ma;
+    double esc_tau_ms;        // Current ramp after the duty edge
+    uint32_t baseline_ms, hold_ms, recover_ms;
+    uint32_t latch_us;        // Width of the edge window
+    double noise_mv, noise_ma; // Standard deviation per conversion
+    bool valid;               // Both steps expected to fit
+    double tol_r0, tol_r1, tol_tau;   // Relative
+};
+
+static const trace_case_t cases[] = {
+    { "clean, 16 V pack",   { 16700, 12.0, 8.0, 400 }, 4000, 24000, 3, 200, 1500, 1500, 20000, 0, 0,
+      true, 0.05, 0.10, 0.15 },
+    { "clean, fast PWM",    { 16700, 12.0, 8.0, 250 }, 4000, 24000, 3, 200, 1500, 1500, 500, 0, 0,
+      true, 0.05, 0.10, 0.15 },
+    { "noisy",              { 16700, 12.0, 8.0, 400 }, 4000, 24000, 3, 200, 1500, 1500, 20000, 6, 150,
+      true, 0.12, 0.20, 0.30 },
+    { "small pack, 2 A",    { 8300, 45.0, 30.0, 300 }, 500, 2500, 3, 200, 1500, 1500, 20000, 1.25, 20,
+      true, 0.08, 0.15, 0.20 },
+    { "step below 500 mA",  { 16700, 12.0, 8.0, 400 }, 4000, 4400, 3, 200, 1500, 1500, 20000, 0, 0,
+      false, 0, 0, 0 },
+    { "hold too short",     { 16700, 12.0, 8.0, 400 }, 4000, 24000, 3, 200, 8, 8, 20000, 0, 0,
+      false, 0, 0, 0 },
+};
+
+// Deterministic normal noise, the same on every host
+static uint32_t rng = 12345;
+static double gauss(void)
+{
+    double sum = 0;
+    for (int i = 0; i < 12; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        sum += (rng >> 8) / 16777216.0;
+    }
+    return sum - 6.0;
+}
+
+struct trace_t {
+    battery_sample_t samples[MAX_SAMPLES];
+    size_t count;
+    battery_step_t up, down;
+};
+
+// Simulate the pack in SIM_DT_US steps and average each conversion window
+static void make_trace(const trace_case_t *c, trace_t *t)
+{
+    uint32_t up_start = c->baseline_ms * 1000;
+    uint32_t down_start = up_start + c->hold_ms * 1000;
+    uint32_t end = down_start + c->recover_ms * 1000;
+    uint32_t up_edge = up_start + c->latch_us / 2;       // Where LEDC actually latched
+    uint32_t down_edge = down_start + c->latch_us / 2;
+
+    double i_ma = c->low_ma;
+    double vp_mv = c->pack.r1_mohm * c->low_ma / 1000;   // Polarization settled at the low load
+    double sum_mv = 0, sum_ma = 0;
+    int n = 0;
+    t->count = 0;
+    for (uint32_t us = 0; us < end && t->count < MAX_SAMPLES; us += SIM_DT_US) {
+        double target = us >= up_edge && us < down_edge ? c->high_ma : c->low_ma;
+        i_ma += (target - i_ma) * (1 - exp(-SIM_DT_US / (c->esc_tau_ms * 1000)));
+        double vp_inf = c->pack.r1_mohm * i_ma / 1000;
+        vp_mv += (vp_inf - vp_mv) * (1 - exp(-SIM_DT_US / (c->pack.tau_ms * 1000)));
+        sum_mv += c->pack.ocv_mv - c->pack.r0_mohm * i_ma / 1000 - vp_mv;
+        sum_ma += i_ma;
+        n++;
+        if ((us + SIM_DT_US) % CONVERSION_US == 0) {
+            battery_sample_t *s = &t->samples[t->count++];
+            s->t_us = us + SIM_DT_US;
+            s->bus_mv = (int32_t)lround(sum_mv / n + gauss() * c->noise_mv);
+            s->current_ma = (int32_t)lround(sum_ma / n + gauss() * c->noise_ma);
+            sum_mv = sum_ma = 0;
+            n = 0;
+        }
+    }
+
+    // As battery_test.cpp lays the two steps out
+    uint32_t up_end = up_start + c->latch_us, down_end = down_start + c->latch_us;
+    uint32_t last = t->count ? t->samples[t->count - 1].t_us : 0;
+    t->up = { 0, up_start, up_end, down_start };
+    t->down = { down_start - (down_start - up_end) / 5, down_start, down_end, last };
+}
+
+static int failures = 0;
+
+static void expect(bool cond, const char *what, const char *name)
+{
+    if (!cond) {
+        printf("FAIL %s: %s\n", name, what);
+        failures++;
+    }
+}
+
+static bool within(double got, double want, double tol)
+{
+    return fabs(got - want) <= want * tol;
+}
+
+static void check_fit(const trace_case_t *c, const battery_step_fit_t *f, const char *dir)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s, %s", c->name, dir);
+    printf("  %-26s %s r0 %6.2f mOhm  r1 %6.2f mOhm  tau %5.0f ms  rise %5.1f ms  %u/%u samples, %u straddling\n",
+           dir, f->valid ? "valid  " : "invalid", f->r0_uohm / 1000.0, f->r1_uohm / 1000.0, f->tau_us / 1000.0,
+           f->rise_us / 1000.0, f->pre_samples, f->post_samples, f->straddling);
+    expect(f->valid == c->valid, c->valid ? "rejected" : "accepted", name);
+    if (!f->valid || !c->valid) {
+        return;
+    }
+    expect(within(f->r0_uohm / 1000.0, c->pack.r0_mohm, c->tol_r0), "R0", name);
+    expect(within(f->r1_uohm / 1000.0, c->pack.r1_mohm, c->tol_r1), "R1", name);
+    expect(within(f->tau_us / 1000.0, c->pack.tau_ms, c->tol_tau), "tau", name);
+    // Every conversion whose window touches the edge window is dropped
+    uint32_t straddle_max = (c->latch_us + CONVERSION_US - 1) / CONVERSION_US + 1;
+    expect(f->straddling >= 1 && f->straddling <= straddle_max, "straddling count", name);
+}
+
+int main()
+{
+    static trace_t trace;
+    for (const trace_case_t &c : cases) {
+        printf("%s\n", c.name);
+        make_trace(&c, &trace);
+        battery_step_fit_t up, down;
+        battery_fit_step(trace.samples, trace.count, CONVERSION_US, &trace.up, &up);
+        battery_fit_step(trace.samples, trace.count, CONVERSION_US, &trace.down, &down);
+        check_fit(&c, &up, "load");
+        check_fit(&c, &down, "release");
+        expect(battery_fit_gaps(trace.samples, trace.count, CONVERSION_US) == 0, "gaps in a gapless trace", c.name);
+    }
+
+    // A baseline that ends before it starts has no clean conversion
+    make_trace(&cases[0], &trace);
+    battery_step_t no_pre = trace.up;
+    no_pre.pre_from_us = no_pre.edge_start_us;
+    battery_step_fit_t f;
+    expect(!battery_fit_step(trace.samples, trace.count, CONVERSION_US, &no_pre, &f) && !f.valid,
+           "accepted", "no baseline");
+
+    // A trace cut off right after the edge
+    size_t cut = 0;
+    while (cut < trace.count && trace.samples[cut].t_us < trace.up.edge_end_us + 5 * CONVERSION_US) cut++;
+    expect(!battery_fit_step(trace.samples, cut, CONVERSION_US, &trace.up, &f) && !f.valid,
+           "accepted", "trace ends after the edge");
+
+    // Missed conversions are counted as gaps
+    for (size_t i = 100; i + 1 < trace.count; i++) trace.samples[i] = trace.samples[i + 1];
+    for (size_t i = 200; i + 2 < trace.count; i++) trace.samples[i] = trace.samples[i + 2];
+    expect(battery_fit_gaps(trace.samples, trace.count - 3, CONVERSION_US) == 2, "gap count", "missed conversions");
+
+    printf("%zu traces, %d failures\n%s\n", sizeof(cases) / sizeof(cases[0]), failures, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+// A simulated bench on the UDP control channel (src/udp_protocol.h), for
+// exercising host tools without hardware. It answers control and monitor
+// packets like src/udp_control.cpp, spins the motor model from
+// src/rpm_control.cpp and sags a pack voltage under load. Its clock starts at
+// a random point and can drift, as two real benches never agree on time.
+//
+// Build:  g++ -O2 -Isrc host/bench_sim.cpp src/rpm_control.cpp -o bench_sim
+// Run:    ./bench_sim 4211                    # one bench on 127.0.0.1:4211
+//         ./bench_sim 4211 --spin 300         # motors held at 30% throttle
+//         ./bench_sim 4211 --drift 80         # clock runs 80 ppm fast
+//         ./bench_sim 4211 --bind 0.0.0.0     # reachable from other machines
+//
+// Run one process per bench; stop one with SIGSTOP to make it drop off.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "rpm_control.h"
+#include "udp_protocol.h"
+
+#define SIM_MOTORS      2
+#define SIM_MAX_RPM     24000
+#define SIM_STEP_MS     5
+#define SIM_PACK_MV     16800   // 4S, full
+#define SIM_SAG_MV      3       // Per mille of throttle, per motor
+
+static int64_t mono_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct sim_bench_t {
+    rpm_sim_motor_t motor[SIM_MOTORS];
+    uint16_t throttle[SIM_MOTORS];
+    uint32_t rpm[SIM_MOTORS];
+    int64_t start_us;
+    uint64_t boot_offset_us;   // Bench time at start
+    double drift;              // Fractional clock rate error
+    uint32_t last_seq;
+    bool have_seq;
+    uint16_t failsafe_ms;
+    int64_t last_frame_us;
+    bool failsafe_tripped;
+    uint32_t failsafe_trips;
+    uint32_t rejected;
+};
+
+static uint32_t bench_time_us(const sim_bench_t *b, int64_t now)
+{
+    return (uint32_t)(b->boot_offset_us + (uint64_t)((now - b->start_us) * (1.0 + b->drift)));
+}
+
+static void fill_telemetry(const sim_bench_t *b, udp_telemetry_packet_t *tlm, const udp_control_packet_t *pkt,
+                           bool rejected, int64_t now)
+{
+    memset(tlm, 0, sizeof(*tlm));
+    tlm->magic = UDP_CONTROL_MAGIC;
+    tlm->version = UDP_CONTROL_VERSION;
+    tlm->flags = (b->failsafe_tripped ? UDP_TLM_FAILSAFE : 0) | (rejected ? UDP_TLM_REJECTED : 0);
+    tlm->seq = pkt->seq;
+    tlm->host_time_us = pkt->host_time_us;
+    tlm->bench_time_us = bench_time_us(b, now);
+    tlm->apply_us = (pkt->flags & UDP_FLAG_MONITOR) ? 0 : 40;
+    int32_t mv = SIM_PACK_MV;
+    for (int m = 0; m < SIM_MOTORS; m++) {
+        mv -= SIM_SAG_MV * b->throttle[m];
+        tlm->throttle[m] = b->throttle[m];
+        tlm->rpm[m] = b->rpm[m] > 0xFFFF ? 0xFFFF : b->rpm[m];
+    }
+    tlm->battery_mv = (uint16_t)mv;
+    tlm->failsafe_trips = b->failsafe_trips;
+    tlm->rejected = b->rejected;
+}
+
+// Same acceptance rules as udp_control.cpp
+static bool handle_control(sim_bench_t *b, const udp_control_packet_t *pkt, int64_t now)
+{
+    if (!(pkt->flags & UDP_FLAG_RESET_SEQ) && b->have_seq && (int32_t)(pkt->seq - b->last_seq) <= 0) {
+        b->rejected++;
+        return false;
+    }
+    b->last_seq = pkt->seq;
+    b->have_seq = true;
+    if (pkt->flags & UDP_FLAG_DISARM) {
+        memset(b->throttle, 0, sizeof(b->throttle));
+        b->failsafe_ms = 0;
+        return true;
+    }
+    for (int m = 0; m < SIM_MOTORS; m++) {
+        if (pkt->throttle[m] != 0xFFFF) {
+            b->throttle[m] = pkt->throttle[m] > 1000 ? 1000 : pkt->throttle[m];
+        }
+    }
+    b->failsafe_ms = pkt->failsafe_ms;
+    b->last_frame_us = now;
+    b->failsafe_tripped = false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <port> [--spin permille] [--drift ppm] [--bind addr]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    const char *bind_addr = "127.0.0.1";
+    int spin = 0;
+    double drift_ppm = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--spin") == 0) spin = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--drift") == 0) drift_ppm = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--bind") == 0) bind_addr = argv[i + 1];
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, bind_addr, &addr.sin_addr);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    sim_bench_t b = {};
+    b.start_us = mono_us();
+    srand((unsigned)(b.start_us ^ (port * 2654435761u)));
+    b.boot_offset_us = (uint64_t)rand() % 4000000000u;   // Some benches wrap their 32-bit stamp soon
+    b.drift = drift_ppm * 1e-6;
+    for (int m = 0; m < SIM_MOTORS; m++) {
+        rpm_sim_init(&b.motor[m], SIM_MAX_RPM);
+        b.throttle[m] = (uint16_t)spin;
+    }
+    printf("bench_sim on %s:%d, %d motors, drift %.0f ppm\n", bind_addr, port, SIM_MOTORS, drift_ppm);
+    fflush(stdout);
+
+    int64_t last_step = b.start_us;
+    while (1) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        poll(&pfd, 1, SIM_STEP_MS);
+        int64_t now = mono_us();
+
+        if (now - last_step >= SIM_STEP_MS * 1000) {
+            if (b.failsafe_ms && !b.failsafe_tripped && now - b.last_frame_us > b.failsafe_ms * 1000) {
+                memset(b.throttle, 0, sizeof(b.throttle));
+                b.failsafe_tripped = true;
+                b.failsafe_trips++;
+            }
+            for (int m = 0; m < SIM_MOTORS; m++) {
+                b.rpm[m] = (uint32_t)rpm_sim_step(&b.motor[m], b.throttle[m], (uint32_t)(now - last_step));
+            }
+            last_step = now;
+        }
+        if (!(pfd.revents & POLLIN)) {
+            continue;
+        }
+
+        udp_control_packet_t pkt;
+        struct sockaddr_in src;
+        socklen_t src_len = sizeof(src);
+        ssize_t len = recvfrom(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&src, &src_len);
+        if (len != (ssize_t)sizeof(pkt) || pkt.magic != UDP_CONTROL_MAGIC || pkt.version != UDP_CONTROL_VERSION) {
+            continue;
+        }
+        bool rejected = false;
+        if (!(pkt.flags & UDP_FLAG_MONITOR)) {
+            rejected = !handle_control(&b, &pkt, now);
+        }
+        if (!(pkt.flags & UDP_FLAG_NO_REPLY)) {
+            udp_telemetry_packet_t tlm;
+            fill_telemetry(&b, &tlm, &pkt, rejected, now);
+            sendto(sock, &tlm, sizeof(tlm), 0, (struct sockaddr *)&src, src_len);
+        }
+    }
+}
@@ -0,0 +1,584 @@
+// Decode the binary log (src/binlog.h) read from the bench's USB-Serial-JTAG
+// port. Records carry the address of their call site descriptor; the format
+// string, tag and line are looked up in the firmware ELF that is running.
+//
+// Build:  g++ -O2 -Isrc host/binlog_decode.cpp src/binlog_format.cpp -o binlog_decode
+// Run:    ./binlog_decode .pio/build/esp32c6/firmware.elf /dev/ttyACM0
+//         ./binlog_decode firmware.elf capture.bin --json   # one typed event per line
+//         ./binlog_decode firmware.elf /dev/ttyACM0 --save session.bin   # keep the raw stream too
+//         ./binlog_decode --check                          # synthetic stream, exits 1 on a mismatch
+//
+// Text output looks like ESP_LOG's ("I (12345) UDDI: ..."). Bytes outside
+// frames (ROM boot messages, panics) are passed through as they come.
+// Motor control input records are counted and left to host/control_replay.cpp,
+// which reads a saved stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "binlog_format.h"
+
+struct site_t {
+    bool valid;
+    std::string fmt;
+    std::string tag;
+    int line;
+    int level;
+};
+
+// Allocated sections of a 32-bit little-endian ELF, addressable by their load address
+class elf_image_t {
+public:
+    bool load(const char *path)
+    {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        data_.resize(ftell(f));
+        fseek(f, 0, SEEK_SET);
+        bool ok = fread(data_.data(), 1, data_.size(), f) == data_.size();
+        fclose(f);
+        if (!ok || data_.size() < 52 || memcmp(data_.data(), "\x7f" "ELF", 4) != 0 || data_[4] != 1 || data_[5] != 1) {
+            fprintf(stderr, "%s: not a 32-bit little-endian ELF\n", path);
+            return false;
+        }
+        uint32_t shoff = u32(32);
+        uint16_t shentsize = u16(46), shnum = u16(48);
+        for (uint16_t i = 0; i < shnum; i++) {
+            size_t sh = shoff + (size_t)i * shentsize;
+            if (sh + 40 > data_.size()) {
+                break;
+            }
+            uint32_t type = u32(sh + 4), flags = u32(sh + 8), addr = u32(sh + 12);
+            uint32_t offset = u32(sh + 16), size = u32(sh + 20);
+            const uint32_t SHT_NOBITS = 8, SHF_ALLOC = 2;
+            if ((flags & SHF_ALLOC) && type != SHT_NOBITS && size > 0 && (size_t)offset + size <= data_.size()) {
+                sections_.push_back({ addr, offset, size });
+            }
+        }
+        return true;
+    }
+
+    // Bytes at a load address, NULL unless len bytes are in one section
+    const uint8_t *at(uint32_t addr, size_t len) const
+    {
+        for (const section_t &s : sections_) {
+            if (addr >= s.addr && (uint64_t)addr + len <= (uint64_t)s.addr + s.size) {
+                return data_.data() + s.offset + (addr - s.addr);
+            }
+        }
+        return NULL;
+    }
+
+    bool cstr(uint32_t addr, std::string *out) const
+    {
+        out->clear();
+        for (size_t i = 0; i < 512; i++) {
+            const uint8_t *p = at(addr + i, 1);
+            if (!p) {
+                return false;
+            }
+            if (*p == 0) {
+                return true;
+            }
+            *out += (char)*p;
+        }
+        return false;
+    }
+
+private:
+    struct section_t { uint32_t addr, offset, size; };
+    std::vector<uint8_t> data_;
+    std::vector<section_t> sections_;
+
+    uint16_t u16(size_t o) const { return (uint16_t)(data_[o] | (data_[o + 1] << 8)); }
+    uint32_t u32(size_t o) const { return blog_get_u32(&data_[o]); }
+};
+
+class site_table_t {
+public:
+    explicit site_table_t(const elf_image_t *elf) : elf_(elf) {}
+
+    void add(uint32_t id, const site_t &site) { cache_[id] = site; }
+
+    const site_t &lookup(uint32_t id)
+    {
+        auto it = cache_.find(id);
+        if (it != cache_.end()) {
+            return it->second;
+        }
+        site_t s = { false, "", "", 0, 0 };
+        const uint8_t *d = elf_ ? elf_->at(id, BLOG_SITE_SIZE) : NULL;
+        if (d && (d[BLOG_SITE_MAGIC_OFS] | (d[BLOG_SITE_MAGIC_OFS + 1] << 8)) == BLOG_SITE_MAGIC) {
+            const uint8_t *tag_ptr = elf_->at(blog_get_u32(d + BLOG_SITE_TAG), 4);
+            s.valid = elf_->cstr(blog_get_u32(d + BLOG_SITE_FMT), &s.fmt) && tag_ptr &&
+                      elf_->cstr(blog_get_u32(tag_ptr), &s.tag);
+            s.line = d[BLOG_SITE_LINE] | (d[BLOG_SITE_LINE + 1] << 8);
+            s.level = d[BLOG_SITE_LEVEL];
+        }
+        return cache_[id] = s;
+    }
+
+private:
+    const elf_image_t *elf_;
+    std::map<uint32_t, site_t> cache_;
+};
+
+// printf over decoded arguments. Each conversion takes the next argument,
+// converted to what the conversion expects if the types differ.
+static std::string format_message(const std::string &fmt, const blog_arg_t *args, int nargs)
+{
+    std::string out;
+    int ai = 0;
+    size_t n = fmt.size();
+    for (size_t i = 0; i < n; i++) {
+        if (fmt[i] != '%') {
+            out += fmt[i];
+            continue;
+        }
+        if (i + 1 < n && fmt[i + 1] == '%') {
+            out += '%';
+            i++;
+            continue;
+        }
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < n && strchr("-+ #0", fmt[j])) spec += fmt[j++];
+        if (j < n && fmt[j] == '*') {
+            spec += std::to_string(ai < nargs ? (int)args[ai++].i : 0);
+            j++;
+        }
+        while (j < n && fmt[j] >= '0' && fmt[j] <= '9') spec += fmt[j++];
+        if (j < n && fmt[j] == '.') {
+            spec += fmt[j++];
+            if (j < n && fmt[j] == '*') {
+                spec += std::to_string(ai < nargs ? (int)args[ai++].i : 0);
+                j++;
+            }
+            while (j < n && fmt[j] >= '0' && fmt[j] <= '9') spec += fmt[j++];
+        }
+        while (j < n && strchr("hlzjtL", fmt[j])) j++;
+        if (j >= n) {
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+        if (ai >= nargs) {
+            out += "<?>";
+            continue;
+        }
+        const blog_arg_t *a = &args[ai++];
+        bool is_float = a->type == BLOG_ARG_DOUBLE;
+        bool is_str = a->type == BLOG_ARG_STR;
+        char buf[512];
+        switch (conv) {
+            case 'd': case 'i':
+                snprintf(buf, sizeof(buf), (spec + "lld").c_str(), is_float ? (long long)a->d : (long long)a->i);
+                break;
+            case 'u': case 'x': case 'X': case 'o': {
+                // A 32-bit argument prints as 32 bits, as on the device
+                unsigned long long v = is_float ? (unsigned long long)a->d :
+                    (a->type == BLOG_ARG_I32 || a->type == BLOG_ARG_U32) ? (uint32_t)a->i : (unsigned long long)a->i;
+                snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), v);
+                break;
+            }
+            case 'c':
+                snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)a->i);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                snprintf(buf, sizeof(buf), (spec + conv).c_str(), is_float ? a->d : (double)a->i);
+                break;
+            case 's': {
+                std::string s = is_str ? std::string((const char *)a->s, a->s_len) : "<?>";
+                snprintf(buf, sizeof(buf), (spec + "s").c_str(), s.c_str());
+                break;
+            }
+            case 'p':
+                snprintf(buf, sizeof(buf), "0x%08llx", (unsigned long long)(uint32_t)a->i);
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "<%%%c?>", conv);
+                break;
+        }
+        out += buf;
+    }
+    return out;
+}
+
+static std::string json_escape(const std::string &s)
+{
+    std::string out;
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += (char)c;
+        }
+    }
+    return out;
+}
+
+static char level_char(int level)
+{
+    static const char levels[] = "NEWIDV";
+    return level >= 0 && level <= 5 ? levels[level] : '?';
+}
+
+struct decoder_counters_t {
+    uint32_t frames;
+    uint32_t bad_frames;       // CRC or stuffing errors
+    uint32_t unknown_sites;    // Address not a descriptor in this ELF
+    uint32_t text_records;
+    uint32_t replay_records;
+    uint32_t raw_lines;
+};
+
+class decoder_t {
+public:
+    decoder_t(site_table_t *sites, bool json, std::vector<std::string> *capture)
+        : sites_(sites), json_(json), capture_(capture) {}
+
+    void feed(uint8_t b)
+    {
+        if (!in_frame_) {
+            if (b == 0) {
+                flush_raw();
+                in_frame_ = true;
+                frame_.clear();
+            } else if (b == '\n') {
+                flush_raw();
+            } else if (b != '\r') {
+                raw_ += (char)b;
+            }
+            return;
+        }
+        if (b != 0) {
+            frame_.push_back(b);
+            if (frame_.size() > 2 * BLOG_MAX_FRAME) {   // Lost the closing delimiter
+                counters.bad_frames++;
+                in_frame_ = false;
+            }
+            return;
+        }
+        if (frame_.empty()) {
+            return;   // Back-to-back delimiters, the frame starts here
+        }
+        in_frame_ = false;
+        uint8_t record[BLOG_MAX_RECORD + 1];
+        size_t len;
+        if (!blog_frame_decode(frame_.data(), frame_.size(), record, &len)) {
+            counters.bad_frames++;
+            return;
+        }
+        counters.frames++;
+        handle_record(record, len);
+    }
+
+    void finish() { flush_raw(); }
+
+    decoder_counters_t counters = {};
+
+private:
+    site_table_t *sites_;
+    bool json_;
+    std::vector<std::string> *capture_;
+    bool in_frame_ = false;
+    std::vector<uint8_t> frame_;
+    std::string raw_;
+    uint64_t time_us_ = 0;
+
+    void emit(const std::string &line)
+    {
+        if (capture_) {
+            capture_->push_back(line);
+        } else {
+            printf("%s\n", line.c_str());
+            fflush(stdout);
+        }
+    }
+
+    void flush_raw()
+    {
+        if (raw_.empty()) {
+            return;
+        }
+        counters.raw_lines++;
+        emit(json_ ? "{\"raw\":\"" + json_escape(raw_) + "\"}" : raw_);
+        raw_.clear();
+    }
+
+    // Extend a 32-bit stamp to the time nearest the last one
+    uint64_t unwrap(uint32_t t32)
+    {
+        uint64_t t = (time_us_ & ~0xFFFFFFFFull) | t32;
+        if (t + 0x80000000ull < time_us_) {
+            t += 0x100000000ull;
+        } else if (t > time_us_ + 0x80000000ull && t >= 0x100000000ull) {
+            t -= 0x100000000ull;
+        }
+        time_us_ = t;
+        return t;
+    }
+
+    void handle_record(const uint8_t *r, size_t len)
+    {
+        uint32_t id = blog_get_u32(r);
+        uint64_t t_us = unwrap(blog_get_u32(r + 4));
+        const uint8_t *body = r + BLOG_HEADER_LEN;
+        size_t body_len = len - BLOG_HEADER_LEN;
+
+        if (id == BLOG_ID_SYNC) {
+            if (body_len == 8) {
+                uint64_t full = 0;
+                memcpy(&full, body, 8);
+                time_us_ = full;
+            }
+            return;
+        }
+        if (id == BLOG_ID_REPLAY) {
+            counters.replay_records++;
+            return;
+        }
+        if (id == BLOG_ID_TEXT) {
+            counters.text_records++;
+            std::string text((const char *)body, body_len);
+            emit(json_ ? "{\"t_us\":" + std::to_string(t_us) + ",\"text\":\"" + json_escape(text) + "\"}" : text);
+            return;
+        }
+
+        blog_arg_t args[16];
+        int nargs = blog_parse_args(body, body_len, args, 16);
+        const site_t &site = sites_->lookup(id);
+        char idbuf[16];
+        snprintf(idbuf, sizeof(idbuf), "0x%08x", id);
+        if (!site.valid || nargs < 0) {
+            counters.unknown_sites++;
+            emit(json_ ? "{\"t_us\":" + std::to_string(t_us) + ",\"id\":\"" + idbuf + "\",\"unknown\":true}"
+                       : "? (" + std::to_string(t_us / 1000) + ") record " + idbuf + " not in this ELF");
+            return;
+        }
+
+        std::string msg = format_message(site.fmt, args, nargs);
+        if (!json_) {
+            char head[64];
+            snprintf(head, sizeof(head), "%c (%llu) ", level_char(site.level), (unsigned long long)(t_us / 1000));
+            emit(head + site.tag + ": " + msg);
+            return;
+        }
+        std::string j = "{\"t_us\":" + std::to_string(t_us) + ",\"level\":\"" + level_char(site.level) +
+                        "\",\"tag\":\"" + json_escape(site.tag) + "\",\"line\":" + std::to_string(site.line) +
+                        ",\"id\":\"" + idbuf + "\",\"fmt\":\"" + json_escape(site.fmt) + "\",\"args\":[";
+        for (int i = 0; i < nargs; i++) {
+            const blog_arg_t *a = &args[i];
+            if (i) j += ",";
+            char buf[64];
+            switch (a->type) {
+                case BLOG_ARG_STR: j += "\"" + json_escape(std::string((const char *)a->s, a->s_len)) + "\""; continue;
+                case BLOG_ARG_DOUBLE: snprintf(buf, sizeof(buf), "%.17g", a->d); break;
+                case BLOG_ARG_U32: case BLOG_ARG_PTR: snprintf(buf, sizeof(buf), "%u", (uint32_t)a->i); break;
+                case BLOG_ARG_U64: snprintf(buf, sizeof(buf), "%llu", (unsigned long long)a->i); break;
+                default: snprintf(buf, sizeof(buf), "%lld", (long long)a->i); break;
+            }
+            j += buf;
+        }
+        emit(j + "],\"msg\":\"" + json_escape(msg) + "\"}");
+    }
+};
+
+// Synthetic records through the framing, with the faults a shared port sees
+static int check(void)
+{
+    site_table_t sites(NULL);
+    sites.add(0x42001000, { true, "Motor speed set: %d%% (%d RPM, PWM: %lu)", "UDDI", 440, 3 });
+    sites.add(0x42001010, { true, "Disconnected from '%.*s' (reason: %d - %s)", "wifi_sta", 234, 2 });
+    sites.add(0x42001020, { true, "Battery counters reset, voltage: %.2fV", "UDDI", 346, 3 });
+    sites.add(0x42001030, { true, "Batch of %u commands applied in %lu us, total %lld", "UDDI", 1235, 3 });
+
+    std::vector<uint8_t> stream;
+    std::vector<std::string> want;
+    auto frame = [&](const blog_record_t &r) {
+        uint8_t out[BLOG_MAX_FRAME];
+        size_t n = blog_frame_encode(r.buf, r.len, out);
+        stream.insert(stream.end(), out, out + n);
+    };
+    auto text = [&](const char *s) {
+        stream.insert(stream.end(), s, s + strlen(s));
+        want.push_back(std::string(s, strlen(s) - 1));
+    };
+
+    text("ESP-ROM:esp32c6-20220919\n");
+    uint32_t bad = 0;
+    for (int i = 0; i < 40; i++) {
+        uint32_t t_us = 4000000000u + (uint32_t)i * 10000000u;   // Wraps past 2^32 on the way
+        uint64_t t64 = 4000000000ull + (uint64_t)i * 10000000ull;
+        blog_record_t r;
+        char buf[160];
+        switch (i % 5) {
+            case 0:
+                blog_record_begin(&r, 0x42001000, t_us);
+                blog_put_int(&r, BLOG_ARG_I32, (uint32_t)(i * 2), 4);
+                blog_put_int(&r, BLOG_ARG_I32, (uint32_t)(i * 400), 4);
+                blog_put_int(&r, BLOG_ARG_U32, 1000u + i, 4);
+                snprintf(buf, sizeof(buf), "I (%llu) UDDI: Motor speed set: %d%% (%d RPM, PWM: %lu)",
+                         (unsigned long long)(t64 / 1000), i * 2, i * 400, 1000ul + i);
+                break;
+            case 1:
+                blog_record_begin(&r, 0x42001010, t_us);
+                blog_put_int(&r, BLOG_ARG_I32, 7, 4);
+                blog_put_str(&r, "BenchNet-with-a-long-name");
+                blog_put_int(&r, BLOG_ARG_I32, 201, 4);
+                blog_put_str(&r, "NO_AP_FOUND");
+                snprintf(buf, sizeof(buf), "W (%llu) wifi_sta: Disconnected from 'BenchNe' (reason: 201 - NO_AP_FOUND)",
+                         (unsigned long long)(t64 / 1000));
+                break;
+            case 2:
+                blog_record_begin(&r, 0x42001020, t_us);
+                blog_put_double(&r, 16.0 + i / 100.0);
+                snprintf(buf, sizeof(buf), "I (%llu) UDDI: Battery counters reset, voltage: %.2fV",
+                         (unsigned long long)(t64 / 1000), 16.0 + i / 100.0);
+                break;
+            case 3:
+                blog_record_begin(&r, 0x42001030, t_us);
+                blog_put_int(&r, BLOG_ARG_U32, 0xFFFFFFF0u, 4);
+                blog_put_int(&r, BLOG_ARG_U32, 12, 4);
+                blog_put_int(&r, BLOG_ARG_I64, (uint64_t)-5000000000ll, 8);
+                snprintf(buf, sizeof(buf), "I (%llu) UDDI: Batch of %u commands applied in %u us, total %lld",
+                         (unsigned long long)(t64 / 1000), 0xFFFFFFF0u, 12u, -5000000000ll);
+                break;
+            default: {
+                // A text record, then a frame with a flipped bit that must be dropped
+                blog_record_begin(&r, BLOG_ID_TEXT, t_us);
+                const char *line = "I (1234) sensors: INA226 on I2C";
+                blog_put_bytes(&r, line, strlen(line));
+                frame(r);
+                want.push_back(line);
+                blog_record_begin(&r, 0x42001000, t_us);
+                blog_put_int(&r, BLOG_ARG_I32, 1, 4);
+                uint8_t out[BLOG_MAX_FRAME];
+                size_t n = blog_frame_encode(r.buf, r.len, out);
+                out[3] ^= 0x04;
+                stream.insert(stream.end(), out, out + n);
+                bad++;
+                if (i == 24) {
+                    text("Guru Meditation Error: Core 0 panic'ed\n");   // Raw text between frames
+                }
+                continue;
+            }
+        }
+        frame(r);
+        want.push_back(buf);
+    }
+
+    std::vector<std::string> got;
+    decoder_t dec(&sites, false, &got);
+    for (uint8_t b : stream) {
+        dec.feed(b);
+    }
+    dec.finish();
+
+    bool pass = got == want && dec.counters.bad_frames == bad;
+    printf("%u frames, %u bad frames, %u text records, %u raw lines, %zu bytes\n", dec.counters.frames,
+           dec.counters.bad_frames, dec.counters.text_records, dec.counters.raw_lines, stream.size());
+    for (size_t i = 0; i < want.size() || i < got.size(); i++) {
+        const std::string &w = i < want.size() ? want[i] : "";
+        const std::string &g = i < got.size() ? got[i] : "";
+        if (w != g) {
+            printf("  line %zu\n    want: %s\n    got:  %s\n", i, w.c_str(), g.c_str());
+            pass = false;
+            break;
+        }
+    }
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+
+static int open_input(const char *path)
+{
+    if (strcmp(path, "-") == 0) {
+        return STDIN_FILENO;
+    }
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {   // A serial port: raw bytes, no echo or line editing
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
+    }
+    bool json = false;
+    const char *save_path = NULL;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2) {
+        fprintf(stderr, "usage: %s firmware.elf <capture | /dev/ttyACM0 | -> [--json] [--save raw.bin] | --check\n",
+                argv[0]);
+        return 1;
+    }
+
+    elf_image_t elf;
+    if (!elf.load(paths[0])) {
+        return 1;
+    }
+    int fd = open_input(paths[1]);
+    if (fd < 0) {
+        return 1;
+    }
+    FILE *save = NULL;
+    if (save_path && !(save = fopen(save_path, "wb"))) {
+        perror(save_path);
+        return 1;
+    }
+    site_table_t sites(&elf);
+    decoder_t dec(&sites, json, NULL);
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (save) {
+            fwrite(buf, 1, n, save);
+            fflush(save);
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            dec.feed(buf[i]);
+        }
+    }
+    dec.finish();
+    if (save) {
+        fclose(save);
+    }
+    fprintf(stderr, "%u frames, %u bad frames, %u unknown sites, %u text records, %u replay records, %u raw lines\n",
+            dec.counters.frames, dec.counters.bad_frames, dec.counters.unknown_sites,
+            dec.counters.text_records, dec.counters.replay_records, dec.counters.raw_lines);
+    return 0;
+}
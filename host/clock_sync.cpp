@@ -0,0 +1,116 @@
+#include <math.h>
+#include <string.h>
+#include "clock_sync.h"
+
+void clock_sync_init(clock_sync_t *cs)
+{
+    memset(cs, 0, sizeof(*cs));
+}
+
+// Refit from the retained minima and the open bucket's best exchange
+static void refit(clock_sync_t *cs)
+{
+    clock_sync_point_t pts[CLOCK_SYNC_POINTS + 1];
+    int n = 0;
+    for (int i = 0; i < cs->count; i++) {
+        pts[n++] = cs->points[(cs->head - cs->count + i + CLOCK_SYNC_POINTS) % CLOCK_SYNC_POINTS];
+    }
+    if (cs->have_best) {
+        pts[n++] = cs->best;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    // A second spent in a retry burst has no good exchange; leave it out
+    int64_t min_delay = pts[0].delay_us;
+    for (int i = 1; i < n; i++) {
+        if (pts[i].delay_us < min_delay) min_delay = pts[i].delay_us;
+    }
+    int64_t limit = 2 * min_delay + 200;
+    int64_t ref = pts[n - 1].local_us;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        if (pts[i].delay_us > limit) continue;
+        double x = (double)(pts[i].local_us - ref);
+        double y = (double)(pts[i].offset_us - pts[n - 1].offset_us);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+        used++;
+    }
+
+    double slope = 0, intercept = sy / used;
+    double var = sxx - sx * sx / used;
+    if (used >= 3 && var > 4e12) {   // Needs a couple of seconds of spread to say anything about drift
+        slope = (sxy - sx * sy / used) / var;
+        intercept = (sy - slope * sx) / used;
+    }
+    double resid = 0;
+    for (int i = 0; i < n; i++) {
+        if (pts[i].delay_us > limit) continue;
+        double x = (double)(pts[i].local_us - ref);
+        double e = (double)(pts[i].offset_us - pts[n - 1].offset_us) - (intercept + slope * x);
+        resid += e * e;
+    }
+
+    cs->valid = true;
+    cs->ref_us = ref;
+    cs->offset_us = pts[n - 1].offset_us + (int64_t)llround(intercept);
+    cs->skew_ppb = (int32_t)llround(slope * 1e9);
+    cs->min_delay_us = min_delay;
+    cs->error_us = min_delay / 2 + (int64_t)sqrt(resid / used);
+}
+
+bool clock_sync_add(clock_sync_t *cs, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+    clock_sync_point_t p;
+    p.delay_us = (t4 - t1) - (t3 - t2);
+    if (p.delay_us < 0 || t3 < t2) {
+        cs->rejected++;
+        return false;
+    }
+    p.local_us = t1 + (t4 - t1) / 2;
+    p.offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    cs->exchanges++;
+
+    if (cs->valid) {
+        int64_t predicted = cs->offset_us + (int64_t)cs->skew_ppb * (p.local_us - cs->ref_us) / 1000000000;
+        int64_t jump = p.offset_us - predicted;
+        if (jump < 0) jump = -jump;
+        if (jump > p.delay_us / 2 + CLOCK_SYNC_STEP_US) {
+            uint32_t steps = cs->steps + 1, rejected = cs->rejected, exchanges = cs->exchanges;
+            clock_sync_init(cs);
+            cs->steps = steps;
+            cs->rejected = rejected;
+            cs->exchanges = exchanges;
+        }
+    }
+
+    if (cs->have_best && p.local_us >= cs->bucket_end_us) {
+        cs->points[cs->head] = cs->best;
+        cs->head = (cs->head + 1) % CLOCK_SYNC_POINTS;
+        if (cs->count < CLOCK_SYNC_POINTS) cs->count++;
+        cs->have_best = false;
+    }
+    if (!cs->have_best) {
+        cs->best = p;
+        cs->have_best = true;
+        cs->bucket_end_us = p.local_us + CLOCK_SYNC_BUCKET_US;
+    } else if (p.delay_us <= cs->best.delay_us) {
+        cs->best = p;
+    }
+    refit(cs);
+    return true;
+}
+
+int64_t clock_sync_to_remote(const clock_sync_t *cs, int64_t local_us)
+{
+    return local_us + cs->offset_us + (int64_t)cs->skew_ppb * (local_us - cs->ref_us) / 1000000000;
+}
+
+int64_t clock_sync_to_local(const clock_sync_t *cs, int64_t remote_us)
+{
+    // Offset is small against the skew term's sensitivity, one correction is exact to well below 1 us
+    int64_t local = remote_us - cs->offset_us;
+    return remote_us - cs->offset_us - (int64_t)cs->skew_ppb * (local - cs->ref_us) / 1000000000;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Offset and drift of a remote clock (a bench's esp_timer) against the local
+// one, from NTP-style exchanges. Each exchange gives four stamps: t1 local
+// send, t2 remote receive, t3 remote send, t4 local receive. Queueing on the
+// network only ever adds delay, so the exchanges with the least round trip
+// pin the offset best. The lowest-delay exchange of every second is kept, and
+// a line is fitted through the recent ones: its intercept is the offset and
+// its slope the drift. A constant asymmetry between the two directions cannot
+// be seen from either end and stays in the result.
+//
+// Shared by the host tools: g++ ... host/clock_sync.cpp
+
+#define CLOCK_SYNC_POINTS     32        // Retained per-second minima, the fit spans this many seconds
+#define CLOCK_SYNC_BUCKET_US  1000000
+#define CLOCK_SYNC_STEP_US    100000    // A jump beyond the delay plus this restarts the estimate (reboot)
+
+typedef struct {
+    int64_t local_us;       // Midpoint of t1 and t4
+    int64_t offset_us;      // Remote minus local there
+    int64_t delay_us;       // Round trip less the remote's turnaround
+} clock_sync_point_t;
+
+typedef struct {
+    clock_sync_point_t points[CLOCK_SYNC_POINTS];
+    int count;
+    int head;
+    clock_sync_point_t best;  // Lowest delay in the open bucket
+    bool have_best;
+    int64_t bucket_end_us;
+
+    // remote = local + offset_us + skew_ppb * (local - ref_us) / 1e9
+    bool valid;
+    int64_t ref_us;
+    int64_t offset_us;
+    int32_t skew_ppb;
+    int64_t error_us;         // Half the least round trip plus the fit residual: bound on the offset error
+    int64_t min_delay_us;
+
+    uint32_t exchanges;
+    uint32_t rejected;        // Negative delay, the stamps were wrong
+    uint32_t steps;           // Restarts after a jump
+} clock_sync_t;
+
+void clock_sync_init(clock_sync_t *cs);
+
+// Add one exchange; returns false if it was rejected
+bool clock_sync_add(clock_sync_t *cs, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+// Convert with the current estimate. Only meaningful once cs->valid.
+int64_t clock_sync_to_remote(const clock_sync_t *cs, int64_t local_us);
+int64_t clock_sync_to_local(const clock_sync_t *cs, int64_t remote_us);
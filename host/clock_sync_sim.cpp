@@ -0,0 +1,177 @@
+// Simulation of host/clock_sync.cpp against benches on a jittery network.
+// Two bench clocks with their own offset, drift and thermal wander are polled
+// every 50 ms like fleet_aggregator does. Delays are a fixed path plus
+// exponential queueing, with occasional WiFi retry bursts and lost packets.
+// One bench reboots halfway through. Errors are measured against the true
+// time of every reply and between the two benches at common instants.
+//
+// Build:  g++ -O2 -Ihost host/clock_sync_sim.cpp host/clock_sync.cpp -o clock_sync_sim
+// Run:    ./clock_sync_sim              # summary for the default network
+//         ./clock_sync_sim 5000         # mean queueing delay per direction, us
+//         ./clock_sync_sim --check      # exits 1 unless sub-millisecond on the default network
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "clock_sync.h"
+
+#define SIM_DURATION_US  600000000LL  // 10 min
+#define SIM_POLL_US      50000
+#define SIM_WARMUP_US    5000000
+#define SIM_REBOOT_US    300000000LL  // Bench A restarts its clock here
+#define SIM_RECOVER_US   5000000      // Allowed to settle after the reboot
+#define SIM_PATH_US      1200         // Fixed one-way delay
+#define SIM_LOSS         0.01
+#define SIM_BURST_CHANCE 0.002        // Per poll, start of a retry burst
+#define PI               3.14159265358979
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double exponential(double mean)
+{
+    return -mean * log(1.0 - uniform());
+}
+
+// A bench clock: offset, fixed drift and a slow thermal swing of the crystal
+struct sim_clock_t {
+    double start_us;
+    double drift;         // Fractional
+    double wander;        // Amplitude of the swing, fractional
+    double period_us;
+    double epoch_us;      // True time of the last (re)start
+};
+
+static double remote_time(const sim_clock_t *c, double t)
+{
+    double dt = t - c->epoch_us;
+    double w = 2 * PI / c->period_us;
+    double swing = c->wander / w * (cos(w * c->epoch_us) - cos(w * t));
+    return c->start_us + dt * (1.0 + c->drift) + swing;
+}
+
+struct sim_link_t {
+    double queue_mean_us;
+    double burst_until_us;
+};
+
+static double one_way(sim_link_t *l, double t)
+{
+    double d = SIM_PATH_US + exponential(l->queue_mean_us);
+    if (t < l->burst_until_us) {
+        d += 10000 + uniform() * 70000;   // Link-layer retries
+    }
+    return d;
+}
+
+struct sim_bench_t {
+    sim_clock_t clock;
+    sim_link_t link;
+    clock_sync_t sync;
+    std::vector<double> err, naive_err;
+};
+
+static void poll(sim_bench_t *b, double t, bool measure)
+{
+    if (uniform() < SIM_BURST_CHANCE) {
+        b->link.burst_until_us = t + 500000 + uniform() * 2500000;
+    }
+    if (uniform() < SIM_LOSS) {
+        return;
+    }
+    double fwd = one_way(&b->link, t);
+    double turnaround = 30 + uniform() * 170;
+    double back = one_way(&b->link, t + fwd + turnaround);
+    int64_t t1 = (int64_t)t;
+    int64_t t2 = (int64_t)remote_time(&b->clock, t + fwd);
+    int64_t t3 = (int64_t)remote_time(&b->clock, t + fwd + turnaround);
+    int64_t t4 = (int64_t)(t + fwd + turnaround + back);
+    clock_sync_add(&b->sync, t1, t2, t3, t4);
+    if (!measure || !b->sync.valid) {
+        return;
+    }
+    // The reply's sample was taken at t3; where does each estimate put it?
+    double truth = t + fwd + turnaround;
+    b->err.push_back(fabs(clock_sync_to_local(&b->sync, t3) - truth));
+    double naive_offset = ((t2 - t1) + (t3 - t4)) / 2.0;
+    b->naive_err.push_back(fabs(t3 - naive_offset - truth));
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void report(const char *label, const std::vector<double> &v)
+{
+    printf("  %-28s p50 %7.0f us  p99 %7.0f us  max %7.0f us  (%zu)\n", label,
+           percentile(v, 0.5), percentile(v, 0.99), percentile(v, 1.0), v.size());
+}
+
+int main(int argc, char **argv)
+{
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+    double queue_mean = (argc > 1 && !check) ? atof(argv[1]) : 2000;
+
+    sim_bench_t a = {}, b = {};
+    a.clock = { 123456789.0, 47e-6, 2e-6, 300e6, 0 };
+    b.clock = { 3900000000.0, -81e-6, 1.5e-6, 420e6, 0 };
+    a.link.queue_mean_us = queue_mean;
+    b.link.queue_mean_us = queue_mean * 1.5;
+    clock_sync_init(&a.sync);
+    clock_sync_init(&b.sync);
+
+    std::vector<double> between;
+    bool rebooted = false;
+    for (double t = 0; t < SIM_DURATION_US; t += SIM_POLL_US) {
+        if (!rebooted && t >= SIM_REBOOT_US) {
+            a.clock.start_us = 5000000;   // Bench A boots again
+            a.clock.epoch_us = t;
+            rebooted = true;
+        }
+        bool settled = t > SIM_WARMUP_US && (t < SIM_REBOOT_US || t > SIM_REBOOT_US + SIM_RECOVER_US);
+        poll(&a, t, settled);
+        poll(&b, t + SIM_POLL_US / 2, settled);
+
+        // Two samples taken at the same instant on both benches, placed on the host timeline
+        if (settled && a.sync.valid && b.sync.valid) {
+            double instant = t + SIM_POLL_US * 0.75;
+            double ta = clock_sync_to_local(&a.sync, (int64_t)remote_time(&a.clock, instant));
+            double tb = clock_sync_to_local(&b.sync, (int64_t)remote_time(&b.clock, instant));
+            between.push_back(fabs(ta - tb));
+        }
+    }
+
+    printf("queueing %.0f/%.0f us mean per direction, path %d us, %.0f%% loss, retry bursts\n",
+           a.link.queue_mean_us, b.link.queue_mean_us, SIM_PATH_US, SIM_LOSS * 100);
+    printf("bench A: drift %+.1f ppm, estimate %+.1f ppm, error bound %lld us, %u steps\n",
+           a.clock.drift * 1e6, a.sync.skew_ppb / 1000.0, (long long)a.sync.error_us, a.sync.steps);
+    printf("bench B: drift %+.1f ppm, estimate %+.1f ppm, error bound %lld us, %u steps\n",
+           b.clock.drift * 1e6, b.sync.skew_ppb / 1000.0, (long long)b.sync.error_us, b.sync.steps);
+    report("A sample time, estimator", a.err);
+    report("A sample time, per exchange", a.naive_err);
+    report("B sample time, estimator", b.err);
+    report("B sample time, per exchange", b.naive_err);
+    report("A against B, same instant", between);
+
+    if (!check) {
+        return 0;
+    }
+    bool pass = percentile(a.err, 0.99) < 500 && percentile(b.err, 0.99) < 500 &&
+                percentile(a.err, 1.0) < 1000 && percentile(b.err, 1.0) < 1000 &&
+                percentile(between, 1.0) < 1000 && a.sync.steps == 1 && b.sync.steps == 0;
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// Checks of the HTTP admission policy in src/conn_limit.cpp, driven the way
+// http_guard.cpp drives it: sockets opened and closed by descriptor, requests
+// charged at the route's cost. Covers the token bucket (burst, refill, the
+// Retry-After it reports), the exempt stop route, the per-client socket
+// budget, the last socket kept for a new client, and idle eviction.
+//
+// Build:  g++ -O2 -Isrc host/conn_limit_test.cpp src/conn_limit.cpp -o conn_limit_test
+// Run:    ./conn_limit_test          # exits 1 on any mismatch
+
+#include <stdio.h>
+#include "conn_limit.h"
+
+#define MAX_SOCKETS 7                // HTTPD_DEFAULT_CONFIG, as main.cpp starts the server
+#define IP(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+static int failures = 0;
+
+static void expect(bool cond, const char *what)
+{
+    printf("  %-60s %s\n", what, cond ? "PASS" : "FAIL");
+    if (!cond) failures++;
+}
+
+static const conn_client_t *client(const conn_limit_t *cl, uint32_t ip)
+{
+    for (const conn_client_t &c : cl->clients) {
+        if (c.ip == ip) return &c;
+    }
+    static const conn_client_t none = {};
+    return &none;
+}
+
+int main()
+{
+    static conn_limit_t cl;
+    const uint32_t tech = IP(192, 168, 4, 2), script = IP(192, 168, 4, 3), other = IP(192, 168, 4, 4);
+    uint32_t retry = 0;
+    int64_t now = 1000000;
+
+    printf("token bucket\n");
+    conn_limit_init(&cl, MAX_SOCKETS);
+    expect(conn_limit_open(&cl, 10, script, now), "first socket accepted");
+    int light = 0;
+    while (conn_limit_request(&cl, 10, CONN_COST_LIGHT, now, &retry)) light++;
+    expect(light == CONN_LIMIT_BURST, "a full bucket affords the burst of light requests");
+    expect(retry == 1000 / CONN_LIMIT_RATE, "retry after one token's refill");
+    expect(conn_limit_request(&cl, 10, CONN_COST_EXEMPT, now, &retry), "stop is answered on an empty bucket");
+    expect(!conn_limit_request(&cl, 10, CONN_COST_HEAVY, now, &retry) && retry == 5000 / CONN_LIMIT_RATE,
+           "a heavy request waits for five tokens");
+    now += retry * 1000 - 1000;
+    expect(!conn_limit_request(&cl, 10, CONN_COST_HEAVY, now, &retry) && retry == 1,
+           "a millisecond early it is still a millisecond short");
+    now += retry * 1000;
+    expect(conn_limit_request(&cl, 10, CONN_COST_HEAVY, now, &retry), "affordable once Retry-After has passed");
+    now += 60 * 1000000LL;
+    light = 0;
+    while (conn_limit_request(&cl, 10, CONN_COST_LIGHT, now, &retry)) light++;
+    expect(light == CONN_LIMIT_BURST, "refill stops at the burst");
+    expect(client(&cl, script)->throttled == 4 && cl.throttled == 4, "throttled requests counted");
+
+    printf("clients are independent\n");
+    expect(conn_limit_open(&cl, 11, tech, now), "second client accepted");
+    expect(conn_limit_request(&cl, 11, CONN_COST_HEAVY, now, &retry), "its bucket is full");
+    expect(!conn_limit_request(&cl, 10, CONN_COST_LIGHT, now, &retry), "the first one's is still empty");
+
+    printf("socket budget\n");
+    conn_limit_init(&cl, MAX_SOCKETS);
+    int fd = 20;
+    for (int i = 0; i < CONN_LIMIT_CLIENT_SOCKETS; i++) {
+        conn_limit_open(&cl, fd++, script, now);
+    }
+    expect(!conn_limit_open(&cl, fd, script, now), "a client over its budget is refused");
+    expect(cl.refused == 1 && client(&cl, script)->refused == 1, "refusal counted");
+    conn_limit_close(&cl, 20);
+    expect(conn_limit_open(&cl, fd++, script, now), "closing one frees a place in the budget");
+    conn_limit_close(&cl, 99);
+    expect(client(&cl, script)->sockets == CONN_LIMIT_CLIENT_SOCKETS, "closing an unknown descriptor changes nothing");
+
+    printf("last socket\n");
+    conn_limit_init(&cl, MAX_SOCKETS);
+    fd = 30;
+    // Three clients at two sockets each fill all but the last
+    for (uint32_t host = 10; host < 13; host++) {
+        conn_limit_open(&cl, fd++, IP(192, 168, 4, host), now);
+        conn_limit_open(&cl, fd++, IP(192, 168, 4, host), now);
+    }
+    expect(conn_limit_open_sockets(&cl) == MAX_SOCKETS - 1, "one socket short of full");
+    expect(!conn_limit_open(&cl, fd, IP(192, 168, 4, 10), now), "a client holding sockets may not take the last");
+    expect(conn_limit_open(&cl, fd++, tech, now), "a new client gets the last");
+
+    printf("idle eviction\n");
+    conn_limit_init(&cl, MAX_SOCKETS);
+    conn_limit_open(&cl, 40, script, now);
+    conn_limit_open(&cl, 41, other, now);
+    conn_limit_open(&cl, 42, tech, now);
+    conn_limit_set_persistent(&cl, 42);
+    int fds[CONN_LIMIT_SOCKETS];
+    now += CONN_LIMIT_IDLE_US / 2;
+    conn_limit_request(&cl, 41, CONN_COST_LIGHT, now, &retry);
+    expect(conn_limit_idle(&cl, now, fds, CONN_LIMIT_SOCKETS) == 0, "nothing idle yet");
+    now += CONN_LIMIT_IDLE_US / 2 + 1;
+    int n = conn_limit_idle(&cl, now, fds, CONN_LIMIT_SOCKETS);
+    expect(n == 1 && fds[0] == 40, "the quiet socket is listed, the WebSocket is not");
+    expect(conn_limit_idle(&cl, now, fds, CONN_LIMIT_SOCKETS) == 0, "not listed again while its close is pending");
+    expect(cl.evicted == 1, "eviction counted");
+
+    printf("%d failures\n%s\n", failures, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
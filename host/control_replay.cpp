@@ -0,0 +1,762 @@
+// Deterministic replay of recorded bench sessions through the motor control
+// core (src/motor_core.cpp) on a virtual clock: the same command handling,
+// UDP frame and failsafe logic, RPM loop, feed-forward maps and motor model
+// as on the ESP32-C6, fed with the inputs the bench recorded and checked
+// against the digest each record carries. Runs as fast as the host allows.
+//
+// Build:  g++ -O2 -Isrc host/control_replay.cpp src/motor_core.cpp src/rpm_control.cpp src/binlog_format.cpp -o control_replay
+// Run:    ./binlog_decode firmware.elf /dev/ttyACM0 --save session.bin    # record
+//         ./control_replay session.bin                       # replay, report the first divergence
+//         ./control_replay session.bin --trace a.txt         # one line per input: outputs, RPM, hold
+//         ./control_replay session.bin --tuning 0.015,0.15,0,500 --trace b.txt      # what-if gains
+//         ./control_replay --compare a.txt b.txt             # exits 1 if two traces differ
+//         ./control_replay --synth session.bin               # a simulated session to try it on
+//         ./control_replay --check                           # self test, exits 1 on a mismatch
+//
+// The session is the raw binary log stream (src/binlog.cpp). Replay starts
+// from the first complete state snapshot and verifies every input after it;
+// a lost record or a divergence waits for the next snapshot, which the bench
+// sends at least every 10 s while busy. --free keeps running on the replay's
+// own state instead, for traces of a changed build or tuning; --cold starts
+// from the boot state for builds whose snapshot layout differs. To compare
+// two firmware versions, build this tool in a worktree of each and compare
+// their traces of the same session.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "binlog_format.h"
+#include "motor_core.h"
+
+#define SYNTH_START_US     4290000000LL   // Near the 32-bit wrap, which comes 5 s in
+#define SYNTH_DURATION_US  32000000LL
+#define SYNTH_TICK_US      10000          // CONTROL_TICK_MS in motor_control.cpp
+#define SYNTH_SYNC_US      10000000LL     // BINLOG_SYNC_MS in binlog.cpp
+#define SYNTH_TLM_US       40000          // ESC_TLM_SLOT_MS in esc_telemetry.cpp, one motor per slot
+#define SYNTH_JITTER_US    150
+
+static const char *kind_names[] = { "tick", "command", "frame", "disarm", "tuning", "map", "rpm" };
+#define KIND_COUNT (int)(sizeof(kind_names) / sizeof(kind_names[0]))
+
+// One BLOG_ID_REPLAY record with its full time
+typedef struct {
+    int64_t t_us;
+    std::vector<uint8_t> data;
+} session_rec_t;
+
+typedef struct {
+    std::vector<session_rec_t> recs;
+    uint32_t frames;
+    uint32_t bad_frames;
+    uint32_t before_sync;          // Replay records before the first time sync, dropped
+} session_t;
+
+// Frames out of a raw binlog stream, with 32-bit stamps unwrapped as in binlog_decode
+static void read_session(const std::vector<uint8_t> &bytes, session_t *out)
+{
+    out->recs.clear();
+    out->frames = out->bad_frames = out->before_sync = 0;
+    std::vector<uint8_t> frame;
+    bool in_frame = false, synced = false;
+    uint64_t time_us = 0;
+
+    for (uint8_t b : bytes) {
+        if (!in_frame || b != 0) {
+            if (b == 0) {
+                in_frame = true;
+                frame.clear();
+            } else if (in_frame) {
+                frame.push_back(b);
+                if (frame.size() > 2 * BLOG_MAX_FRAME) {
+                    out->bad_frames++;
+                    in_frame = false;
+                }
+            }
+            continue;
+        }
+        if (frame.empty()) {
+            continue;
+        }
+        in_frame = false;
+        uint8_t r[BLOG_MAX_RECORD + 1];
+        size_t len;
+        if (!blog_frame_decode(frame.data(), frame.size(), r, &len)) {
+            out->bad_frames++;
+            continue;
+        }
+        out->frames++;
+
+        uint64_t t = (time_us & ~0xFFFFFFFFull) | blog_get_u32(r + 4);
+        if (t + 0x80000000ull < time_us) {
+            t += 0x100000000ull;
+        } else if (t > time_us + 0x80000000ull && t >= 0x100000000ull) {
+            t -= 0x100000000ull;
+        }
+        time_us = t;
+
+        uint32_t id = blog_get_u32(r);
+        if (id == BLOG_ID_SYNC && len == BLOG_HEADER_LEN + 8) {
+            int64_t full;
+            memcpy(&full, r + BLOG_HEADER_LEN, 8);
+            time_us = (uint64_t)full;
+            synced = true;
+        } else if (id == BLOG_ID_REPLAY) {
+            if (!synced) {
+                out->before_sync++;
+                continue;
+            }
+            session_rec_t rec;
+            rec.t_us = (int64_t)time_us;
+            rec.data.assign(r + BLOG_HEADER_LEN, r + len);
+            out->recs.push_back(rec);
+        }
+    }
+}
+
+// One line of a trace: the outputs after an input
+typedef struct {
+    int64_t t_us;
+    int kind;
+    int32_t v[MOTOR_COUNT][4];     // Throttle, duty, measured RPM, hold target (0 when not holding)
+} trace_row_t;
+
+static const char *column_names[4] = { "throttle", "duty", "rpm", "hold" };
+
+static trace_row_t trace_row(const motor_core_t *c, int64_t t_us, int kind)
+{
+    trace_row_t row;
+    row.t_us = t_us;
+    row.kind = kind;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        row.v[m][0] = c->s.throttle[m];
+        row.v[m][1] = (int32_t)c->s.duty[m];
+        row.v[m][2] = c->s.rpm_measured[m];
+        row.v[m][3] = c->s.rpm_hold[m] ? c->s.rpm_target[m] : 0;
+    }
+    return row;
+}
+
+static void write_trace(FILE *f, const std::vector<trace_row_t> &rows)
+{
+    fprintf(f, "# t_us kind");
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        for (int i = 0; i < 4; i++) fprintf(f, " %s%d", column_names[i], m);
+    }
+    fprintf(f, "\n");
+    for (const trace_row_t &r : rows) {
+        fprintf(f, "%lld %s", (long long)r.t_us, kind_names[r.kind]);
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            for (int i = 0; i < 4; i++) fprintf(f, " %d", r.v[m][i]);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+static bool read_trace(const char *path, std::vector<trace_row_t> *rows)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        trace_row_t r = {};
+        char kind[16];
+        long long t;
+        int n;
+        if (sscanf(line, "%lld %15s%n", &t, kind, &n) != 2) continue;
+        r.t_us = t;
+        for (int k = 0; k < KIND_COUNT; k++) {
+            if (strcmp(kind, kind_names[k]) == 0) r.kind = k;
+        }
+        const char *p = line + n;
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            for (int i = 0; i < 4; i++) r.v[m][i] = (int32_t)strtol(p, (char **)&p, 10);
+        }
+        rows->push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+// First differing row and the largest difference per column. Returns true if the traces match.
+static bool compare_traces(const std::vector<trace_row_t> &a, const std::vector<trace_row_t> &b, bool print)
+{
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    int64_t max_diff[MOTOR_COUNT][4] = {};
+    size_t differing = 0, first = n;
+    for (size_t i = 0; i < n; i++) {
+        bool same = a[i].t_us == b[i].t_us && a[i].kind == b[i].kind;
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            for (int c = 0; c < 4; c++) {
+                int64_t d = llabs((int64_t)a[i].v[m][c] - b[i].v[m][c]);
+                if (d > max_diff[m][c]) max_diff[m][c] = d;
+                same &= d == 0;
+            }
+        }
+        if (!same) {
+            differing++;
+            if (first == n) first = i;
+        }
+    }
+    bool match = differing == 0 && a.size() == b.size();
+    if (!print) {
+        return match;
+    }
+    printf("%zu and %zu rows, %zu of %zu common rows differ\n", a.size(), b.size(), differing, n);
+    if (first < n) {
+        printf("first difference at row %zu, t=%lld us (%s):\n", first, (long long)a[first].t_us,
+               kind_names[a[first].kind]);
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            printf("  motor %d:", m);
+            for (int c = 0; c < 4; c++) printf(" %s %d/%d", column_names[c], a[first].v[m][c], b[first].v[m][c]);
+            printf("\n");
+        }
+        printf("largest differences:");
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            for (int c = 0; c < 4; c++) printf(" %s%d %lld", column_names[c], m, (long long)max_diff[m][c]);
+        }
+        printf("\n");
+    }
+    printf("%s\n", match ? "MATCH" : "DIFFER");
+    return match;
+}
+
+typedef struct {
+    bool free;                     // Never reload a snapshot once running
+    bool cold;                     // Start from motor_core_init, ignore snapshots
+    bool override_tuning;
+    rpm_pid_config_t tuning;
+    bool print;
+} replay_opts_t;
+
+typedef struct {
+    uint32_t inputs;
+    uint32_t ticks;
+    uint32_t loads;                // Snapshots the replay (re)started from
+    uint32_t layout_mismatches;    // Snapshots of a different state size
+    uint32_t mismatches;           // Inputs whose result differs from the recording
+    uint32_t gaps;
+    uint32_t skipped;              // Inputs while waiting for a snapshot
+    bool diverged;
+    int64_t first_mismatch_us;
+    uint16_t first_mismatch_seq;
+    int first_mismatch_kind;
+    int64_t first_us, last_us;
+    double wall_s;
+    std::vector<trace_row_t> trace;
+    motor_core_t core;
+} replay_result_t;
+
+static double wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_step(int motor, const rpm_step_t *st)
+{
+    printf("  step motor %d %d -> %d RPM: ", motor, st->from_rpm, st->to_rpm);
+    if (st->timed_out) {
+        printf("did not settle\n");
+    } else {
+        printf("rise %.1f ms, overshoot %.1f%%, settled in %.1f ms\n",
+               st->rise_us / 1000.0, st->overshoot_permille / 10.0, st->settle_us / 1000.0);
+    }
+}
+
+static void replay(const session_t *session, const replay_opts_t *opts, replay_result_t *r)
+{
+    *r = replay_result_t();
+    motor_core_t *c = &r->core;
+    motor_core_init(c, NULL, session->recs.empty() ? 0 : session->recs[0].t_us);
+    bool running = opts->cold;
+    bool have_seq = false;
+    uint16_t next_seq = 0;
+    bool step_done[MOTOR_COUNT];
+
+    // Snapshot being assembled
+    uint8_t snap[sizeof(motor_core_state_t)];
+    size_t snap_len = 0;
+    uint16_t snap_next_seq = 0;
+
+    auto set_tuning = [&]() {
+        c->s.rpm_config = opts->tuning;
+        for (int m = 0; m < MOTOR_COUNT; m++) c->s.rpm_pid[m].cfg = opts->tuning;
+    };
+    auto watch_steps = [&]() {
+        for (int m = 0; m < MOTOR_COUNT; m++) step_done[m] = c->s.rpm_step[m].complete;
+    };
+    if (opts->cold && opts->override_tuning) set_tuning();
+    watch_steps();
+
+    double start = wall_seconds();
+    for (const session_rec_t &sr : session->recs) {
+        motor_rec_t rec;
+        if (!motor_rec_decode(sr.data.data(), sr.data.size(), &rec)) {
+            continue;
+        }
+        if (r->inputs == 0 && r->skipped == 0 && r->loads == 0) r->first_us = sr.t_us;
+        r->last_us = sr.t_us;
+        if (have_seq && rec.seq != next_seq) {
+            r->gaps++;
+            snap_len = 0;
+            if (!opts->free && !opts->cold) running = false;
+        }
+        have_seq = true;
+        next_seq = rec.seq + 1;
+
+        if (rec.kind == MOTOR_REC_SNAPSHOT) {
+            if (rec.state_size != sizeof(motor_core_state_t)) {
+                r->layout_mismatches++;
+                continue;
+            }
+            if (rec.offset == 0) {
+                snap_len = 0;
+            } else if (rec.offset != snap_len || rec.seq != snap_next_seq) {
+                snap_len = 0;
+                continue;
+            }
+            if (rec.offset + rec.chunk_len > sizeof(snap)) {
+                snap_len = 0;
+                continue;
+            }
+            memcpy(snap + rec.offset, rec.chunk, rec.chunk_len);
+            snap_len = rec.offset + rec.chunk_len;
+            snap_next_seq = rec.seq + 1;
+            if (snap_len < sizeof(snap) || opts->cold) {
+                continue;
+            }
+            snap_len = 0;
+            if (running) {
+                // The check covers what a wake-up leaves alone, so it holds before the input too
+                if (motor_core_check(&c->s) != rec.check) {
+                    r->diverged = true;
+                    if (!opts->free) running = false;
+                }
+                if (running) continue;
+            }
+            memcpy(&c->s, snap, sizeof(snap));
+            c->quiet = false;
+            if (opts->override_tuning) set_tuning();
+            watch_steps();
+            running = true;
+            r->loads++;
+            continue;
+        }
+
+        if (!running) {
+            r->skipped++;
+            continue;
+        }
+        motor_input_t in = rec.input;
+        in.now_us = sr.t_us;
+        if (in.kind == MOTOR_IN_TUNING && opts->override_tuning) {
+            in.tuning = opts->tuning;
+        }
+        motor_core_apply(c, &in);
+        r->inputs++;
+        r->ticks += in.kind == MOTOR_IN_TICK;
+        r->trace.push_back(trace_row(c, sr.t_us, in.kind));
+
+        if (motor_core_check(&c->s) != rec.check) {
+            if (r->mismatches++ == 0) {
+                r->first_mismatch_us = sr.t_us;
+                r->first_mismatch_seq = rec.seq;
+                r->first_mismatch_kind = in.kind;
+            }
+            if (!opts->free) {
+                r->diverged = true;
+                running = false;
+            }
+        }
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            if (c->s.rpm_step[m].complete && !step_done[m] && opts->print) {
+                print_step(m, &c->s.rpm_step[m]);
+            }
+            step_done[m] = c->s.rpm_step[m].complete;
+        }
+    }
+    r->wall_s = wall_seconds() - start;
+}
+
+static void print_result(const session_t *s, const replay_result_t *r)
+{
+    printf("session: %u frames, %u bad frames, %zu control records, %u before the first time sync\n",
+           s->frames, s->bad_frames, s->recs.size(), s->before_sync);
+    printf("replay: %u inputs (%u ticks), %u snapshot loads, %u gaps, %u inputs skipped, %u mismatches\n",
+           r->inputs, r->ticks, r->loads, r->gaps, r->skipped, r->mismatches);
+    if (r->layout_mismatches) {
+        printf("%u snapshot chunks of another state layout ignored; --cold replays such a build\n",
+               r->layout_mismatches);
+    }
+    if (r->mismatches) {
+        printf("first mismatch: t=%lld us, seq %u, %s\n", (long long)r->first_mismatch_us,
+               r->first_mismatch_seq, kind_names[r->first_mismatch_kind]);
+    }
+    double span = (r->last_us - r->first_us) / 1e6;
+    printf("%.1f s of bench time in %.3f s, %.0fx real time\n", span, r->wall_s,
+           r->wall_s > 0 ? span / r->wall_s : 0.0);
+}
+
+// A control task with a virtual clock: wakes on the idle tick, the RPM loop
+// timer and queued inputs, like motor_control_task, and records through the
+// core into binlog frames the way the firmware does
+struct synth_bench_t {
+    motor_core_t core;
+    motor_core_io_t io;
+    std::vector<uint8_t> stream;
+    uint32_t lcg = 12345;
+
+    void frame(const blog_record_t &r)
+    {
+        uint8_t out[BLOG_MAX_FRAME];
+        size_t n = blog_frame_encode(r.buf, r.len, out);
+        stream.insert(stream.end(), out, out + n);
+    }
+
+    void sync(int64_t now)
+    {
+        blog_record_t r;
+        blog_record_begin(&r, BLOG_ID_SYNC, (uint32_t)now);
+        blog_put_bytes(&r, &now, sizeof(now));
+        frame(r);
+    }
+
+    void text(const char *s) { stream.insert(stream.end(), s, s + strlen(s)); }
+
+    uint32_t rand(uint32_t n)
+    {
+        lcg = lcg * 1103515245u + 12345u;
+        return (lcg >> 16) % n;
+    }
+
+    static void record(void *ctx, int64_t now_us, const uint8_t *data, size_t len)
+    {
+        synth_bench_t *b = (synth_bench_t *)ctx;
+        blog_record_t r;
+        blog_record_begin(&r, BLOG_ID_REPLAY, (uint32_t)now_us);
+        blog_put_bytes(&r, data, len);
+        b->frame(r);
+    }
+};
+
+typedef struct {
+    int64_t at_us;                 // From the start of the session
+    motor_input_t in;
+} synth_event_t;
+
+static motor_input_t command(motor_cmd_type_t type, int motor, int32_t value)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_COMMAND;
+    in.cmd.type = type;
+    in.cmd.motor = (int8_t)motor;
+    in.cmd.value = value;
+    return in;
+}
+
+static std::vector<synth_event_t> synth_scenario(void)
+{
+    std::vector<synth_event_t> ev;
+    auto at = [&](double s, const motor_input_t &in) { ev.push_back({ (int64_t)(s * 1e6), in }); };
+
+    at(0.5, command(MOTOR_CMD_THROTTLE, MOTOR_ALL, 300));
+    at(2.0, command(MOTOR_CMD_RPM, 0, 8000));
+    at(4.0, command(MOTOR_CMD_RPM, 0, 12000));
+    at(4.0, command(MOTOR_CMD_RPM, 1, 6000));
+    motor_input_t tuning = {};
+    tuning.kind = MOTOR_IN_TUNING;
+    tuning.tuning = { RPM_Q16(0.015f), RPM_Q16(0.15f), 0, 500 };
+    at(6.0, tuning);
+    at(8.0, command(MOTOR_CMD_RPM, 0, 9000));
+    // Throttle frames with a 200 ms failsafe, then the link goes silent
+    for (int i = 0; i < 100; i++) {
+        motor_input_t f = {};
+        f.kind = MOTOR_IN_FRAME;
+        f.frame.throttle[0] = (uint16_t)(400 + i);
+        f.frame.throttle[1] = MOTOR_THROTTLE_UNCHANGED;
+        f.frame.failsafe_ms = 200;
+        at(11.0 + i * 0.02, f);
+    }
+    at(14.0, command(MOTOR_CMD_PROTOCOL, MOTOR_ALL, PROTOCOL_ONESHOT125));
+    at(14.5, command(MOTOR_CMD_START, 1, 0));
+    at(15.0, command(MOTOR_CMD_SPEED, 0, 60));
+    at(16.0, command(MOTOR_CMD_PROTOCOL, MOTOR_ALL, PROTOCOL_MULTISHOT | MOTOR_PROTOCOL_PRESERVE));
+    at(17.0, command(MOTOR_CMD_STOP, MOTOR_ALL, 0));
+    // Idle until the motors have spun down, then wake up again
+    at(25.0, command(MOTOR_CMD_RPM, MOTOR_ALL, 10000));
+    motor_input_t map = {};
+    map.kind = MOTOR_IN_MAP;
+    map.map.motor = 1;
+    rpm_ff_init(&map.map.map, 18000);
+    at(27.0, map);
+    motor_input_t disarm = {};
+    disarm.kind = MOTOR_IN_DISARM;
+    at(29.0, disarm);
+    return ev;
+}
+
+static void synth_session(synth_bench_t *b)
+{
+    int64_t start = SYNTH_START_US, end = SYNTH_START_US + SYNTH_DURATION_US;
+    b->io = { b, NULL, NULL, NULL, synth_bench_t::record };
+    motor_core_init(&b->core, &b->io, start);
+    b->text("ESP-ROM:esp32c6-20220919\nbuild:Mar 27 2021\n");
+    b->sync(start);
+
+    std::vector<synth_event_t> ev = synth_scenario();
+    size_t next_ev = 0;
+    int64_t now = start, next_idle = start + SYNTH_TICK_US, next_rpm = INT64_MAX, next_sync = start + SYNTH_SYNC_US;
+    int64_t next_tlm = start + SYNTH_TLM_US;
+    int tlm_motor = 0;
+    while (now < end) {
+        int64_t wake = next_idle < next_rpm ? next_idle : next_rpm;
+        if (next_tlm < wake) wake = next_tlm;
+        if (next_ev < ev.size() && start + ev[next_ev].at_us < wake) wake = start + ev[next_ev].at_us;
+        now = wake + b->rand(SYNTH_JITTER_US);
+
+        if (now >= next_sync) {
+            b->sync(now);
+            next_sync += SYNTH_SYNC_US;
+        }
+        bool rpm_due = false;
+        int64_t period = 1000000 / b->core.s.rpm_config.rate_hz;
+        while (next_rpm <= now) {
+            rpm_due = true;
+            next_rpm += period;
+        }
+        // Queued inputs first, each a few microseconds apart, then the periodic work
+        while (next_ev < ev.size() && start + ev[next_ev].at_us <= now) {
+            motor_input_t in = ev[next_ev++].in;
+            in.now_us = now;
+            motor_core_apply(&b->core, &in);
+            if (in.kind == MOTOR_IN_TUNING && next_rpm != INT64_MAX) {
+                next_rpm = now + 1000000 / b->core.s.rpm_config.rate_hz;
+            }
+            now += 3 + b->rand(20);
+        }
+        // The ESC telemetry reports the model's speed, one motor per slot
+        if (now >= next_tlm) {
+            motor_input_t in = {};
+            in.kind = MOTOR_IN_RPM;
+            in.now_us = now;
+            in.feedback.motor = (uint8_t)tlm_motor;
+            in.feedback.rpm = b->core.s.rpm[tlm_motor];
+            motor_core_apply(&b->core, &in);
+            tlm_motor = (tlm_motor + 1) % MOTOR_COUNT;
+            next_tlm += SYNTH_TLM_US;
+            now += 3 + b->rand(20);
+        }
+        motor_input_t tick = {};
+        tick.kind = MOTOR_IN_TICK;
+        tick.now_us = now;
+        tick.rpm_due = rpm_due;
+        motor_core_apply(&b->core, &tick);
+
+        bool hold = motor_core_any_hold(&b->core);
+        if (hold && next_rpm == INT64_MAX) {
+            next_rpm = now + 1000000 / b->core.s.rpm_config.rate_hz;
+        } else if (!hold) {
+            next_rpm = INT64_MAX;
+        }
+        next_idle = now + SYNTH_TICK_US;
+        if (b->rand(400) == 0) {
+            b->text("I (1234) wifi: station rssi -61\n");
+        }
+    }
+}
+
+static bool parse_tuning(const char *arg, rpm_pid_config_t *cfg)
+{
+    float kp, ki, kd;
+    unsigned rate;
+    if (sscanf(arg, "%f,%f,%f,%u", &kp, &ki, &kd, &rate) != 4 || rate < MOTOR_RPM_RATE_MIN_HZ ||
+        rate > MOTOR_RPM_RATE_MAX_HZ) {
+        return false;
+    }
+    *cfg = { RPM_Q16(kp), RPM_Q16(ki), RPM_Q16(kd), rate };
+    return true;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *out)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+    if (f != stdin) fclose(f);
+    return true;
+}
+
+static int check(void)
+{
+    synth_bench_t bench;
+    synth_session(&bench);
+    session_t session;
+    read_session(bench.stream, &session);
+    bool pass = true;
+
+    replay_opts_t opts = {};
+    replay_result_t *exact = new replay_result_t;
+    replay(&session, &opts, exact);
+    print_result(&session, exact);
+    bool ok = exact->mismatches == 0 && exact->gaps == 0 && exact->skipped == 0 && !exact->diverged &&
+              exact->inputs == bench.core.recorded && exact->loads == 1 &&
+              motor_core_check(&exact->core.s) == motor_core_check(&bench.core.s) &&
+              bench.core.snapshots >= 3 && bench.core.s.failsafe_trips == 1;
+    printf("exact replay of %u recorded inputs, %u snapshots: %s\n", bench.core.recorded, bench.core.snapshots,
+           ok ? "PASS" : "FAIL");
+    pass &= ok;
+
+    replay_result_t *again = new replay_result_t;
+    replay(&session, &opts, again);
+    ok = compare_traces(exact->trace, again->trace, false);
+    printf("second replay identical: %s\n", ok ? "PASS" : "FAIL");
+    pass &= ok;
+
+    opts.cold = true;
+    replay_result_t *cold = new replay_result_t;
+    replay(&session, &opts, cold);
+    ok = cold->mismatches == 0 && compare_traces(exact->trace, cold->trace, false);
+    printf("cold replay from the boot state: %u mismatches: %s\n", cold->mismatches, ok ? "PASS" : "FAIL");
+    pass &= ok;
+    opts.cold = false;
+
+    // Lose one record while the RPM loop runs; the periodic snapshot brings it back
+    std::vector<uint8_t> lossy;
+    int frame_no = 0;
+    bool dropped = false;
+    size_t i = 0;
+    while (i < bench.stream.size()) {
+        if (bench.stream[i] != 0) {
+            lossy.push_back(bench.stream[i++]);
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < bench.stream.size() && bench.stream[j] != 0) j++;
+        if (++frame_no == 1500 && !dropped) {
+            dropped = true;
+        } else {
+            lossy.insert(lossy.end(), bench.stream.begin() + i, bench.stream.begin() + j + 1);
+        }
+        i = j + 1;
+    }
+    session_t lossy_session;
+    read_session(lossy, &lossy_session);
+    replay_result_t *gap = new replay_result_t;
+    replay(&lossy_session, &opts, gap);
+    ok = gap->gaps == 1 && gap->mismatches == 0 && gap->loads == 2 && gap->skipped > 0 &&
+         motor_core_check(&gap->core.s) == motor_core_check(&bench.core.s);
+    printf("lost record: %u gaps, %u inputs skipped, %u loads, %u mismatches: %s\n", gap->gaps, gap->skipped,
+           gap->loads, gap->mismatches, ok ? "PASS" : "FAIL");
+    pass &= ok;
+
+    // What-if gains must show up in the trace and as divergence from the recording
+    opts.free = true;
+    opts.override_tuning = parse_tuning("0.02,0.2,0,250", &opts.tuning);
+    replay_result_t *whatif = new replay_result_t;
+    replay(&session, &opts, whatif);
+    ok = opts.override_tuning && whatif->mismatches > 0 && whatif->inputs == exact->inputs &&
+         !compare_traces(exact->trace, whatif->trace, true);
+    printf("tuning override diverges: %u mismatches: %s\n", whatif->mismatches, ok ? "PASS" : "FAIL");
+    pass &= ok;
+
+    delete exact;
+    delete again;
+    delete cold;
+    delete gap;
+    delete whatif;
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
+    }
+    if (argc == 3 && strcmp(argv[1], "--synth") == 0) {
+        synth_bench_t bench;
+        synth_session(&bench);
+        FILE *f = fopen(argv[2], "wb");
+        if (!f) {
+            perror(argv[2]);
+            return 1;
+        }
+        fwrite(bench.stream.data(), 1, bench.stream.size(), f);
+        fclose(f);
+        printf("%zu bytes, %u inputs, %u snapshots\n", bench.stream.size(), bench.core.recorded, bench.core.snapshots);
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "--compare") == 0) {
+        std::vector<trace_row_t> a, b;
+        if (!read_trace(argv[2], &a) || !read_trace(argv[3], &b)) {
+            return 2;
+        }
+        return compare_traces(a, b, true) ? 0 : 1;
+    }
+
+    replay_opts_t opts = {};
+    opts.print = true;
+    const char *path = NULL, *trace_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--free") == 0) {
+            opts.free = true;
+        } else if (strcmp(argv[i], "--cold") == 0) {
+            opts.cold = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--tuning") == 0 && i + 1 < argc) {
+            if (!parse_tuning(argv[++i], &opts.tuning)) {
+                fprintf(stderr, "--tuning kp,ki,kd,rate_hz with %d-%d Hz\n", MOTOR_RPM_RATE_MIN_HZ,
+                        MOTOR_RPM_RATE_MAX_HZ);
+                return 2;
+            }
+            opts.override_tuning = true;
+            opts.free = true;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s session.bin [--trace out.txt] [--free] [--cold] [--tuning kp,ki,kd,hz]\n"
+                        "       %s --compare a.txt b.txt | --synth session.bin | --check\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> bytes;
+    if (!read_file(path, &bytes)) {
+        return 2;
+    }
+    session_t session;
+    read_session(bytes, &session);
+    replay_result_t *r = new replay_result_t;
+    replay(&session, &opts, r);
+    print_result(&session, r);
+    if (trace_path) {
+        FILE *f = fopen(trace_path, "w");
+        if (!f) {
+            perror(trace_path);
+            return 2;
+        }
+        write_trace(f, r->trace);
+        fclose(f);
+    }
+    int rc = r->mismatches && !opts.free ? 1 : 0;
+    delete r;
+    return rc;
+}
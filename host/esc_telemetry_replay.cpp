@@ -0,0 +1,214 @@
+// Replay ESC telemetry byte streams through the on-device framer
+// (src/kiss_telemetry.cpp) and report every frame and error counter.
+//
+// Build:  g++ -O2 -Isrc host/esc_telemetry_replay.cpp src/kiss_telemetry.cpp -o esc_telemetry_replay
+// Run:    ./esc_telemetry_replay capture.txt       # one burst per line, hex bytes
+//         ./esc_telemetry_replay --raw capture.bin # raw bytes, e.g. from a USB-UART on the wire
+//         ./esc_telemetry_replay --synth > synth.txt
+//         ./esc_telemetry_replay --check           # synthetic stream with corruption, exits 1 on a mismatch
+//
+// In the text format each line holds the bytes the UART delivered before an
+// idle gap, which is what the firmware sees per RX timeout event. Raw
+// captures carry no gaps and exercise the CRC resync alone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "kiss_telemetry.h"
+
+typedef std::vector<uint8_t> burst_t;
+
+struct replay_t {
+    kiss_tlm_parser_t parser;
+    std::vector<kiss_tlm_frame_t> frames;
+};
+
+static void replay(const std::vector<burst_t> &bursts, bool gaps, replay_t *r, bool print)
+{
+    kiss_tlm_parser_init(&r->parser);
+    r->frames.clear();
+    for (const burst_t &b : bursts) {
+        for (uint8_t byte : b) {
+            kiss_tlm_frame_t f;
+            if (kiss_tlm_parser_byte(&r->parser, byte, &f)) {
+                r->frames.push_back(f);
+                if (print) {
+                    printf("%4d C %6u mV %7u mA %5u mAh %7u eRPM\n",
+                           f.temp_c, f.voltage_mv, f.current_ma, f.consumption_mah, f.erpm);
+                }
+            }
+        }
+        if (gaps) {
+            kiss_tlm_parser_gap(&r->parser);
+        }
+    }
+}
+
+static void print_counters(const char *label, const replay_t *r)
+{
+    printf("%s: %u frames, %u crc errors, %u short frames, %u dropped bytes\n", label,
+           r->parser.frames, r->parser.crc_errors, r->parser.short_frames, r->parser.dropped_bytes);
+}
+
+static burst_t make_frame(int i)
+{
+    burst_t b(KISS_TLM_FRAME_LEN);
+    uint16_t mv10 = 1600 - i, ma10 = 500 + 37 * i, mah = 10 + i, erpm100 = 300 + 11 * i;
+    b[0] = 30 + i % 20;
+    b[1] = mv10 >> 8;    b[2] = mv10 & 0xFF;
+    b[3] = ma10 >> 8;    b[4] = ma10 & 0xFF;
+    b[5] = mah >> 8;     b[6] = mah & 0xFF;
+    b[7] = erpm100 >> 8; b[8] = erpm100 & 0xFF;
+    b[9] = kiss_tlm_crc8(b.data(), KISS_TLM_FRAME_LEN - 1);
+    return b;
+}
+
+// Good frames with the usual line faults mixed in. Returns the good frames
+// every replay must recover and the corrupted windows and short frames it
+// must count when gaps are known.
+static std::vector<burst_t> synth_stream(std::vector<burst_t> *good, uint32_t *crc_errors, uint32_t *short_frames)
+{
+    std::vector<burst_t> bursts;
+    *crc_errors = 0;
+    *short_frames = 0;
+    for (int i = 0; i < 60; i++) {
+        burst_t f = make_frame(i);
+        switch (i % 10) {
+            case 3: {                       // Bit error: the frame is lost
+                f[4] ^= 0x10;
+                bursts.push_back(f);
+                (*crc_errors)++;
+                continue;
+            }
+            case 5: {                       // Cut short by a glitch, then the line idles
+                bursts.push_back(burst_t(f.begin(), f.begin() + 7));
+                (*short_frames)++;
+                continue;
+            }
+            case 7: {                       // Noise byte in front, same burst
+                burst_t b(1, 0x5A);
+                b.insert(b.end(), f.begin(), f.end());
+                bursts.push_back(b);
+                (*crc_errors)++;
+                break;
+            }
+            case 8: {                       // Two frames back to back without a gap
+                burst_t b = f;
+                burst_t g = make_frame(100 + i);
+                b.insert(b.end(), g.begin(), g.end());
+                bursts.push_back(b);
+                good->push_back(f);
+                good->push_back(g);
+                continue;
+            }
+            default:
+                bursts.push_back(f);
+                break;
+        }
+        good->push_back(f);
+    }
+    return bursts;
+}
+
+static bool same_frames(const std::vector<kiss_tlm_frame_t> &got, const std::vector<burst_t> &want)
+{
+    if (got.size() != want.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < got.size(); i++) {
+        kiss_tlm_frame_t w;
+        kiss_tlm_decode(want[i].data(), &w);
+        const kiss_tlm_frame_t &g = got[i];
+        if (g.temp_c != w.temp_c || g.voltage_mv != w.voltage_mv || g.current_ma != w.current_ma ||
+            g.consumption_mah != w.consumption_mah || g.erpm != w.erpm) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int check(void)
+{
+    std::vector<burst_t> good;
+    uint32_t crc_errors, short_frames;
+    std::vector<burst_t> bursts = synth_stream(&good, &crc_errors, &short_frames);
+    bool pass = true;
+
+    replay_t r;
+    replay(bursts, true, &r, false);
+    print_counters("with gaps", &r);
+    if (!same_frames(r.frames, good) || r.parser.crc_errors != crc_errors || r.parser.short_frames != short_frames) {
+        printf("  expected %zu frames, %u crc errors, %u short frames\n", good.size(), crc_errors, short_frames);
+        pass = false;
+    }
+
+    // Without gaps the CRC alone has to find the frames again
+    replay(bursts, false, &r, false);
+    print_counters("raw     ", &r);
+    if (!same_frames(r.frames, good)) {
+        printf("  expected %zu frames\n", good.size());
+        pass = false;
+    }
+
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--synth") == 0) {
+        std::vector<burst_t> good;
+        uint32_t crc_errors, short_frames;
+        for (const burst_t &b : synth_stream(&good, &crc_errors, &short_frames)) {
+            for (size_t i = 0; i < b.size(); i++) {
+                printf("%s%02x", i ? " " : "", b[i]);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+    bool raw = argc >= 3 && strcmp(argv[1], "--raw") == 0;
+    if (argc < 2 || (strcmp(argv[1], "--raw") == 0 && !raw)) {
+        fprintf(stderr, "usage: %s capture.txt | --raw capture.bin | --synth | --check\n", argv[0]);
+        return 1;
+    }
+
+    const char *path = raw ? argv[2] : argv[1];
+    FILE *f = fopen(path, raw ? "rb" : "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    std::vector<burst_t> bursts;
+    if (raw) {
+        burst_t all;
+        int c;
+        while ((c = fgetc(f)) != EOF) {
+            all.push_back((uint8_t)c);
+        }
+        bursts.push_back(all);
+    } else {
+        char line[1024];
+        while (fgets(line, sizeof(line), f)) {
+            burst_t b;
+            char *p = line;
+            unsigned v;
+            int n;
+            while (sscanf(p, "%x%n", &v, &n) == 1) {
+                b.push_back((uint8_t)v);
+                p += n;
+            }
+            bursts.push_back(b);
+        }
+    }
+    fclose(f);
+
+    replay_t r;
+    replay(bursts, !raw, &r, true);
+    print_counters(raw ? "raw" : "with gaps", &r);
+    return 0;
+}
@@ -0,0 +1,901 @@
+// Fleet telemetry aggregator: watches a rack of benches over their UDP
+// channel (src/udp_protocol.h), merges the telemetry into one store on a
+// common time grid and serves it over HTTP.
+//
+// Build:  g++ -O2 -std=c++17 -Isrc -Ihost host/fleet_aggregator.cpp host/clock_sync.cpp -o fleet_aggregator
+// Run:    ./fleet_aggregator --listen 8080 bay1=192.168.1.31 bay2=192.168.1.32:4210 ...
+//         ./fleet_aggregator --check ./bench_sim     # 12 simulated benches, drop-offs, exits 1 on a failure
+//
+// API:    GET /benches                      state, link and clock figures per bench
+//         GET /history?range=60&bench=a,b   columnar grid rows, null where a bench has no data
+//         GET /stream                       server-sent events, one per grid row plus state changes
+//
+// Each bench is asked for telemetry with UDP_FLAG_MONITOR every POLL_MS. That
+// flag applies nothing and leaves the sequence alone, so the aggregator can
+// run next to whatever script is driving the bench. Everything runs on one
+// thread around epoll: a socket per bench, a timer, the listener and clients.
+//
+// Time alignment: a reply carries the bench's own clock and how long the
+// request sat on the bench, which with the host's send and receive times
+// makes an NTP-style exchange. host/clock_sync.cpp estimates offset and drift
+// from the quickest exchanges, and samples are placed on the grid by their
+// bench time converted to host time. WiFi jitter therefore does not move
+// samples between rows, and benches line up with each other through the host.
+//
+// Drop-offs: a bench that misses STALE_MISSES replies is stale and one that
+// misses OFFLINE_MISSES is offline. Offline benches are probed with a
+// doubling interval and rejoin on their first reply. Their cells stay null,
+// the other benches are unaffected. Stream clients that cannot keep up are
+// disconnected rather than buffered without bound.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include "udp_protocol.h"
+#include "clock_sync.h"
+
+#define POLL_MS            50         // Monitor request interval per bench
+#define TICK_MS            10
+#define GRID_MS            100        // Store resolution
+#define STORE_CELLS        3000       // 5 min of grid rows
+#define FINAL_LAG_MS       300        // A row is complete this long after it ends
+#define STALE_MISSES       4
+#define OFFLINE_MISSES     20
+#define PROBE_MIN_MS       500        // Offline benches are probed with a doubling interval
+#define PROBE_MAX_MS       8000
+#define REPLY_WINDOW       64         // Replies to older requests are ignored
+#define CLIENT_MAX_BUFFER  (256 * 1024)
+#define DEFAULT_BENCH_PORT 4210
+
+enum bench_state_t { BENCH_ONLINE, BENCH_STALE, BENCH_OFFLINE };
+
+static const char *state_name(bench_state_t s)
+{
+    switch (s) {
+        case BENCH_ONLINE: return "online";
+        case BENCH_STALE: return "stale";
+        default: return "offline";
+    }
+}
+
+// Samples of one bench that fell into one grid row
+struct grid_cell_t {
+    uint16_t n;
+    uint8_t flags;                      // OR of the telemetry flags
+    uint32_t mv_sum;
+    uint32_t rpm_sum[UDP_MAX_MOTORS];
+    uint16_t throttle[UDP_MAX_MOTORS];  // Last one
+};
+
+enum { EP_TIMER, EP_LISTEN, EP_BENCH, EP_CLIENT };
+
+struct endpoint_t {
+    int kind;
+    int fd;
+};
+
+struct bench_t : endpoint_t {
+    std::string name;
+    std::string address;
+    bench_state_t state;
+    uint32_t seq;
+    uint32_t answered_seq;
+    int64_t next_send_us;
+    int64_t last_reply_us;
+    uint32_t missed;                    // Consecutive requests without a reply
+    uint32_t probe_ms;
+
+    // Clock alignment
+    bool have_bench_time;
+    int64_t bench_us;                   // Unwrapped bench time of the last reply
+    uint32_t bench_last32;
+    int64_t rtt_us;                     // Smoothed
+    clock_sync_t clock;
+
+    udp_telemetry_packet_t last;
+    uint32_t sent;
+    uint32_t replies;
+    uint32_t late;                      // Replies to an earlier request
+    uint32_t refused;                   // ICMP port unreachable
+    uint32_t dropouts;
+    uint32_t rejoins;
+    uint32_t stored;
+    uint32_t discarded;                 // Samples outside the open part of the grid
+
+    std::vector<grid_cell_t> cells;
+};
+
+struct client_t : endpoint_t {
+    std::string in;
+    std::string out;
+    bool streaming;
+    bool close_when_sent;
+    bool closed;
+};
+
+struct fleet_t {
+    int ep;
+    endpoint_t timer;
+    endpoint_t listener;
+    int listen_port;
+    int motors;
+    std::vector<bench_t *> benches;
+    std::vector<client_t *> clients;
+    std::vector<int64_t> row_id;        // Grid row held by each slot of the store
+    int64_t final_row;                  // Rows up to this one are complete
+    int64_t epoch_offset_us;            // Realtime minus monotonic
+    uint32_t slow_clients;
+};
+
+static int64_t mono_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t epoch_ms(const fleet_t *f, int64_t mono)
+{
+    return (mono + f->epoch_offset_us) / 1000;
+}
+
+static void epoll_add(fleet_t *f, endpoint_t *e, uint32_t events)
+{
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.ptr = e;
+    epoll_ctl(f->ep, EPOLL_CTL_ADD, e->fd, &ev);
+}
+
+// ---- HTTP clients ----
+
+static void client_close(fleet_t *f, client_t *c)
+{
+    if (!c->closed) {
+        epoll_ctl(f->ep, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->closed = true;
+    }
+}
+
+static void client_flush(fleet_t *f, client_t *c)
+{
+    while (!c->out.empty()) {
+        ssize_t n = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            client_close(f, c);
+            return;
+        }
+        c->out.erase(0, n);
+    }
+    if (c->out.empty() && c->close_when_sent) {
+        client_close(f, c);
+        return;
+    }
+    struct epoll_event ev = {};
+    ev.events = c->out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(f->ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void client_write(fleet_t *f, client_t *c, const std::string &data)
+{
+    if (c->closed) {
+        return;
+    }
+    if (c->out.size() + data.size() > CLIENT_MAX_BUFFER) {
+        f->slow_clients++;
+        client_close(f, c);
+        return;
+    }
+    c->out += data;
+    client_flush(f, c);
+}
+
+static void broadcast(fleet_t *f, const std::string &event)
+{
+    for (client_t *c : f->clients) {
+        if (c->streaming) {
+            client_write(f, c, event);
+        }
+    }
+}
+
+// ---- Store ----
+
+static void store_sample(fleet_t *f, bench_t *b, const udp_telemetry_packet_t *tlm, int64_t t_us, int64_t now)
+{
+    int64_t row = t_us / (GRID_MS * 1000);
+    if (row <= f->final_row || row > now / (GRID_MS * 1000) + 1) {
+        b->discarded++;   // Too late for its row, or a clock that is not settled yet
+        return;
+    }
+    size_t slot = row % STORE_CELLS;
+    if (f->row_id[slot] != row) {
+        f->row_id[slot] = row;
+        for (bench_t *other : f->benches) {
+            memset(&other->cells[slot], 0, sizeof(grid_cell_t));
+        }
+    }
+    grid_cell_t *c = &b->cells[slot];
+    c->n++;
+    c->flags |= tlm->flags;
+    c->mv_sum += tlm->battery_mv;
+    for (int m = 0; m < UDP_MAX_MOTORS; m++) {
+        c->rpm_sum[m] += tlm->rpm[m];
+        c->throttle[m] = tlm->throttle[m];
+    }
+    b->stored++;
+}
+
+static const grid_cell_t *store_cell(const fleet_t *f, const bench_t *b, int64_t row)
+{
+    size_t slot = row % STORE_CELLS;
+    if (row < 0 || f->row_id[slot] != row || b->cells[slot].n == 0) {
+        return NULL;
+    }
+    return &b->cells[slot];
+}
+
+static std::string cell_json(const fleet_t *f, const grid_cell_t *c)
+{
+    if (!c) {
+        return "null";
+    }
+    std::string rpm, thr;
+    for (int m = 0; m < f->motors; m++) {
+        rpm += (m ? "," : "") + std::to_string(c->rpm_sum[m] / c->n);
+        thr += (m ? "," : "") + std::to_string(c->throttle[m]);
+    }
+    char buf[96];
+    snprintf(buf, sizeof(buf), "{\"n\":%u,\"flags\":%u,\"mv\":%u,", c->n, c->flags, c->mv_sum / c->n);
+    return buf + ("\"rpm\":[" + rpm + "],\"throttle\":[" + thr + "]}");
+}
+
+// Close every row whose samples can no longer arrive and stream it
+static void finalize_rows(fleet_t *f, int64_t now)
+{
+    int64_t last = (now - FINAL_LAG_MS * 1000) / (GRID_MS * 1000) - 1;
+    while (f->final_row < last) {
+        int64_t row = ++f->final_row;
+        std::string ev = "event: row\ndata: {\"t_ms\":" + std::to_string(epoch_ms(f, row * GRID_MS * 1000)) +
+                         ",\"benches\":{";
+        for (size_t i = 0; i < f->benches.size(); i++) {
+            const bench_t *b = f->benches[i];
+            ev += (i ? ",\"" : "\"") + b->name + "\":" + cell_json(f, store_cell(f, b, row));
+        }
+        broadcast(f, ev + "}}\n\n");
+    }
+}
+
+// ---- Benches ----
+
+static void set_state(fleet_t *f, bench_t *b, bench_state_t state, int64_t now)
+{
+    if (b->state == state) {
+        return;
+    }
+    b->state = state;
+    char ev[160];
+    snprintf(ev, sizeof(ev), "event: state\ndata: {\"t_ms\":%lld,\"bench\":\"%s\",\"state\":\"%s\"}\n\n",
+             (long long)epoch_ms(f, now), b->name.c_str(), state_name(state));
+    broadcast(f, ev);
+    fprintf(stderr, "%s: %s\n", b->name.c_str(), state_name(state));
+}
+
+static void bench_send(fleet_t *f, bench_t *b, int64_t now)
+{
+    if (b->sent && b->answered_seq != b->seq) {
+        b->missed++;
+        if (b->state == BENCH_ONLINE && b->missed >= STALE_MISSES) {
+            set_state(f, b, BENCH_STALE, now);
+        } else if (b->state == BENCH_STALE && b->missed >= OFFLINE_MISSES) {
+            set_state(f, b, BENCH_OFFLINE, now);
+            b->dropouts++;
+            b->probe_ms = PROBE_MIN_MS;
+        } else if (b->state == BENCH_OFFLINE && b->missed > OFFLINE_MISSES) {
+            b->probe_ms = b->probe_ms * 2 > PROBE_MAX_MS ? PROBE_MAX_MS : b->probe_ms * 2;
+        }
+    }
+
+    udp_control_packet_t pkt = {};
+    pkt.magic = UDP_CONTROL_MAGIC;
+    pkt.version = UDP_CONTROL_VERSION;
+    pkt.flags = UDP_FLAG_MONITOR;
+    pkt.seq = ++b->seq;
+    pkt.host_time_us = (uint32_t)now;
+    for (int m = 0; m < UDP_MAX_MOTORS; m++) {
+        pkt.throttle[m] = 0xFFFF;
+    }
+    if (send(b->fd, &pkt, sizeof(pkt), 0) < 0 && errno == ECONNREFUSED) {
+        b->refused++;   // Reported for an earlier packet; this one is not sent
+    }
+    b->sent++;
+
+    int64_t interval = (int64_t)(b->state == BENCH_OFFLINE ? b->probe_ms : POLL_MS) * 1000;
+    b->next_send_us += interval;
+    if (b->next_send_us <= now) {
+        b->next_send_us = now + interval;   // Fell behind, do not burst
+    }
+}
+
+// Feed the exchange to the estimator; returns the host time the sample was taken at
+static int64_t clock_update(bench_t *b, const udp_telemetry_packet_t *tlm, int64_t now)
+{
+    // Unwrap the 32-bit stamp; a reboot is a jump the estimator restarts on
+    if (b->have_bench_time) {
+        b->bench_us += (int32_t)(tlm->bench_time_us - b->bench_last32);
+    } else {
+        b->bench_us = tlm->bench_time_us;
+        b->have_bench_time = true;
+    }
+    b->bench_last32 = tlm->bench_time_us;
+
+    int64_t rtt = (uint32_t)((uint32_t)now - tlm->host_time_us);
+    b->rtt_us = b->replies > 1 ? b->rtt_us + (rtt - b->rtt_us) / 8 : rtt;
+    // The request arrived apply_us before the reply was stamped
+    clock_sync_add(&b->clock, now - rtt, b->bench_us - tlm->apply_us, b->bench_us, now);
+    return clock_sync_to_local(&b->clock, b->bench_us);
+}
+
+static void bench_receive(fleet_t *f, bench_t *b, int64_t now)
+{
+    while (1) {
+        udp_telemetry_packet_t tlm;
+        ssize_t n = recv(b->fd, &tlm, sizeof(tlm), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == ECONNREFUSED) {
+                b->refused++;
+                continue;
+            }
+            return;
+        }
+        if (n != (ssize_t)sizeof(tlm) || tlm.magic != UDP_CONTROL_MAGIC || tlm.version != UDP_CONTROL_VERSION ||
+            b->seq - tlm.seq >= REPLY_WINDOW) {
+            continue;
+        }
+        b->replies++;
+        b->missed = 0;
+        if (tlm.seq == b->seq) {
+            b->answered_seq = tlm.seq;
+        } else {
+            b->late++;
+        }
+        if (b->state != BENCH_ONLINE) {
+            if (b->state == BENCH_OFFLINE && b->dropouts) {
+                b->rejoins++;
+            }
+            if (b->state == BENCH_OFFLINE) {
+                b->next_send_us = now + POLL_MS * 1000;
+            }
+            set_state(f, b, BENCH_ONLINE, now);
+        }
+
+        int64_t t = clock_update(b, &tlm, now);
+        store_sample(f, b, &tlm, t, now);
+        b->last = tlm;
+        b->last_reply_us = now;
+    }
+}
+
+static bool bench_add(fleet_t *f, const char *spec)
+{
+    // name=host[:port], or host[:port] named after itself
+    std::string s = spec, name, host;
+    size_t eq = s.find('=');
+    name = eq == std::string::npos ? s : s.substr(0, eq);
+    host = eq == std::string::npos ? s : s.substr(eq + 1);
+    int port = DEFAULT_BENCH_PORT;
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos) {
+        port = atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+    }
+
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &res) != 0) {
+        fprintf(stderr, "%s: cannot resolve %s\n", name.c_str(), host.c_str());
+        return false;
+    }
+    struct sockaddr_in addr = *(struct sockaddr_in *)res->ai_addr;
+    freeaddrinfo(res);
+    addr.sin_port = htons(port);
+
+    bench_t *b = new bench_t();
+    b->kind = EP_BENCH;
+    b->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    // Connected, so replies from anyone else are filtered and ICMP errors are reported
+    connect(b->fd, (struct sockaddr *)&addr, sizeof(addr));
+    b->name = name;
+    b->address = host + ":" + std::to_string(port);
+    b->state = BENCH_OFFLINE;
+    b->probe_ms = PROBE_MIN_MS;
+    b->cells.resize(STORE_CELLS);
+    clock_sync_init(&b->clock);
+    f->benches.push_back(b);
+    epoll_add(f, b, EPOLLIN);
+    return true;
+}
+
+// ---- HTTP API ----
+
+static std::string query_param(const std::string &query, const char *key)
+{
+    std::string k = std::string(key) + "=";
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        if (query.compare(pos, k.size(), k) == 0) {
+            return query.substr(pos + k.size(), end - pos - k.size());
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+static std::string benches_json(const fleet_t *f, int64_t now)
+{
+    std::string j = "{\"t_ms\":" + std::to_string(epoch_ms(f, now)) + ",\"slow_clients\":" +
+                    std::to_string(f->slow_clients) + ",\"benches\":[";
+    for (size_t i = 0; i < f->benches.size(); i++) {
+        const bench_t *b = f->benches[i];
+        char buf[640];
+        snprintf(buf, sizeof(buf),
+            "%s{\"name\":\"%s\",\"address\":\"%s\",\"state\":\"%s\",\"last_seen_ms\":%lld,\"rtt_us\":%lld,"
+            "\"clock\":{\"offset_us\":%lld,\"skew_ppb\":%ld,\"error_us\":%lld,\"steps\":%u},"
+            "\"battery_mv\":%u,\"failsafe\":%s,\"sent\":%u,"
+            "\"replies\":%u,\"late\":%u,\"refused\":%u,\"dropouts\":%u,\"rejoins\":%u,"
+            "\"stored\":%u,\"discarded\":%u,\"probe_ms\":%u}",
+            i ? "," : "", b->name.c_str(), b->address.c_str(), state_name(b->state),
+            b->replies ? (long long)((now - b->last_reply_us) / 1000) : -1LL, (long long)b->rtt_us,
+            (long long)b->clock.offset_us, (long)b->clock.skew_ppb, (long long)b->clock.error_us, b->clock.steps,
+            b->last.battery_mv,
+            (b->last.flags & UDP_TLM_FAILSAFE) ? "true" : "false", b->sent, b->replies, b->late, b->refused,
+            b->dropouts, b->rejoins, b->stored, b->discarded,
+            b->state == BENCH_OFFLINE ? b->probe_ms : 0);
+        j += buf;
+    }
+    return j + "]}";
+}
+
+// Columnar rows of the complete part of the grid
+static std::string history_json(const fleet_t *f, const std::string &query)
+{
+    std::string range = query_param(query, "range");
+    int64_t rows = (range.empty() ? 10 : atoll(range.c_str())) * 1000 / GRID_MS;
+    if (rows < 1) rows = 1;
+    if (rows > STORE_CELLS) rows = STORE_CELLS;
+    std::string filter = "," + query_param(query, "bench") + ",";
+    int64_t first = f->final_row - rows + 1;
+
+    std::string j = "{\"grid_ms\":" + std::to_string(GRID_MS) + ",\"t_ms\":[";
+    for (int64_t row = first; row <= f->final_row; row++) {
+        j += (row > first ? "," : "") + std::to_string(epoch_ms(f, row * GRID_MS * 1000));
+    }
+    j += "],\"benches\":{";
+    bool any = false;
+    for (const bench_t *b : f->benches) {
+        if (filter != ",," && filter.find("," + b->name + ",") == std::string::npos) {
+            continue;
+        }
+        std::string mv, rpm[UDP_MAX_MOTORS];
+        for (int64_t row = first; row <= f->final_row; row++) {
+            const grid_cell_t *c = store_cell(f, b, row);
+            const char *sep = row > first ? "," : "";
+            mv += sep + (c ? std::to_string(c->mv_sum / c->n) : "null");
+            for (int m = 0; m < f->motors; m++) {
+                rpm[m] += sep + (c ? std::to_string(c->rpm_sum[m] / c->n) : "null");
+            }
+        }
+        j += (any ? ",\"" : "\"") + b->name + "\":{\"state\":\"" + state_name(b->state) + "\",\"mv\":[" + mv + "]";
+        for (int m = 0; m < f->motors; m++) {
+            j += ",\"rpm" + std::to_string(m) + "\":[" + rpm[m] + "]";
+        }
+        j += "}";
+        any = true;
+    }
+    return j + "}}";
+}
+
+static void http_reply(fleet_t *f, client_t *c, const char *status, const std::string &body)
+{
+    char head[160];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+             status, body.size());
+    c->close_when_sent = true;
+    client_write(f, c, head + body);
+}
+
+static void client_request(fleet_t *f, client_t *c, int64_t now)
+{
+    size_t end = c->in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c->in.size() > 8192) {
+            client_close(f, c);
+        }
+        return;
+    }
+    char method[8] = "", target[512] = "";
+    sscanf(c->in.c_str(), "%7s %511s", method, target);
+    c->in.clear();
+    std::string path = target, query;
+    size_t q = path.find('?');
+    if (q != std::string::npos) {
+        query = path.substr(q + 1);
+        path = path.substr(0, q);
+    }
+
+    if (strcmp(method, "GET") != 0) {
+        http_reply(f, c, "405 Method Not Allowed", "{\"error\":\"GET only\"}");
+    } else if (path == "/benches") {
+        http_reply(f, c, "200 OK", benches_json(f, now));
+    } else if (path == "/history") {
+        http_reply(f, c, "200 OK", history_json(f, query));
+    } else if (path == "/stream") {
+        c->streaming = true;
+        client_write(f, c, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n");
+    } else {
+        http_reply(f, c, "404 Not Found", "{\"error\":\"not found\"}");
+    }
+}
+
+static void client_readable(fleet_t *f, client_t *c, int64_t now)
+{
+    char buf[2048];
+    while (!c->closed) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            client_close(f, c);
+            return;
+        }
+        if (n < 0) {
+            break;
+        }
+        if (!c->streaming) {
+            c->in.append(buf, n);
+        }
+    }
+    if (!c->streaming && !c->close_when_sent) {
+        client_request(f, c, now);
+    }
+}
+
+static void accept_clients(fleet_t *f)
+{
+    int fd;
+    while ((fd = accept4(f->listener.fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        client_t *c = new client_t();
+        c->kind = EP_CLIENT;
+        c->fd = fd;
+        f->clients.push_back(c);
+        epoll_add(f, c, EPOLLIN);
+    }
+}
+
+// ---- Event loop ----
+
+static bool fleet_init(fleet_t *f, int listen_port)
+{
+    f->ep = epoll_create1(0);
+    if (f->motors < 1 || f->motors > UDP_MAX_MOTORS) {
+        f->motors = 2;   // MOTOR_COUNT of the firmware
+    }
+    f->row_id.assign(STORE_CELLS, -1);
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    int64_t now = mono_us();
+    f->epoch_offset_us = (int64_t)rt.tv_sec * 1000000 + rt.tv_nsec / 1000 - now;
+    f->final_row = now / (GRID_MS * 1000);
+
+    f->timer.kind = EP_TIMER;
+    f->timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec its = {};
+    its.it_interval.tv_nsec = TICK_MS * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(f->timer.fd, 0, &its, NULL);
+    epoll_add(f, &f->timer, EPOLLIN);
+
+    f->listener.kind = EP_LISTEN;
+    f->listener.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(f->listener.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listen_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t len = sizeof(addr);
+    if (bind(f->listener.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(f->listener.fd, 16) < 0 ||
+        getsockname(f->listener.fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        return false;
+    }
+    f->listen_port = ntohs(addr.sin_port);
+    epoll_add(f, &f->listener, EPOLLIN);
+    return true;
+}
+
+static void fleet_start(fleet_t *f)
+{
+    // Spread the requests over the poll period
+    int64_t now = mono_us();
+    for (size_t i = 0; i < f->benches.size(); i++) {
+        f->benches[i]->next_send_us = now + (int64_t)i * POLL_MS * 1000 / f->benches.size();
+    }
+}
+
+static void fleet_run(fleet_t *f, int64_t until_us)
+{
+    struct epoll_event events[64];
+    while (until_us == 0 || mono_us() < until_us) {
+        int n = epoll_wait(f->ep, events, 64, TICK_MS * 2);
+        int64_t now = mono_us();
+        for (int i = 0; i < n; i++) {
+            endpoint_t *e = (endpoint_t *)events[i].data.ptr;
+            switch (e->kind) {
+                case EP_TIMER: {
+                    uint64_t expirations;
+                    if (read(e->fd, &expirations, sizeof(expirations)) < 0) {
+                        break;
+                    }
+                    for (bench_t *b : f->benches) {
+                        if (now >= b->next_send_us) {
+                            bench_send(f, b, now);
+                        }
+                    }
+                    finalize_rows(f, now);
+                    break;
+                }
+                case EP_LISTEN:
+                    accept_clients(f);
+                    break;
+                case EP_BENCH:
+                    bench_receive(f, (bench_t *)e, now);
+                    break;
+                case EP_CLIENT: {
+                    client_t *c = (client_t *)e;
+                    if (c->closed) {
+                        break;
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        client_readable(f, c, now);
+                    }
+                    if (!c->closed && (events[i].events & EPOLLOUT)) {
+                        client_flush(f, c);
+                    }
+                    break;
+                }
+            }
+        }
+        // Freed only here, events of this batch may still point at them
+        for (size_t i = 0; i < f->clients.size();) {
+            if (f->clients[i]->closed) {
+                delete f->clients[i];
+                f->clients[i] = f->clients.back();
+                f->clients.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+// ---- Self-test against bench_sim processes ----
+
+#define CHECK_BENCHES 12
+#define CHECK_STOPPED 3
+
+static bool check_failed = false;
+
+static void expect(bool ok, const char *what)
+{
+    printf("  %s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) check_failed = true;
+}
+
+static int http_open(int port, const char *path)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    send(fd, req.data(), req.size(), 0);
+    return fd;
+}
+
+static std::string http_drain(int fd)
+{
+    std::string s;
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        s.append(buf, n);
+    }
+    return s;
+}
+
+static size_t count(const std::string &s, const char *needle)
+{
+    size_t n = 0;
+    for (size_t pos = s.find(needle); pos != std::string::npos; pos = s.find(needle, pos + 1)) n++;
+    return n;
+}
+
+// Fraction of the last `rows` complete rows that hold data from the bench
+static double coverage(const fleet_t *f, const bench_t *b, int rows)
+{
+    int have = 0;
+    for (int64_t row = f->final_row - rows + 1; row <= f->final_row; row++) {
+        have += store_cell(f, b, row) != NULL;
+    }
+    return (double)have / rows;
+}
+
+static int check(const char *sim_path)
+{
+    signal(SIGPIPE, SIG_IGN);
+    fleet_t f = {};
+    if (!fleet_init(&f, 0)) {
+        return 1;
+    }
+    int base_port = 40000 + getpid() % 20000;
+    pid_t pids[CHECK_BENCHES];
+    for (int i = 0; i < CHECK_BENCHES; i++) {
+        std::string port = std::to_string(base_port + i), spin = std::to_string(100 + 50 * i);
+        std::string drift = std::to_string(-100 + 20 * i);
+        char *argv[] = { (char *)sim_path, (char *)port.c_str(), (char *)"--spin", (char *)spin.c_str(),
+                         (char *)"--drift", (char *)drift.c_str(), NULL };
+        if (posix_spawn(&pids[i], sim_path, NULL, NULL, argv, NULL) != 0) {
+            fprintf(stderr, "cannot run %s\n", sim_path);
+            return 1;
+        }
+        std::string spec = "bay" + std::to_string(i) + "=127.0.0.1:" + port;
+        bench_add(&f, spec.c_str());
+    }
+    usleep(300000);   // Let the simulators bind
+    fleet_start(&f);
+
+    printf("%d simulated benches, HTTP on port %d\n", CHECK_BENCHES, f.listen_port);
+    int stream = http_open(f.listen_port, "/stream");
+    fleet_run(&f, mono_us() + 3000000);
+
+    printf("all benches up:\n");
+    bool all_online = true, covered = true, aligned = true;
+    for (bench_t *b : f.benches) {
+        all_online &= b->state == BENCH_ONLINE;
+        covered &= coverage(&f, b, 15) >= 0.99;
+        aligned &= b->clock.valid && b->clock.error_us < 1000;
+    }
+    expect(all_online, "every bench online");
+    expect(covered, "every bench has data in each of the last 15 rows");
+    expect(aligned, "clock offsets known to within 1 ms despite -100..+120 ppm drift");
+    std::string events = http_drain(stream);
+    expect(count(events, "event: row") >= 20, "stream delivered the grid rows");
+
+    printf("benches 0-%d stopped:\n", CHECK_STOPPED - 1);
+    for (int i = 0; i < CHECK_STOPPED; i++) {
+        kill(pids[i], SIGSTOP);
+    }
+    fleet_run(&f, mono_us() + 2500000);
+    bool stopped_offline = true, others_fine = true, gaps = true;
+    for (int i = 0; i < CHECK_BENCHES; i++) {
+        bench_t *b = f.benches[i];
+        if (i < CHECK_STOPPED) {
+            stopped_offline &= b->state == BENCH_OFFLINE && b->dropouts == 1;
+            gaps &= coverage(&f, b, 10) == 0;
+        } else {
+            others_fine &= b->state == BENCH_ONLINE && coverage(&f, b, 20) >= 0.99;
+        }
+    }
+    expect(stopped_offline, "stopped benches marked offline");
+    expect(gaps, "their recent rows are null");
+    expect(others_fine, "the other benches kept full coverage");
+    events = http_drain(stream);
+    expect(count(events, "\"state\":\"offline\"") == CHECK_STOPPED, "stream reported the drop-offs");
+    int hist = http_open(f.listen_port, "/history?range=2&bench=bay0,bay5");
+    fleet_run(&f, mono_us() + 100000);
+    std::string history = http_drain(hist);
+    close(hist);
+    expect(history.find("200 OK") != std::string::npos && history.find("\"bay0\":{\"state\":\"offline\"") !=
+           std::string::npos && history.find("\"bay5\"") != std::string::npos &&
+           history.find("\"bay1\"") == std::string::npos, "history filtered by bench, offline bench included");
+
+    printf("benches resumed, bench %d killed:\n", CHECK_BENCHES - 1);
+    for (int i = 0; i < CHECK_STOPPED; i++) {
+        kill(pids[i], SIGCONT);
+    }
+    kill(pids[CHECK_BENCHES - 1], SIGKILL);
+    fleet_run(&f, mono_us() + 6000000);
+    bool rejoined = true;
+    for (int i = 0; i < CHECK_STOPPED; i++) {
+        rejoined &= f.benches[i]->state == BENCH_ONLINE && f.benches[i]->rejoins == 1 &&
+                    f.benches[i]->clock.steps == 0 && coverage(&f, f.benches[i], 20) >= 0.99;
+    }
+    bench_t *dead = f.benches[CHECK_BENCHES - 1];
+    expect(rejoined, "resumed benches rejoined with the same clock estimate");
+    expect(dead->state == BENCH_OFFLINE && dead->probe_ms >= 2 * PROBE_MIN_MS && dead->refused > 0,
+           "killed bench offline, probed with backoff");
+    bool drift_found = true;
+    for (int i = 0; i < CHECK_BENCHES; i++) {
+        drift_found &= labs(f.benches[i]->clock.skew_ppb - (-100 + 20 * i) * 1000) < 10000;
+    }
+    expect(drift_found, "each bench's drift estimated within 10 ppm");
+    int info = http_open(f.listen_port, "/benches");
+    fleet_run(&f, mono_us() + 100000);
+    std::string benches = http_drain(info);
+    close(info);
+    expect(count(benches, "\"name\":") == CHECK_BENCHES, "/benches lists every bench");
+
+    close(stream);
+    for (int i = 0; i < CHECK_BENCHES; i++) {
+        kill(pids[i], SIGKILL);
+        waitpid(pids[i], NULL, 0);
+    }
+    for (bench_t *b : f.benches) {
+        printf("  %-6s %-7s sent %4u replies %4u late %2u stored %4u rtt %4lld us skew %+6.1f ppm +-%lld us\n",
+               b->name.c_str(), state_name(b->state), b->sent, b->replies, b->late, b->stored,
+               (long long)b->rtt_us, b->clock.skew_ppb / 1000.0, (long long)b->clock.error_us);
+    }
+    printf("%s\n", check_failed ? "FAIL" : "PASS");
+    return check_failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "--check") == 0) {
+        return check(argv[2]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fleet_t f = {};
+    int port = 8080;
+    std::vector<const char *> specs;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--motors") == 0 && i + 1 < argc) {
+            f.motors = atoi(argv[++i]);
+        } else {
+            specs.push_back(argv[i]);
+        }
+    }
+    if (specs.empty()) {
+        fprintf(stderr, "usage: %s [--listen port] [--motors n] name=host[:port] ... | --check ./bench_sim\n", argv[0]);
+        return 1;
+    }
+    if (!fleet_init(&f, port)) {
+        return 1;
+    }
+    for (const char *spec : specs) {
+        if (!bench_add(&f, spec)) {
+            return 1;
+        }
+    }
+    fleet_start(&f);
+    fprintf(stderr, "%zu benches, HTTP on port %d\n", f.benches.size(), f.listen_port);
+    fleet_run(&f, 0);
+    return 0;
+}
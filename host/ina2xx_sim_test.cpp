@@ -0,0 +1,177 @@
+// Checks of the INA226 driver (src/ina2xx.cpp) against the register-level
+// stand-in (src/ina2xx_sim.cpp): identification and calibration, conversion
+// timing and the ready flag, scaled readings, and the mAh/Wh integration the
+// sampler publishes, compared with the charge and energy the simulated pack
+// actually delivered. Both integration rates are run: the normal 35.2 ms
+// conversions and the 1.12 ms ones of the IR test trace.
+//
+// Build:  g++ -O2 -Isrc host/ina2xx_sim_test.cpp src/ina2xx.cpp src/ina2xx_sim.cpp -o ina2xx_sim_test
+// Run:    ./ina2xx_sim_test          # exits 1 on any mismatch
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ina2xx.h"
+#include "ina2xx_sim.h"
+
+#define SHUNT_UOHM      500        // As sensors.cpp
+#define MAX_CURRENT_MA  80000
+#define STEP_US         100        // Simulated time step between polls
+
+static int failures = 0;
+
+static void expect(bool cond, const char *what)
+{
+    printf("  %-58s %s\n", what, cond ? "PASS" : "FAIL");
+    if (!cond) failures++;
+}
+
+static bool near(int64_t got, int64_t want, int64_t tol)
+{
+    return llabs(got - want) <= tol;
+}
+
+// A bus that reports another die, to check identification
+static bool other_die_read(void *ctx, uint8_t reg, uint16_t *value)
+{
+    const ina2xx_bus_t *inner = (const ina2xx_bus_t *)ctx;
+    if (reg == INA2XX_REG_DIE_ID) {
+        *value = 0x2270;   // INA228
+        return true;
+    }
+    return inner->read(inner->ctx, reg, value);
+}
+
+static bool other_die_write(void *ctx, uint8_t reg, uint16_t value)
+{
+    const ina2xx_bus_t *inner = (const ina2xx_bus_t *)ctx;
+    return inner->write(inner->ctx, reg, value);
+}
+
+// Terminal voltage the pack model puts on the bus right now, in uV
+static int64_t true_bus_uv(const ina2xx_sim_t *sim)
+{
+    const ina2xx_sim_pack_t *p = &sim->pack;
+    int64_t drawn_uah = sim->drawn_ua_us / 3600000000LL;
+    int64_t capacity_uah = (int64_t)p->capacity_mah * 1000;
+    int64_t ocv_uv = (int64_t)p->full_mv * 1000 - (int64_t)(p->full_mv - p->empty_mv) * 1000 * drawn_uah / capacity_uah;
+    return ocv_uv - (int64_t)sim->load_ma * p->r0_mohm - sim->v1_uv;
+}
+
+struct load_step_t {
+    int32_t load_ma;
+    uint32_t ms;
+};
+
+// Idle, a run at two throttles, a step back down
+static const load_step_t profile[] = {
+    { 150, 5000 }, { 12000, 60000 }, { 24000, 20000 }, { 4000, 40000 }, { 150, 5000 },
+};
+
+// Run the profile, polling the ready flag every STEP_US like the sampler
+// without its alert, and integrate every conversion
+static void run_profile(ina2xx_avg_t avg, ina2xx_ct_t ct, const char *name)
+{
+    printf("%s\n", name);
+    ina2xx_sim_pack_t pack = INA2XX_SIM_DEFAULT_PACK;
+    ina2xx_sim_t sim;
+    ina2xx_sim_init(&sim, &pack, SHUNT_UOHM);
+    ina2xx_t dev;
+    ina2xx_init(&dev, &sim.bus, SHUNT_UOHM, MAX_CURRENT_MA);
+    ina2xx_configure(&dev, avg, ct);
+
+    ina2xx_totals_t totals = {};
+    int64_t now = 0, first_us = -1, last_us = 0;
+    double energy_true_mw_us = 0;
+    uint32_t conversions = 0, missed = 0;
+    for (const load_step_t &step : profile) {
+        ina2xx_sim_set_load(&sim, step.load_ma);
+        for (uint32_t t = 0; t < step.ms * 1000; t += STEP_US) {
+            energy_true_mw_us += true_bus_uv(&sim) / 1000.0 * sim.load_ma / 1000.0 * STEP_US;
+            now += STEP_US;
+            bool completed = ina2xx_sim_advance(&sim, STEP_US);
+            bool ready = false;
+            ina2xx_sample_t s;
+            if (!ina2xx_conversion_ready(&dev, &ready) || ready != completed) {
+                missed++;
+            }
+            if (ready && ina2xx_read(&dev, &s)) {
+                ina2xx_totals_add(&totals, &s, now);
+                if (first_us < 0) first_us = now;
+                last_us = now;
+                conversions++;
+            }
+        }
+    }
+
+    // The integration starts at the first conversion; what the pack gave
+    // before it is at most one conversion at idle
+    int64_t charge_true_uah = sim.drawn_ua_us / 3600000000LL;
+    int64_t energy_true_uwh = (int64_t)(energy_true_mw_us / 3600000.0);
+    printf("  %lu conversions, %lld/%lld uAh, %lld/%lld uWh (integrated/true), %llu ms\n",
+           (unsigned long)conversions, (long long)totals.charge_uah, (long long)charge_true_uah,
+           (long long)totals.energy_uwh, (long long)energy_true_uwh,
+           (unsigned long long)(totals.integrated_us / 1000));
+    expect(missed == 0, "ready flag set exactly once per completed conversion");
+    expect(totals.integrated_us == (uint64_t)(last_us - first_us), "integrated time is the span of the conversions");
+    // Shunt LSB 5 mA, bus LSB 1.25 mV, and every load change lands inside a conversion
+    expect(near(totals.charge_uah, charge_true_uah, charge_true_uah / 500 + 50), "charge within 0.2% of the pack's");
+    expect(near(totals.energy_uwh, energy_true_uwh, energy_true_uwh / 200 + 500), "energy within 0.5% of the pack's");
+}
+
+int main()
+{
+    ina2xx_sim_pack_t pack = INA2XX_SIM_DEFAULT_PACK;
+    ina2xx_sim_t sim;
+    ina2xx_t dev;
+
+    printf("identification and calibration\n");
+    ina2xx_sim_init(&sim, &pack, SHUNT_UOHM);
+    expect(ina2xx_init(&dev, &sim.bus, SHUNT_UOHM, MAX_CURRENT_MA), "init on the simulated INA226");
+    expect(dev.current_lsb_ua == 2442 && dev.calibration == 4193, "current LSB 2442 uA, CAL 4193");
+    expect(sim.regs[INA2XX_REG_CALIBRATION] == dev.calibration, "calibration written to the device");
+    ina2xx_bus_t other = { other_die_read, other_die_write, &sim.bus };
+    ina2xx_t rejected;
+    expect(!ina2xx_init(&rejected, &other, SHUNT_UOHM, MAX_CURRENT_MA), "another die is refused");
+    expect(!ina2xx_init(&rejected, &sim.bus, 0, MAX_CURRENT_MA), "zero shunt is refused");
+    expect(!ina2xx_init(&rejected, &sim.bus, 1, MAX_CURRENT_MA), "calibration out of range is refused");
+    ina2xx_init(&dev, &sim.bus, SHUNT_UOHM, MAX_CURRENT_MA);
+
+    printf("conversion timing and the ready flag\n");
+    expect(ina2xx_configure(&dev, INA2XX_AVG_16, INA2XX_CT_1100US), "configure 16 x 1.1 ms");
+    expect(ina2xx_conversion_us(dev.config) == 35200, "35.2 ms per conversion");
+    expect(sim.regs[INA2XX_REG_MASK_ENABLE] == (INA2XX_MASK_CNVR | INA2XX_MASK_LEN), "alert on conversion ready, latched");
+    bool ready = true;
+    ina2xx_conversion_ready(&dev, &ready);
+    expect(!ready, "not ready after configuring");
+    ina2xx_sim_set_load(&sim, 20000);
+    expect(!ina2xx_sim_advance(&sim, 35100), "no conversion before 35.2 ms");
+    ina2xx_conversion_ready(&dev, &ready);
+    expect(!ready, "still not ready at 35.1 ms");
+    expect(ina2xx_sim_advance(&sim, 100) && sim.since_conversion_us == 0, "converted at 35.2 ms");
+    ina2xx_conversion_ready(&dev, &ready);
+    expect(ready, "ready after the conversion");
+    ina2xx_conversion_ready(&dev, &ready);
+    expect(!ready, "reading the flag cleared it");
+
+    printf("readings\n");
+    ina2xx_sample_t s;
+    expect(ina2xx_read(&dev, &s), "read");
+    int64_t bus_mv = true_bus_uv(&sim) / 1000;
+    printf("  %ld mV (model %lld), %ld mA, %ld mW\n", (long)s.bus_mv, (long long)bus_mv, (long)s.current_ma,
+           (long)s.power_mw);
+    expect(near(s.bus_mv, bus_mv, 2), "bus voltage within one 1.25 mV LSB");
+    expect(near(s.current_ma, 20000, 8), "current within one shunt LSB (5 mA) of 20 A");
+    expect(near(s.power_mw, (int64_t)s.bus_mv * s.current_ma / 1000, 62), "power within one power LSB of V x I");
+    ina2xx_sim_set_load(&sim, -3000);
+    ina2xx_sim_advance(&sim, 35200);
+    ina2xx_read(&dev, &s);
+    expect(near(s.current_ma, -3000, 8) && s.power_mw > 0, "charging current is negative, power its magnitude");
+    expect(ina2xx_configure(&dev, INA2XX_AVG_4, INA2XX_CT_140US) && ina2xx_conversion_us(dev.config) == 1120,
+           "trace rate: 1.12 ms per conversion");
+
+    run_profile(INA2XX_AVG_16, INA2XX_CT_1100US, "integration at 35.2 ms");
+    run_profile(INA2XX_AVG_4, INA2XX_CT_140US, "integration at 1.12 ms (IR test trace)");
+
+    printf("%d failures\n%s\n", failures, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
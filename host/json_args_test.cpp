@@ -0,0 +1,90 @@
+// Checks of src/json_args.cpp: /api/batch entries as the web UI, the README
+// and hand-written scripts send them. The command name is itself a quoted
+// string that equals a key for speed, protocol and rpm, so those entries pin
+// that a key is only taken where a colon follows it.
+//
+// Build:  g++ -O2 -Isrc host/json_args_test.cpp src/json_args.cpp src/motor_core.cpp src/rpm_control.cpp -o json_args_test
+// Run:    ./json_args_test          # exits 1 on the first mismatch
+
+#include <stdio.h>
+#include <string.h>
+#include "json_args.h"
+
+struct entry_case_t {
+    const char *obj;          // Entry without its braces, as the batch walker hands it over
+    bool ok;
+    motor_cmd_type_t type;
+    int motor;
+    int value;
+};
+
+static const entry_case_t entry_cases[] = {
+    // The README's batch example
+    { "\"cmd\": \"protocol\", \"protocol\": \"oneshot125\"", true, MOTOR_CMD_PROTOCOL, MOTOR_ALL, PROTOCOL_ONESHOT125 },
+    { "\"cmd\": \"speed\", \"motor\": 0, \"speed\": 30", true, MOTOR_CMD_SPEED, 0, 30 },
+    { "\"cmd\": \"wait\", \"ms\": 500", true, MOTOR_CMD_WAIT, MOTOR_ALL, 500 },
+    { "\"cmd\": \"speed\", \"speed\": 60", true, MOTOR_CMD_SPEED, MOTOR_ALL, 60 },
+    { "\"cmd\": \"stop\"", true, MOTOR_CMD_STOP, MOTOR_ALL, 0 },
+    // Compact, key order and whitespace around the colon
+    { "\"cmd\":\"speed\",\"speed\":30", true, MOTOR_CMD_SPEED, MOTOR_ALL, 30 },
+    { "\"speed\":45,\"cmd\":\"speed\",\"motor\":1", true, MOTOR_CMD_SPEED, 1, 45 },
+    { "\"cmd\":\"speed\",\"speed\" :\n 70", true, MOTOR_CMD_SPEED, MOTOR_ALL, 70 },
+    { "\"cmd\":\"protocol\",\"protocol\":\"multishot\",\"preserve\":true", true, MOTOR_CMD_PROTOCOL, MOTOR_ALL,
+      PROTOCOL_MULTISHOT | MOTOR_PROTOCOL_PRESERVE },
+    { "\"cmd\":\"protocol\",\"preserve\":false,\"protocol\":\"oneshot42\"", true, MOTOR_CMD_PROTOCOL, MOTOR_ALL,
+      PROTOCOL_ONESHOT42 },
+    { "\"cmd\":\"rpm\",\"motor\":0,\"rpm\":8000", true, MOTOR_CMD_RPM, 0, 8000 },
+    { "\"cmd\":\"rpm\",\"rpm\":0", true, MOTOR_CMD_RPM, MOTOR_ALL, 0 },
+    { "\"cmd\":\"start\",\"motor\":1", true, MOTOR_CMD_START, 1, 0 },
+    // Rejected: the value the command needs is missing, or only the name matches
+    { "\"cmd\":\"speed\"", false, MOTOR_CMD_SPEED, 0, 0 },
+    { "\"cmd\":\"protocol\"", false, MOTOR_CMD_PROTOCOL, 0, 0 },
+    { "\"cmd\":\"protocol\",\"protocol\":\"dshot600\"", false, MOTOR_CMD_PROTOCOL, 0, 0 },
+    { "\"cmd\":\"rpm\",\"motor\":0", false, MOTOR_CMD_RPM, 0, 0 },
+    { "\"cmd\":\"wait\"", false, MOTOR_CMD_WAIT, 0, 0 },
+    { "\"cmd\":\"spin\",\"speed\":10", false, MOTOR_CMD_SPEED, 0, 0 },
+    { "\"speed\":10", false, MOTOR_CMD_SPEED, 0, 0 },
+    // Rejected: motor indexes that name no motor, or would wrap to one as int8_t
+    { "\"cmd\":\"stop\",\"motor\":2", false, MOTOR_CMD_STOP, 0, 0 },
+    { "\"cmd\":\"stop\",\"motor\":-2", false, MOTOR_CMD_STOP, 0, 0 },
+    { "\"cmd\":\"stop\",\"motor\":256", false, MOTOR_CMD_STOP, 0, 0 },
+    { "\"cmd\":\"stop\",\"motor\":\"0\"", false, MOTOR_CMD_STOP, 0, 0 },
+};
+
+static int failures = 0;
+
+static void expect(bool cond, const char *what, const char *input)
+{
+    if (!cond) {
+        printf("FAIL %s: %s\n", what, input);
+        failures++;
+    }
+}
+
+int main()
+{
+    for (const entry_case_t &c : entry_cases) {
+        motor_cmd_t cmd = {};
+        bool ok = json_parse_motor_command(c.obj, &cmd);
+        expect(ok == c.ok, c.ok ? "rejected" : "accepted", c.obj);
+        if (ok && c.ok) {
+            expect(cmd.type == c.type && cmd.motor == c.motor && cmd.value == c.value, "parsed as", c.obj);
+            expect(motor_core_command_valid(&cmd), "invalid after parsing", c.obj);
+        }
+    }
+
+    // Lookups on their own
+    char buf[16];
+    expect(json_find_value("{\"a\":\"b\",\"b\":2}", "b")[0] == '2', "value taken for key", "b");
+    expect(json_find_value("{\"a\":\"b\"}", "b") == NULL, "value taken for key", "b alone");
+    expect(json_get_string("{\"peer\" : \"10.0.0.21\"}", "peer", buf, sizeof(buf)) && strcmp(buf, "10.0.0.21") == 0,
+           "string", "peer");
+    expect(!json_get_string("{\"peer\":\"10.0.0.21:8080-too-long\"}", "peer", buf, sizeof(buf)), "long string", "peer");
+    expect(json_get_bool("{\"reboot\": true}", "reboot") && !json_get_bool("{\"reboot\":false}", "reboot") &&
+           !json_get_bool("{\"cmd\":\"reboot\",\"x\":true}", "reboot"), "bool", "reboot");
+    expect(json_find_value("{\"k\":1}", "a_key_longer_than_the_pattern_buffer") == NULL, "long key", "");
+
+    printf("%zu entries, %d failures\n%s\n", sizeof(entry_cases) / sizeof(entry_cases[0]), failures,
+           failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+// Step response of the RPM hold against the simulated motor, through
+// motor_core as the control task runs it: a tick every millisecond with the
+// loop due, the default gains and a feed-forward map that starts from the
+// seed. The test plays the ESC telemetry: the model's speed goes in as a
+// measurement once per telemetry period, from a frame on every visit down to
+// the slowest the telemetry task visits a wire. Each setpoint change is
+// checked against rise time, overshoot and settling limits, the way
+// rpm_step_t reports them on /api/motor/rpm; then the measurements stop.
+//
+// Build:  g++ -O2 -Isrc host/rpm_step_test.cpp src/motor_core.cpp src/rpm_control.cpp -o rpm_step_test
+// Run:    ./rpm_step_test          # exits 1 if any step misses its limits
+
+#include <stdio.h>
+#include <string.h>
+#include "motor_core.h"
+
+#define TICK_US 1000
+
+// Visit lengths of src/esc_telemetry.cpp: a frame every ESC_TLM_SLOT_MS, or
+// every MOTOR_COUNT slots when the other wires use their whole slot
+static const int64_t tlm_periods_us[] = { 40000, 80000 };
+
+struct step_case_t {
+    const char *name;
+    int32_t target;
+    uint32_t max_rise_ms;       // 0 for a step down, where rise is not the point
+    int32_t max_overshoot_permille;
+    uint32_t max_settle_ms;
+};
+
+// Spin-up follows tau_up (60 ms), spin-down tau_down (150 ms) without braking.
+// The first pass starts on the seeded map, the second repeats the steps on
+// the map the first pass has learned. No step may overshoot by more than a
+// tenth of its size.
+static const step_case_t steps[] = {
+    { "0 -> 8000",        8000, 600, 100, 2000 },   // The seed comes in from below
+    { "8000 -> 12000",   12000, 400, 100, 2000 },
+    { "12000 -> 16000",  16000, 400, 100, 2000 },
+    { "16000 -> 6000",    6000,   0, 100, 2000 },
+    { "6000 -> 10000",   10000, 400, 100, 2000 },
+    // Learned
+    { "10000 -> 8000",    8000,   0, 100, 1000 },
+    { "8000 -> 12000",   12000, 400, 100, 1000 },
+    { "12000 -> 16000",  16000, 400, 100, 1000 },
+    { "16000 -> 6000",    6000,   0, 100, 1000 },
+    { "6000 -> 10000",   10000, 400, 100, 1000 },
+};
+
+static int failures = 0;
+
+static void expect(bool cond, const char *what, const char *step)
+{
+    if (!cond) {
+        printf("FAIL %s: %s\n", step, what);
+        failures++;
+    }
+}
+
+// One telemetry frame: the model's speed, as the ESC would measure it
+static void feed(motor_core_t *core, int64_t now)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_RPM;
+    in.now_us = now;
+    in.feedback.motor = 0;
+    in.feedback.rpm = core->s.rpm[0];
+    motor_core_apply(core, &in);
+}
+
+static void tick(motor_core_t *core, int64_t now)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_TICK;
+    in.now_us = now;
+    in.rpm_due = true;
+    motor_core_apply(core, &in);
+}
+
+static void command(motor_core_t *core, int64_t now, int32_t rpm)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_COMMAND;
+    in.now_us = now;
+    in.cmd = { MOTOR_CMD_RPM, 0, rpm };
+    motor_core_apply(core, &in);
+}
+
+static void run(int64_t period)
+{
+    static motor_core_t core;
+    int64_t now = 1000000;
+    motor_core_init(&core, NULL, now);
+    printf("telemetry every %lld ms\n", (long long)(period / 1000));
+
+    // A hold without measurements ends on the first loop tick
+    command(&core, now, 8000);
+    tick(&core, now += TICK_US);
+    expect(!core.s.rpm_hold[0] && core.s.throttle[0] == 0 && core.s.rpm_feedback_lost == 1,
+           "held without measurements", "unmeasured");
+
+    // The ESC reports the motor at rest before the first command
+    feed(&core, now);
+    int64_t next_tlm = now + period;
+
+    for (const step_case_t &c : steps) {
+        command(&core, now, c.target);
+
+        // Run until the step settles or times out
+        const rpm_step_t *st = &core.s.rpm_step[0];
+        while (!st->complete) {
+            tick(&core, now += TICK_US);
+            if (now >= next_tlm) {
+                feed(&core, now);
+                next_tlm += period;
+            }
+        }
+
+        printf("  %-20s rise %4u ms  overshoot %3d permille  settle %4u ms  peak %5d  final %5d%s\n",
+               c.name, st->rise_us / 1000, st->overshoot_permille, st->settle_us / 1000,
+               st->peak_rpm, core.s.rpm[0], st->timed_out ? "  TIMED OUT" : "");
+        expect(!st->timed_out, "did not settle", c.name);
+        if (c.max_rise_ms) {
+            expect(st->t90_us >= 0 && st->rise_us <= c.max_rise_ms * 1000, "rise time", c.name);
+        }
+        expect(st->overshoot_permille <= c.max_overshoot_permille, "overshoot", c.name);
+        expect(st->settle_us <= c.max_settle_ms * 1000, "settling time", c.name);
+        // The loop saw the settled speed; the motor itself may have drifted
+        // a little since its last frame
+        int32_t size = st->to_rpm - st->from_rpm;
+        int32_t band = (size > 0 ? size : -size) * RPM_STEP_BAND_PERMILLE / 1000;
+        if (band < RPM_STEP_BAND_MIN_RPM) band = RPM_STEP_BAND_MIN_RPM;
+        int32_t err = core.s.rpm[0] - c.target;
+        expect(err <= 2 * band && err >= -2 * band, "left the band after settling", c.name);
+    }
+
+    // Measurements stop: the hold ends once the last one is too old
+    int64_t last = core.s.rpm_measured_us[0];
+    while (core.s.rpm_hold[0] && now - last <= 2 * MOTOR_RPM_FEEDBACK_US) {
+        tick(&core, now += TICK_US);
+    }
+    expect(!core.s.rpm_hold[0] && core.s.throttle[0] == 0 && core.s.rpm_feedback_lost == 2 &&
+           now - last > MOTOR_RPM_FEEDBACK_US, "held on after the telemetry stopped", "telemetry lost");
+
+    // Stopping through the loop ends the hold and spins down
+    feed(&core, now);
+    command(&core, now, 9000);
+    command(&core, now, 0);
+    expect(!core.s.rpm_hold[0] && core.s.throttle[0] == 0, "RPM 0 did not stop the motor", "stop");
+}
+
+int main()
+{
+    for (int64_t period : tlm_periods_us) {
+        run(period);
+    }
+    printf("%zu steps, %d failures\n%s\n", sizeof(tlm_periods_us) / sizeof(tlm_periods_us[0]) *
+           (sizeof(steps) / sizeof(steps[0])), failures, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
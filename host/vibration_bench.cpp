@@ -0,0 +1,126 @@
+// Replay a recorded accelerometer capture through the on-device vibration
+// pipeline (src/vibration_dsp.cpp) and time it on the host.
+//
+// Build:  g++ -O2 -Isrc host/vibration_bench.cpp src/vibration_dsp.cpp -o vibration_bench
+// Record: curl http://192.168.4.1/api/vibration/capture > capture.csv
+// Run:    ./vibration_bench capture.csv [fft_size] [rpm] [blades]
+//         ./vibration_bench --synth <rpm> [rate_hz] > synth.csv
+//
+// Capture format: a "# rate_hz=<n> lsb_per_g=<n> rpm=<n> rpm_source=<s>" line,
+// then one "x,y,z" line of raw accelerometer counts per sample. rpm is the
+// measured speed, 0 with rpm_source=none when there was no measurement; pass
+// [rpm] to label orders against a speed taken some other way.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "vibration_dsp.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Imbalance at 1x, some blade pass at 2x the blade count and noise, at 2048 LSB/g
+static int synth(uint32_t rpm, uint32_t rate_hz)
+{
+    double f1 = rpm / 60.0;
+    printf("# rate_hz=%u lsb_per_g=2048 rpm=%u\n", rate_hz, rpm);
+    srand(1);
+    for (uint32_t i = 0; i < rate_hz * 4; i++) {
+        double t = (double)i / rate_hz;
+        double x = 400 * sin(2 * M_PI * f1 * t) + 120 * sin(2 * M_PI * 2 * f1 * t + 0.3);
+        double y = 400 * cos(2 * M_PI * f1 * t) + 60 * sin(2 * M_PI * 4 * f1 * t);
+        double z = 2048 + 80 * sin(2 * M_PI * 2 * f1 * t + 1.0);
+        x += rand() % 41 - 20;
+        y += rand() % 41 - 20;
+        z += rand() % 41 - 20;
+        printf("%d,%d,%d\n", (int)lrint(x), (int)lrint(y), (int)lrint(z));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "--synth") == 0) {
+        return synth(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 4000);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.csv [fft_size] [rpm] [blades]\n"
+                        "       %s --synth <rpm> [rate_hz]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "r");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    unsigned rate_hz = 0, lsb_per_g = 2048, rpm = 0;
+    std::vector<vib_sample_t> samples;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            const char *p;
+            if ((p = strstr(line, "rate_hz="))) rate_hz = atoi(p + 8);
+            if ((p = strstr(line, "lsb_per_g="))) lsb_per_g = atoi(p + 10);
+            if ((p = strstr(line, "rpm="))) rpm = atoi(p + 4);
+            continue;
+        }
+        int x, y, z;
+        if (sscanf(line, "%d,%d,%d", &x, &y, &z) == 3) {
+            samples.push_back({ (int16_t)x, (int16_t)y, (int16_t)z });
+        }
+    }
+    fclose(f);
+
+    int n = argc > 2 ? atoi(argv[2]) : 1024;
+    if (argc > 3) rpm = atoi(argv[3]);
+    int blades = argc > 4 ? atoi(argv[4]) : 2;
+    if (rate_hz == 0 || !vib_dsp_init(n) || (int)samples.size() < n) {
+        fprintf(stderr, "need a rate_hz header, a power-of-two fft_size (%d-%d) and at least fft_size samples\n",
+                VIB_FFT_MIN, VIB_FFT_MAX);
+        return 1;
+    }
+
+    std::vector<uint32_t> amp(n / 2);
+    vib_peak_t peaks[VIB_MAX_PEAKS];
+    vib_orders_t orders;
+    double spectrum_us = 0, peaks_us = 0, worst_us = 0;
+    int frames = 0;
+    uint32_t rotor_mhz = rpm * 1000 / 60;
+    double mg_per_q4 = 1000.0 / lsb_per_g / 16.0;
+
+    // Same 50% overlap as the bench
+    for (size_t start = 0; start + n <= samples.size(); start += n / 2) {
+        double t0 = now_us();
+        vib_dsp_spectrum(&samples[start], n, 0x7, amp.data());
+        double t1 = now_us();
+        int count = vib_dsp_find_peaks(amp.data(), n, rate_hz, peaks, VIB_MAX_PEAKS);
+        vib_dsp_match_orders(amp.data(), n, rate_hz, rotor_mhz, blades, peaks, count, &orders);
+        double t2 = now_us();
+        spectrum_us += t1 - t0;
+        peaks_us += t2 - t1;
+        if (t2 - t0 > worst_us) worst_us = t2 - t0;
+
+        if (frames++ == 0 || start + n + n / 2 > samples.size()) {
+            printf("frame %d @ %.3f s: 1x %.1f mg, 2x %.1f mg, bpf %.1f mg\n", frames - 1,
+                   (double)start / rate_hz, orders.amp_1x_q4 * mg_per_q4, orders.amp_2x_q4 * mg_per_q4,
+                   orders.amp_bpf_q4 * mg_per_q4);
+            for (int i = 0; i < count; i++) {
+                printf("  %8.2f Hz %8.1f mg  order %.2f%s\n", peaks[i].freq_mhz / 1000.0,
+                       peaks[i].amp_q4 * mg_per_q4, peaks[i].order_x100 / 100.0, peaks[i].harmonic ? " *" : "");
+            }
+        }
+    }
+
+    printf("%d frames of %d points at %u Hz (%.2f Hz bins)\n", frames, n, rate_hz, (double)rate_hz / n);
+    printf("spectrum %.1f us, peaks %.1f us per frame, worst %.1f us\n",
+           spectrum_us / frames, peaks_us / frames, worst_us);
+    return 0;
+}
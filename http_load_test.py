@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""
+ESP32-C6 Service Bench HTTP fairness load test
+Measures POST /api/motor/stop latency from a technician connection, first on
+a quiet server and then while abusive clients poll as fast as they can and
+open more sockets than their budget. Exits 1 if the control latency moves.
+
+A last phase keeps each long handler busy in turn (a batch parked in its wait,
+the battery IR test, the firmware image stream) and checks that the exempt
+stop route still answers. The batch and the IR test run off the server task,
+so stop stays as fast as on a quiet server and ends the batch's wait. The
+image stream holds the server task until the image is out, with the outputs
+held stopped; there the stop only has to be answered, not be fast. The IR test
+spins the motors; leave it out with --long batch,image.
+
+The bench tells clients apart by IP address. Run with --abuse-only on a
+second machine and --probe-only on the technician's for the real picture;
+from one machine the probe shares the abusers' budget.
+"""
+
+import argparse
+import http.client
+import json
+import socket
+import sys
+import threading
+import time
+
+from latency_benchmark import summarize
+
+
+def percentile(samples, q):
+    samples = sorted(samples)
+    return samples[min(len(samples) - 1, int(q * len(samples)))] if samples else float('inf')
+
+
+def probe(host, seconds, interval, timeout=2):
+    """Motor stop on one keep-alive connection, like the web UI's stop button"""
+    samples, lost = [], 0
+    conn = http.client.HTTPConnection(host, 80, timeout=timeout)
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        start = time.perf_counter()
+        try:
+            conn.request('POST', '/api/motor/stop')
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status == 200:
+                samples.append((time.perf_counter() - start) * 1e6)
+            else:
+                lost += 1
+        except (OSError, http.client.HTTPException):
+            lost += 1
+            conn.close()
+            conn = http.client.HTTPConnection(host, 80, timeout=timeout)
+        time.sleep(interval)
+    conn.close()
+    return samples, lost
+
+
+class Abuser(threading.Thread):
+    """Polls path back to back and ignores Retry-After; also parks idle sockets"""
+
+    def __init__(self, host, path, parked, stop):
+        super().__init__(daemon=True)
+        self.host, self.path, self.parked, self.stop = host, path, parked, stop
+        self.ok = self.throttled = self.errors = self.refused = 0
+        self.retry_after = set()
+
+    def run(self):
+        held = []
+        for _ in range(self.parked):
+            try:
+                held.append(socket.create_connection((self.host, 80), timeout=2))
+            except OSError:
+                self.refused += 1
+        conn = http.client.HTTPConnection(self.host, 80, timeout=2)
+        while not self.stop.is_set():
+            try:
+                conn.request('GET', self.path)
+                resp = conn.getresponse()
+                resp.read()
+                if resp.status == 429:
+                    self.throttled += 1
+                    self.retry_after.add(resp.getheader('Retry-After'))
+                elif resp.status == 200:
+                    self.ok += 1
+                else:
+                    self.errors += 1
+            except (OSError, http.client.HTTPException):
+                self.errors += 1
+                conn.close()
+                conn = http.client.HTTPConnection(self.host, 80, timeout=2)
+        conn.close()
+        for s in held:
+            s.close()
+
+
+# A batch that only waits: nothing spins, and the probe's stop ends the wait
+BATCH_BODY = json.dumps({'commands': [{'cmd': 'wait', 'ms': 5000}]})
+IMAGE_TIMEOUT = 30   # Seconds a whole image may take over WiFi
+
+
+class LongRunner(threading.Thread):
+    """Starts one long handler again as soon as the last one ended, minding Retry-After"""
+
+    def __init__(self, host, kind, stop):
+        super().__init__(daemon=True)
+        self.host, self.kind, self.stop = host, kind, stop
+        self.runs = self.stopped = self.throttled = self.errors = 0
+
+    def request(self, conn, method, path, body=None):
+        conn.request(method, path, body=body, headers={'Content-Type': 'application/json'} if body else {})
+        resp = conn.getresponse()
+        return resp.status, resp.getheader('Retry-After'), resp.read()
+
+    def once(self, conn):
+        ended_by_stop = False
+        if self.kind == 'batch':
+            status, retry, body = self.request(conn, 'POST', '/api/batch', BATCH_BODY)
+            ended_by_stop = status == 409 and b'"aborted":true' in body
+            self.stopped += ended_by_stop
+        elif self.kind == 'ir':
+            status, retry, _ = self.request(conn, 'POST', '/api/battery/ir_test', '{}')
+            while status == 200 and not self.stop.is_set():
+                time.sleep(0.2)
+                _, _, body = self.request(conn, 'GET', '/api/battery/ir_test')
+                if json.loads(body).get('state') != 'running':
+                    break
+        else:
+            status, retry, _ = self.request(conn, 'GET', '/api/firmware/image')
+        if status == 429:
+            self.throttled += 1
+            time.sleep(float(retry or 1))
+        elif status == 200 or ended_by_stop:
+            self.runs += 1
+        elif status != 409:
+            self.errors += 1
+
+    def run(self):
+        conn = http.client.HTTPConnection(self.host, 80, timeout=IMAGE_TIMEOUT)
+        while not self.stop.is_set():
+            try:
+                self.once(conn)
+            except (OSError, http.client.HTTPException, ValueError):
+                self.errors += 1
+                conn.close()
+                conn = http.client.HTTPConnection(self.host, 80, timeout=IMAGE_TIMEOUT)
+                time.sleep(0.5)
+        if self.kind == 'ir':
+            try:
+                self.request(conn, 'POST', '/api/battery/ir_test/stop', '{}')
+            except (OSError, http.client.HTTPException):
+                pass
+        conn.close()
+
+
+def long_phase(host, kind, duration, interval, quiet_p95):
+    """Stop latency while one long handler runs back to back; True if it held up"""
+    stop = threading.Event()
+    runner = LongRunner(host, kind, stop)
+    runner.start()
+    time.sleep(0.5)   # Let the first one get going
+    holds_server = kind == 'image'
+    samples, lost = probe(host, duration, interval, IMAGE_TIMEOUT if holds_server else 2)
+    stop.set()
+    runner.join()
+    summarize(kind, samples, lost)
+    p95 = percentile(samples, 0.95)
+    extra = f", {runner.stopped} ended by stop" if kind == 'batch' else ''
+    print(f"  {kind}: {runner.runs} runs{extra}, {runner.throttled} answered 429, {runner.errors} errors")
+    if holds_server:
+        ok = lost == 0 and runner.runs > 0
+        print(f"  stop p95 {p95 / 1000:.2f} ms behind the stream, none lost: {'PASS' if ok else 'FAIL'}")
+    else:
+        ok = lost == 0 and runner.runs > 0 and p95 <= 2 * quiet_p95 + 10000
+        print(f"  stop p95 {quiet_p95 / 1000:.2f} -> {p95 / 1000:.2f} ms: {'PASS' if ok else 'FAIL'}")
+    return ok
+
+
+def show_counters(host):
+    try:
+        conn = http.client.HTTPConnection(host, 80, timeout=2)
+        conn.request('GET', '/api/http')
+        stats = json.loads(conn.getresponse().read())
+        conn.close()
+    except (OSError, http.client.HTTPException, ValueError) as e:
+        print(f"  /api/http unavailable: {e}")
+        return
+    print(f"  server: open={stats['open']}/{stats['max_sockets']} accepted={stats['accepted']} "
+          f"refused={stats['refused']} requests={stats['requests']} reused={stats['reused']} "
+          f"throttled={stats['throttled']} evicted={stats['evicted']}")
+    for c in stats['clients']:
+        print(f"  {c['ip']:>15}: sockets={c['sockets']} requests={c['requests']} "
+              f"throttled={c['throttled']} refused={c['refused']}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('host', nargs='?', default='192.168.4.1')
+    parser.add_argument('-d', '--duration', type=float, default=20, help='seconds per phase')
+    parser.add_argument('-a', '--abusers', type=int, default=4, help='polling threads')
+    parser.add_argument('-p', '--parked', type=int, default=2, help='idle sockets opened by each abuser')
+    parser.add_argument('--path', default='/api/status', help='endpoint the abusers poll')
+    parser.add_argument('-i', '--interval', type=float, default=0.1, help='seconds between probes')
+    parser.add_argument('--abuse-only', action='store_true', help='only run the abusive clients')
+    parser.add_argument('--probe-only', action='store_true', help='only measure, abuse comes from elsewhere')
+    parser.add_argument('--long', default='batch,ir,image',
+                        help='long handlers to run under the probe after the abuse, comma separated, "" for none')
+    args = parser.parse_args()
+
+    if args.probe_only:
+        summarize('stop', *probe(args.host, args.duration, args.interval))
+        show_counters(args.host)
+        return 0
+
+    baseline = None
+    if not args.abuse_only:
+        print(f"🔌 {args.host}: {args.duration:.0f} s quiet, then {args.abusers} abusers polling {args.path}")
+        print("=" * 60)
+        baseline = probe(args.host, args.duration, args.interval)
+        summarize('quiet', *baseline)
+
+    stop = threading.Event()
+    abusers = [Abuser(args.host, args.path, args.parked, stop) for _ in range(args.abusers)]
+    for a in abusers:
+        a.start()
+    if args.abuse_only:
+        time.sleep(args.duration)
+    else:
+        loaded = probe(args.host, args.duration, args.interval)
+        summarize('load', *loaded)
+    stop.set()
+    for a in abusers:
+        a.join()
+
+    ok = sum(a.ok for a in abusers)
+    throttled = sum(a.throttled for a in abusers)
+    print(f"abusers: {ok} served, {throttled} answered 429 "
+          f"(Retry-After {','.join(sorted(filter(None, set().union(*(a.retry_after for a in abusers))))) or '-'}), "
+          f"{sum(a.errors for a in abusers)} errors, {sum(a.refused for a in abusers)} parked sockets refused")
+    show_counters(args.host)
+    if baseline is None:
+        return 0
+
+    # Flat: the tail under load stays within twice the quiet one plus a WiFi retry or two
+    quiet_p95, load_p95 = percentile(baseline[0], 0.95), percentile(loaded[0], 0.95)
+    flat = loaded[1] == 0 and load_p95 <= 2 * quiet_p95 + 10000
+    print(f"control p95 {quiet_p95 / 1000:.2f} -> {load_p95 / 1000:.2f} ms: {'PASS' if flat else 'FAIL'}")
+
+    for kind in filter(None, args.long.split(',')):
+        if kind not in ('batch', 'ir', 'image'):
+            print(f"unknown long handler {kind}")
+            return 2
+        print(f"long handler: {kind}, {args.duration:.0f} s")
+        flat = long_phase(args.host, kind, args.duration, args.interval, quiet_p95) and flat
+    return 0 if flat else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
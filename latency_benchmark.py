@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+ESP32-C6 Service Bench command latency benchmark
+Compares throttle round-trip time over the UDP channel with POST /api/motor/speed
+
+WARNING: this arms the ESC outputs at the given throttle - remove props first.
+"""
+
+import argparse
+import http.client
+import json
+import statistics
+import sys
+import time
+
+from udp_client import BenchUdpClient, DEFAULT_PORT
+
+
+def summarize(name, samples_us, lost):
+    samples = sorted(samples_us)
+    if not samples:
+        print(f"{name:>5}: no replies ({lost} lost)")
+        return
+    p = lambda q: samples[min(len(samples) - 1, int(q * len(samples)))]
+    print(f"{name:>5}: n={len(samples)} lost={lost} "
+          f"min={samples[0] / 1000:.2f} median={statistics.median(samples) / 1000:.2f} "
+          f"p95={p(0.95) / 1000:.2f} p99={p(0.99) / 1000:.2f} max={samples[-1] / 1000:.2f} "
+          f"jitter(stdev)={statistics.pstdev(samples) / 1000:.2f} ms")
+
+
+def bench_udp(host, count, throttle, interval):
+    samples, lost = [], 0
+    with BenchUdpClient(host, DEFAULT_PORT, timeout=0.5, failsafe_ms=500) as bench:
+        for _ in range(count):
+            tlm = bench.send_throttle([throttle] * 4)
+            if tlm is None or tlm.rejected:
+                lost += 1
+            else:
+                samples.append(tlm.rtt_us)
+            time.sleep(interval)
+    return samples, lost
+
+
+def bench_http(host, count, throttle, interval):
+    samples, lost = [], 0
+    conn = http.client.HTTPConnection(host, 80, timeout=2)
+    body = json.dumps({"speed": throttle // 10})
+    for _ in range(count):
+        start = time.perf_counter()
+        try:
+            conn.request('POST', '/api/motor/speed', body, {'Content-Type': 'application/json'})
+            conn.getresponse().read()
+            samples.append((time.perf_counter() - start) * 1e6)
+        except (OSError, http.client.HTTPException):
+            lost += 1
+            conn.close()
+            conn = http.client.HTTPConnection(host, 80, timeout=2)
+        time.sleep(interval)
+    conn.request('POST', '/api/motor/stop')
+    conn.getresponse().read()
+    conn.close()
+    return samples, lost
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('host', nargs='?', default='192.168.4.1')
+    parser.add_argument('-n', '--count', type=int, default=500)
+    parser.add_argument('-t', '--throttle', type=int, default=0, help='per mille, default 0 (idle pulse)')
+    parser.add_argument('-i', '--interval', type=float, default=0.01, help='seconds between commands')
+    args = parser.parse_args()
+
+    print(f"🔌 Benchmarking {args.host} with {args.count} commands per transport")
+    print("=" * 60)
+    summarize('udp', *bench_udp(args.host, args.count, args.throttle, args.interval))
+    summarize('http', *bench_http(args.host, args.count, args.throttle, args.interval))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""
+ESP32-C6 Service Bench static memory budget
+Reads the linker map of a firmware build and reports flash and RAM per
+subsystem: one row per source file in src/, one per library for the rest.
+Then lists the largest RAM symbols, which with MEM_STATIC_ALLOCATION are
+the task stacks and buffer pools. Exits 1 if --budget is given and the
+bench's own static RAM exceeds it.
+
+  python3 mem_budget.py                         # finds the map of the last build
+  python3 mem_budget.py build/bench.map --budget 200
+"""
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+KINDS = ('text', 'rodata', 'iram', 'data', 'bss')
+
+# An input section line, possibly with the name wrapped onto the line before
+SECTION = re.compile(r'^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$')
+OBJECT = re.compile(r'(?:\(|/)([^/()]+?)\.(?:c|cc|cpp|S)\.o(?:bj)?\)?$')
+ARCHIVE = re.compile(r'([^/]+)\.a\(')
+
+
+def find_map():
+    found = glob.glob('.pio/build/*/firmware.map') + glob.glob('build/*.map')
+    return max(found, key=os.path.getmtime) if found else None
+
+
+def kind_of(output_section):
+    """Where an output section lives, or None for what takes no space on the target"""
+    name = output_section.lower()
+    if name.startswith('.debug') or name.startswith('.comment') or name.startswith('.riscv'):
+        return None
+    if 'bss' in name or 'noinit' in name:
+        return 'bss'
+    if 'rodata' in name:
+        return 'rodata'
+    if 'iram' in name:
+        return 'iram'
+    if 'data' in name:
+        return 'data'
+    if 'text' in name:
+        return 'text'
+    return None
+
+
+def owner_of(source):
+    """Subsystem for an object path: src/<name>.cpp, else the library"""
+    obj = OBJECT.search(source)
+    if obj and ('libsrc.a' in source or 'libmain.a' in source or '/src/' in source or source.startswith('src/')):
+        return obj.group(1), True
+    lib = ARCHIVE.search(source)
+    if lib:
+        return lib.group(1), False
+    return os.path.basename(source), False
+
+
+def parse(path):
+    """{owner: {kind: bytes}}, {owner: is_bench}, [(bytes, kind, owner, symbol)]"""
+    usage, bench, symbols = {}, {}, []
+    with open(path, errors='replace') as f:
+        lines = iter(f.read().splitlines())
+    for line in lines:
+        if line.startswith('Linker script and memory map'):
+            break
+
+    kind, pending = None, None
+    for line in lines:
+        if line.startswith('.') or (line and not line[0].isspace() and not line.startswith('LOAD')):
+            kind = kind_of(line.split()[0])
+            pending = None
+            continue
+        if kind is None:
+            continue
+        # Long names go on a line of their own, the address and size follow
+        stripped = line.strip()
+        if stripped and ' ' not in stripped and line.startswith(' ') and not stripped.startswith('0x') \
+                and not stripped.startswith('*'):
+            pending = stripped
+            continue
+        m = SECTION.match(line)
+        if not m:
+            pending = None
+            continue
+        name = m.group(1) or pending
+        pending = None
+        size = int(m.group(3), 16)
+        source = m.group(4).strip()
+        if name is None or size == 0 or source.startswith('0x') or name.startswith('*'):
+            continue
+        owner, own = owner_of(source)
+        usage.setdefault(owner, dict.fromkeys(KINDS, 0))[kind] += size
+        bench[owner] = own
+        if kind in ('data', 'bss'):
+            symbol = name.split('.', 2)[-1] if name.count('.') >= 2 else name
+            symbols.append((size, kind, owner, symbol))
+    return usage, bench, symbols
+
+
+def demangle(names):
+    """c++filt when the toolchain is around, else the plain _ZL<len><name> form"""
+    tool = shutil.which('riscv32-esp-elf-c++filt') or shutil.which('c++filt')
+    if tool and names:
+        try:
+            out = subprocess.run([tool], input='\n'.join(names), capture_output=True, text=True, timeout=10)
+            result = out.stdout.splitlines()
+            if len(result) == len(names):
+                return dict(zip(names, result))
+        except (OSError, subprocess.SubprocessError):
+            pass
+    simple = {}
+    for n in names:
+        m = re.match(r'_ZL(\d+)(.*)', n)
+        simple[n] = m.group(2)[:int(m.group(1))] if m else n
+    return simple
+
+
+def ram(row):
+    return row['iram'] + row['data'] + row['bss']
+
+
+def flash(row):
+    return row['text'] + row['rodata'] + row['iram'] + row['data']   # IRAM and .data load from flash
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('map', nargs='?', help='linker map (default: newest under .pio/build or build)')
+    parser.add_argument('--budget', type=float, help='KB of static RAM the bench sources may use')
+    parser.add_argument('-n', '--top', type=int, default=15, help='RAM symbols to list')
+    parser.add_argument('--all', action='store_true', help='list every library, not only the ten largest')
+    args = parser.parse_args()
+
+    path = args.map or find_map()
+    if not path or not os.path.exists(path):
+        print("No linker map found; build first or pass its path")
+        return 2
+    usage, bench, symbols = parse(path)
+    if not usage:
+        print(f"{path}: no sections found, is it a GNU ld map?")
+        return 2
+
+    def table(title, owners):
+        print(f"\n{title}")
+        print(f"  {'':<22}{'flash':>9}{'iram':>9}{'data':>9}{'bss':>9}{'ram':>9}")
+        for o in owners:
+            r = usage[o]
+            print(f"  {o:<22}{flash(r):>9}{r['iram']:>9}{r['data']:>9}{r['bss']:>9}{ram(r):>9}")
+
+    def total(owners):
+        t = dict.fromkeys(KINDS, 0)
+        for o in owners:
+            for k in KINDS:
+                t[k] += usage[o][k]
+        return t
+
+    print(f"📦 {path}")
+    print("=" * 60)
+    ours = sorted((o for o in usage if bench[o]), key=lambda o: -ram(usage[o]))
+    libs = sorted((o for o in usage if not bench[o]), key=lambda o: -(ram(usage[o]) + flash(usage[o])))
+    table("Bench sources (bytes)", ours)
+    table("Libraries (bytes)", libs if args.all else libs[:10])
+    if not args.all and len(libs) > 10:
+        print(f"  ... {len(libs) - 10} more, --all lists them")
+
+    mine, theirs = total(ours), total(libs)
+    print(f"\nbench: {flash(mine) / 1024:.1f} KB flash, {ram(mine) / 1024:.1f} KB RAM "
+          f"({mine['bss'] / 1024:.1f} KB bss)")
+    print(f"all:   {(flash(mine) + flash(theirs)) / 1024:.1f} KB flash, "
+          f"{(ram(mine) + ram(theirs)) / 1024:.1f} KB RAM")
+
+    top = sorted(symbols, reverse=True)[:args.top]
+    names = demangle([s[3] for s in top])
+    print("\nLargest RAM symbols")
+    for size, kind, owner, symbol in top:
+        print(f"  {size:>8}  {kind:<5} {owner:<20} {names.get(symbol, symbol)}")
+
+    if args.budget is not None:
+        used = ram(mine) / 1024
+        ok = used <= args.budget
+        print(f"\nbudget: {used:.1f} of {args.budget:.1f} KB: {'PASS' if ok else 'FAIL'}")
+        return 0 if ok else 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,15 +1,45 @@
 #!/usr/bin/env python3
 """
 ESP32-C6 Service Bench Monitor
-Real-time serial monitor with formatted output
+Real-time log monitor over the binary log (src/binlog.h)
+
+The firmware sends log records in binary over USB-Serial-JTAG; host/binlog_decode
+formats them using the strings in the firmware ELF and hands us one typed JSON
+event per line, so messages are matched by tag and format string, not by
+searching the printed text.
+
+Build the decoder once:
+    g++ -O2 -Isrc host/binlog_decode.cpp src/binlog_format.cpp -o binlog_decode
+
+Usage: monitor.py [firmware.elf] [port]
 """
 
-import serial
-import serial.tools.list_ports
-import time
+import json
+import os
+import subprocess
 import sys
+import serial.tools.list_ports
 from datetime import datetime
 
+DEFAULT_ELF = ".pio/build/esp32c6/firmware.elf"
+DECODER = os.environ.get("BINLOG_DECODE", "./binlog_decode")
+
+# (tag, format string prefix) -> icon, for records from BLOG* call sites
+FORMAT_ICONS = [
+    ("UDDI", "Motor speed set", "🌀"),
+    ("UDDI", "Motor started", "🌀"),
+    ("UDDI", "Motor stopped", "🛑"),
+    ("UDDI", "RPM ", "🎯"),
+    ("UDDI", "Batch ", "📦"),
+    ("UDDI", "Battery counters reset", "🔋"),
+    ("wifi_sta", "Connecting to", "📶"),
+    ("wifi_sta", "✓ Connected", "🌐"),
+    ("wifi_sta", "Disconnected", "📴"),
+    ("wifi_sta", "Round ", "⏳"),
+]
+
+LEVEL_ICONS = {"E": "❌", "W": "⚠️ "}
+
 def find_esp32_port():
     """Find the ESP32 serial port automatically"""
     ports = serial.tools.list_ports.comports()
@@ -22,61 +52,87 @@ def format_timestamp():
     """Return formatted timestamp"""
     return datetime.now().strftime("%H:%M:%S.%f")[:-3]
 
+def classify_text(line):
+    """Icon for an already formatted line (ESP_LOG text records, raw port output)"""
+    if "WiFi AP Started" in line:
+        return "✅"
+    elif "IP:" in line or "IP Address:" in line:
+        return "🌐"
+    elif "SSID:" in line:
+        return "📶"
+    elif "Password:" in line:
+        return "🔐"
+    elif "MAC Address:" in line:
+        return "🏷️ "
+    elif "WebSocket client" in line:
+        return "🔌"
+    elif "server started" in line.lower():
+        return "🚀"
+    elif "error" in line.lower() or "failed" in line.lower():
+        return "❌"
+    elif "Starting" in line:
+        return "⚡"
+    return None
+
+def classify_event(event):
+    """Icon for a typed record, by level first, then call site"""
+    if event["level"] in LEVEL_ICONS:
+        return LEVEL_ICONS[event["level"]]
+    for tag, prefix, icon in FORMAT_ICONS:
+        if event["tag"] == tag and event["fmt"].startswith(prefix):
+            return icon
+    return None
+
+def render(event):
+    """Return (icon, text) for one decoder event"""
+    if "raw" in event:
+        return classify_text(event["raw"]), event["raw"]
+    if "text" in event:
+        return classify_text(event["text"]), event["text"]
+    if event.get("unknown"):
+        return "❓", f"record {event['id']} not in this ELF, is it the running firmware?"
+    t_ms = event["t_us"] // 1000
+    return classify_event(event), f"{event['level']} ({t_ms}) {event['tag']}: {event['msg']}"
+
 def main():
-    # Find port
-    port = find_esp32_port()
+    elf = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_ELF
+    port = sys.argv[2] if len(sys.argv) > 2 else find_esp32_port()
     if not port:
         print("❌ ESP32-C6 not found. Please connect the device.")
         sys.exit(1)
-    
+    if not os.path.exists(elf):
+        print(f"❌ Firmware ELF not found: {elf}")
+        sys.exit(1)
+
     print(f"🔌 Connected to: {port}")
-    print(f"📡 Baud rate: 115200")
+    print(f"📜 Strings from: {elf}")
     print("=" * 60)
-    
+
     try:
-        ser = serial.Serial(port, 115200, timeout=1)
-        time.sleep(2)  # Wait for connection
-        
-        print(f"[{format_timestamp()}] 🎧 Listening for messages...\n")
-        
-        while True:
-            if ser.in_waiting > 0:
-                try:
-                    line = ser.readline().decode('utf-8', errors='ignore').strip()
-                    if line:
-                        timestamp = format_timestamp()
-                        
-                        # Format different message types
-                        if "WiFi AP Started" in line:
-                            print(f"[{timestamp}] ✅ {line}")
-                        elif "IP:" in line or "IP Address:" in line:
-                            print(f"[{timestamp}] 🌐 {line}")
-                        elif "SSID:" in line:
-                            print(f"[{timestamp}] 📶 {line}")
-                        elif "Password:" in line:
-                            print(f"[{timestamp}] 🔐 {line}")
-                        elif "MAC Address:" in line:
-                            print(f"[{timestamp}] 🏷️  {line}")
-                        elif "WebSocket client" in line:
-                            print(f"[{timestamp}] 🔌 {line}")
-                        elif "server started" in line.lower():
-                            print(f"[{timestamp}] 🚀 {line}")
-                        elif "error" in line.lower() or "failed" in line.lower():
-                            print(f"[{timestamp}] ❌ {line}")
-                        elif "Starting" in line:
-                            print(f"[{timestamp}] ⚡ {line}")
-                        else:
-                            print(f"[{timestamp}] {line}")
-                            
-                except UnicodeDecodeError:
-                    pass
-                    
+        decoder = subprocess.Popen([DECODER, elf, port, "--json"], stdout=subprocess.PIPE,
+                                   text=True, encoding="utf-8", errors="replace")
+    except OSError as e:
+        print(f"❌ Cannot run {DECODER}: {e}")
+        sys.exit(1)
+
+    print(f"[{format_timestamp()}] 🎧 Listening for messages...\n")
+    try:
+        for line in decoder.stdout:
+            try:
+                event = json.loads(line)
+            except json.JSONDecodeError:
+                continue
+            icon, text = render(event)
+            timestamp = format_timestamp()
+            if icon:
+                print(f"[{timestamp}] {icon} {text}")
+            else:
+                print(f"[{timestamp}] {text}")
     except KeyboardInterrupt:
         print("\n\n👋 Disconnected")
-        ser.close()
-    except Exception as e:
-        print(f"\n❌ Error: {e}")
-        sys.exit(1)
+    finally:
+        decoder.terminate()
+        decoder.wait()
 
 if __name__ == "__main__":
     main()
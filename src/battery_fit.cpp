@@ -0,0 +1,157 @@
+#include <string.h>
+#include "battery_fit.h"
+
+#define FIT_MIN_POST_SAMPLES 10
+#define FIT_TAU_SMOOTH       4        // Conversions averaged before the 63% crossing is looked for
+#define FIT_TAU_MIN_UV       2000     // Polarization too small to time below this
+
+// Polarization voltage of a sample: the sag left after the baseline and the
+// ohmic drop of the current change are taken out. uOhm x mA = nV.
+static int64_t polarization_uv(const battery_step_fit_t *fit, const battery_sample_t *s)
+{
+    return (int64_t)(fit->before_mv - s->bus_mv) * 1000 -
+           (int64_t)fit->r0_uohm * (s->current_ma - fit->before_ma) / 1000;
+}
+
+// Time from the edge until the smoothed polarization first reaches 63.2% of
+// its settled value, interpolated between conversions
+static uint32_t fit_tau(const battery_sample_t *samples, size_t first, size_t end, uint32_t conversion_us,
+                        const battery_step_t *step, const battery_step_fit_t *fit, int64_t p_inf_uv)
+{
+    int64_t sign = p_inf_uv < 0 ? -1 : 1;
+    if (p_inf_uv * sign < FIT_TAU_MIN_UV) {
+        return 0;
+    }
+    int64_t target = p_inf_uv * 632 / 1000 * sign;
+    int64_t edge_mid = ((int64_t)step->edge_start_us + step->edge_end_us) / 2;
+
+    int64_t p_win[FIT_TAU_SMOOTH], t_win[FIT_TAU_SMOOTH];
+    int64_t p_sum = 0, t_sum = 0, prev_p = 0, prev_t = 0;
+    size_t filled = 0;
+    for (size_t i = first; i < end; i++) {
+        const battery_sample_t *s = &samples[i];
+        if (s->t_us < step->edge_end_us + conversion_us || s->t_us > step->post_to_us) {
+            continue;
+        }
+        int64_t p = polarization_uv(fit, s) * sign;
+        int64_t t = (int64_t)s->t_us - conversion_us / 2;   // Middle of the conversion
+        size_t slot = filled % FIT_TAU_SMOOTH;
+        if (filled >= FIT_TAU_SMOOTH) {
+            p_sum -= p_win[slot];
+            t_sum -= t_win[slot];
+        }
+        p_win[slot] = p;
+        t_win[slot] = t;
+        p_sum += p;
+        t_sum += t;
+        filled++;
+        if (filled < FIT_TAU_SMOOTH) {
+            continue;
+        }
+
+        int64_t avg_p = p_sum / FIT_TAU_SMOOTH;
+        int64_t avg_t = t_sum / FIT_TAU_SMOOTH;
+        if (avg_p >= target) {
+            int64_t at = avg_t;
+            if (filled > FIT_TAU_SMOOTH && avg_p > prev_p && target > prev_p) {
+                at = prev_t + (avg_t - prev_t) * (target - prev_p) / (avg_p - prev_p);
+            }
+            return at > edge_mid ? (uint32_t)(at - edge_mid) : 0;
+        }
+        prev_p = avg_p;
+        prev_t = avg_t;
+    }
+    return 0;
+}
+
+bool battery_fit_step(const battery_sample_t *samples, size_t count, uint32_t conversion_us,
+                      const battery_step_t *step, battery_step_fit_t *fit)
+{
+    memset(fit, 0, sizeof(*fit));
+
+    // Sort conversions by where their averaging window lies relative to the edge
+    int64_t pre_mv = 0, pre_ma = 0, set_mv = 0, set_ma = 0;
+    uint32_t settle_from = step->post_to_us - (step->post_to_us - step->edge_end_us) / 5;
+    uint32_t settled = 0;
+    size_t post_first = count, post_end = count;
+    for (size_t i = 0; i < count; i++) {
+        const battery_sample_t *s = &samples[i];
+        uint32_t window_start = s->t_us > conversion_us ? s->t_us - conversion_us : 0;
+        if (s->t_us > step->post_to_us) {
+            post_end = i;
+            break;
+        }
+        if (s->t_us <= step->edge_start_us) {
+            if (window_start >= step->pre_from_us) {
+                pre_mv += s->bus_mv;
+                pre_ma += s->current_ma;
+                fit->pre_samples++;
+            }
+        } else if (window_start < step->edge_end_us) {
+            fit->straddling++;
+        } else {
+            if (post_first == count) post_first = i;
+            fit->post_samples++;
+            if (s->t_us >= settle_from) {
+                set_mv += s->bus_mv;
+                set_ma += s->current_ma;
+                settled++;
+            }
+        }
+    }
+    if (fit->pre_samples == 0 || fit->post_samples < FIT_MIN_POST_SAMPLES || settled == 0) {
+        return false;
+    }
+    fit->before_mv = (int32_t)(pre_mv / fit->pre_samples);
+    fit->before_ma = (int32_t)(pre_ma / fit->pre_samples);
+    fit->settled_mv = (int32_t)(set_mv / settled);
+    fit->settled_ma = (int32_t)(set_ma / settled);
+
+    int32_t step_ma = fit->settled_ma - fit->before_ma;
+    int32_t step_abs = step_ma < 0 ? -step_ma : step_ma;
+    if (step_abs < BATTERY_FIT_MIN_STEP_MA) {
+        return false;
+    }
+
+    // The ESC ramps the current; the ohmic drop is taken once it is 90% there,
+    // before the polarization has had time to develop
+    size_t first = post_end;
+    fit->peak_mv = fit->before_mv;
+    for (size_t i = post_first; i < post_end; i++) {
+        const battery_sample_t *s = &samples[i];
+        int32_t d = s->current_ma - fit->before_ma;
+        if (first == post_end && (d < 0 ? -d : d) * 10 >= step_abs * 9) {
+            first = i;
+        }
+        if (step_ma > 0 ? s->bus_mv < fit->peak_mv : s->bus_mv > fit->peak_mv) {
+            fit->peak_mv = s->bus_mv;
+        }
+    }
+    if (first == post_end) {
+        return false;
+    }
+    fit->first_mv = samples[first].bus_mv;
+    fit->first_ma = samples[first].current_ma;
+    fit->rise_us = samples[first].t_us > step->edge_start_us ? samples[first].t_us - step->edge_start_us : 0;
+    fit->r0_uohm = (int32_t)((int64_t)(fit->before_mv - fit->first_mv) * 1000000 /
+                             (fit->first_ma - fit->before_ma));
+
+    // Whatever the settled sag has beyond the ohmic drop is polarization
+    battery_sample_t end_state = { step->post_to_us, fit->settled_mv, fit->settled_ma };
+    int64_t p_inf_uv = polarization_uv(fit, &end_state);
+    fit->r1_uohm = (int32_t)(p_inf_uv * 1000 / step_ma);
+    fit->tau_us = fit_tau(samples, first, post_end, conversion_us, step, fit, p_inf_uv);
+    fit->valid = true;
+    return true;
+}
+
+uint32_t battery_fit_gaps(const battery_sample_t *samples, size_t count, uint32_t conversion_us)
+{
+    uint32_t gaps = 0;
+    for (size_t i = 1; i < count; i++) {
+        if ((samples[i].t_us - samples[i - 1].t_us) * 2 > conversion_us * 3) {
+            gaps++;
+        }
+    }
+    return gaps;
+}
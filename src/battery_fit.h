@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Battery step analysis: ohmic resistance, polarization resistance and its
+// time constant from a voltage/current trace around one load step. Works on
+// plain arrays, so host/battery_fit_test.cpp feeds it synthetic packs.
+
+// One power monitor conversion. t_us is the completion time relative to the
+// start of the trace; the values are averaged over the conversion before it.
+typedef struct {
+    uint32_t t_us;
+    int32_t bus_mv;
+    int32_t current_ma;
+} battery_sample_t;
+
+// Where the step is in the trace. The output changed somewhere between
+// edge_start_us and edge_end_us; conversions overlapping that window mix both
+// loads and are left out.
+typedef struct {
+    uint32_t pre_from_us;     // Baseline window starts here and ends at the edge
+    uint32_t edge_start_us;
+    uint32_t edge_end_us;
+    uint32_t post_to_us;      // End of the step
+} battery_step_t;
+
+#define BATTERY_FIT_MIN_STEP_MA 500   // Smaller steps are reported as invalid
+
+typedef struct {
+    bool valid;
+    int32_t before_mv;        // Baseline means
+    int32_t before_ma;
+    int32_t settled_mv;       // Means over the last fifth of the step
+    int32_t settled_ma;
+    int32_t first_mv;         // First conversion with 90% of the current step done
+    int32_t first_ma;
+    uint32_t rise_us;         // Edge to the end of that conversion
+    int32_t peak_mv;          // Furthest voltage excursion in the step direction
+    int32_t r0_uohm;          // Ohmic resistance
+    int32_t r1_uohm;          // Polarization resistance
+    uint32_t tau_us;          // Polarization 63% developed, 0 if too small to time
+    uint16_t pre_samples;
+    uint16_t post_samples;
+    uint16_t straddling;      // Conversions dropped because they overlap the edge
+} battery_step_fit_t;
+
+// Fit one step. Returns false (and fit->valid = false) if either side has too
+// few clean conversions or the current step is below BATTERY_FIT_MIN_STEP_MA.
+bool battery_fit_step(const battery_sample_t *samples, size_t count, uint32_t conversion_us,
+                      const battery_step_t *step, battery_step_fit_t *fit);
+
+// Conversions further apart than 1.5 conversion times, i.e. results the reader missed
+uint32_t battery_fit_gaps(const battery_sample_t *samples, size_t count, uint32_t conversion_us);
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "motor_control.h"
+#include "sensors.h"
+#include "battery_test.h"
+#include "mem_pool.h"
+
+static const char *TAG = "battery_test";
+
+#define IR_MAX_TRACE_MS (BATTERY_IR_MAX_SAMPLES * (SENSORS_TRACE_CONVERSION_US / 10) / 100 - 100)
+#define IR_MAX_SETTLE_MS 5000
+#define IR_TASK_PRIORITY 3
+#define IR_TASK_STACK    3072
+
+static portMUX_TYPE ir_lock = portMUX_INITIALIZER_UNLOCKED;
+static battery_ir_result_t result;
+static TaskHandle_t ir_task_handle = NULL;   // The test task while a test runs
+static TaskHandle_t ir_worker = NULL;
+MEM_TASK_STORAGE(ir_task, IR_TASK_STACK);
+static volatile bool abort_requested = false;
+
+// Set the tested outputs and return when the new duty can first and last be
+// on the wire, relative to the trace start
+static esp_err_t step_throttle(const battery_ir_config_t *cfg, int throttle, int64_t trace_us,
+                               uint32_t *edge_start, uint32_t *edge_end)
+{
+    motor_cmd_t cmd = { MOTOR_CMD_THROTTLE, (int8_t)cfg->motor, throttle };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int first = cfg->motor == MOTOR_ALL ? 0 : cfg->motor;
+    int last = cfg->motor == MOTOR_ALL ? MOTOR_COUNT - 1 : cfg->motor;
+    int64_t start = INT64_MAX, end = 0;
+    for (int m = first; m <= last; m++) {
+        motor_update_t u;
+        motor_get_last_update(m, &u);
+        if (u.update_us < start) start = u.update_us;
+        if (u.update_us + u.latch_us > end) end = u.update_us + u.latch_us;
+    }
+    *edge_start = (uint32_t)(start - trace_us);
+    *edge_end = (uint32_t)(end - trace_us);
+    return ESP_OK;
+}
+
+static void stop_motors(const battery_ir_config_t *cfg)
+{
+    motor_cmd_t cmd = { MOTOR_CMD_STOP, (int8_t)cfg->motor, 0 };
+    motor_apply_command(&cmd);
+}
+
+// Sleep unless the test is aborted; returns true on abort
+static bool wait_ms(uint32_t ms)
+{
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+    return abort_requested;
+}
+
+static void run_test(void)
+{
+    battery_ir_result_t r = result;
+    const battery_ir_config_t *cfg = &r.config;
+
+    static_assert(sizeof(battery_sample_t) * BATTERY_IR_MAX_SAMPLES <= MEM_BULK_BLOCK,
+                  "trace outgrew the bulk block");
+    battery_sample_t *trace = (battery_sample_t *)mem_alloc(sizeof(battery_sample_t) * BATTERY_IR_MAX_SAMPLES);
+    esp_err_t err = trace != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+
+    // Spin up to the low throttle before tracing, so the baseline is settled
+    uint32_t up_start = 0, up_end = 0, down_start = 0, down_end = 0;
+    int64_t trace_us = 0;
+    bool traced = false;
+    if (err == ESP_OK) {
+        motor_cmd_t cmd = { MOTOR_CMD_THROTTLE, (int8_t)cfg->motor, cfg->low_throttle };
+        err = motor_apply_command(&cmd);
+    }
+    if (err == ESP_OK && !wait_ms(cfg->settle_ms)) {
+        err = sensors_start_trace(trace, BATTERY_IR_MAX_SAMPLES, &trace_us, &r.conversion_us);
+        traced = err == ESP_OK;
+    }
+    if (traced) {
+        if (!wait_ms(BATTERY_IR_BASELINE_MS)) {
+            err = step_throttle(cfg, cfg->high_throttle, trace_us, &up_start, &up_end);
+            if (err == ESP_OK && !wait_ms(cfg->hold_ms)) {
+                err = step_throttle(cfg, cfg->low_throttle, trace_us, &down_start, &down_end);
+                if (err == ESP_OK) {
+                    wait_ms(cfg->recover_ms);
+                }
+            }
+        }
+        r.samples = sensors_stop_trace();
+    }
+    stop_motors(cfg);
+
+    if (err == ESP_OK && !abort_requested && r.samples > 0) {
+        r.latch_us = up_end - up_start;
+        r.gaps = battery_fit_gaps(trace, r.samples, r.conversion_us);
+
+        // The recovery baseline is the settled end of the load step
+        battery_step_t up = { 0, up_start, up_end, down_start };
+        battery_step_t down = { down_start - (down_start - up_end) / 5, down_start, down_end,
+                                trace[r.samples - 1].t_us };
+        battery_fit_step(trace, r.samples, r.conversion_us, &up, &r.load);
+        battery_fit_step(trace, r.samples, r.conversion_us, &down, &r.release);
+
+        r.pass = r.load.valid && r.release.valid;
+        if (r.pass) {
+            r.r0_uohm = (r.load.r0_uohm + r.release.r0_uohm) / 2;
+            r.r1_uohm = (r.load.r1_uohm + r.release.r1_uohm) / 2;
+            r.sag_mv = r.load.before_mv - r.load.peak_mv;
+        }
+        ESP_LOGI(TAG, "IR test: %lu conversions, %lu gaps, R0 %ld uOhm, R1 %ld uOhm, tau %lu/%lu ms, sag %ld mV, %s",
+                 r.samples, r.gaps, r.r0_uohm, r.r1_uohm, r.load.tau_us / 1000, r.release.tau_us / 1000,
+                 r.sag_mv, r.pass ? "PASS" : "FAIL");
+    }
+    mem_free(trace);
+
+    r.state = err != ESP_OK ? BATTERY_IR_FAILED : abort_requested ? BATTERY_IR_ABORTED : BATTERY_IR_DONE;
+    r.err = err;
+    r.elapsed_ms = (uint32_t)((esp_timer_get_time() - r.start_us) / 1000);
+    portENTER_CRITICAL(&ir_lock);
+    result = r;
+    ir_task_handle = NULL;
+    portEXIT_CRITICAL(&ir_lock);
+    if (r.state != BATTERY_IR_DONE) {
+        ESP_LOGI(TAG, "IR test %s%s%s", battery_ir_state_name(r.state),
+                 err != ESP_OK ? ": " : "", err != ESP_OK ? esp_err_to_name(err) : "");
+    }
+}
+
+// Created on the first test and parked between tests, so its stack can be static
+static void ir_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        portENTER_CRITICAL(&ir_lock);
+        bool start = ir_task_handle != NULL;
+        portEXIT_CRITICAL(&ir_lock);
+        if (start) {   // Else a stop that came in as the last test ended
+            run_test();
+        }
+    }
+}
+
+esp_err_t battery_test_ir_start(const battery_ir_config_t *cfg)
+{
+    if ((cfg->motor != MOTOR_ALL && (cfg->motor < 0 || cfg->motor >= MOTOR_COUNT)) ||
+        cfg->low_throttle < 0 || cfg->high_throttle > 1000 || cfg->low_throttle >= cfg->high_throttle ||
+        cfg->settle_ms > IR_MAX_SETTLE_MS || cfg->hold_ms == 0 || cfg->recover_ms == 0 ||
+        BATTERY_IR_BASELINE_MS + cfg->hold_ms + cfg->recover_ms > IR_MAX_TRACE_MS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ir_worker == NULL &&
+        MEM_TASK_CREATE(ir_task, "ir_test", NULL, IR_TASK_PRIORITY, &ir_worker) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&ir_lock);
+    bool busy = ir_task_handle != NULL;
+    if (!busy) {
+        memset(&result, 0, sizeof(result));
+        result.state = BATTERY_IR_RUNNING;
+        result.config = *cfg;
+        result.start_us = esp_timer_get_time();
+        abort_requested = false;
+        ir_task_handle = ir_worker;
+    }
+    portEXIT_CRITICAL(&ir_lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(ir_worker);
+    ESP_LOGI(TAG, "IR test motor %d from %d to %d per mille", cfg->motor, cfg->low_throttle, cfg->high_throttle);
+    return ESP_OK;
+}
+
+esp_err_t battery_test_ir_stop(void)
+{
+    portENTER_CRITICAL(&ir_lock);
+    TaskHandle_t handle = ir_task_handle;
+    if (handle) {
+        abort_requested = true;
+    }
+    portEXIT_CRITICAL(&ir_lock);
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(handle);
+    return ESP_OK;
+}
+
+void battery_test_ir_get_result(battery_ir_result_t *out)
+{
+    portENTER_CRITICAL(&ir_lock);
+    *out = result;
+    portEXIT_CRITICAL(&ir_lock);
+    if (out->state == BATTERY_IR_RUNNING) {
+        out->elapsed_ms = (uint32_t)((esp_timer_get_time() - out->start_us) / 1000);
+    }
+}
+
+const char *battery_ir_state_name(battery_ir_state_t state)
+{
+    switch (state) {
+        case BATTERY_IR_IDLE:    return "idle";
+        case BATTERY_IR_RUNNING: return "running";
+        case BATTERY_IR_DONE:    return "done";
+        case BATTERY_IR_ABORTED: return "aborted";
+        case BATTERY_IR_FAILED:  return "failed";
+    }
+    return "unknown";
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "battery_fit.h"
+
+// Battery internal resistance test. Steps the throttle up and back down
+// through the motor control task while the power monitor traces every
+// conversion, then fits each step with battery_fit_step(). The motors need a
+// load (props or a brake) for the current step to be large enough.
+
+typedef struct {
+    int motor;                // Motor index or MOTOR_ALL
+    int low_throttle;         // Per mille, held before and after the step
+    int high_throttle;
+    uint32_t settle_ms;       // At low throttle before the trace starts
+    uint32_t hold_ms;         // At high throttle
+    uint32_t recover_ms;      // Back at low throttle
+} battery_ir_config_t;
+
+#define BATTERY_IR_DEFAULT_CONFIG { -1, 100, 600, 1000, 1500, 1500 }
+#define BATTERY_IR_BASELINE_MS    200    // Traced at low throttle before the step
+#define BATTERY_IR_MAX_SAMPLES    3072   // 36KB, allocated for the test only
+
+typedef enum {
+    BATTERY_IR_IDLE,
+    BATTERY_IR_RUNNING,
+    BATTERY_IR_DONE,
+    BATTERY_IR_ABORTED,
+    BATTERY_IR_FAILED
+} battery_ir_state_t;
+
+typedef struct {
+    battery_ir_state_t state;
+    battery_ir_config_t config;
+    esp_err_t err;                 // Why the run failed
+    int64_t start_us;
+    uint32_t elapsed_ms;
+    bool pass;                     // Both steps fitted
+    uint32_t conversion_us;
+    uint32_t samples;
+    uint32_t gaps;                 // Conversions the sampler missed
+    uint32_t latch_us;             // Uncertainty of each edge, one PWM period
+    battery_step_fit_t load;       // Throttle step up
+    battery_step_fit_t release;    // Throttle step down, the recovery
+    int32_t r0_uohm;               // Mean of both steps
+    int32_t r1_uohm;
+    int32_t sag_mv;                // Baseline to the lowest voltage under load
+} battery_ir_result_t;
+
+// Validate the test and start it on its own task. It takes settle_ms +
+// BATTERY_IR_BASELINE_MS + hold_ms + recover_ms; the tested motors are stopped
+// when it ends, fails or is aborted.
+esp_err_t battery_test_ir_start(const battery_ir_config_t *cfg);
+
+// Abort a running test
+esp_err_t battery_test_ir_stop(void);
+
+// Progress, and the fit once the test is done
+void battery_test_ir_get_result(battery_ir_result_t *result);
+
+const char *battery_ir_state_name(battery_ir_state_t state);
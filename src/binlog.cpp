@@ -0,0 +1,196 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "driver/usb_serial_jtag.h"
+#include "esp_vfs_usb_serial_jtag.h"
+#include "binlog.h"
+#include "mem_pool.h"
+
+static const char *TAG = "binlog";
+
+#define BINLOG_RING_SIZE     4096    // Bytes, power of two
+#define BINLOG_RING_MASK     (BINLOG_RING_SIZE - 1)
+#define BINLOG_TX_BUFFER     2048    // USB-Serial-JTAG driver ring
+#define BINLOG_TX_TIMEOUT    pdMS_TO_TICKS(20)
+#define BINLOG_DRAIN_MS      20
+#define BINLOG_SYNC_MS       10000   // The 32-bit stamps wrap every 71 minutes
+#define BINLOG_TASK_PRIORITY 1
+#define BINLOG_TASK_STACK    3072
+
+// Ring entries start with a header word; the record follows, padded to a
+// word. Producers reserve space by advancing the head with a CAS, copy the
+// record and publish it by storing the header with the commit bit. The drain
+// task is the only consumer: it stops at the first uncommitted header, so
+// records leave in reservation order, and zeroes each entry it consumes.
+// A record that would wrap is preceded by a pad entry up to the end.
+#define HDR_COMMIT 0x80000000u
+#define HDR_PAD    0x40000000u
+#define HDR_LEN    0x0000FFFFu
+
+MEM_TASK_STORAGE(binlog_task, BINLOG_TASK_STACK);
+static uint32_t ring[BINLOG_RING_SIZE / 4];
+static std::atomic<uint32_t> ring_head(0);   // Next byte to reserve, free running
+static std::atomic<uint32_t> ring_tail(0);   // Next byte to drain, written by the drain task only
+
+static std::atomic<uint32_t> stat_records(0);
+static std::atomic<uint32_t> stat_text_records(0);
+static std::atomic<uint32_t> stat_dropped(0);
+static std::atomic<uint32_t> stat_high_water(0);
+static uint32_t stat_frames = 0;
+static uint32_t stat_bytes = 0;
+static uint32_t stat_unsent = 0;
+
+volatile uint8_t binlog_level = CONFIG_LOG_MAXIMUM_LEVEL;
+
+bool binlog_submit(const uint8_t *record, size_t len)
+{
+    uint32_t size = 4 + (((uint32_t)len + 3) & ~3u);
+    uint32_t pos = ring_head.load(std::memory_order_relaxed);
+    uint32_t pad, next;
+    do {
+        uint32_t room = BINLOG_RING_SIZE - (pos & BINLOG_RING_MASK);
+        pad = room < size ? room : 0;
+        next = pos + pad + size;
+        if (next - ring_tail.load(std::memory_order_acquire) > BINLOG_RING_SIZE) {
+            stat_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!ring_head.compare_exchange_weak(pos, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    if (pad) {
+        __atomic_store_n(&ring[(pos & BINLOG_RING_MASK) / 4], HDR_COMMIT | HDR_PAD | pad, __ATOMIC_RELEASE);
+    }
+    uint32_t *hdr = &ring[((pos + pad) & BINLOG_RING_MASK) / 4];
+    memcpy(hdr + 1, record, len);
+    __atomic_store_n(hdr, HDR_COMMIT | (uint32_t)len, __ATOMIC_RELEASE);
+
+    stat_records.fetch_add(1, std::memory_order_relaxed);
+    uint32_t depth = next - ring_tail.load(std::memory_order_relaxed);
+    uint32_t high = stat_high_water.load(std::memory_order_relaxed);
+    while (depth > high && !stat_high_water.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+static bool ring_pop(uint8_t *record, size_t *len)
+{
+    while (1) {
+        uint32_t tail = ring_tail.load(std::memory_order_relaxed);
+        if (tail == ring_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        uint32_t *hdr = &ring[(tail & BINLOG_RING_MASK) / 4];
+        uint32_t h = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+        if (!(h & HDR_COMMIT)) {
+            return false;   // Reserved, still being written
+        }
+        uint32_t size;
+        if (h & HDR_PAD) {
+            size = h & HDR_LEN;
+        } else {
+            *len = h & HDR_LEN;
+            memcpy(record, hdr + 1, *len);
+            size = 4 + (((uint32_t)*len + 3) & ~3u);
+        }
+        memset(hdr, 0, size);   // Free space reads as uncommitted headers
+        ring_tail.store(tail + size, std::memory_order_release);
+        if (!(h & HDR_PAD)) {
+            return true;
+        }
+    }
+}
+
+// ESP_LOG output after init: the line is already formatted, send it as text
+static int log_vprintf(const char *fmt, va_list args)
+{
+    blog_record_t r;
+    blog_record_begin(&r, BLOG_ID_TEXT, (uint32_t)esp_timer_get_time());
+    size_t room = BLOG_MAX_RECORD - r.len;
+    int n = vsnprintf((char *)r.buf + r.len, room, fmt, args);
+    if (n < 0) {
+        return n;
+    }
+    size_t used = (size_t)n < room ? (size_t)n : room - 1;
+    while (used > 0 && (r.buf[r.len + used - 1] == '\n' || r.buf[r.len + used - 1] == '\r')) {
+        used--;
+    }
+    r.len += used;
+    if (binlog_submit(r.buf, r.len)) {
+        stat_text_records.fetch_add(1, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+static void submit_sync(void)
+{
+    int64_t now = esp_timer_get_time();
+    blog_record_t r;
+    blog_record_begin(&r, BLOG_ID_SYNC, (uint32_t)now);
+    blog_put_bytes(&r, &now, sizeof(now));
+    binlog_submit(r.buf, r.len);
+}
+
+static void binlog_task(void *arg)
+{
+    uint8_t record[BLOG_MAX_RECORD];
+    uint8_t frame[BLOG_MAX_FRAME];
+    int64_t next_sync = 0;
+
+    while (1) {
+        if (esp_timer_get_time() >= next_sync) {
+            submit_sync();
+            next_sync = esp_timer_get_time() + (int64_t)BINLOG_SYNC_MS * 1000;
+        }
+        // Without a host the driver would hold every write for the timeout
+        bool host = usb_serial_jtag_is_connected();
+        size_t len;
+        while (ring_pop(record, &len)) {
+            if (!host) {
+                stat_unsent++;
+                continue;
+            }
+            size_t n = blog_frame_encode(record, len, frame);
+            int written = usb_serial_jtag_write_bytes(frame, n, BINLOG_TX_TIMEOUT);
+            if (written > 0) {
+                stat_frames++;
+                stat_bytes += written;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(BINLOG_DRAIN_MS));
+    }
+}
+
+esp_err_t binlog_init(void)
+{
+    usb_serial_jtag_driver_config_t cfg = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+    cfg.tx_buffer_size = BINLOG_TX_BUFFER;
+    esp_err_t err = usb_serial_jtag_driver_install(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "USB-Serial-JTAG driver: %s", esp_err_to_name(err));
+        return err;
+    }
+    // Console text goes through the same driver, so it cannot split a frame
+    esp_vfs_usb_serial_jtag_use_driver();
+
+    if (MEM_TASK_CREATE(binlog_task, "binlog", NULL, BINLOG_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Binary log on USB-Serial-JTAG, decode with host/binlog_decode");
+    esp_log_set_vprintf(log_vprintf);
+    return ESP_OK;
+}
+
+void binlog_get_stats(binlog_stats_t *out)
+{
+    out->records = stat_records.load(std::memory_order_relaxed);
+    out->text_records = stat_text_records.load(std::memory_order_relaxed);
+    out->dropped = stat_dropped.load(std::memory_order_relaxed);
+    out->ring_high_water = stat_high_water.load(std::memory_order_relaxed);
+    out->frames = stat_frames;
+    out->bytes = stat_bytes;
+    out->unsent = stat_unsent;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <type_traits>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "binlog_format.h"
+
+// Deferred-format logging. BLOGI(fmt, ...) and friends take the place of
+// ESP_LOGI(TAG, fmt, ...) on hot paths: the call site stores a descriptor
+// (format, TAG, line, level) in flash, and the call itself only copies the
+// descriptor's address, a timestamp and the raw arguments into a lock-free
+// ring. A low priority task frames the records out over USB-Serial-JTAG, and
+// host/binlog_decode.cpp formats them using the strings in the ELF.
+// After binlog_init() plain ESP_LOG output travels the same way as text records.
+//
+// The file must have the usual `static const char *TAG`.
+
+typedef struct {
+    const char *fmt;
+    const char *const *tag;
+    uint16_t magic;           // BLOG_SITE_MAGIC, checked by the decoder
+    uint16_t line;
+    uint8_t level;            // esp_log_level_t
+} blog_site_t;
+
+static_assert(sizeof(void *) != 4 || sizeof(blog_site_t) == BLOG_SITE_SIZE, "Decoder expects this layout");
+
+typedef struct {
+    uint32_t records;         // Records queued, text records included
+    uint32_t text_records;
+    uint32_t dropped;         // Ring full, the record was lost
+    uint32_t frames;          // Framed and handed to USB-Serial-JTAG
+    uint32_t bytes;           // Frame bytes written
+    uint32_t unsent;          // Drained while no host was attached
+    uint32_t ring_high_water; // Deepest ring fill in bytes
+} binlog_stats_t;
+
+// Install the USB-Serial-JTAG driver, route ESP_LOG output into the ring and
+// start the drain task. Records logged before this are kept and sent then.
+esp_err_t binlog_init(void);
+
+void binlog_get_stats(binlog_stats_t *stats);
+
+// Queue a finished record; never blocks. Returns false if the ring is full.
+bool binlog_submit(const uint8_t *record, size_t len);
+
+extern volatile uint8_t binlog_level;   // Records above this level are not queued
+
+// Typed argument encoding, by the C++ type as passed to printf
+template <typename T>
+static inline void blog_put(blog_record_t *r, T v)
+{
+    typedef typename std::remove_cv<typename std::remove_pointer<T>::type>::type pointee_t;
+    if constexpr (std::is_pointer<T>::value &&
+                  (std::is_same<pointee_t, char>::value || std::is_same<pointee_t, unsigned char>::value ||
+                   std::is_same<pointee_t, signed char>::value)) {
+        blog_put_str(r, (const char *)v);
+    } else if constexpr (std::is_pointer<T>::value) {
+        blog_put_int(r, BLOG_ARG_PTR, (uint32_t)(uintptr_t)v, 4);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        blog_put_double(r, (double)v);
+    } else if constexpr (std::is_enum<T>::value) {
+        blog_put_int(r, BLOG_ARG_I32, (uint32_t)(int32_t)v, 4);
+    } else if constexpr (sizeof(T) <= 4) {
+        // Narrow types are promoted as for printf
+        if constexpr (std::is_signed<T>::value || sizeof(T) < sizeof(int)) {
+            blog_put_int(r, BLOG_ARG_I32, (uint32_t)(int32_t)v, 4);
+        } else {
+            blog_put_int(r, BLOG_ARG_U32, (uint32_t)v, 4);
+        }
+    } else {
+        blog_put_int(r, std::is_signed<T>::value ? BLOG_ARG_I64 : BLOG_ARG_U64, (uint64_t)v, 8);
+    }
+}
+
+template <typename... Args>
+static inline void blog_emit(const blog_site_t *site, Args... args)
+{
+    blog_record_t r;
+    blog_record_begin(&r, (uint32_t)(uintptr_t)site, (uint32_t)esp_timer_get_time());
+    (blog_put(&r, args), ...);
+    binlog_submit(r.buf, r.len);
+}
+
+// Never called; lets the compiler check the arguments against the format
+static inline void blog_check_format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static inline void blog_check_format(const char *fmt, ...) {}
+
+#define BLOG_AT(level, fmt, ...) do {                                                            \
+        static const blog_site_t _blog_site = { fmt, &TAG, BLOG_SITE_MAGIC, __LINE__, level };  \
+        if (0) blog_check_format(fmt, ##__VA_ARGS__);                                           \
+        if ((level) <= binlog_level) blog_emit(&_blog_site, ##__VA_ARGS__);                     \
+    } while (0)
+
+#define BLOGE(fmt, ...) BLOG_AT(ESP_LOG_ERROR, fmt, ##__VA_ARGS__)
+#define BLOGW(fmt, ...) BLOG_AT(ESP_LOG_WARN, fmt, ##__VA_ARGS__)
+#define BLOGI(fmt, ...) BLOG_AT(ESP_LOG_INFO, fmt, ##__VA_ARGS__)
+#define BLOGD(fmt, ...) BLOG_AT(ESP_LOG_DEBUG, fmt, ##__VA_ARGS__)
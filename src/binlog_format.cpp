@@ -0,0 +1,176 @@
+#include <string.h>
+#include "binlog_format.h"
+
+void blog_record_begin(blog_record_t *r, uint32_t id, uint32_t time_us)
+{
+    r->len = 0;
+    r->truncated = false;
+    blog_put_bytes(r, &id, 4);
+    blog_put_bytes(r, &time_us, 4);
+}
+
+static bool reserve(blog_record_t *r, size_t len)
+{
+    if (r->truncated || r->len + len > BLOG_MAX_RECORD) {
+        r->truncated = true;
+        return false;
+    }
+    return true;
+}
+
+void blog_put_int(blog_record_t *r, char type, uint64_t value, size_t size)
+{
+    if (!reserve(r, 1 + size)) {
+        return;
+    }
+    r->buf[r->len++] = (uint8_t)type;
+    for (size_t i = 0; i < size; i++) {
+        r->buf[r->len++] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+void blog_put_double(blog_record_t *r, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    blog_put_int(r, BLOG_ARG_DOUBLE, bits, 8);
+}
+
+void blog_put_str(blog_record_t *r, const char *s)
+{
+    size_t n = s ? strnlen(s, BLOG_MAX_STR) : 0;
+    if (!r->truncated && r->len + 2 + n > BLOG_MAX_RECORD && r->len + 2 < BLOG_MAX_RECORD) {
+        n = BLOG_MAX_RECORD - r->len - 2;   // Keep the start of a long string
+    }
+    if (!reserve(r, 2 + n)) {
+        return;
+    }
+    r->buf[r->len++] = BLOG_ARG_STR;
+    r->buf[r->len++] = (uint8_t)n;
+    memcpy(r->buf + r->len, s, n);
+    r->len += n;
+}
+
+void blog_put_bytes(blog_record_t *r, const void *data, size_t len)
+{
+    if (r->len + len > BLOG_MAX_RECORD) {
+        len = BLOG_MAX_RECORD - r->len;
+        r->truncated = true;
+    }
+    memcpy(r->buf + r->len, data, len);
+    r->len += len;
+}
+
+uint8_t blog_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t blog_frame_encode(const uint8_t *record, size_t len, uint8_t *out)
+{
+    uint8_t crc = blog_crc8(record, len);
+    size_t o = 0;
+    out[o++] = 0;
+
+    // COBS: each block starts with the distance to the next zero
+    size_t code_pos = o++;
+    uint8_t code = 1;
+    for (size_t i = 0; i <= len; i++) {
+        uint8_t b = i < len ? record[i] : crc;
+        if (b == 0) {
+            out[code_pos] = code;
+            code_pos = o++;
+            code = 1;
+            continue;
+        }
+        out[o++] = b;
+        if (++code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = o++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    out[o++] = 0;
+    return o;
+}
+
+bool blog_frame_decode(const uint8_t *in, size_t len, uint8_t *record, size_t *record_len)
+{
+    size_t o = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) {
+            return false;
+        }
+        for (uint8_t k = 1; k < code; k++) {
+            if (o >= BLOG_MAX_RECORD + 1) {
+                return false;
+            }
+            record[o++] = in[i++];
+        }
+        if (code != 0xFF && i < len) {
+            if (o >= BLOG_MAX_RECORD + 1) {
+                return false;
+            }
+            record[o++] = 0;
+        }
+    }
+    if (o < BLOG_HEADER_LEN + 1 || blog_crc8(record, o - 1) != record[o - 1]) {
+        return false;
+    }
+    *record_len = o - 1;
+    return true;
+}
+
+int blog_parse_args(const uint8_t *data, size_t len, blog_arg_t *args, int max_args)
+{
+    int n = 0;
+    size_t i = 0;
+    while (i < len && n < max_args) {
+        blog_arg_t *a = &args[n];
+        memset(a, 0, sizeof(*a));
+        a->type = (char)data[i++];
+        size_t size;
+        switch (a->type) {
+            case BLOG_ARG_I32: case BLOG_ARG_U32: case BLOG_ARG_PTR: size = 4; break;
+            case BLOG_ARG_I64: case BLOG_ARG_U64: case BLOG_ARG_DOUBLE: size = 8; break;
+            case BLOG_ARG_STR:
+                if (i >= len || i + 1 + data[i] > len) {
+                    return -1;
+                }
+                a->s_len = data[i];
+                a->s = data + i + 1;
+                i += 1 + a->s_len;
+                n++;
+                continue;
+            default:
+                return -1;
+        }
+        if (i + size > len) {
+            return -1;
+        }
+        uint64_t v = 0;
+        for (size_t k = 0; k < size; k++) {
+            v |= (uint64_t)data[i + k] << (8 * k);
+        }
+        i += size;
+        if (a->type == BLOG_ARG_DOUBLE) {
+            memcpy(&a->d, &v, sizeof(v));
+        } else if (a->type == BLOG_ARG_I32) {
+            a->i = (int32_t)(uint32_t)v;
+        } else {
+            a->i = (int64_t)v;
+        }
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Wire format of the binary log. A record is a header followed by typed
+// arguments; the format string stays in the firmware image and the record
+// names it by the address of its call site descriptor. Records are framed as
+// 0x00, COBS(record + CRC8), 0x00, so frames can share the port with plain
+// text, which never contains a zero byte. host/binlog_decode.cpp and
+// host/control_replay.cpp read records back with this same file.
+
+#define BLOG_MAX_RECORD   128     // Record bytes before framing
+#define BLOG_MAX_STR      48      // Longest string argument, longer ones are cut
+#define BLOG_MAX_FRAME    (BLOG_MAX_RECORD + 1 + (BLOG_MAX_RECORD + 1) / 254 + 3)
+#define BLOG_HEADER_LEN   8       // u32 site address, u32 esp_timer time in us (low half)
+
+// Site addresses below the first RAM/flash address are reserved ids
+#define BLOG_ID_TEXT      0       // Payload is a formatted ESP_LOG line
+#define BLOG_ID_SYNC      1       // Payload is the full 64-bit time, to unwrap the 32-bit stamps
+#define BLOG_ID_REPLAY    2       // Payload is a motor control input record (motor_core.h)
+
+// Argument type codes, each followed by its little-endian value
+#define BLOG_ARG_I32      'i'
+#define BLOG_ARG_U32      'u'
+#define BLOG_ARG_I64      'q'
+#define BLOG_ARG_U64      'Q'
+#define BLOG_ARG_DOUBLE   'd'
+#define BLOG_ARG_PTR      'p'
+#define BLOG_ARG_STR      's'     // u8 length, then the bytes without a terminator
+
+// Call site descriptor as laid out in the 32-bit firmware image
+#define BLOG_SITE_MAGIC   0xB10C
+#define BLOG_SITE_FMT     0       // u32 address of the format string
+#define BLOG_SITE_TAG     4       // u32 address of the file's TAG pointer
+#define BLOG_SITE_MAGIC_OFS 8     // u16 BLOG_SITE_MAGIC
+#define BLOG_SITE_LINE    10      // u16 source line
+#define BLOG_SITE_LEVEL   12      // u8 esp_log_level_t
+#define BLOG_SITE_SIZE    16
+
+typedef struct {
+    uint8_t buf[BLOG_MAX_RECORD];
+    size_t len;
+    bool truncated;           // An argument did not fit and was left out
+} blog_record_t;
+
+typedef struct {
+    char type;
+    int64_t i;                // Integer types, sign- or zero-extended
+    double d;
+    const uint8_t *s;         // Points into the record
+    size_t s_len;
+} blog_arg_t;
+
+void blog_record_begin(blog_record_t *r, uint32_t id, uint32_t time_us);
+void blog_put_int(blog_record_t *r, char type, uint64_t value, size_t size);
+void blog_put_double(blog_record_t *r, double value);
+void blog_put_str(blog_record_t *r, const char *s);
+void blog_put_bytes(blog_record_t *r, const void *data, size_t len);   // Untyped, for text records
+
+uint8_t blog_crc8(const uint8_t *data, size_t len);
+
+// Frame a record; out needs BLOG_MAX_FRAME bytes. Returns the frame length.
+size_t blog_frame_encode(const uint8_t *record, size_t len, uint8_t *out);
+
+// Undo the COBS stuffing of the bytes between two delimiters and check the
+// CRC. Returns false for a damaged frame.
+bool blog_frame_decode(const uint8_t *in, size_t len, uint8_t *record, size_t *record_len);
+
+// Split a record's arguments. Returns the count, or -1 if the record is malformed.
+int blog_parse_args(const uint8_t *data, size_t len, blog_arg_t *args, int max_args);
+
+static inline uint32_t blog_get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
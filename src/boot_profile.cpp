@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "boot_profile.h"
+
+static const char *TAG = "boot";
+
+typedef struct {
+    const char *phase;
+    int64_t us;
+} boot_mark_t;
+
+static boot_mark_t marks[BOOT_PROFILE_MAX_MARKS];
+static int mark_count = 0;
+static bool first_request_seen = false;
+static portMUX_TYPE marks_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_mark(const char *phase)
+{
+    int64_t now = esp_timer_get_time();
+    bool added = false;
+
+    // Marks come from app_main, the init task and event handlers
+    portENTER_CRITICAL(&marks_lock);
+    bool seen = false;
+    for (int i = 0; i < mark_count; i++) {
+        if (strcmp(marks[i].phase, phase) == 0) seen = true;
+    }
+    if (!seen && mark_count < BOOT_PROFILE_MAX_MARKS) {
+        marks[mark_count].phase = phase;
+        marks[mark_count].us = now;
+        mark_count++;
+        added = true;
+    }
+    portEXIT_CRITICAL(&marks_lock);
+
+    if (added) {
+        ESP_LOGI(TAG, "%-16s %7lld us", phase, now);
+    }
+}
+
+void boot_note_request(void)
+{
+    if (first_request_seen) {
+        return;
+    }
+    first_request_seen = true;
+    boot_mark("first_request");
+    boot_log_timeline();
+}
+
+void boot_log_timeline(void)
+{
+    ESP_LOGI(TAG, "Boot timeline:");
+    int64_t prev = 0;
+    for (int i = 0; i < mark_count; i++) {
+        ESP_LOGI(TAG, "  %-16s %7lld us  (+%lld)", marks[i].phase, marks[i].us, marks[i].us - prev);
+        prev = marks[i].us;
+    }
+}
+
+int boot_timeline_json(char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "{\"marks\":[");
+    for (int i = 0; i < mark_count && n < (int)len; i++) {
+        n += snprintf(buf + n, len - n, "%s{\"phase\":\"%s\",\"us\":%lld}",
+                      i ? "," : "", marks[i].phase, marks[i].us);
+    }
+    if (n < (int)len) {
+        n += snprintf(buf + n, len - n, "]}");
+    }
+    return n < (int)len ? n : (int)len - 1;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Boot timeline: named marks in esp_timer microseconds since the app started.
+// Marks are recorded once; repeats of a phase name are ignored.
+
+#define BOOT_PROFILE_MAX_MARKS 20
+
+void boot_mark(const char *phase);
+
+// Record the first served HTTP request (time-to-first-served-request)
+void boot_note_request(void);
+
+void boot_log_timeline(void);
+
+// Write the timeline as a JSON object into buf, returns the length
+int boot_timeline_json(char *buf, size_t len);
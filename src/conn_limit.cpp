@@ -0,0 +1,159 @@
+#include <string.h>
+#include "conn_limit.h"
+
+void conn_limit_init(conn_limit_t *cl, int max_sockets)
+{
+    memset(cl, 0, sizeof(*cl));
+    cl->max_sockets = max_sockets;
+    for (int i = 0; i < CONN_LIMIT_SOCKETS; i++) {
+        cl->sockets[i].fd = -1;
+    }
+}
+
+static conn_socket_t *find_socket(conn_limit_t *cl, int fd)
+{
+    for (int i = 0; i < CONN_LIMIT_SOCKETS; i++) {
+        if (cl->sockets[i].fd == fd) {
+            return &cl->sockets[i];
+        }
+    }
+    return NULL;
+}
+
+// Existing entry, else a free one, else the longest-quiet client without sockets
+static int find_client(conn_limit_t *cl, uint32_t ip, int64_t now_us)
+{
+    int slot = -1;
+    for (int i = 0; i < CONN_LIMIT_CLIENTS; i++) {
+        conn_client_t *c = &cl->clients[i];
+        if (c->ip == ip) {
+            return i;
+        }
+        if (c->sockets == 0 && (slot < 0 || c->ip == 0 ||
+                                (cl->clients[slot].ip != 0 && c->last_us < cl->clients[slot].last_us))) {
+            slot = i;
+        }
+    }
+    if (slot >= 0) {
+        conn_client_t *c = &cl->clients[slot];
+        memset(c, 0, sizeof(*c));
+        c->ip = ip;
+        c->tokens_milli = CONN_LIMIT_BURST * 1000;
+        c->refill_us = now_us;
+        c->last_us = now_us;
+    }
+    return slot;
+}
+
+int conn_limit_open_sockets(const conn_limit_t *cl)
+{
+    int n = 0;
+    for (int i = 0; i < CONN_LIMIT_SOCKETS; i++) {
+        n += cl->sockets[i].fd >= 0;
+    }
+    return n;
+}
+
+bool conn_limit_open(conn_limit_t *cl, int fd, uint32_t ip, int64_t now_us)
+{
+    int open = conn_limit_open_sockets(cl);
+    int ci = find_client(cl, ip, now_us);
+    if (ci >= 0) {
+        conn_client_t *c = &cl->clients[ci];
+        c->last_us = now_us;
+        if (c->sockets >= CONN_LIMIT_CLIENT_SOCKETS || (c->sockets > 0 && open + 1 >= cl->max_sockets)) {
+            c->refused++;
+            cl->refused++;
+            return false;
+        }
+    }
+    conn_socket_t *s = find_socket(cl, -1);
+    if (!s) {
+        // More sockets than the table tracks; let the server's own limit decide
+        cl->accepted++;
+        return true;
+    }
+    s->fd = fd;
+    s->client = (int8_t)ci;
+    s->persistent = false;
+    s->last_us = now_us;
+    s->requests = 0;
+    if (ci >= 0) {
+        cl->clients[ci].sockets++;
+    }
+    cl->accepted++;
+    return true;
+}
+
+void conn_limit_close(conn_limit_t *cl, int fd)
+{
+    conn_socket_t *s = fd >= 0 ? find_socket(cl, fd) : NULL;
+    if (!s) {
+        return;
+    }
+    if (s->client >= 0 && cl->clients[s->client].sockets > 0) {
+        cl->clients[s->client].sockets--;
+    }
+    s->fd = -1;
+}
+
+bool conn_limit_request(conn_limit_t *cl, int fd, int cost, int64_t now_us, uint32_t *retry_after_ms)
+{
+    cl->requests++;
+    conn_socket_t *s = find_socket(cl, fd);
+    if (!s) {
+        return true;
+    }
+    if (s->requests++ > 0) {
+        cl->reused++;
+    }
+    s->last_us = now_us;
+    if (s->client < 0) {
+        return true;
+    }
+
+    conn_client_t *c = &cl->clients[s->client];
+    c->requests++;
+    c->last_us = now_us;
+    int64_t refill = (now_us - c->refill_us) * CONN_LIMIT_RATE / 1000;
+    if (refill > 0) {
+        int64_t tokens = c->tokens_milli + refill;
+        c->tokens_milli = tokens > CONN_LIMIT_BURST * 1000 ? CONN_LIMIT_BURST * 1000 : (int32_t)tokens;
+        c->refill_us = now_us;
+    }
+    if (cost <= 0) {
+        return true;
+    }
+    if (c->tokens_milli < cost * 1000) {
+        c->throttled++;
+        cl->throttled++;
+        if (retry_after_ms) {
+            *retry_after_ms = (uint32_t)((cost * 1000 - c->tokens_milli + CONN_LIMIT_RATE - 1) / CONN_LIMIT_RATE);
+        }
+        return false;
+    }
+    c->tokens_milli -= cost * 1000;
+    return true;
+}
+
+void conn_limit_set_persistent(conn_limit_t *cl, int fd)
+{
+    conn_socket_t *s = find_socket(cl, fd);
+    if (s) {
+        s->persistent = true;
+    }
+}
+
+int conn_limit_idle(conn_limit_t *cl, int64_t now_us, int *fds, int max)
+{
+    int n = 0;
+    for (int i = 0; i < CONN_LIMIT_SOCKETS && n < max; i++) {
+        conn_socket_t *s = &cl->sockets[i];
+        if (s->fd >= 0 && !s->persistent && now_us - s->last_us > CONN_LIMIT_IDLE_US) {
+            fds[n++] = s->fd;
+            s->last_us = now_us;   // Not listed again while the close is pending
+            cl->evicted++;
+        }
+    }
+    return n;
+}
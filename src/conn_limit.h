@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Per-client admission for the HTTP server. Clients are told apart by IPv4
+// address; each gets a budget of concurrent sockets and a token bucket of
+// requests, so a runaway polling script is answered with 429s instead of
+// taking the server task and every socket from the technician. Time comes in
+// from the caller: http_guard.cpp passes esp_timer, host/conn_limit_test.cpp
+// a clock of its own.
+
+#define CONN_LIMIT_CLIENTS         8
+#define CONN_LIMIT_SOCKETS         16
+#define CONN_LIMIT_CLIENT_SOCKETS  3        // Concurrent sockets per client
+#define CONN_LIMIT_RATE            10       // Request cost units refilled per second
+#define CONN_LIMIT_BURST           30       // Bucket depth
+#define CONN_LIMIT_IDLE_US         20000000 // Keep-alive sockets quiet this long are closed
+
+// Request costs
+#define CONN_COST_EXEMPT 0   // Never throttled (motor stop)
+#define CONN_COST_LIGHT  1
+#define CONN_COST_HEAVY  5   // Long-running or large responses
+
+typedef struct {
+    uint32_t ip;              // 0 for a free slot
+    uint8_t sockets;
+    int32_t tokens_milli;
+    int64_t refill_us;
+    int64_t last_us;
+    uint32_t requests;
+    uint32_t throttled;
+    uint32_t refused;         // Connections over the socket budget
+} conn_client_t;
+
+typedef struct {
+    int fd;                   // -1 for a free slot
+    int8_t client;            // Index into clients, -1 if untracked
+    bool persistent;          // WebSocket: never evicted for idling
+    int64_t last_us;
+    uint32_t requests;
+} conn_socket_t;
+
+typedef struct {
+    int max_sockets;          // Server-wide limit
+    conn_client_t clients[CONN_LIMIT_CLIENTS];
+    conn_socket_t sockets[CONN_LIMIT_SOCKETS];
+    uint32_t accepted;
+    uint32_t refused;
+    uint32_t requests;
+    uint32_t reused;          // Requests on an already used keep-alive socket
+    uint32_t throttled;
+    uint32_t evicted;
+} conn_limit_t;
+
+void conn_limit_init(conn_limit_t *cl, int max_sockets);
+
+// A socket was accepted. Returns false if it should be closed right away:
+// the client already holds its budget, or it holds any socket while the
+// server is one short of full (the last one is kept for a new client).
+bool conn_limit_open(conn_limit_t *cl, int fd, uint32_t ip, int64_t now_us);
+
+// Unknown descriptors are ignored
+void conn_limit_close(conn_limit_t *cl, int fd);
+
+// Charge a request of the given cost. Returns false when the client's bucket
+// is empty; retry_after_ms is then the time until it can afford the request.
+bool conn_limit_request(conn_limit_t *cl, int fd, int cost, int64_t now_us, uint32_t *retry_after_ms);
+
+void conn_limit_set_persistent(conn_limit_t *cl, int fd);
+
+// Collect sockets idle for CONN_LIMIT_IDLE_US, returns how many were written
+int conn_limit_idle(conn_limit_t *cl, int64_t now_us, int *fds, int max);
+
+int conn_limit_open_sockets(const conn_limit_t *cl);
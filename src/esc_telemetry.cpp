@@ -0,0 +1,199 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "motor_control.h"
+#include "esc_telemetry.h"
+#include "mem_pool.h"
+
+static const char *TAG = "esc_tlm";
+
+// Telemetry wires, one per motor. GPIO17 is the UART0 RX pad, free because the
+// sdkconfigs put the console on USB Serial/JTAG.
+static const gpio_num_t tlm_gpios[MOTOR_COUNT] = { GPIO_NUM_17, GPIO_NUM_0 };
+
+#define ESC_TLM_UART        UART_NUM_1
+#define ESC_TLM_RX_BUFFER   512        // Driver ring buffer, the FIFO drains into it
+#define ESC_TLM_QUEUE_LEN   16
+#define ESC_TLM_RX_TIMEOUT  3          // Idle symbols that end a burst (~260us)
+#define ESC_TLM_RX_FULL     30         // FIFO fill that wakes the task mid-burst
+#define ESC_TLM_SLOT_MS     40         // Visit length; auto telemetry repeats within it
+#define ESC_TLM_TASK_PRIORITY 3
+#define ESC_TLM_TASK_STACK  3072
+
+MEM_TASK_STORAGE(esc_telemetry_task, ESC_TLM_TASK_STACK);
+static QueueHandle_t uart_queue = NULL;
+static kiss_tlm_parser_t parsers[MOTOR_COUNT];
+static esc_telemetry_t readings[MOTOR_COUNT];
+static esc_telemetry_stats_t stats;
+static portMUX_TYPE tlm_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void store_frame(int motor, const kiss_tlm_frame_t *f)
+{
+    portENTER_CRITICAL(&tlm_lock);
+    esc_telemetry_t *r = &readings[motor];
+    r->time_us = esp_timer_get_time();
+    r->temp_c = f->temp_c;
+    r->voltage_mv = f->voltage_mv;
+    r->current_ma = f->current_ma;
+    r->consumption_mah = f->consumption_mah;
+    r->erpm = f->erpm;
+    r->rpm = f->erpm * 2 / ESC_TLM_MOTOR_POLES;
+    int32_t rpm = (int32_t)r->rpm;
+    portEXIT_CRITICAL(&tlm_lock);
+    motor_submit_rpm_feedback(motor, rpm);
+}
+
+static void sync_counters(int motor)
+{
+    const kiss_tlm_parser_t *p = &parsers[motor];
+    portENTER_CRITICAL(&tlm_lock);
+    readings[motor].frames = p->frames;
+    readings[motor].crc_errors = p->crc_errors;
+    readings[motor].short_frames = p->short_frames;
+    readings[motor].dropped_bytes = p->dropped_bytes;
+    portEXIT_CRITICAL(&tlm_lock);
+}
+
+// Route the UART input to a motor's wire. Bytes of the previous wire are
+// dropped, and so is the burst in flight on the new one until the line idles.
+static void select_motor(int motor)
+{
+    uart_set_pin(ESC_TLM_UART, UART_PIN_NO_CHANGE, tlm_gpios[motor], UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_flush_input(ESC_TLM_UART);
+    xQueueReset(uart_queue);
+    kiss_tlm_parser_reset(&parsers[motor]);
+}
+
+// Visit each motor in turn. A visit ends with its first good frame or after
+// ESC_TLM_SLOT_MS, whichever comes first.
+static void esc_telemetry_task(void *arg)
+{
+    uint8_t data[64];
+    int motor = 0;
+    bool synced = false;
+    bool got_frame = false;
+    int64_t slot_end = 0;
+    select_motor(motor);
+    slot_end = esp_timer_get_time() + ESC_TLM_SLOT_MS * 1000;
+
+    while (1) {
+        int64_t left_us = slot_end - esp_timer_get_time();
+        uart_event_t ev;
+        if (left_us > 0 && xQueueReceive(uart_queue, &ev, pdMS_TO_TICKS(left_us / 1000) + 1) == pdTRUE) {
+            switch (ev.type) {
+                case UART_DATA: {
+                    size_t remaining = ev.size;
+                    while (remaining > 0 && !got_frame) {
+                        int n = uart_read_bytes(ESC_TLM_UART, data, remaining < sizeof(data) ? remaining : sizeof(data), 0);
+                        if (n <= 0) {
+                            break;
+                        }
+                        remaining -= n;
+                        // Until the first idle gap on a new wire we may be mid-frame
+                        for (int i = 0; i < n && synced && !got_frame; i++) {
+                            kiss_tlm_frame_t f;
+                            if (kiss_tlm_parser_byte(&parsers[motor], data[i], &f)) {
+                                store_frame(motor, &f);
+                                got_frame = true;
+                            }
+                        }
+                    }
+                    if (ev.timeout_flag) {
+                        if (synced) {
+                            kiss_tlm_parser_gap(&parsers[motor]);
+                        }
+                        synced = true;
+                    }
+                    break;
+                }
+                case UART_FIFO_OVF:
+                case UART_BUFFER_FULL:
+                    portENTER_CRITICAL(&tlm_lock);
+                    stats.overruns++;
+                    portEXIT_CRITICAL(&tlm_lock);
+                    select_motor(motor);
+                    synced = false;
+                    break;
+                case UART_FRAME_ERR:
+                case UART_PARITY_ERR:
+                case UART_BREAK:
+                    portENTER_CRITICAL(&tlm_lock);
+                    stats.line_errors++;
+                    portEXIT_CRITICAL(&tlm_lock);
+                    break;
+                default:
+                    break;
+            }
+            if (!got_frame) {
+                continue;
+            }
+        }
+
+        // End of the visit
+        sync_counters(motor);
+        portENTER_CRITICAL(&tlm_lock);
+        stats.slots++;
+        if (!got_frame) {
+            readings[motor].missed_slots++;
+        }
+        portEXIT_CRITICAL(&tlm_lock);
+
+        motor = (motor + 1) % MOTOR_COUNT;
+        select_motor(motor);
+        synced = false;
+        got_frame = false;
+        slot_end = esp_timer_get_time() + ESC_TLM_SLOT_MS * 1000;
+    }
+}
+
+esp_err_t esc_telemetry_init(void)
+{
+    uart_config_t cfg = {};
+    cfg.baud_rate = KISS_TLM_BAUD;
+    cfg.data_bits = UART_DATA_8_BITS;
+    cfg.parity = UART_PARITY_DISABLE;
+    cfg.stop_bits = UART_STOP_BITS_1;
+    cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_DEFAULT;
+
+    esp_err_t err = uart_driver_install(ESC_TLM_UART, ESC_TLM_RX_BUFFER, 0, ESC_TLM_QUEUE_LEN, &uart_queue, 0);
+    if (err == ESP_OK) err = uart_param_config(ESC_TLM_UART, &cfg);
+    if (err == ESP_OK) err = uart_set_rx_timeout(ESC_TLM_UART, ESC_TLM_RX_TIMEOUT);
+    if (err == ESP_OK) err = uart_set_rx_full_threshold(ESC_TLM_UART, ESC_TLM_RX_FULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "UART setup failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    // Idle-high line when a wire is unplugged, so it reads as silence instead of breaks
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        gpio_pullup_en(tlm_gpios[m]);
+        kiss_tlm_parser_init(&parsers[m]);
+    }
+
+    if (MEM_TASK_CREATE(esc_telemetry_task, "esc_tlm", NULL, ESC_TLM_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "ESC telemetry on UART1, %d wires from GPIO%d", MOTOR_COUNT, tlm_gpios[0]);
+    return ESP_OK;
+}
+
+void esc_telemetry_get(int motor, esc_telemetry_t *out)
+{
+    portENTER_CRITICAL(&tlm_lock);
+    *out = readings[motor];
+    portEXIT_CRITICAL(&tlm_lock);
+    out->fresh = out->time_us != 0 &&
+                 esp_timer_get_time() - out->time_us < (int64_t)ESC_TLM_STALE_MS * 1000;
+}
+
+void esc_telemetry_get_stats(esc_telemetry_stats_t *out)
+{
+    portENTER_CRITICAL(&tlm_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&tlm_lock);
+}
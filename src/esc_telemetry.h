@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "kiss_telemetry.h"
+
+// ESC serial telemetry receiver. Each ESC's telemetry wire has its own pad;
+// one UART visits them in turn by moving its RX input through the GPIO
+// matrix, taking one frame per visit. The ESCs must send telemetry on their
+// own (BLHeli_32 auto telemetry): the bench drives PWM-style protocols, which
+// have no request bit.
+
+#define ESC_TLM_MOTOR_POLES 14     // Shaft RPM = eRPM * 2 / poles
+#define ESC_TLM_STALE_MS    500    // Readings older than this are not fresh
+
+typedef struct {
+    bool fresh;                  // A frame arrived within ESC_TLM_STALE_MS
+    int64_t time_us;             // Arrival of the last frame, 0 if none yet
+    int16_t temp_c;
+    uint32_t voltage_mv;
+    uint32_t current_ma;
+    uint16_t consumption_mah;
+    uint32_t erpm;
+    uint32_t rpm;
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t short_frames;
+    uint32_t dropped_bytes;
+    uint32_t missed_slots;       // Visits that ended without a frame
+} esc_telemetry_t;
+
+typedef struct {
+    uint32_t slots;              // Visits made, all motors
+    uint32_t overruns;           // UART FIFO or ring buffer overflowed
+    uint32_t line_errors;        // Framing, parity or break conditions
+} esc_telemetry_stats_t;
+
+// Install the UART and start the polling task
+esp_err_t esc_telemetry_init(void);
+
+void esc_telemetry_get(int motor, esc_telemetry_t *out);
+void esc_telemetry_get_stats(esc_telemetry_stats_t *out);
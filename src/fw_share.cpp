@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_image_format.h"
+#include "esp_http_client.h"
+#include "mbedtls/sha256.h"
+#include "fw_share.h"
+#include "motor_control.h"
+#include "settings.h"
+#include "mem_pool.h"
+
+static const char *TAG = "fw_share";
+
+static portMUX_TYPE share_lock = portMUX_INITIALIZER_UNLOCKED;
+static fw_image_info_t cache[FW_IMAGE_COUNT];   // Keyed by partition address, recomputed when it moves
+static fw_share_status_t status;
+static int64_t pull_start_us;
+
+// Pull request, handed to the task
+static char pull_peer[64];
+static uint8_t pull_sha[32];
+static bool pull_want_sha;
+static bool pull_reboot;
+
+static TaskHandle_t pull_worker = NULL;
+MEM_TASK_STORAGE(pull_task, FW_SHARE_TASK_STACK);
+static uint8_t pull_buf[FW_SHARE_CHUNK];   // The pull task's own, so it never competes with requests for a pool block
+
+void fw_share_hex(const uint8_t *sha256, char *out)
+{
+    for (int i = 0; i < 32; i++) {
+        sprintf(out + 2 * i, "%02x", sha256[i]);
+    }
+    out[64] = '\0';
+}
+
+bool fw_share_parse_hex(const char *hex, uint8_t *sha256)
+{
+    for (int i = 0; i < 32; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) {
+            return false;
+        }
+        sha256[i] = (uint8_t)v;
+    }
+    return true;
+}
+
+static const esp_partition_t *slot_partition(fw_image_slot_t slot)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (slot == FW_IMAGE_RUNNING) {
+        return running;
+    }
+    const esp_partition_t *boot = esp_ota_get_boot_partition();
+    return boot && boot->address != running->address ? boot : NULL;
+}
+
+// buf is FW_SHARE_CHUNK bytes, or NULL to take a pool block
+static esp_err_t hash_image(const esp_partition_t *part, uint32_t size, uint8_t *sha256, uint8_t *buf)
+{
+    static_assert(FW_SHARE_CHUNK <= MEM_SMALL_BLOCK, "chunk outgrew its pool block");
+    uint8_t *block = NULL;
+    if (buf == NULL && (buf = block = (uint8_t *)mem_alloc(FW_SHARE_CHUNK)) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    esp_err_t err = ESP_OK;
+    for (uint32_t ofs = 0; ofs < size && err == ESP_OK; ofs += FW_SHARE_CHUNK) {
+        uint32_t n = size - ofs < FW_SHARE_CHUNK ? size - ofs : FW_SHARE_CHUNK;
+        err = esp_partition_read(part, ofs, buf, n);
+        if (err == ESP_OK) mbedtls_sha256_update(&ctx, buf, n);
+    }
+    mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+    mem_free(block);
+    return err;
+}
+
+static esp_err_t describe_image(fw_image_slot_t slot, fw_image_info_t *out, uint8_t *buf)
+{
+    memset(out, 0, sizeof(*out));
+    const esp_partition_t *part = slot_partition(slot);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    portENTER_CRITICAL(&share_lock);
+    bool cached = cache[slot].valid && cache[slot].partition_address == part->address;
+    if (cached) *out = cache[slot];
+    portEXIT_CRITICAL(&share_lock);
+    if (cached) {
+        return ESP_OK;
+    }
+
+    esp_partition_pos_t pos = { part->address, part->size };
+    esp_image_metadata_t meta;
+    esp_app_desc_t desc;
+    esp_err_t err = esp_image_get_metadata(&pos, &meta);
+    if (err == ESP_OK) err = esp_ota_get_partition_description(part, &desc);
+    if (err == ESP_OK) err = hash_image(part, meta.image_len, out->sha256, buf);
+    if (err != ESP_OK) {
+        return err == ESP_ERR_NO_MEM ? err : ESP_ERR_NOT_FOUND;
+    }
+    out->valid = true;
+    out->partition_address = part->address;
+    out->size = meta.image_len;
+    snprintf(out->version, sizeof(out->version), "%s", desc.version);
+    snprintf(out->project, sizeof(out->project), "%s", desc.project_name);
+
+    portENTER_CRITICAL(&share_lock);
+    cache[slot] = *out;
+    portEXIT_CRITICAL(&share_lock);
+    return ESP_OK;
+}
+
+esp_err_t fw_share_get_image(fw_image_slot_t slot, fw_image_info_t *out)
+{
+    return describe_image(slot, out, NULL);
+}
+
+esp_err_t fw_share_find(const uint8_t *sha256, fw_image_slot_t *slot, fw_image_info_t *out)
+{
+    for (int s = 0; s < FW_IMAGE_COUNT; s++) {
+        if (fw_share_get_image((fw_image_slot_t)s, out) != ESP_OK) {
+            continue;
+        }
+        if (sha256 == NULL || memcmp(out->sha256, sha256, 32) == 0) {
+            *slot = (fw_image_slot_t)s;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t fw_share_stream(fw_image_slot_t slot, const fw_image_info_t *image, fw_share_send_t send, void *ctx)
+{
+    const esp_partition_t *part = slot_partition(slot);
+    if (part == NULL || part->address != image->partition_address) {
+        return ESP_ERR_NOT_FOUND;   // Staged image replaced since it was looked up
+    }
+
+    char *buf = (char *)mem_alloc(FW_SHARE_CHUNK);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = ESP_OK;
+    for (uint32_t ofs = 0; ofs < image->size && err == ESP_OK; ofs += FW_SHARE_CHUNK) {
+        uint32_t n = image->size - ofs < FW_SHARE_CHUNK ? image->size - ofs : FW_SHARE_CHUNK;
+        err = esp_partition_read(part, ofs, buf, n);
+        if (err == ESP_OK) err = send(ctx, buf, n);
+    }
+    mem_free(buf);
+
+    portENTER_CRITICAL(&share_lock);
+    if (err == ESP_OK) {
+        status.served++;
+    } else {
+        status.serve_aborts++;
+    }
+    portEXIT_CRITICAL(&share_lock);
+    return err;
+}
+
+typedef struct {
+    char etag[72];
+    char project[32];
+    uint32_t size;
+} pull_headers_t;
+
+static esp_err_t pull_event(esp_http_client_event_t *evt)
+{
+    pull_headers_t *h = (pull_headers_t *)evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_HEADER) {
+        return ESP_OK;
+    }
+    if (strcasecmp(evt->header_key, "ETag") == 0) {
+        snprintf(h->etag, sizeof(h->etag), "%s", evt->header_value);
+    } else if (strcasecmp(evt->header_key, "X-Firmware-Project") == 0) {
+        snprintf(h->project, sizeof(h->project), "%s", evt->header_value);
+    } else if (strcasecmp(evt->header_key, "X-Firmware-Size") == 0) {
+        h->size = strtoul(evt->header_value, NULL, 10);
+    }
+    return ESP_OK;
+}
+
+// ETags are quoted hex
+static bool etag_hash(const char *etag, uint8_t *sha256)
+{
+    return strlen(etag) == 66 && etag[0] == '"' && fw_share_parse_hex(etag + 1, sha256);
+}
+
+static void set_progress(uint32_t bytes, uint32_t total)
+{
+    portENTER_CRITICAL(&share_lock);
+    status.bytes = bytes;
+    status.total = total;
+    portEXIT_CRITICAL(&share_lock);
+}
+
+static void finish(fw_pull_state_t state, const char *error)
+{
+    portENTER_CRITICAL(&share_lock);
+    status.state = error ? FW_PULL_FAILED : state;
+    status.elapsed_ms = (uint32_t)((esp_timer_get_time() - pull_start_us) / 1000);
+    snprintf(status.error, sizeof(status.error), "%s", error ? error : "");
+    if (!error && state == FW_PULL_STAGED && status.bytes > 0) status.pulls++;
+    portEXIT_CRITICAL(&share_lock);
+    if (error) {
+        ESP_LOGW(TAG, "Pull from %s failed: %s", pull_peer, error);
+    } else {
+        ESP_LOGI(TAG, "Pull from %s: %s, %lu bytes in %lu ms", pull_peer, fw_pull_state_name(state),
+                 (unsigned long)status.bytes, (unsigned long)status.elapsed_ms);
+    }
+}
+
+// Receive size bytes into the next OTA partition, hashing them on the way
+static const char *receive_image(esp_http_client_handle_t client, uint32_t size, const uint8_t *expected)
+{
+    const esp_partition_t *target = esp_ota_get_next_update_partition(NULL);
+    if (target == NULL || size > target->size) {
+        return "no room for the image";
+    }
+    // The target may hold the staged image; it is gone from here on
+    portENTER_CRITICAL(&share_lock);
+    cache[FW_IMAGE_STAGED].valid = false;
+    portEXIT_CRITICAL(&share_lock);
+    esp_ota_handle_t ota;
+    if (esp_ota_begin(target, size, &ota) != ESP_OK) {
+        return "OTA begin failed";
+    }
+    char *buf = (char *)pull_buf;
+
+    const char *error = NULL;
+    uint8_t got[32];
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    for (uint32_t received = 0; received < size && error == NULL;) {
+        uint32_t want = size - received < FW_SHARE_CHUNK ? size - received : FW_SHARE_CHUNK;
+        int n = esp_http_client_read(client, buf, want);
+        if (n <= 0) {
+            error = "transfer broken off";
+        } else if (esp_ota_write(ota, buf, n) != ESP_OK) {
+            error = "flash write failed";
+        } else {
+            mbedtls_sha256_update(&sha, (const uint8_t *)buf, n);
+            received += n;
+            set_progress(received, size);
+        }
+    }
+    mbedtls_sha256_finish(&sha, got);
+    mbedtls_sha256_free(&sha);
+
+    if (error == NULL && memcmp(got, expected, 32) != 0) {
+        error = "hash mismatch";
+    }
+    if (error) {
+        esp_ota_abort(ota);
+        // A staged image was overwritten; boot what runs rather than the remains
+        const esp_partition_t *boot = esp_ota_get_boot_partition();
+        if (boot && boot->address == target->address) {
+            esp_ota_set_boot_partition(esp_ota_get_running_partition());
+        }
+        return error;
+    }
+    // esp_ota_end checks the image itself as well
+    if (esp_ota_end(ota) != ESP_OK || esp_ota_set_boot_partition(target) != ESP_OK) {
+        return "image rejected";
+    }
+    return NULL;
+}
+
+// Ask the peer for its image, offering our own hashes as If-None-Match.
+// staged is NULL when no image is staged.
+static const char *negotiate(esp_http_client_handle_t client, const pull_headers_t *h,
+                             const fw_image_info_t *running, const fw_image_info_t *staged,
+                             fw_pull_state_t *state)
+{
+    uint8_t expected[32];
+    if (esp_http_client_open(client, 0) != ESP_OK) {
+        return "peer unreachable";
+    }
+    esp_http_client_fetch_headers(client);
+    int code = esp_http_client_get_status_code(client);
+    if (code == 304) {
+        // The peer has one of ours; its ETag must say which, or nothing is known
+        // to be staged and a reboot would only restart into what runs
+        if (!etag_hash(h->etag, expected) || (pull_want_sha && memcmp(expected, pull_sha, 32) != 0)) {
+            return "bad peer response";
+        }
+        if (memcmp(expected, running->sha256, 32) == 0) {
+            *state = FW_PULL_CURRENT;
+        } else if (staged && memcmp(expected, staged->sha256, 32) == 0) {
+            *state = FW_PULL_STAGED;
+        } else {
+            return "bad peer response";
+        }
+        return NULL;
+    }
+    if (code == 404) {
+        return "peer lacks the image";
+    }
+    if (code != 200 || !etag_hash(h->etag, expected) || h->size == 0) {
+        return "bad peer response";
+    }
+    if (strcmp(h->project, running->project) != 0) {
+        return "different project";
+    }
+    if (pull_want_sha && memcmp(expected, pull_sha, 32) != 0) {
+        return "peer sent another image";
+    }
+    *state = FW_PULL_STAGED;
+    return receive_image(client, h->size, expected);
+}
+
+static void run_pull(void)
+{
+    fw_image_info_t running, staged;
+    describe_image(FW_IMAGE_RUNNING, &running, pull_buf);
+    bool have_staged = describe_image(FW_IMAGE_STAGED, &staged, pull_buf) == ESP_OK;
+    fw_pull_state_t state = FW_PULL_FAILED;
+    const char *error = NULL;
+
+    // A requested hash we already hold needs no peer
+    if (pull_want_sha && memcmp(pull_sha, running.sha256, 32) == 0) {
+        state = FW_PULL_CURRENT;
+    } else if (pull_want_sha && have_staged && memcmp(pull_sha, staged.sha256, 32) == 0) {
+        state = FW_PULL_STAGED;
+    } else {
+        char url[160], hex[65], if_none[144];
+        fw_share_hex(pull_sha, hex);
+        snprintf(url, sizeof(url), "http://%s/api/firmware/image%s%s", pull_peer,
+                 pull_want_sha ? "?sha256=" : "", pull_want_sha ? hex : "");
+        fw_share_hex(running.sha256, hex);
+        int len = snprintf(if_none, sizeof(if_none), "\"%s\"", hex);
+        if (have_staged) {
+            fw_share_hex(staged.sha256, hex);
+            snprintf(if_none + len, sizeof(if_none) - len, ", \"%s\"", hex);
+        }
+
+        pull_headers_t headers = {};
+        esp_http_client_config_t config = {};
+        config.url = url;
+        config.timeout_ms = FW_SHARE_TIMEOUT_MS;
+        config.event_handler = pull_event;
+        config.user_data = &headers;
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        if (client == NULL) {
+            error = "no HTTP client";
+        } else {
+            esp_http_client_set_header(client, "If-None-Match", if_none);
+            error = negotiate(client, &headers, &running, have_staged ? &staged : NULL, &state);
+            esp_http_client_close(client);
+            esp_http_client_cleanup(client);
+        }
+    }
+    finish(state, error);
+
+    if (error == NULL && state == FW_PULL_STAGED && pull_reboot) {
+        ESP_LOGI(TAG, "Rebooting into the staged image");
+        settings_flush();
+        vTaskDelay(pdMS_TO_TICKS(500));   // Lets a status poll see the result
+        esp_restart();
+    }
+}
+
+// Created on the first pull and parked between pulls, so its stack can be static
+static void pull_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_pull();
+        motor_hold_idle(false);
+    }
+}
+
+esp_err_t fw_share_pull(const char *peer, const uint8_t *sha256, bool reboot)
+{
+    if (peer == NULL || peer[0] == '\0' || strlen(peer) >= sizeof(pull_peer)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pull_worker == NULL &&
+        MEM_TASK_CREATE(pull_task, "fw_pull", NULL, FW_SHARE_TASK_PRIORITY, &pull_worker) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Held until the pull task is done, so nothing spins up under the flash writes
+    esp_err_t err = motor_hold_idle(true);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    portENTER_CRITICAL(&share_lock);
+    bool busy = status.state == FW_PULL_RUNNING;
+    if (!busy) {
+        snprintf(pull_peer, sizeof(pull_peer), "%s", peer);
+        snprintf(status.peer, sizeof(status.peer), "%s", peer);
+        pull_want_sha = sha256 != NULL;
+        if (sha256) memcpy(pull_sha, sha256, 32);
+        pull_reboot = reboot;
+        status.state = FW_PULL_RUNNING;
+        status.bytes = status.total = status.elapsed_ms = 0;
+        status.error[0] = '\0';
+        pull_start_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&share_lock);
+    if (busy) {
+        motor_hold_idle(false);
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(pull_worker);
+    return ESP_OK;
+}
+
+void fw_share_get_status(fw_share_status_t *out)
+{
+    portENTER_CRITICAL(&share_lock);
+    *out = status;
+    portEXIT_CRITICAL(&share_lock);
+    if (out->state == FW_PULL_RUNNING) {
+        out->elapsed_ms = (uint32_t)((esp_timer_get_time() - pull_start_us) / 1000);
+    }
+}
+
+const char *fw_pull_state_name(fw_pull_state_t state)
+{
+    switch (state) {
+        case FW_PULL_IDLE:    return "idle";
+        case FW_PULL_RUNNING: return "running";
+        case FW_PULL_STAGED:  return "staged";
+        case FW_PULL_CURRENT: return "current";
+        case FW_PULL_FAILED:  return "failed";
+    }
+    return "unknown";
+}
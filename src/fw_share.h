@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Firmware distribution between benches. Every bench serves the image it
+// runs, and one it has staged for the next boot, at GET /api/firmware/image;
+// the SHA-256 of the image bytes is its ETag. A pull streams a peer's image
+// straight into the next OTA partition, skipping the transfer when the peer
+// answers 304 to our own hashes, and verifies the hash before staging it.
+// Benches that have staged an image serve it at once, so fw_rollout.py can
+// double the number of sources every round.
+
+#define FW_SHARE_CHUNK        1024    // Flash read and HTTP transfer unit
+#define FW_SHARE_TIMEOUT_MS   10000   // Per socket operation of a pull
+#define FW_SHARE_TASK_STACK   6144
+#define FW_SHARE_TASK_PRIORITY 3
+
+typedef enum {
+    FW_IMAGE_RUNNING,
+    FW_IMAGE_STAGED,                  // Set to boot next, only while it differs from the running one
+    FW_IMAGE_COUNT
+} fw_image_slot_t;
+
+typedef struct {
+    bool valid;
+    uint32_t partition_address;
+    uint32_t size;                    // Image bytes, what a stream carries
+    uint8_t sha256[32];               // Over those bytes
+    char version[32];
+    char project[32];
+} fw_image_info_t;
+
+typedef enum {
+    FW_PULL_IDLE,
+    FW_PULL_RUNNING,
+    FW_PULL_STAGED,                   // Written and verified, boots next
+    FW_PULL_CURRENT,                  // The peer has what we already run
+    FW_PULL_FAILED
+} fw_pull_state_t;
+
+typedef struct {
+    fw_pull_state_t state;
+    char peer[64];
+    uint32_t bytes;
+    uint32_t total;
+    uint32_t elapsed_ms;
+    char error[48];
+    uint32_t pulls;                   // Completed transfers since boot
+    uint32_t served;                  // Complete images streamed to peers
+    uint32_t serve_aborts;            // Streams the peer broke off
+} fw_share_status_t;
+
+// Describe an image slot. The hash is computed on the first call per image
+// (a flash read of the whole image) and cached. ESP_ERR_NOT_FOUND if the slot is empty.
+esp_err_t fw_share_get_image(fw_image_slot_t slot, fw_image_info_t *out);
+
+// The slot holding an image with this hash, or the running one for NULL
+esp_err_t fw_share_find(const uint8_t *sha256, fw_image_slot_t *slot, fw_image_info_t *out);
+
+// Read an image in FW_SHARE_CHUNK pieces and hand each to send. Stops at
+// the first error send returns.
+typedef esp_err_t (*fw_share_send_t)(void *ctx, const char *data, size_t len);
+esp_err_t fw_share_stream(fw_image_slot_t slot, const fw_image_info_t *image, fw_share_send_t send, void *ctx);
+
+// Pull from peer ("host" or "host:port") in the background. sha256 may be
+// NULL for whatever the peer runs. With reboot the bench restarts into the
+// image once staged, also when it was staged already. Refused while any
+// output is running: flash writes stall the control task, so the outputs are
+// held stopped (motor_hold_idle) until the pull has ended.
+esp_err_t fw_share_pull(const char *peer, const uint8_t *sha256, bool reboot);
+void fw_share_get_status(fw_share_status_t *out);
+const char *fw_pull_state_name(fw_pull_state_t state);
+
+// Hex helpers for the HTTP side; out holds 65 chars
+void fw_share_hex(const uint8_t *sha256, char *out);
+bool fw_share_parse_hex(const char *hex, uint8_t *sha256);
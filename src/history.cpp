@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sensors.h"
+#include "history.h"
+#include "mem_pool.h"
+
+static const char *TAG = "history";
+
+typedef struct {
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} bucket_t;
+
+// One resolution. Points are contiguous in time, so only the newest start
+// time is stored and the rest follow from period_ms.
+typedef struct {
+    uint32_t period_ms;
+    uint16_t len;
+    uint16_t fold;              // Points of the level below per point of this one
+    bucket_t *ring;             // len * HISTORY_CHANNELS, oldest overwritten
+    uint16_t head;              // Slot the next point goes to
+    uint16_t count;
+    uint32_t newest_ms;
+    // Bucket being built from the level below
+    int32_t acc_sum[HISTORY_CHANNELS];
+    int16_t acc_min[HISTORY_CHANNELS];
+    int16_t acc_max[HISTORY_CHANNELS];
+    uint16_t acc_n;
+    uint32_t acc_start_ms;
+} history_level_t;
+
+// 20 s of samples, 3 min of 1 s, 1 h of 10 s and 6 h of 60 s buckets
+#define RAW_LEN  200
+#define SEC_LEN  180
+#define TEN_LEN  360
+#define MIN_LEN  360
+
+static bucket_t raw_ring[RAW_LEN * HISTORY_CHANNELS];
+static bucket_t sec_ring[SEC_LEN * HISTORY_CHANNELS];
+static bucket_t ten_ring[TEN_LEN * HISTORY_CHANNELS];
+static bucket_t min_ring[MIN_LEN * HISTORY_CHANNELS];
+
+static history_level_t levels[HISTORY_LEVELS] = {
+    { HISTORY_SAMPLE_MS, RAW_LEN, 1, raw_ring },
+    { 1000, SEC_LEN, 1000 / HISTORY_SAMPLE_MS, sec_ring },
+    { 10000, TEN_LEN, 10, ten_ring },
+    { 60000, MIN_LEN, 6, min_ring },
+};
+
+static portMUX_TYPE history_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t sample_timer = NULL;
+
+static const char *channel_names[HISTORY_CHANNELS] = {
+    "battery_mv", "rpm0", "rpm1", "throttle0", "throttle1"
+};
+static_assert(MOTOR_COUNT == 2, "channel_names lists two motors");
+
+static int16_t clamp_i16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+// Store a point and fold it into the next coarser level. Called under history_lock.
+static void push_point(int k, const bucket_t *point, uint32_t start_ms)
+{
+    history_level_t *lvl = &levels[k];
+    memcpy(&lvl->ring[lvl->head * HISTORY_CHANNELS], point, sizeof(bucket_t) * HISTORY_CHANNELS);
+    lvl->head = (lvl->head + 1) % lvl->len;
+    if (lvl->count < lvl->len) lvl->count++;
+    lvl->newest_ms = start_ms;
+
+    if (k + 1 >= HISTORY_LEVELS) {
+        return;
+    }
+    history_level_t *up = &levels[k + 1];
+    if (up->acc_n == 0) {
+        up->acc_start_ms = start_ms;
+        for (int c = 0; c < HISTORY_CHANNELS; c++) {
+            up->acc_sum[c] = 0;
+            up->acc_min[c] = point[c].min;
+            up->acc_max[c] = point[c].max;
+        }
+    }
+    for (int c = 0; c < HISTORY_CHANNELS; c++) {
+        up->acc_sum[c] += point[c].mean;
+        if (point[c].min < up->acc_min[c]) up->acc_min[c] = point[c].min;
+        if (point[c].max > up->acc_max[c]) up->acc_max[c] = point[c].max;
+    }
+    if (++up->acc_n == up->fold) {
+        bucket_t rolled[HISTORY_CHANNELS];
+        for (int c = 0; c < HISTORY_CHANNELS; c++) {
+            rolled[c].min = up->acc_min[c];
+            rolled[c].max = up->acc_max[c];
+            rolled[c].mean = (int16_t)(up->acc_sum[c] / up->fold);
+        }
+        up->acc_n = 0;
+        push_point(k + 1, rolled, up->acc_start_ms);
+    }
+}
+
+static void sample_timer_cb(void *arg)
+{
+    int32_t values[HISTORY_CHANNELS];
+    values[HISTORY_CH_BATTERY_MV] = (int32_t)(sensors_get_battery_voltage() * 1000.0f);
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        motor_rpm_status_t st;
+        motor_get_rpm_status(m, &st);
+        values[HISTORY_CH_RPM(m)] = st.measured ? st.measured_rpm : 0;
+        values[HISTORY_CH_THROTTLE(m)] = motor_get_throttle(m);
+    }
+
+    bucket_t point[HISTORY_CHANNELS];
+    for (int c = 0; c < HISTORY_CHANNELS; c++) {
+        point[c].min = point[c].max = point[c].mean = clamp_i16(values[c]);
+    }
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    portENTER_CRITICAL(&history_lock);
+    push_point(0, point, now_ms);
+    portEXIT_CRITICAL(&history_lock);
+}
+
+esp_err_t history_start(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = sample_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "history",
+        .skip_unhandled_events = true
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &sample_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sample_timer, HISTORY_SAMPLE_MS * 1000);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Sampling %d channels every %d ms (%u bytes)", HISTORY_CHANNELS, HISTORY_SAMPLE_MS,
+                 (unsigned)(sizeof(raw_ring) + sizeof(sec_ring) + sizeof(ten_ring) + sizeof(min_ring)));
+    }
+    return err;
+}
+
+// Largest-Triangle-Three-Buckets over evenly spaced points. The first and
+// last points are kept; each bucket in between contributes the point that
+// forms the largest triangle with the previous pick and the next bucket's
+// average. min/max carry the envelope of the whole bucket.
+static int lttb(const bucket_t *p, int n, int m, uint32_t t0_ms, uint32_t period_ms, history_point_t *out)
+{
+    if (n <= m) {
+        for (int i = 0; i < n; i++) {
+            out[i] = { t0_ms + i * period_ms, p[i].mean, p[i].min, p[i].max };
+        }
+        return n;
+    }
+
+    int k = 0;
+    out[k++] = { t0_ms, p[0].mean, p[0].min, p[0].max };
+    int a = 0;
+    int inner = m - 2;
+    for (int b = 0; b < inner; b++) {
+        int start = 1 + (int)((int64_t)b * (n - 2) / inner);
+        int end = 1 + (int)((int64_t)(b + 1) * (n - 2) / inner);
+        int next_end = b + 1 < inner ? 1 + (int)((int64_t)(b + 2) * (n - 2) / inner) : n;
+
+        // Next bucket average, kept as sums to stay in integers (no FPU)
+        int64_t sum_x = 0, sum_y = 0;
+        int64_t cnt = next_end - end;
+        for (int j = end; j < next_end; j++) {
+            sum_x += j;
+            sum_y += p[j].mean;
+        }
+
+        int64_t best_area = -1;
+        int best = start;
+        int16_t lo = p[start].min, hi = p[start].max;
+        for (int j = start; j < end; j++) {
+            int64_t area = ((int64_t)a * cnt - sum_x) * (p[j].mean - p[a].mean) -
+                           (int64_t)(a - j) * (sum_y - (int64_t)p[a].mean * cnt);
+            if (area < 0) area = -area;
+            if (area > best_area) {
+                best_area = area;
+                best = j;
+            }
+            if (p[j].min < lo) lo = p[j].min;
+            if (p[j].max > hi) hi = p[j].max;
+        }
+        out[k++] = { t0_ms + best * period_ms, p[best].mean, lo, hi };
+        a = best;
+    }
+    out[k++] = { t0_ms + (n - 1) * period_ms, p[n - 1].mean, p[n - 1].min, p[n - 1].max };
+    return k;
+}
+
+esp_err_t history_query(int channel, uint32_t range_ms, int max_points,
+                        history_point_t *out, history_series_t *series)
+{
+    memset(series, 0, sizeof(*series));
+    if (channel < 0 || channel >= HISTORY_CHANNELS) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (max_points < 3 || max_points > HISTORY_MAX_POINTS || range_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Finest level that retains the whole range, else the coarsest
+    int k = 0;
+    while (k < HISTORY_LEVELS - 1 && (uint32_t)levels[k].len * levels[k].period_ms < range_ms) {
+        k++;
+    }
+    history_level_t *lvl = &levels[k];
+    uint32_t wanted = (range_ms + lvl->period_ms - 1) / lvl->period_ms;
+    if (wanted > lvl->len) wanted = lvl->len;
+
+    static_assert(sizeof(bucket_t) * MIN_LEN <= MEM_SMALL_BLOCK && RAW_LEN <= MIN_LEN && SEC_LEN <= MIN_LEN &&
+                  TEN_LEN <= MIN_LEN, "a level's points outgrew their block");
+    bucket_t *points = (bucket_t *)mem_alloc(sizeof(bucket_t) * wanted);
+    if (points == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Copy the newest points oldest-first; the ring keeps moving while we downsample
+    portENTER_CRITICAL(&history_lock);
+    int n = lvl->count < wanted ? lvl->count : wanted;
+    int slot = (lvl->head + lvl->len - n) % lvl->len;
+    for (int i = 0; i < n; i++) {
+        points[i] = lvl->ring[slot * HISTORY_CHANNELS + channel];
+        slot = (slot + 1) % lvl->len;
+    }
+    uint32_t newest_ms = lvl->newest_ms;
+    portEXIT_CRITICAL(&history_lock);
+
+    series->period_ms = lvl->period_ms;
+    if (n > 0) {
+        uint32_t t0_ms = newest_ms - (uint32_t)(n - 1) * lvl->period_ms;
+        series->count = lttb(points, n, max_points, t0_ms, lvl->period_ms, out);
+        series->span_ms = (uint32_t)n * lvl->period_ms;
+    }
+    mem_free(points);
+    return ESP_OK;
+}
+
+const char *history_channel_name(int channel)
+{
+    return channel >= 0 && channel < HISTORY_CHANNELS ? channel_names[channel] : "unknown";
+}
+
+int history_channel_from_name(const char *name)
+{
+    for (int c = 0; c < HISTORY_CHANNELS; c++) {
+        if (strcmp(name, channel_names[c]) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+uint32_t history_level_span_ms(int level)
+{
+    return level >= 0 && level < HISTORY_LEVELS ? (uint32_t)levels[level].len * levels[level].period_ms : 0;
+}
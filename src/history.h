@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "motor_control.h"
+
+// Fixed-memory telemetry history in RAM. Samples are taken every
+// HISTORY_SAMPLE_MS and rolled up into 1 s / 10 s / 60 s min/max/mean
+// buckets as they arrive, O(1) per sample. Queries pick the finest level
+// covering the range and downsample it with LTTB.
+
+#define HISTORY_SAMPLE_MS 100
+
+// Channels, values are stored as int16
+#define HISTORY_CH_BATTERY_MV    0
+#define HISTORY_CH_RPM(m)        (1 + (m))                 // Measured RPM, 0 while stale
+#define HISTORY_CH_THROTTLE(m)   (1 + MOTOR_COUNT + (m))   // per mille
+#define HISTORY_CHANNELS         (1 + 2 * MOTOR_COUNT)
+
+#define HISTORY_LEVELS     4
+#define HISTORY_MAX_POINTS 500   // Per series in one query
+
+typedef struct {
+    uint32_t t_ms;     // Start of the sample or bucket, ms since boot
+    int16_t value;     // Sample, or bucket mean
+    int16_t min;       // Over every source point the returned point stands for
+    int16_t max;
+} history_point_t;
+
+typedef struct {
+    uint32_t period_ms;   // Spacing of the points the series was built from
+    uint32_t span_ms;     // Time actually covered
+    int count;
+} history_series_t;
+
+// Start the sampler
+esp_err_t history_start(void);
+
+// Downsample the last range_ms of a channel to at most max_points into out
+// (max_points >= 3). Returns ESP_ERR_NOT_FOUND for an unknown channel.
+esp_err_t history_query(int channel, uint32_t range_ms, int max_points,
+                        history_point_t *out, history_series_t *series);
+
+const char *history_channel_name(int channel);
+int history_channel_from_name(const char *name);   // -1 if unknown
+
+// Retention of a level, for clients choosing ranges
+uint32_t history_level_span_ms(int level);
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "http_guard.h"
+
+static const char *TAG = "http_guard";
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    int cost;
+    bool websocket;
+} guard_route_t;
+
+static conn_limit_t limits;
+static guard_route_t routes[HTTP_GUARD_ROUTES];
+static int route_count;
+static httpd_handle_t guard_server;
+static esp_timer_handle_t sweep_timer;
+
+// IPv4 address of the peer; IPv6 peers are told apart by their low 32 bits
+static uint32_t peer_ip(int fd)
+{
+    struct sockaddr_in6 addr = {};
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr *)&addr, &len) != 0) {
+        return 0;
+    }
+    uint32_t ip = 0;
+    if (addr.sin6_family == AF_INET) {
+        ip = ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+    } else {
+        memcpy(&ip, &addr.sin6_addr.s6_addr[12], sizeof(ip));   // IPv4-mapped on a dual-stack listener
+    }
+    return ip;
+}
+
+static esp_err_t guard_open(httpd_handle_t hd, int sockfd)
+{
+    uint32_t ip = peer_ip(sockfd);
+    if (!conn_limit_open(&limits, sockfd, ip, esp_timer_get_time())) {
+        ESP_LOGD(TAG, "Socket budget: refused %u.%u.%u.%u", (unsigned)(ip & 0xFF), (unsigned)((ip >> 8) & 0xFF),
+                 (unsigned)((ip >> 16) & 0xFF), (unsigned)(ip >> 24));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Replaces the server's close, so it has to close the socket itself
+static void guard_close(httpd_handle_t hd, int sockfd)
+{
+    conn_limit_close(&limits, sockfd);
+    close(sockfd);
+}
+
+static esp_err_t send_throttled(httpd_req_t *req, uint32_t retry_after_ms)
+{
+    char retry[12];
+    snprintf(retry, sizeof(retry), "%lu", (unsigned long)((retry_after_ms + 999) / 1000));
+    char json[64];
+    snprintf(json, sizeof(json), "{\"error\":\"rate limited\",\"retry_after_ms\":%lu}", (unsigned long)retry_after_ms);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Retry-After", retry);
+    return httpd_resp_send(req, json, strlen(json));
+}
+
+// Every guarded route lands here first
+static esp_err_t guard_dispatch(httpd_req_t *req)
+{
+    const guard_route_t *route = (const guard_route_t *)req->user_ctx;
+    int fd = httpd_req_to_sockfd(req);
+    bool handshake = !route->websocket || req->method == HTTP_GET;
+
+    // Frames on an open WebSocket were admitted with the handshake
+    if (handshake) {
+        uint32_t retry_after_ms = 0;
+        if (!conn_limit_request(&limits, fd, route->cost, esp_timer_get_time(), &retry_after_ms)) {
+            return send_throttled(req, retry_after_ms);
+        }
+    }
+
+    req->user_ctx = route->user_ctx;
+    esp_err_t err = route->handler(req);
+    if (route->websocket && handshake && err == ESP_OK) {
+        conn_limit_set_persistent(&limits, fd);
+    }
+    return err;
+}
+
+void http_guard_configure(httpd_config_t *config)
+{
+    conn_limit_init(&limits, config->max_open_sockets);
+    config->open_fn = guard_open;
+    config->close_fn = guard_close;
+    config->max_uri_handlers = HTTP_GUARD_ROUTES;
+
+    // Probe quiet peers so sockets of clients that left the network come back
+    config->keep_alive_enable = true;
+    config->keep_alive_idle = 10;
+    config->keep_alive_interval = 5;
+    config->keep_alive_count = 3;
+}
+
+esp_err_t http_guard_register(httpd_handle_t server, const httpd_uri_t *uri, int cost)
+{
+    if (route_count >= HTTP_GUARD_ROUTES) {
+        ESP_LOGE(TAG, "No room for route %s", uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+    guard_route_t *route = &routes[route_count];
+    route->handler = uri->handler;
+    route->user_ctx = uri->user_ctx;
+    route->cost = cost;
+    route->websocket = uri->is_websocket;
+
+    httpd_uri_t guarded = *uri;
+    guarded.handler = guard_dispatch;
+    guarded.user_ctx = route;
+    esp_err_t err = httpd_register_uri_handler(server, &guarded);
+    if (err == ESP_OK) {
+        route_count++;
+    }
+    return err;
+}
+
+// Runs on the httpd task
+static void sweep_idle(void *arg)
+{
+    int fds[CONN_LIMIT_SOCKETS];
+    int n = conn_limit_idle(&limits, esp_timer_get_time(), fds, CONN_LIMIT_SOCKETS);
+    for (int i = 0; i < n; i++) {
+        httpd_sess_trigger_close(guard_server, fds[i]);
+    }
+}
+
+static void sweep_timer_cb(void *arg)
+{
+    httpd_queue_work(guard_server, sweep_idle, NULL);
+}
+
+esp_err_t http_guard_start(httpd_handle_t server)
+{
+    guard_server = server;
+    const esp_timer_create_args_t timer_args = {
+        .callback = sweep_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "http_guard",
+        .skip_unhandled_events = true
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &sweep_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sweep_timer, HTTP_GUARD_SWEEP_US);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "%d routes, %d sockets per client, %d requests/s (burst %d)", route_count,
+                 CONN_LIMIT_CLIENT_SOCKETS, CONN_LIMIT_RATE, CONN_LIMIT_BURST);
+    }
+    return err;
+}
+
+const conn_limit_t *http_guard_state(void)
+{
+    return &limits;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "conn_limit.h"
+
+// Fair sharing of the HTTP server between clients. Every route is registered
+// through http_guard_register with a cost; requests from a client whose
+// token bucket is empty get 429 with Retry-After before their handler runs.
+// Sockets over a client's budget are closed on accept, and keep-alive
+// sockets left idle are closed so a script cannot park on them. The policy
+// is in conn_limit.cpp. All state is touched only from the httpd task.
+
+#define HTTP_GUARD_ROUTES       48        // Also the server's max_uri_handlers
+#define HTTP_GUARD_SWEEP_US     5000000   // Idle socket sweep period
+
+// Install the socket hooks; call before httpd_start
+void http_guard_configure(httpd_config_t *config);
+
+// Register a route whose requests are charged cost (CONN_COST_*)
+esp_err_t http_guard_register(httpd_handle_t server, const httpd_uri_t *uri, int cost);
+
+// Start the idle sweep once the server runs
+esp_err_t http_guard_start(httpd_handle_t server);
+
+// Counters and per-client state, only to be read from a handler
+const conn_limit_t *http_guard_state(void);
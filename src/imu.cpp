@@ -0,0 +1,194 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "driver/spi_master.h"
+#include "imu.h"
+
+static const char *TAG = "imu";
+
+// SPI2 pins. CS is GPIO16, the UART0 TX pad: the sdkconfigs put the console on
+// USB Serial/JTAG, leaving UART0 unused after the boot ROM's banner
+#define IMU_SPI_HOST    SPI2_HOST
+#define IMU_PIN_SCK     GPIO_NUM_19
+#define IMU_PIN_MISO    GPIO_NUM_20
+#define IMU_PIN_MOSI    GPIO_NUM_18
+#define IMU_PIN_CS      GPIO_NUM_16
+#define IMU_SPI_HZ      (8 * 1000 * 1000)
+
+// ICM-42688-P bank 0 registers
+#define REG_DEVICE_CONFIG      0x11
+#define REG_FIFO_CONFIG        0x16
+#define REG_INT_STATUS         0x2D
+#define REG_FIFO_COUNTH        0x2E
+#define REG_FIFO_DATA          0x30
+#define REG_SIGNAL_PATH_RESET  0x4B
+#define REG_INTF_CONFIG0       0x4C
+#define REG_PWR_MGMT0          0x4E
+#define REG_ACCEL_CONFIG0      0x50
+#define REG_FIFO_CONFIG1       0x5F
+#define REG_WHO_AM_I           0x75
+
+#define WHO_AM_I_ICM42688      0x47
+#define INT_STATUS_FIFO_FULL   0x02
+#define FIFO_FLUSH             0x02
+#define FIFO_MODE_STREAM       0x40
+#define FIFO_ACCEL_EN          0x01
+#define INTF_BIG_ENDIAN_RECORD 0x70   // Count in records, big-endian count and data
+#define PWR_ACCEL_LN           0x03
+#define ACCEL_FS_16G           0x00
+
+// Packet 1: header, accel x/y/z, temperature
+#define FIFO_PACKET_BYTES      8
+#define FIFO_HEADER_EMPTY      0x80
+#define FIFO_HEADER_ACCEL      0x40
+#define FIFO_MAX_PACKETS       (2048 / FIFO_PACKET_BYTES)
+
+static spi_device_handle_t imu_dev = NULL;
+static WORD_ALIGNED_ATTR uint8_t fifo_buf[FIFO_MAX_PACKETS * FIFO_PACKET_BYTES];
+
+static esp_err_t reg_write(uint8_t reg, uint8_t value)
+{
+    spi_transaction_t t = {};
+    t.flags = SPI_TRANS_USE_TXDATA;
+    t.addr = reg;
+    t.length = 8;
+    t.tx_data[0] = value;
+    return spi_device_polling_transmit(imu_dev, &t);
+}
+
+static esp_err_t reg_read(uint8_t reg, uint8_t *out, size_t len)
+{
+    spi_transaction_t t = {};
+    t.addr = reg | 0x80;
+    t.length = len * 8;
+    t.rxlength = len * 8;
+    if (len <= 4) {
+        t.flags = SPI_TRANS_USE_RXDATA;
+        esp_err_t err = spi_device_polling_transmit(imu_dev, &t);
+        memcpy(out, t.rx_data, len);
+        return err;
+    }
+    // Bursts go through DMA straight into the caller's buffer
+    t.rx_buffer = out;
+    return spi_device_transmit(imu_dev, &t);
+}
+
+static bool rate_to_odr(uint32_t rate_hz, uint8_t *odr)
+{
+    switch (rate_hz) {
+        case 8000: *odr = 0x03; return true;
+        case 4000: *odr = 0x04; return true;
+        case 2000: *odr = 0x05; return true;
+        case 1000: *odr = 0x06; return true;
+        default: return false;
+    }
+}
+
+esp_err_t imu_set_rate(uint32_t rate_hz)
+{
+    uint8_t odr;
+    if (imu_dev == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!rate_to_odr(rate_hz, &odr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = reg_write(REG_ACCEL_CONFIG0, ACCEL_FS_16G | odr);
+    if (err == ESP_OK) err = reg_write(REG_PWR_MGMT0, PWR_ACCEL_LN);
+    vTaskDelay(pdMS_TO_TICKS(10));   // Accelerometer start-up, samples before this are invalid
+    if (err == ESP_OK) err = reg_write(REG_SIGNAL_PATH_RESET, FIFO_FLUSH);
+    return err;
+}
+
+esp_err_t imu_init(uint32_t rate_hz)
+{
+    if (imu_dev == NULL) {
+        spi_bus_config_t bus = {};
+        bus.mosi_io_num = IMU_PIN_MOSI;
+        bus.miso_io_num = IMU_PIN_MISO;
+        bus.sclk_io_num = IMU_PIN_SCK;
+        bus.quadwp_io_num = -1;
+        bus.quadhd_io_num = -1;
+        bus.max_transfer_sz = sizeof(fifo_buf) + 4;
+        esp_err_t err = spi_bus_initialize(IMU_SPI_HOST, &bus, SPI_DMA_CH_AUTO);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        spi_device_interface_config_t dev = {};
+        dev.address_bits = 8;
+        dev.mode = 0;
+        dev.clock_speed_hz = IMU_SPI_HZ;
+        dev.spics_io_num = IMU_PIN_CS;
+        dev.queue_size = 1;
+        err = spi_bus_add_device(IMU_SPI_HOST, &dev, &imu_dev);
+        if (err != ESP_OK) {
+            spi_bus_free(IMU_SPI_HOST);
+            return err;
+        }
+    }
+
+    esp_err_t err = reg_write(REG_DEVICE_CONFIG, 0x01);   // Soft reset
+    vTaskDelay(pdMS_TO_TICKS(10));
+    uint8_t who = 0;
+    if (err == ESP_OK) err = reg_read(REG_WHO_AM_I, &who, 1);
+    if (err != ESP_OK || who != WHO_AM_I_ICM42688) {
+        ESP_LOGW(TAG, "No ICM-42688-P on SPI (WHO_AM_I 0x%02x)", who);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = reg_write(REG_INTF_CONFIG0, INTF_BIG_ENDIAN_RECORD);
+    if (err == ESP_OK) err = reg_write(REG_FIFO_CONFIG1, FIFO_ACCEL_EN);
+    if (err == ESP_OK) err = reg_write(REG_FIFO_CONFIG, FIFO_MODE_STREAM);
+    if (err == ESP_OK) err = imu_set_rate(rate_hz);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "ICM-42688-P at %lu Hz, FIFO burst reads", rate_hz);
+    }
+    return err;
+}
+
+esp_err_t imu_stop(void)
+{
+    if (imu_dev == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = reg_write(REG_PWR_MGMT0, 0x00);
+    if (err == ESP_OK) err = reg_write(REG_SIGNAL_PATH_RESET, FIFO_FLUSH);
+    return err;
+}
+
+int imu_read_fifo(vib_sample_t *out, int max, bool *overflow)
+{
+    uint8_t status_count[3];
+    *overflow = false;
+    if (reg_read(REG_INT_STATUS, status_count, 1) != ESP_OK ||
+        reg_read(REG_FIFO_COUNTH, &status_count[1], 2) != ESP_OK) {
+        return -1;
+    }
+    *overflow = (status_count[0] & INT_STATUS_FIFO_FULL) != 0;
+
+    int records = (status_count[1] << 8) | status_count[2];
+    if (records > max) records = max;
+    if (records > FIFO_MAX_PACKETS) records = FIFO_MAX_PACKETS;
+    if (records == 0) {
+        return 0;
+    }
+    if (reg_read(REG_FIFO_DATA, fifo_buf, records * FIFO_PACKET_BYTES) != ESP_OK) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < records; i++) {
+        const uint8_t *p = &fifo_buf[i * FIFO_PACKET_BYTES];
+        if ((p[0] & FIFO_HEADER_EMPTY) || !(p[0] & FIFO_HEADER_ACCEL)) {
+            continue;
+        }
+        out[count].x = (int16_t)((p[1] << 8) | p[2]);
+        out[count].y = (int16_t)((p[3] << 8) | p[4]);
+        out[count].z = (int16_t)((p[5] << 8) | p[6]);
+        count++;
+    }
+    return count;
+}
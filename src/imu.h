@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "vibration_dsp.h"
+
+// ICM-42688-P accelerometer on SPI2. Samples are buffered in the sensor's
+// 2 KB FIFO and drained in bursts, so the host only has to poll every few
+// milliseconds even at 8 kHz. Pins are listed in imu.cpp.
+
+#define IMU_LSB_PER_G 2048     // +/-16 g full scale
+
+// Output data rates the sampler accepts
+#define IMU_RATE_MIN_HZ 1000
+#define IMU_RATE_MAX_HZ 8000
+
+// Probe the sensor, accelerometer only, FIFO in stream mode, rate_hz one of 1000/2000/4000/8000
+esp_err_t imu_init(uint32_t rate_hz);
+
+// Change the output data rate; flushes the FIFO
+esp_err_t imu_set_rate(uint32_t rate_hz);
+
+// Drain up to max samples from the FIFO. Returns the number read, or -1 on a
+// bus error. *overflow is set if the FIFO filled up since the last read.
+int imu_read_fifo(vib_sample_t *out, int max, bool *overflow);
+
+// Stop sampling (accelerometer off) and flush the FIFO
+esp_err_t imu_stop(void);
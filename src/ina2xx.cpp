@@ -0,0 +1,88 @@
+#include "ina2xx.h"
+
+static const uint16_t conversion_time_us[8] = { 140, 204, 332, 588, 1100, 2116, 4156, 8244 };
+static const uint16_t averages[8] = { 1, 4, 16, 64, 128, 256, 512, 1024 };
+
+bool ina2xx_init(ina2xx_t *dev, const ina2xx_bus_t *bus, uint32_t shunt_uohm, uint32_t max_current_ma)
+{
+    dev->bus = bus;
+    dev->shunt_uohm = shunt_uohm;
+    // Full scale of the signed current register, rounded up to a whole uA
+    dev->current_lsb_ua = ((uint64_t)max_current_ma * 1000 + 32767) / 32768;
+    if (dev->current_lsb_ua == 0 || shunt_uohm == 0) {
+        return false;
+    }
+
+    // CAL = 0.00512 / (current_LSB * R_shunt)
+    uint64_t cal = 5120000000ULL / ((uint64_t)dev->current_lsb_ua * shunt_uohm);
+    if (cal == 0 || cal > 0x7FFF) {
+        return false;
+    }
+    dev->calibration = (uint16_t)cal;
+
+    uint16_t manufacturer = 0, die = 0;
+    if (!bus->write(bus->ctx, INA2XX_REG_CONFIG, INA2XX_CONFIG_RESET) ||
+        !bus->read(bus->ctx, INA2XX_REG_MANUFACTURER, &manufacturer) ||
+        !bus->read(bus->ctx, INA2XX_REG_DIE_ID, &die)) {
+        return false;
+    }
+    if (manufacturer != INA2XX_MANUFACTURER_TI || (die & 0xFFF0) != INA2XX_DIE_ID_INA226) {
+        return false;
+    }
+    return bus->write(bus->ctx, INA2XX_REG_CALIBRATION, dev->calibration);
+}
+
+bool ina2xx_configure(ina2xx_t *dev, ina2xx_avg_t avg, ina2xx_ct_t ct)
+{
+    dev->config = (uint16_t)(0x4000 | (avg << 9) | (ct << 6) | (ct << 3) | INA2XX_MODE_CONTINUOUS);
+    return dev->bus->write(dev->bus->ctx, INA2XX_REG_CONFIG, dev->config) &&
+           dev->bus->write(dev->bus->ctx, INA2XX_REG_MASK_ENABLE, INA2XX_MASK_CNVR | INA2XX_MASK_LEN);
+}
+
+uint32_t ina2xx_conversion_us(uint16_t config)
+{
+    uint32_t avg = averages[(config >> 9) & 0x7];
+    uint32_t bus_ct = conversion_time_us[(config >> 6) & 0x7];
+    uint32_t shunt_ct = conversion_time_us[(config >> 3) & 0x7];
+    return avg * (bus_ct + shunt_ct);
+}
+
+bool ina2xx_conversion_ready(ina2xx_t *dev, bool *ready)
+{
+    uint16_t mask = 0;
+    if (!dev->bus->read(dev->bus->ctx, INA2XX_REG_MASK_ENABLE, &mask)) {
+        return false;
+    }
+    *ready = (mask & INA2XX_MASK_CVRF) != 0;
+    return true;
+}
+
+bool ina2xx_read(ina2xx_t *dev, ina2xx_sample_t *sample)
+{
+    uint16_t bus = 0, current = 0, power = 0;
+    if (!dev->bus->read(dev->bus->ctx, INA2XX_REG_BUS, &bus) ||
+        !dev->bus->read(dev->bus->ctx, INA2XX_REG_CURRENT, &current) ||
+        !dev->bus->read(dev->bus->ctx, INA2XX_REG_POWER, &power)) {
+        return false;
+    }
+    sample->bus_mv = (int32_t)bus * 125 / 100;
+    sample->current_ma = (int32_t)((int64_t)(int16_t)current * dev->current_lsb_ua / 1000);
+    sample->power_mw = (int32_t)((int64_t)power * 25 * dev->current_lsb_ua / 1000);
+    return true;
+}
+
+void ina2xx_totals_add(ina2xx_totals_t *totals, const ina2xx_sample_t *sample, int64_t t_us)
+{
+    if (totals->primed) {
+        int64_t dt = t_us - totals->last_us;
+        totals->charge_ua_us += (int64_t)(totals->last_ma + sample->current_ma) * 500 * dt;   // mean mA -> uA
+        totals->energy_mw_us += (int64_t)(totals->last_mw + sample->power_mw) * dt / 2;
+        totals->integrated_us += dt;
+        totals->charge_uah = totals->charge_ua_us / 3600000000LL;
+        totals->energy_uwh = totals->energy_mw_us / 3600000LL;
+    }
+    totals->primed = true;
+    totals->last_us = t_us;
+    totals->last_ma = sample->current_ma;
+    totals->last_mw = sample->power_mw;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+// INA226-compatible power monitor. Registers go through an ina2xx_bus_t, so
+// the same driver runs on the bench's I2C bus and against the register-level
+// stand-in in ina2xx_sim.cpp, which is also how host/ina2xx_sim_test.cpp
+// checks it.
+
+typedef struct {
+    bool (*read)(void *ctx, uint8_t reg, uint16_t *value);
+    bool (*write)(void *ctx, uint8_t reg, uint16_t value);
+    void *ctx;
+} ina2xx_bus_t;
+
+#define INA2XX_REG_CONFIG       0x00
+#define INA2XX_REG_SHUNT        0x01   // 2.5 uV/LSB, signed
+#define INA2XX_REG_BUS          0x02   // 1.25 mV/LSB
+#define INA2XX_REG_POWER        0x03   // 25 x current LSB
+#define INA2XX_REG_CURRENT      0x04   // Current LSB, signed
+#define INA2XX_REG_CALIBRATION  0x05
+#define INA2XX_REG_MASK_ENABLE  0x06
+#define INA2XX_REG_ALERT_LIMIT  0x07
+#define INA2XX_REG_MANUFACTURER 0xFE
+#define INA2XX_REG_DIE_ID       0xFF
+
+#define INA2XX_CONFIG_RESET     0x8000
+#define INA2XX_MODE_CONTINUOUS  0x0007   // Shunt and bus, continuous
+#define INA2XX_MASK_CNVR        0x0400   // Alert on conversion ready
+#define INA2XX_MASK_CVRF        0x0008   // Conversion ready flag, cleared by reading the register
+#define INA2XX_MASK_LEN         0x0001   // Latch the alert until the register is read
+#define INA2XX_MANUFACTURER_TI  0x5449
+#define INA2XX_DIE_ID_INA226    0x2260
+
+// Samples averaged per conversion
+typedef enum {
+    INA2XX_AVG_1, INA2XX_AVG_4, INA2XX_AVG_16, INA2XX_AVG_64,
+    INA2XX_AVG_128, INA2XX_AVG_256, INA2XX_AVG_512, INA2XX_AVG_1024
+} ina2xx_avg_t;
+
+// Conversion time of each of the bus and shunt measurements
+typedef enum {
+    INA2XX_CT_140US, INA2XX_CT_204US, INA2XX_CT_332US, INA2XX_CT_588US,
+    INA2XX_CT_1100US, INA2XX_CT_2116US, INA2XX_CT_4156US, INA2XX_CT_8244US
+} ina2xx_ct_t;
+
+typedef struct {
+    const ina2xx_bus_t *bus;
+    uint32_t shunt_uohm;
+    uint32_t current_lsb_ua;
+    uint16_t calibration;
+    uint16_t config;
+} ina2xx_t;
+
+typedef struct {
+    int32_t bus_mv;
+    int32_t current_ma;
+    int32_t power_mw;
+} ina2xx_sample_t;
+
+// Reset the device, check its ID and program the calibration for a shunt and
+// the largest current to measure. Returns false on a bus error or unknown device.
+bool ina2xx_init(ina2xx_t *dev, const ina2xx_bus_t *bus, uint32_t shunt_uohm, uint32_t max_current_ma);
+
+// Continuous shunt and bus conversions with the alert pin signalling each completed one
+bool ina2xx_configure(ina2xx_t *dev, ina2xx_avg_t avg, ina2xx_ct_t ct);
+
+// Time from one completed conversion to the next
+uint32_t ina2xx_conversion_us(uint16_t config);
+
+// Read and clear the conversion ready flag (this also releases the latched alert)
+bool ina2xx_conversion_ready(ina2xx_t *dev, bool *ready);
+
+// Bus voltage, current and power of the last completed conversion
+bool ina2xx_read(ina2xx_t *dev, ina2xx_sample_t *sample);
+
+// Charge and energy drawn, integrated with the trapezoidal rule between the
+// completion times of consecutive conversions, in 64-bit uA x us and mW x us
+// so nothing is lost to rounding over a run. Zero it to restart.
+typedef struct {
+    bool primed;               // Holds a previous conversion to integrate from
+    int64_t last_us;
+    int32_t last_ma;
+    int32_t last_mw;
+    int64_t charge_ua_us;
+    int64_t energy_mw_us;
+    uint64_t integrated_us;    // Time covered
+    int64_t charge_uah;        // The totals in reporting units
+    int64_t energy_uwh;
+} ina2xx_totals_t;
+
+void ina2xx_totals_add(ina2xx_totals_t *totals, const ina2xx_sample_t *sample, int64_t t_us);
@@ -0,0 +1,135 @@
+#include <string.h>
+#include "ina2xx_sim.h"
+
+#define SIM_REG_DEFAULT_CONFIG 0x4127
+
+static void reset_registers(ina2xx_sim_t *sim)
+{
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[INA2XX_REG_CONFIG] = SIM_REG_DEFAULT_CONFIG;
+    sim->since_conversion_us = 0;
+}
+
+static bool sim_read(void *ctx, uint8_t reg, uint16_t *value)
+{
+    ina2xx_sim_t *sim = (ina2xx_sim_t *)ctx;
+    if (reg == INA2XX_REG_MANUFACTURER) {
+        *value = INA2XX_MANUFACTURER_TI;
+        return true;
+    }
+    if (reg == INA2XX_REG_DIE_ID) {
+        *value = INA2XX_DIE_ID_INA226;
+        return true;
+    }
+    if (reg >= 8) {
+        return false;
+    }
+    *value = sim->regs[reg];
+    if (reg == INA2XX_REG_MASK_ENABLE) {
+        sim->regs[reg] &= ~INA2XX_MASK_CVRF;
+    }
+    return true;
+}
+
+static bool sim_write(void *ctx, uint8_t reg, uint16_t value)
+{
+    ina2xx_sim_t *sim = (ina2xx_sim_t *)ctx;
+    if (reg == INA2XX_REG_CONFIG && (value & INA2XX_CONFIG_RESET)) {
+        reset_registers(sim);
+        return true;
+    }
+    if (reg >= 8 || reg == INA2XX_REG_SHUNT || reg == INA2XX_REG_BUS ||
+        reg == INA2XX_REG_POWER || reg == INA2XX_REG_CURRENT) {
+        return false;   // Read-only
+    }
+    if (reg == INA2XX_REG_MASK_ENABLE) {
+        value = (value & ~INA2XX_MASK_CVRF) | (sim->regs[reg] & INA2XX_MASK_CVRF);
+    }
+    sim->regs[reg] = value;
+    return true;
+}
+
+void ina2xx_sim_init(ina2xx_sim_t *sim, const ina2xx_sim_pack_t *pack, uint32_t shunt_uohm)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->bus.read = sim_read;
+    sim->bus.write = sim_write;
+    sim->bus.ctx = sim;
+    sim->pack = *pack;
+    sim->shunt_uohm = shunt_uohm;
+    reset_registers(sim);
+}
+
+void ina2xx_sim_set_load(ina2xx_sim_t *sim, int32_t load_ma)
+{
+    sim->load_ma = load_ma;
+}
+
+void ina2xx_sim_recharge(ina2xx_sim_t *sim)
+{
+    sim->drawn_ua_us = 0;
+    sim->v1_uv = 0;
+}
+
+// Fill the result registers the way the device computes them
+static void complete_conversion(ina2xx_sim_t *sim)
+{
+    const ina2xx_sim_pack_t *p = &sim->pack;
+    int64_t drawn_uah = sim->drawn_ua_us / 3600000000LL;
+    int64_t capacity_uah = (int64_t)p->capacity_mah * 1000;
+    if (drawn_uah > capacity_uah) drawn_uah = capacity_uah;
+    if (drawn_uah < 0) drawn_uah = 0;
+    int64_t ocv_uv = ((int64_t)p->full_mv * 1000 - (int64_t)(p->full_mv - p->empty_mv) * 1000 * drawn_uah / capacity_uah);
+    int64_t bus_uv = ocv_uv - (int64_t)sim->load_ma * p->r0_mohm - sim->v1_uv;
+    if (bus_uv < 0) bus_uv = 0;
+
+    int64_t shunt_nv = (int64_t)sim->load_ma * sim->shunt_uohm;   // mA * uOhm = nV
+    int32_t shunt_reg = (int32_t)(shunt_nv / 2500);
+    if (shunt_reg > 32767) shunt_reg = 32767;
+    if (shunt_reg < -32768) shunt_reg = -32768;
+    uint32_t bus_reg = (uint32_t)(bus_uv / 1250);
+    if (bus_reg > 0x7FFF) bus_reg = 0x7FFF;
+    int32_t current_reg = (int32_t)((int64_t)shunt_reg * sim->regs[INA2XX_REG_CALIBRATION] / 2048);
+    if (current_reg > 32767) current_reg = 32767;
+    if (current_reg < -32768) current_reg = -32768;
+    uint32_t power_reg = (uint32_t)((int64_t)(current_reg < 0 ? -current_reg : current_reg) * bus_reg / 20000);
+
+    sim->regs[INA2XX_REG_SHUNT] = (uint16_t)(int16_t)shunt_reg;
+    sim->regs[INA2XX_REG_BUS] = (uint16_t)bus_reg;
+    sim->regs[INA2XX_REG_CURRENT] = (uint16_t)(int16_t)current_reg;
+    sim->regs[INA2XX_REG_POWER] = (uint16_t)(power_reg > 0xFFFF ? 0xFFFF : power_reg);
+    sim->regs[INA2XX_REG_MASK_ENABLE] |= INA2XX_MASK_CVRF;
+}
+
+bool ina2xx_sim_advance(ina2xx_sim_t *sim, uint32_t dt_us)
+{
+    const ina2xx_sim_pack_t *p = &sim->pack;
+    sim->drawn_ua_us += (int64_t)sim->load_ma * 1000 * dt_us;
+
+    // Polarization branch: v1 approaches I * r1 with time constant tau
+    int64_t target_uv = (int64_t)sim->load_ma * p->r1_mohm;
+    uint64_t tau_us = (uint64_t)p->tau_ms * 1000;
+    if (tau_us == 0 || dt_us >= tau_us) {
+        sim->v1_uv = target_uv;
+    } else {
+        sim->v1_uv += (target_uv - sim->v1_uv) * (int64_t)dt_us / (int64_t)tau_us;
+    }
+
+    if ((sim->regs[INA2XX_REG_CONFIG] & INA2XX_MODE_CONTINUOUS) != INA2XX_MODE_CONTINUOUS) {
+        return false;
+    }
+    sim->since_conversion_us += dt_us;
+    uint32_t period_us = ina2xx_conversion_us(sim->regs[INA2XX_REG_CONFIG]);
+    if (sim->since_conversion_us < period_us) {
+        return false;
+    }
+    sim->since_conversion_us %= period_us;
+    complete_conversion(sim);
+    return true;
+}
+
+uint32_t ina2xx_sim_until_conversion_us(const ina2xx_sim_t *sim)
+{
+    uint32_t period_us = ina2xx_conversion_us(sim->regs[INA2XX_REG_CONFIG]);
+    return sim->since_conversion_us < period_us ? period_us - sim->since_conversion_us : 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "ina2xx.h"
+
+// Register-level INA226 stand-in for benches without the sensor fitted and for
+// host builds. Models a pack as an open-circuit voltage falling with the charge
+// drawn, an ohmic resistance r0 and a polarization branch r1 with time constant
+// tau, behind the bench shunt. Conversions complete on simulated time and set
+// the conversion ready flag like the real device.
+
+typedef struct {
+    int32_t full_mv;        // Open-circuit voltage when charged
+    int32_t empty_mv;       // Open-circuit voltage at capacity_mah drawn
+    uint32_t capacity_mah;
+    uint32_t r0_mohm;
+    uint32_t r1_mohm;
+    uint32_t tau_ms;
+} ina2xx_sim_pack_t;
+
+// A 4S 1500 mAh pack
+#define INA2XX_SIM_DEFAULT_PACK { 16800, 14000, 1500, 12, 8, 400 }
+
+typedef struct {
+    ina2xx_bus_t bus;       // Hand this to ina2xx_init()
+    ina2xx_sim_pack_t pack;
+    uint32_t shunt_uohm;
+    uint16_t regs[8];
+    int32_t load_ma;
+    int64_t drawn_ua_us;    // Charge taken from the pack
+    int64_t v1_uv;          // Polarization voltage
+    uint32_t since_conversion_us;
+} ina2xx_sim_t;
+
+void ina2xx_sim_init(ina2xx_sim_t *sim, const ina2xx_sim_pack_t *pack, uint32_t shunt_uohm);
+
+// Current drawn from the pack from now on
+void ina2xx_sim_set_load(ina2xx_sim_t *sim, int32_t load_ma);
+
+// Swap in a freshly charged pack
+void ina2xx_sim_recharge(ina2xx_sim_t *sim);
+
+// Advance simulated time. Returns true if a conversion completed.
+bool ina2xx_sim_advance(ina2xx_sim_t *sim, uint32_t dt_us);
+
+// Simulated time until the running conversion completes
+uint32_t ina2xx_sim_until_conversion_us(const ina2xx_sim_t *sim);
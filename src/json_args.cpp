@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_args.h"
+
+const char *json_find_value(const char *json, const char *key)
+{
+    char pattern[24];
+    int len = snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    if (len < 0 || len >= (int)sizeof(pattern)) {
+        return NULL;
+    }
+    for (const char *p = strstr(json, pattern); p; p = strstr(p + 1, pattern)) {
+        const char *v = p + len;
+        while (*v == ' ' || *v == '\t' || *v == '\r' || *v == '\n') v++;
+        if (*v != ':') {
+            continue;
+        }
+        v++;
+        while (*v == ' ' || *v == '\t' || *v == '\r' || *v == '\n') v++;
+        return v;
+    }
+    return NULL;
+}
+
+bool json_get_string(const char *json, const char *key, char *out, size_t out_len)
+{
+    const char *p = json_find_value(json, key);
+    if (!p || *p != '\"') {
+        return false;
+    }
+    p++;
+    const char *end = strchr(p, '\"');
+    if (!end || (size_t)(end - p) >= out_len) {
+        return false;
+    }
+    memcpy(out, p, end - p);
+    out[end - p] = '\0';
+    return true;
+}
+
+bool json_get_bool(const char *json, const char *key)
+{
+    const char *p = json_find_value(json, key);
+    return p && strncmp(p, "true", 4) == 0;
+}
+
+bool json_get_motor(const char *json, int8_t *motor)
+{
+    const char *p = json_find_value(json, "motor");
+    if (!p) {
+        *motor = MOTOR_ALL;
+        return true;
+    }
+    char *end;
+    long m = strtol(p, &end, 10);
+    if (end == p || m < MOTOR_ALL || m >= MOTOR_COUNT) {
+        return false;
+    }
+    *motor = (int8_t)m;
+    return true;
+}
+
+bool json_parse_motor_command(const char *obj, motor_cmd_t *cmd)
+{
+    char name[16];
+    if (!json_get_string(obj, "cmd", name, sizeof(name)) || !json_get_motor(obj, &cmd->motor)) {
+        return false;
+    }
+    cmd->value = 0;
+    
+    if (strcmp(name, "speed") == 0) {
+        const char *speed_str = json_find_value(obj, "speed");
+        if (!speed_str) return false;
+        cmd->type = MOTOR_CMD_SPEED;
+        cmd->value = atoi(speed_str);
+    } else if (strcmp(name, "start") == 0) {
+        cmd->type = MOTOR_CMD_START;
+    } else if (strcmp(name, "stop") == 0) {
+        cmd->type = MOTOR_CMD_STOP;
+    } else if (strcmp(name, "protocol") == 0) {
+        char protocol[16];
+        esc_protocol_t p;
+        if (!json_get_string(obj, "protocol", protocol, sizeof(protocol)) ||
+            !motor_core_protocol_from_name(protocol, &p)) {
+            return false;
+        }
+        cmd->type = MOTOR_CMD_PROTOCOL;
+        cmd->value = p | (json_get_bool(obj, "preserve") ? MOTOR_PROTOCOL_PRESERVE : 0);
+    } else if (strcmp(name, "rpm") == 0) {
+        const char *rpm_str = json_find_value(obj, "rpm");
+        if (!rpm_str) return false;
+        cmd->type = MOTOR_CMD_RPM;
+        cmd->value = atoi(rpm_str);
+    } else if (strcmp(name, "wait") == 0) {
+        const char *ms_str = json_find_value(obj, "ms");
+        if (!ms_str) return false;
+        cmd->type = MOTOR_CMD_WAIT;
+        cmd->value = atoi(ms_str);
+    } else {
+        return false;
+    }
+    return true;
+}
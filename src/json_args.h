@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "motor_core.h"
+
+// Field lookups in the small flat JSON bodies the HTTP API takes, and the
+// parser for one /api/batch entry. Not a JSON parser: objects are flat, keys
+// are unique, and a string value is taken up to the next quote.
+// host/json_args_test.cpp checks the batch entries against these rules.
+
+// Start of the value of "key", past the colon and any whitespace. A quoted
+// "key" that is not followed by a colon is a value, and the search goes on.
+const char *json_find_value(const char *json, const char *key);
+
+// Copy a quoted string value into out; false if absent, unquoted or too long
+bool json_get_string(const char *json, const char *key, char *out, size_t out_len);
+
+// True if "key" is present with the literal value true
+bool json_get_bool(const char *json, const char *key);
+
+// The "motor" index, MOTOR_ALL if absent; false unless it is a number naming
+// one motor or MOTOR_ALL
+bool json_get_motor(const char *json, int8_t *motor);
+
+// One batch entry without its braces, e.g. "cmd":"speed","motor":1,"speed":40
+// or "cmd":"wait","ms":250. Values are checked later by motor_core_command_valid.
+bool json_parse_motor_command(const char *obj, motor_cmd_t *cmd);
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "kiss_telemetry.h"
+
+uint8_t kiss_tlm_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+void kiss_tlm_parser_init(kiss_tlm_parser_t *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+void kiss_tlm_parser_reset(kiss_tlm_parser_t *p)
+{
+    p->len = 0;
+    p->aligned = false;
+}
+
+void kiss_tlm_decode(const uint8_t *data, kiss_tlm_frame_t *frame)
+{
+    frame->temp_c = data[0];
+    frame->voltage_mv = (uint32_t)((data[1] << 8) | data[2]) * 10;
+    frame->current_ma = (uint32_t)((data[3] << 8) | data[4]) * 10;
+    frame->consumption_mah = (uint16_t)((data[5] << 8) | data[6]);
+    frame->erpm = (uint32_t)((data[7] << 8) | data[8]) * 100;
+}
+
+bool kiss_tlm_parser_byte(kiss_tlm_parser_t *p, uint8_t byte, kiss_tlm_frame_t *frame)
+{
+    p->buf[p->len++] = byte;
+    if (p->len < KISS_TLM_FRAME_LEN) {
+        return false;
+    }
+
+    if (kiss_tlm_crc8(p->buf, KISS_TLM_FRAME_LEN - 1) == p->buf[KISS_TLM_FRAME_LEN - 1]) {
+        kiss_tlm_decode(p->buf, frame);
+        p->frames++;
+        p->len = 0;
+        p->aligned = true;
+        return true;
+    }
+
+    // Out of step or corrupted: slide the window by one byte
+    if (p->aligned) {
+        p->crc_errors++;
+        p->aligned = false;
+    }
+    p->dropped_bytes++;
+    memmove(p->buf, p->buf + 1, KISS_TLM_FRAME_LEN - 1);
+    p->len = KISS_TLM_FRAME_LEN - 1;
+    return false;
+}
+
+void kiss_tlm_parser_gap(kiss_tlm_parser_t *p)
+{
+    if (p->len > 0) {
+        if (p->aligned) {
+            p->short_frames++;
+        } else {
+            p->dropped_bytes += p->len;
+        }
+    }
+    p->len = 0;
+    p->aligned = true;
+}
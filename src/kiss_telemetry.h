@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// KISS / BLHeli_32 ESC serial telemetry: 10-byte frames at 115200 8N1,
+// big-endian fields followed by a CRC8 (polynomial 0x07). The parser is fed
+// bytes, from the UART here or from a capture in host/esc_telemetry_replay.cpp.
+
+#define KISS_TLM_FRAME_LEN 10
+#define KISS_TLM_BAUD      115200
+
+typedef struct {
+    int16_t temp_c;
+    uint32_t voltage_mv;
+    uint32_t current_ma;
+    uint16_t consumption_mah;
+    uint32_t erpm;            // Electrical RPM, divide by pole pairs for the shaft
+} kiss_tlm_frame_t;
+
+// Byte-stream framer. Frames are aligned by line gaps when the receiver
+// reports them and by the CRC otherwise: a window that fails the CRC is slid
+// forward a byte at a time until one passes.
+typedef struct {
+    uint8_t buf[KISS_TLM_FRAME_LEN];
+    uint8_t len;
+    bool aligned;             // buf starts after a gap or a good frame
+    uint32_t frames;
+    uint32_t crc_errors;      // Aligned windows that failed the CRC
+    uint32_t short_frames;    // Gaps inside a frame
+    uint32_t dropped_bytes;   // Skipped while searching for a frame
+} kiss_tlm_parser_t;
+
+uint8_t kiss_tlm_crc8(const uint8_t *data, size_t len);
+
+void kiss_tlm_parser_init(kiss_tlm_parser_t *p);
+
+// Drop a partial frame without counting it, e.g. after switching sources
+void kiss_tlm_parser_reset(kiss_tlm_parser_t *p);
+
+// Feed one byte. Returns true and fills frame when it completes a good frame.
+bool kiss_tlm_parser_byte(kiss_tlm_parser_t *p, uint8_t byte, kiss_tlm_frame_t *frame);
+
+// The line went idle: the next byte starts a frame
+void kiss_tlm_parser_gap(kiss_tlm_parser_t *p);
+
+// Decode a frame whose CRC has been checked
+void kiss_tlm_decode(const uint8_t *data, kiss_tlm_frame_t *frame);
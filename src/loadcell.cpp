@@ -0,0 +1,306 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "driver/gpio.h"
+#include "motor_control.h"
+#include "esc_telemetry.h"
+#include "loadcell.h"
+#include "mem_pool.h"
+
+static const char *TAG = "loadcell";
+
+#define LOADCELL_PIN_DOUT     GPIO_NUM_1    // Low when a conversion is ready
+#define LOADCELL_PIN_SCK      GPIO_NUM_6    // High for more than 60us powers the HX711 down
+#define LOADCELL_DATA_BITS    24
+#define LOADCELL_GAIN_PULSES  1             // Extra clocks: 1 = channel A, gain 128
+#define LOADCELL_PROBE_MS     200           // A present HX711 has a conversion ready well within this
+#define LOADCELL_TASK_PRIORITY 4
+#define LOADCELL_TASK_STACK   3072
+
+// Simulated stand: thrust grows with the square of the rotor speed
+#define LOADCELL_SIM_MAX_MG   1200000       // At MOTOR_RPM_MAX
+#define LOADCELL_SIM_NOISE_MG 3000          // Peak, uniform
+#define LOADCELL_SIM_OFFSET   61000         // Raw counts of the unloaded simulated cell
+
+MEM_TASK_STORAGE(loadcell_task, LOADCELL_TASK_STACK);
+static bool hardware = false;
+static TaskHandle_t loadcell_task_handle = NULL;
+static esp_timer_handle_t sim_timer = NULL;
+static volatile int64_t ready_us = 0;
+static volatile uint32_t ready_count = 0;
+
+static portMUX_TYPE loadcell_lock = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE clock_lock = portMUX_INITIALIZER_UNLOCKED;
+static loadcell_cal_t cal = { 0, LOADCELL_DEFAULT_COUNTS_PER_KG, 0, false };
+static loadcell_reading_t reading;
+static loadcell_sample_cb_t sample_cb = NULL;
+
+// Tare and calibrate average the next conversions
+static uint32_t avg_remaining = 0;
+static int64_t avg_sum = 0;
+
+static void IRAM_ATTR data_ready_isr(void *arg)
+{
+    ready_us = esp_timer_get_time();
+    ready_count = ready_count + 1;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(loadcell_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void sim_timer_cb(void *arg)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    ready_us = esp_timer_get_time();
+    ready_count = ready_count + 1;
+    portEXIT_CRITICAL(&loadcell_lock);
+    xTaskNotifyGive(loadcell_task_handle);
+}
+
+// Only the high phase of each clock is timed, an interrupt in the low phase is harmless
+static void clock_pulse(void)
+{
+    portENTER_CRITICAL(&clock_lock);
+    gpio_set_level(LOADCELL_PIN_SCK, 1);
+    esp_rom_delay_us(1);
+    gpio_set_level(LOADCELL_PIN_SCK, 0);
+    portEXIT_CRITICAL(&clock_lock);
+    esp_rom_delay_us(1);
+}
+
+// Shift out a ready conversion, MSB first. DOUT toggles with the data, so
+// its interrupt is off meanwhile.
+static int32_t hx711_read(void)
+{
+    gpio_intr_disable(LOADCELL_PIN_DOUT);
+    uint32_t value = 0;
+    for (int i = 0; i < LOADCELL_DATA_BITS; i++) {
+        clock_pulse();
+        value = (value << 1) | (uint32_t)gpio_get_level(LOADCELL_PIN_DOUT);
+    }
+    for (int i = 0; i < LOADCELL_GAIN_PULSES; i++) {
+        clock_pulse();
+    }
+    gpio_intr_enable(LOADCELL_PIN_DOUT);
+    return (int32_t)(value << 8) >> 8;
+}
+
+static int32_t sim_read(int motor)
+{
+    esc_telemetry_t tlm;
+    esc_telemetry_get(motor, &tlm);
+    int64_t rpm = tlm.fresh ? tlm.rpm : motor_get_rpm(motor);
+    int64_t thrust_mg = LOADCELL_SIM_MAX_MG * rpm * rpm / ((int64_t)MOTOR_RPM_MAX * MOTOR_RPM_MAX);
+    thrust_mg += (int32_t)(esp_random() % (2 * LOADCELL_SIM_NOISE_MG + 1)) - LOADCELL_SIM_NOISE_MG;
+    return LOADCELL_SIM_OFFSET + (int32_t)(thrust_mg * LOADCELL_DEFAULT_COUNTS_PER_KG / 1000000);
+}
+
+static void publish_sample(int32_t raw, int64_t t_us)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    reading.raw = raw;
+    reading.thrust_mg = (int32_t)((int64_t)(raw - cal.offset) * 1000000 / cal.counts_per_kg);
+    reading.time_us = t_us;
+    reading.samples++;
+    if (avg_remaining > 0) {
+        avg_sum += raw;
+        avg_remaining--;
+    }
+    loadcell_reading_t r = reading;
+    loadcell_sample_cb_t cb = sample_cb;
+    portEXIT_CRITICAL(&loadcell_lock);
+    if (cb) {
+        cb(&r);
+    }
+}
+
+static void loadcell_task(void *arg)
+{
+    uint32_t seen = 0;
+    while (1) {
+        bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOADCELL_SAMPLE_US / 1000 * 4)) != 0;
+        int64_t t_us = 0;
+        portENTER_CRITICAL(&loadcell_lock);
+        if (ready_count != seen) {
+            seen = ready_count;
+            t_us = ready_us;
+        }
+        portEXIT_CRITICAL(&loadcell_lock);
+
+        if (hardware && t_us == 0 && gpio_get_level(LOADCELL_PIN_DOUT) == 0) {
+            t_us = esp_timer_get_time();   // Became ready while the interrupt was off
+        }
+        if (t_us == 0) {
+            if (!woken) {
+                portENTER_CRITICAL(&loadcell_lock);
+                reading.missed++;
+                portEXIT_CRITICAL(&loadcell_lock);
+            }
+            continue;
+        }
+        publish_sample(hardware ? hx711_read() : sim_read(cal.motor), t_us);
+    }
+}
+
+static bool probe_hardware(void)
+{
+    gpio_config_t io_conf = {};
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pin_bit_mask = 1ULL << LOADCELL_PIN_SCK;
+    gpio_config(&io_conf);
+    gpio_set_level(LOADCELL_PIN_SCK, 0);
+
+    // Pulled up, an absent chip reads as never ready
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = 1ULL << LOADCELL_PIN_DOUT;
+    io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    gpio_config(&io_conf);
+
+    for (int ms = 0; ms < LOADCELL_PROBE_MS; ms += 10) {
+        if (gpio_get_level(LOADCELL_PIN_DOUT) == 0) {
+            hx711_read();   // Selects the gain for the conversions that follow
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+esp_err_t loadcell_init(void)
+{
+    hardware = probe_hardware();
+    reading.hardware = hardware;
+
+    if (MEM_TASK_CREATE(loadcell_task, "loadcell", NULL, LOADCELL_TASK_PRIORITY,
+                        &loadcell_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (hardware) {
+        gpio_set_intr_type(LOADCELL_PIN_DOUT, GPIO_INTR_NEGEDGE);
+        esp_err_t err = gpio_install_isr_service(0);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            return err;
+        }
+        gpio_isr_handler_add(LOADCELL_PIN_DOUT, data_ready_isr, NULL);
+        gpio_intr_enable(LOADCELL_PIN_DOUT);
+        ESP_LOGI(TAG, "HX711 on GPIO%d/%d", LOADCELL_PIN_DOUT, LOADCELL_PIN_SCK);
+        return ESP_OK;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = sim_timer_cb;
+    args.name = "loadcell_sim";
+    esp_err_t err = esp_timer_create(&args, &sim_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sim_timer, LOADCELL_SAMPLE_US);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, "No HX711 on GPIO%d, simulating the thrust stand", LOADCELL_PIN_DOUT);
+    }
+    return err;
+}
+
+void loadcell_set_calibration(const loadcell_cal_t *c)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    cal = *c;
+    if (cal.counts_per_kg == 0) cal.counts_per_kg = LOADCELL_DEFAULT_COUNTS_PER_KG;
+    if (cal.motor >= MOTOR_COUNT) cal.motor = 0;
+    portEXIT_CRITICAL(&loadcell_lock);
+}
+
+void loadcell_get_calibration(loadcell_cal_t *c)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    *c = cal;
+    portEXIT_CRITICAL(&loadcell_lock);
+}
+
+void loadcell_get_reading(loadcell_reading_t *out)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    *out = reading;
+    portEXIT_CRITICAL(&loadcell_lock);
+}
+
+void loadcell_set_sample_callback(loadcell_sample_cb_t cb)
+{
+    portENTER_CRITICAL(&loadcell_lock);
+    sample_cb = cb;
+    portEXIT_CRITICAL(&loadcell_lock);
+}
+
+// Mean raw value of the next LOADCELL_CAL_SAMPLES conversions
+static esp_err_t average_raw(int32_t *mean)
+{
+    if (loadcell_task_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&loadcell_lock);
+    bool idle = avg_remaining == 0;
+    if (idle) {
+        avg_sum = 0;
+        avg_remaining = LOADCELL_CAL_SAMPLES;
+    }
+    portEXIT_CRITICAL(&loadcell_lock);
+    if (!idle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Twice the nominal time before giving up on a stalled converter
+    TickType_t limit = pdMS_TO_TICKS(LOADCELL_CAL_SAMPLES * LOADCELL_SAMPLE_US / 1000 * 2);
+    for (TickType_t t = 0; t < limit && avg_remaining > 0; t++) {
+        vTaskDelay(1);
+    }
+    portENTER_CRITICAL(&loadcell_lock);
+    bool done = avg_remaining == 0;
+    avg_remaining = 0;
+    *mean = (int32_t)(avg_sum / LOADCELL_CAL_SAMPLES);
+    portEXIT_CRITICAL(&loadcell_lock);
+    return done ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t loadcell_tare(void)
+{
+    int32_t mean;
+    esp_err_t err = average_raw(&mean);
+    if (err != ESP_OK) {
+        return err;
+    }
+    portENTER_CRITICAL(&loadcell_lock);
+    cal.offset = mean;
+    portEXIT_CRITICAL(&loadcell_lock);
+    ESP_LOGI(TAG, "Tare at %ld counts", mean);
+    return ESP_OK;
+}
+
+esp_err_t loadcell_calibrate(uint32_t mass_g)
+{
+    if (mass_g == 0 || mass_g > 100000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int32_t mean;
+    esp_err_t err = average_raw(&mean);
+    if (err != ESP_OK) {
+        return err;
+    }
+    portENTER_CRITICAL(&loadcell_lock);
+    int64_t per_kg = (int64_t)(mean - cal.offset) * 1000 / mass_g;
+    bool usable = per_kg >= 1000 || per_kg <= -1000;   // Below that the mass is not on the cell
+    if (usable) {
+        cal.counts_per_kg = (int32_t)per_kg;
+        cal.calibrated = true;
+    }
+    portEXIT_CRITICAL(&loadcell_lock);
+    if (!usable) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(TAG, "Scale %ld counts/kg from %lu g", (int32_t)per_kg, mass_g);
+    return ESP_OK;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Thrust load cell on an HX711 (channel A, gain 128, RATE pin high for 80
+// samples/s). The data-ready edge is timestamped in an interrupt and a task
+// clocks the conversion out, so every sample carries the time it completed.
+// Without an HX711 the task simulates a stand whose thrust follows the square
+// of the mounted motor's RPM.
+
+#define LOADCELL_SAMPLE_US          12500    // 80 SPS; a sample averages the period before it
+#define LOADCELL_DEFAULT_COUNTS_PER_KG 420000   // 1 kg bar cell, 1 mV/V at gain 128
+#define LOADCELL_CAL_SAMPLES        32       // Averaged by tare and calibrate
+
+// Calibration, stored in settings
+typedef struct {
+    int32_t offset;           // Raw counts with nothing pushing on the cell
+    int32_t counts_per_kg;    // Raw counts per kg of thrust, negative if the cell is mounted in pull
+    uint8_t motor;            // Motor mounted on the stand
+    bool calibrated;          // Scale measured against a known mass, else the default
+} loadcell_cal_t;
+
+typedef struct {
+    bool hardware;            // HX711 found, otherwise simulated
+    int32_t raw;              // Last conversion, sign-extended 24 bit
+    int32_t thrust_mg;
+    int64_t time_us;          // Completion of the last conversion
+    uint32_t samples;
+    uint32_t missed;          // Waits that ended without a data-ready edge
+} loadcell_reading_t;
+
+// Called on the load cell task after every conversion
+typedef void (*loadcell_sample_cb_t)(const loadcell_reading_t *reading);
+
+// Probe the HX711 and start the sampler task with the default calibration
+esp_err_t loadcell_init(void);
+
+void loadcell_set_calibration(const loadcell_cal_t *cal);
+void loadcell_get_calibration(loadcell_cal_t *cal);
+void loadcell_get_reading(loadcell_reading_t *reading);
+void loadcell_set_sample_callback(loadcell_sample_cb_t cb);
+
+// Zero the reading at the current load. Blocks for LOADCELL_CAL_SAMPLES conversions.
+esp_err_t loadcell_tare(void);
+
+// Set the scale from a known mass on the cell, after a tare without it.
+// Blocks for LOADCELL_CAL_SAMPLES conversions.
+esp_err_t loadcell_calibrate(uint32_t mass_g);
@@ -1,38 +1,41 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "esp_http_server.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
 #include "driver/gpio.h"
-#include "driver/ledc.h"
+#include "motor_control.h"
+#include "sensors.h"
+#include "udp_control.h"
+#include "pwm_selftest.h"
+#include "fw_share.h"
+#include "settings.h"
+#include "wifi_station.h"
+#include "power.h"
+#include "boot_profile.h"
+#include "history.h"
+#include "vibration.h"
+#include "battery_test.h"
+#include "esc_telemetry.h"
+#include "loadcell.h"
+#include "thrust_test.h"
+#include "binlog.h"
+#include "http_guard.h"
+#include "mem_pool.h"
+#include "json_args.h"
 
 static const char *TAG = "UDDI";
 
-// Motor PWM configuration
-#define MOTOR_PWM_GPIO    GPIO_NUM_2
-#define MOTOR_PWM_CHANNEL LEDC_CHANNEL_0
-#define MOTOR_PWM_TIMER   LEDC_TIMER_0
-
-// ESC Protocol types
-typedef enum {
-    PROTOCOL_STANDARD,   // Standard PWM: 50Hz, 1-2ms pulses
-    PROTOCOL_ONESHOT125, // OneShot125: 125-250µs pulses at motor update rate
-    PROTOCOL_ONESHOT42,  // OneShot42: 42-84µs pulses
-    PROTOCOL_MULTISHOT   // Multishot: 5-25µs pulses
-} esc_protocol_t;
-
-static esc_protocol_t current_protocol = PROTOCOL_STANDARD;
-static uint32_t pwm_frequency = 50;
-static ledc_timer_bit_t pwm_resolution = LEDC_TIMER_14_BIT;
-static uint32_t pwm_min_duty = 820;   // Will be updated based on protocol
-static uint32_t pwm_max_duty = 1638;  // Will be updated based on protocol
-
 // HTML content for the web interface with slider and protocol dropdown
 // GZIP compressed HTML (1928 bytes, saves 4346 bytes from original 6274 bytes)
 static const uint8_t html_page_gz[] = {
@@ -40,159 +43,1175 @@ static const uint8_t html_page_gz[] = {
 };
 static const size_t html_page_gz_len = 1928;
 
-// Simulated sensor data
-static float battery_voltage = 12.6;
-static int motor_rpm = 0;
-static int motor_speed_percent = 0;  // 0-100%
-
-// Configure ESC protocol and recalculate PWM parameters
-static void configure_protocol(esc_protocol_t protocol) {
-    current_protocol = protocol;
-    
-    switch (protocol) {
-        case PROTOCOL_STANDARD:  // Standard PWM: 50Hz, 1-2ms pulses
-            pwm_frequency = 50;
-            pwm_resolution = LEDC_TIMER_14_BIT;  // 16384 steps
-            pwm_min_duty = 820;   // 1ms: 1/20 * 16384 = 820
-            pwm_max_duty = 1638;  // 2ms: 2/20 * 16384 = 1638
-            ESP_LOGI(TAG, "Protocol: Standard PWM (50Hz, 1-2ms)");
-            break;
-            
-        case PROTOCOL_ONESHOT125:  // OneShot125: 3-8kHz, 125-250µs pulses
-            pwm_frequency = 4000;  // 4kHz update rate
-            pwm_resolution = LEDC_TIMER_13_BIT;  // 8192 steps
-            pwm_min_duty = 410;    // 125µs: 125µs / 250µs * 8192 = 4096, scaled to 13-bit
-            pwm_max_duty = 819;    // 250µs: 250µs / 250µs * 8192 = 8192, scaled to 13-bit
-            ESP_LOGI(TAG, "Protocol: OneShot125 (4kHz, 125-250µs)");
-            break;
-            
-        case PROTOCOL_ONESHOT42:  // OneShot42: 3-8kHz, 42-84µs pulses
-            pwm_frequency = 8000;  // 8kHz update rate
-            pwm_resolution = LEDC_TIMER_13_BIT;  // 8192 steps
-            pwm_min_duty = 275;    // 42µs
-            pwm_max_duty = 549;    // 84µs
-            ESP_LOGI(TAG, "Protocol: OneShot42 (8kHz, 42-84µs)");
-            break;
-            
-        case PROTOCOL_MULTISHOT:  // Multishot: 32kHz, 5-25µs pulses
-            pwm_frequency = 32000;  // 32kHz update rate
-            pwm_resolution = LEDC_TIMER_12_BIT;  // 4096 steps
-            pwm_min_duty = 205;    // 5µs
-            pwm_max_duty = 1024;   // 25µs
-            ESP_LOGI(TAG, "Protocol: Multishot (32kHz, 5-25µs)");
-            break;
+// Set by the init task once the motor control task is running
+static EventGroupHandle_t init_events = NULL;
+static StaticEventGroup_t init_events_buf;
+#define INIT_PERIPHERALS_READY BIT0
+
+// HTTP GET handler for main page
+static esp_err_t root_handler(httpd_req_t *req)
+{
+    boot_note_request();
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_send(req, (const char *)html_page_gz, html_page_gz_len);
+    return ESP_OK;
+}
+
+// HTTP GET handler for status API
+static esp_err_t status_handler(httpd_req_t *req)
+{
+    boot_note_request();
+    sensors_power_t pw;
+    sensors_get_power(&pw);
+    char json[256];
+    snprintf(json, sizeof(json), 
+        "{\"battery\":%.1f,\"rpm\":%d,\"current\":%.2f,\"power\":%.1f,\"mah\":%.1f,\"wh\":%.2f,"
+        "\"t_us\":%lld,\"uptime_us\":%lld}",
+        pw.bus_mv / 1000.0f, motor_get_rpm(0), pw.current_ma / 1000.0f, pw.power_mw / 1000.0f,
+        pw.charge_uah / 1000.0f, pw.energy_uwh / 1000000.0f, pw.time_us, esp_timer_get_time());
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for the boot timeline
+static esp_err_t boot_handler(httpd_req_t *req)
+{
+    char json[768];
+    int len = boot_timeline_json(json, sizeof(json));
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, len);
+    return ESP_OK;
+}
+
+// HTTP GET handler for binary log counters
+static esp_err_t log_handler(httpd_req_t *req)
+{
+    binlog_stats_t st;
+    binlog_get_stats(&st);
+    
+    char json[256];
+    snprintf(json, sizeof(json),
+        "{\"level\":%d,\"records\":%lu,\"text_records\":%lu,\"dropped\":%lu,\"frames\":%lu,"
+        "\"bytes\":%lu,\"unsent\":%lu,\"ring_high_water\":%lu}",
+        binlog_level, st.records, st.text_records, st.dropped, st.frames, st.bytes, st.unsent,
+        st.ring_high_water);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for stored settings (without the password) and flash write counters
+static esp_err_t settings_handler(httpd_req_t *req)
+{
+    settings_t cfg;
+    settings_snapshot(&cfg);
+    settings_stats_t st;
+    settings_get_stats(&st);
+    
+    char json[512];
+    int len = snprintf(json, sizeof(json),
+        "{\"version\":%d,\"ssid\":\"%s\",\"channel\":%d,\"protocol\":\"%s\",\"rpm_tuned\":%s,"
+        "\"map_samples\":[",
+        SETTINGS_VERSION, cfg.wifi.ssid, cfg.wifi.channel, motor_protocol_name((esc_protocol_t)cfg.protocol),
+        cfg.rpm_tuning.rate_hz ? "true" : "false");
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%lu", m ? "," : "", cfg.rpm_map[m].samples);
+    }
+    snprintf(json + len, sizeof(json) - len,
+        "],\"stats\":{\"changes\":%lu,\"flash_writes\":%lu,\"writes_avoided\":%lu,\"write_errors\":%lu,"
+        "\"dirty\":%s,\"migrated\":%s,\"loaded_version\":%u}}",
+        st.changes, st.flash_writes, st.writes_avoided, st.write_errors,
+        st.dirty ? "true" : "false", st.migrated ? "true" : "false", st.loaded_version);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for WiFi status API
+static esp_err_t wifi_status_handler(httpd_req_t *req)
+{
+    wifi_station_status_t st;
+    wifi_station_get_status(&st);
+    
+    char json[256];
+    snprintf(json, sizeof(json), 
+        "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\",\"message\":\"%s\",\"state\":\"%s\"}",
+        st.connected ? "true" : "false",
+        st.ssid,
+        st.ip,
+        st.message,
+        wifi_station_state_name(st.state));
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for reconnect timing and link uptime
+static esp_err_t wifi_metrics_handler(httpd_req_t *req)
+{
+    wifi_station_metrics_t m;
+    wifi_station_get_metrics(&m);
+    
+    char json[512];
+    snprintf(json, sizeof(json),
+        "{\"attempts\":%lu,\"fast_attempts\":%lu,\"connects\":%lu,\"fast_connects\":%lu,"
+        "\"link_losses\":%lu,\"timeouts\":%lu,\"rounds\":%lu,\"backoff_ms\":%lu,"
+        "\"last_reconnect_ms\":%lu,\"max_reconnect_ms\":%lu,\"avg_reconnect_ms\":%lu,"
+        "\"last_attempt_ms\":%lu,\"uptime_ms\":%llu,\"link_up_ms\":%lu,\"last_reason\":%u}",
+        m.attempts, m.fast_attempts, m.connects, m.fast_connects, m.link_losses, m.timeouts,
+        m.rounds, m.backoff_ms, m.last_reconnect_ms, m.max_reconnect_ms, m.avg_reconnect_ms,
+        m.last_attempt_ms, m.uptime_ms, m.link_up_ms, m.last_reason);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for DFS/modem-sleep state and the active-time breakdown
+static esp_err_t power_handler(httpd_req_t *req)
+{
+    power_stats_t st;
+    power_get_stats(&st);
+    // The INA226 measures the whole supply when fitted; the estimate is all there is otherwise
+    sensors_power_t pw;
+    sensors_get_power(&pw);
+    
+    char json[512];
+    int len = snprintf(json, sizeof(json),
+        "{\"pm_enabled\":%s,\"cpu_mhz\":%lu,\"modem_sleep\":%s,\"ap_running\":%s,"
+        "\"busy_ms\":%llu,\"idle_ms\":%llu,\"current_ma\":%ld,\"current_source\":\"%s\","
+        "\"est_ma\":%lu,\"est_avg_ma\":%lu,\"clients\":[",
+        st.pm_enabled ? "true" : "false", st.cpu_mhz, st.modem_sleep ? "true" : "false",
+        st.ap_running ? "true" : "false", st.busy_ms, st.idle_ms,
+        pw.hardware ? pw.current_ma : (int32_t)st.est_ma, pw.hardware ? "ina226" : "estimate",
+        st.est_ma, st.est_avg_ma);
+    for (int c = 0; c < POWER_CLIENT_COUNT; c++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s{\"name\":\"%s\",\"active\":%s,\"active_ms\":%llu}",
+                        c ? "," : "", power_client_name((power_client_t)c),
+                        st.active[c] ? "true" : "false", st.active_ms[c]);
+        if (len > (int)sizeof(json) - 3) {   // Room left for "]}"
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+            return ESP_FAIL;
+        }
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for downsampled telemetry history:
+// /api/history?range=<s>&points=<n>&ch=rpm0,battery_mv
+static esp_err_t history_handler(httpd_req_t *req)
+{
+    uint32_t range_s = 60;
+    int points = 200;
+    bool wanted[HISTORY_CHANNELS];
+    for (int c = 0; c < HISTORY_CHANNELS; c++) wanted[c] = true;
+    
+    char query[128];
+    char value[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "range", value, sizeof(value)) == ESP_OK) {
+            range_s = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "points", value, sizeof(value)) == ESP_OK) {
+            points = atoi(value);
+        }
+        if (httpd_query_key_value(query, "ch", value, sizeof(value)) == ESP_OK) {
+            for (int c = 0; c < HISTORY_CHANNELS; c++) wanted[c] = false;
+            for (char *name = strtok(value, ","); name; name = strtok(NULL, ",")) {
+                int c = history_channel_from_name(name);
+                if (c < 0) {
+                    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown channel");
+                    return ESP_OK;
+                }
+                wanted[c] = true;
+            }
+        }
+    }
+    uint32_t max_range_s = history_level_span_ms(HISTORY_LEVELS - 1) / 1000;
+    if (range_s == 0 || range_s > max_range_s || points < 3 || points > HISTORY_MAX_POINTS) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid range or points");
+        return ESP_OK;
+    }
+    
+    static_assert(sizeof(history_point_t) * HISTORY_MAX_POINTS <= MEM_MEDIUM_BLOCK,
+                  "history points outgrew their block");
+    history_point_t *out = (history_point_t *)mem_alloc(sizeof(history_point_t) * points);
+    if (out == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
+    
+    // One chunk per series head and per run of points keeps the buffer small
+    httpd_resp_set_type(req, "application/json");
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "{\"range_s\":%lu,\"now_ms\":%llu,\"series\":{",
+                       range_s, (uint64_t)(esp_timer_get_time() / 1000));
+    bool first = true;
+    for (int c = 0; c < HISTORY_CHANNELS; c++) {
+        if (!wanted[c]) continue;
+        history_series_t series;
+        if (history_query(c, range_s * 1000, points, out, &series) != ESP_OK) continue;
+        if (len > (int)sizeof(buf) - 128) {
+            httpd_resp_send_chunk(req, buf, len);
+            len = 0;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "%s\"%s\":{\"step_ms\":%lu,\"span_ms\":%lu,\"points\":[",
+                        first ? "" : ",", history_channel_name(c), series.period_ms, series.span_ms);
+        first = false;
+        for (int i = 0; i < series.count; i++) {
+            if (len > (int)sizeof(buf) - 64) {
+                httpd_resp_send_chunk(req, buf, len);
+                len = 0;
+            }
+            len += snprintf(buf + len, sizeof(buf) - len, "%s[%lu,%d,%d,%d]", i ? "," : "",
+                            out[i].t_ms, out[i].value, out[i].min, out[i].max);
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "]}");
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "}}");
+    httpd_resp_send_chunk(req, buf, len);
+    httpd_resp_send_chunk(req, NULL, 0);
+    mem_free(out);
+    return ESP_OK;
+}
+
+// HTTP GET handler for UDP control channel statistics
+static esp_err_t udp_status_handler(httpd_req_t *req)
+{
+    udp_control_stats_t stats;
+    udp_control_get_stats(&stats);
+    
+    char json[320];
+    snprintf(json, sizeof(json),
+        "{\"port\":%d,\"received\":%lu,\"applied\":%lu,\"stale\":%lu,\"malformed\":%lu,\"refused\":%lu,"
+        "\"monitored\":%lu,\"last_apply_us\":%lu,\"max_apply_us\":%lu,\"failsafe_trips\":%lu,\"failsafe_active\":%s}",
+        UDP_CONTROL_PORT, stats.received, stats.applied, stats.stale, stats.malformed, stats.refused,
+        stats.monitored, stats.last_apply_us, stats.max_apply_us, motor_get_failsafe_trips(),
+        motor_failsafe_tripped() ? "true" : "false");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for connection fairness counters, one entry per tracked client
+static esp_err_t http_stats_handler(httpd_req_t *req)
+{
+    const conn_limit_t *cl = http_guard_state();
+    
+    char json[1280];
+    int len = snprintf(json, sizeof(json),
+        "{\"open\":%d,\"max_sockets\":%d,\"accepted\":%lu,\"refused\":%lu,\"requests\":%lu,\"reused\":%lu,"
+        "\"throttled\":%lu,\"evicted\":%lu,\"rate\":%d,\"burst\":%d,\"client_sockets\":%d,\"clients\":[",
+        conn_limit_open_sockets(cl), cl->max_sockets, cl->accepted, cl->refused, cl->requests, cl->reused,
+        cl->throttled, cl->evicted, CONN_LIMIT_RATE, CONN_LIMIT_BURST, CONN_LIMIT_CLIENT_SOCKETS);
+    bool first = true;
+    for (int i = 0; i < CONN_LIMIT_CLIENTS && len < (int)sizeof(json); i++) {
+        const conn_client_t *c = &cl->clients[i];
+        if (c->ip == 0) continue;
+        len += snprintf(json + len, sizeof(json) - len,
+            "%s{\"ip\":\"%lu.%lu.%lu.%lu\",\"sockets\":%u,\"tokens\":%.1f,\"requests\":%lu,\"throttled\":%lu,"
+            "\"refused\":%lu}",
+            first ? "" : ",", c->ip & 0xFF, (c->ip >> 8) & 0xFF, (c->ip >> 16) & 0xFF, c->ip >> 24, c->sockets,
+            c->tokens_milli / 1000.0f, c->requests, c->throttled, c->refused);
+        first = false;
+    }
+    if (len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, "]}");
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for the memory budget: heap state, pool and stack high water marks
+static esp_err_t memory_handler(httpd_req_t *req)
+{
+    mem_pool_stats_t pools[MEM_POOL_COUNT];
+    mem_task_stats_t tasks[MEM_MAX_TASKS];
+    int npools = mem_pool_get_stats(pools, MEM_POOL_COUNT);
+    int ntasks = mem_task_get_stats(tasks, MEM_MAX_TASKS);
+    
+    const size_t size = 2048;
+    char *json = (char *)mem_alloc(size);
+    if (json == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
+    int len = snprintf(json, size,
+        "{\"static\":%s,\"heap\":{\"free\":%u,\"min_free\":%u,\"largest_block\":%u},\"pools\":[",
+        MEM_STATIC_ALLOCATION ? "true" : "false", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    for (int i = 0; i < npools; i++) {
+        const mem_pool_stats_t *p = &pools[i];
+        len += snprintf(json + len, size - len,
+            "%s{\"name\":\"%s\",\"block\":%lu,\"blocks\":%u,\"in_use\":%u,\"high_water\":%u,"
+            "\"allocs\":%lu,\"failures\":%lu,\"largest_request\":%lu}",
+            i ? "," : "", p->name, p->block_bytes, p->blocks, p->in_use, p->high_water,
+            p->allocs, p->failures, p->largest_request);
+    }
+    len += snprintf(json + len, size - len, "],\"tasks\":[");
+    for (int i = 0; i < ntasks && len < (int)size; i++) {
+        const mem_task_stats_t *t = &tasks[i];
+        len += snprintf(json + len, size - len, "%s{\"name\":\"%s\",\"stack\":%lu,\"peak\":%lu,\"running\":%s}",
+                        i ? "," : "", t->name, t->stack_bytes, t->peak_bytes, t->running ? "true" : "false");
+    }
+    if (len < (int)size) {
+        len += snprintf(json + len, size - len, "]}");
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    mem_free(json);
+    return ESP_OK;
+}
+
+// HTTP GET handler for ESC serial telemetry, one entry per motor
+static esp_err_t esc_telemetry_handler(httpd_req_t *req)
+{
+    esc_telemetry_stats_t st;
+    esc_telemetry_get_stats(&st);
+    
+    char json[768];
+    int len = snprintf(json, sizeof(json), "{\"slots\":%lu,\"overruns\":%lu,\"line_errors\":%lu,\"motors\":[",
+                       st.slots, st.overruns, st.line_errors);
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        esc_telemetry_t t;
+        esc_telemetry_get(m, &t);
+        int64_t age_ms = t.time_us ? (esp_timer_get_time() - t.time_us) / 1000 : -1;
+        len += snprintf(json + len, sizeof(json) - len,
+            "%s{\"fresh\":%s,\"t_us\":%lld,\"age_ms\":%lld,\"temp_c\":%d,\"voltage_mv\":%lu,\"current_ma\":%lu,"
+            "\"consumption_mah\":%u,\"erpm\":%lu,\"rpm\":%lu,\"frames\":%lu,\"crc_errors\":%lu,"
+            "\"short_frames\":%lu,\"dropped_bytes\":%lu,\"missed_slots\":%lu}",
+            m ? "," : "", t.fresh ? "true" : "false", t.time_us, age_ms, t.temp_c, t.voltage_mv, t.current_ma,
+            t.consumption_mah, t.erpm, t.rpm, t.frames, t.crc_errors,
+            t.short_frames, t.dropped_bytes, t.missed_slots);
+        if (len > (int)sizeof(json) - 3) {   // Room left for "]}"
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+            return ESP_FAIL;
+        }
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for control task queue and latency metrics
+static esp_err_t motor_metrics_handler(httpd_req_t *req)
+{
+    motor_metrics_t m;
+    motor_get_metrics(&m);
+    
+    char json[448];
+    int len = snprintf(json, sizeof(json),
+        "{\"commands\":%lu,\"queue_full\":%lu,\"queue_high_water\":%lu,"
+        "\"latency_us\":{\"samples\":%lu,\"last\":%lu,\"min\":%lu,\"max\":%lu,\"avg\":%lu},"
+        "\"replay\":{\"recorded\":%lu,\"snapshots\":%lu,\"drops\":%lu},"
+        "\"latency_hist_bucket0_us\":%d,\"latency_hist\":[",
+        m.commands, m.queue_full, m.queue_high_water, m.latency_samples,
+        m.latency_last_us, m.latency_min_us, m.latency_max_us, m.latency_avg_us,
+        m.recorded, m.snapshots, m.record_drops, MOTOR_LATENCY_BUCKET0_US);
+    for (int i = 0; i < MOTOR_LATENCY_BUCKETS; i++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%lu", i ? "," : "", m.latency_hist[i]);
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP GET handler for battery voltage, current, power and the consumed charge/energy
+static esp_err_t battery_handler(httpd_req_t *req)
+{
+    sensors_power_t pw;
+    sensors_get_power(&pw);
+    
+    char json[384];
+    snprintf(json, sizeof(json),
+        "{\"source\":\"%s\",\"t_us\":%lld,\"voltage_mv\":%ld,\"current_ma\":%ld,\"power_mw\":%ld,"
+        "\"charge_uah\":%lld,\"energy_uwh\":%lld,\"integrated_ms\":%llu,\"conversion_us\":%lu,"
+        "\"conversions\":%lu,\"missed_alerts\":%lu,\"bus_errors\":%lu}",
+        pw.hardware ? "ina226" : "simulated", pw.time_us, pw.bus_mv, pw.current_ma, pw.power_mw,
+        pw.charge_uah, pw.energy_uwh, pw.integrated_ms, pw.conversion_us,
+        pw.conversions, pw.missed_alerts, pw.bus_errors);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP POST handler for battery reset: zeroes the mAh/Wh counters
+static esp_err_t battery_reset_handler(httpd_req_t *req)
+{
+    float voltage = sensors_reset_battery();
+    BLOGI("Battery counters reset, voltage: %.2fV", voltage);
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// Answer a command the control task did not apply: 400 if it was invalid,
+// 503 if it could not be queued (ring full) or was refused in the current state
+static void send_command_error(httpd_req_t *req, esp_err_t err, const char *invalid)
+{
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, invalid);
+        return;
+    }
+    BLOGW("Motor command not applied: %s", esp_err_to_name(err));
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_sendstr(req, esp_err_to_name(err));
+}
+
+// HTTP POST handler for motor start (default 50% speed)
+static esp_err_t motor_start_handler(httpd_req_t *req)
+{
+    motor_cmd_t cmd = { MOTOR_CMD_START, MOTOR_ALL, 0 };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err != ESP_OK) {
+        send_command_error(req, err, "Invalid command");
+        return ESP_OK;
+    }
+    
+    BLOGI("Motor started: %d%% (%d RPM, PWM: %lu)", motor_get_speed(0), motor_get_rpm(0), motor_get_duty(0));
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler for motor stop
+static esp_err_t motor_stop_handler(httpd_req_t *req)
+{
+    motor_cmd_t cmd = { MOTOR_CMD_STOP, MOTOR_ALL, 0 };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err != ESP_OK) {
+        send_command_error(req, err, "Invalid command");
+        return ESP_OK;
+    }
+    
+    BLOGI("Motor stopped");
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler for motor speed control (JSON: {"speed": 0-100, "motor": index (optional)})
+static esp_err_t motor_speed_handler(httpd_req_t *req)
+{
+    char buf[100];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    // Parse JSON: {"speed":75}
+    const char *speed_str = json_find_value(buf, "speed");
+    if (speed_str) {
+        int speed = atoi(speed_str);
+        if (speed < 0) speed = 0;
+        if (speed > 100) speed = 100;
+        
+        motor_cmd_t cmd = { MOTOR_CMD_SPEED, MOTOR_ALL, speed };
+        if (!json_get_motor(buf, &cmd.motor)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid motor");
+            return ESP_OK;
+        }
+        esp_err_t err = motor_apply_command(&cmd);
+        if (err != ESP_OK) {
+            send_command_error(req, err, "Invalid motor");
+            return ESP_OK;
+        }
+        
+        int m = cmd.motor == MOTOR_ALL ? 0 : cmd.motor;
+        BLOGI("Motor speed set: %d%% (%d RPM, PWM: %lu)", speed, motor_get_rpm(m), motor_get_duty(m));
+        
+        httpd_resp_send(req, "OK", 2);
+        return ESP_OK;
+    }
+    
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+    return ESP_OK;
+}
+
+// HTTP GET handler for RPM hold state, loop tuning and step-response metrics
+static esp_err_t motor_rpm_get_handler(httpd_req_t *req)
+{
+    rpm_pid_config_t cfg;
+    motor_get_rpm_tuning(&cfg);
+    
+    char json[768];
+    char rpm[12];   // Measured speed, null without a fresh measurement
+    int len = snprintf(json, sizeof(json),
+        "{\"rate_hz\":%lu,\"kp\":%.5f,\"ki\":%.5f,\"kd\":%.6f,\"motors\":[",
+        cfg.rate_hz, cfg.kp_q16 / 65536.0f, cfg.ki_q16 / 65536.0f, cfg.kd_q16 / 65536.0f);
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        motor_rpm_status_t st;
+        motor_get_rpm_status(m, &st);
+        if (st.measured) {
+            snprintf(rpm, sizeof(rpm), "%ld", st.measured_rpm);
+        } else {
+            strcpy(rpm, "null");
+        }
+        len += snprintf(json + len, sizeof(json) - len,
+            "%s{\"hold\":%s,\"target\":%ld,\"rpm\":%s,\"throttle\":%d,\"ff_throttle\":%ld,\"map_samples\":%lu,"
+            "\"step\":{\"from\":%ld,\"to\":%ld,\"rise_us\":%lu,\"settle_us\":%lu,\"overshoot_pct\":%.1f,"
+            "\"peak\":%ld,\"complete\":%s,\"timed_out\":%s}}",
+            m ? "," : "", st.hold ? "true" : "false", st.target_rpm, rpm, motor_get_throttle(m),
+            st.ff_throttle, st.map_samples, st.step.from_rpm, st.step.to_rpm, st.step.rise_us,
+            st.step.settle_us, st.step.overshoot_permille / 10.0f, st.step.peak_rpm,
+            st.step.complete ? "true" : "false", st.step.timed_out ? "true" : "false");
+        if (len > (int)sizeof(json) - 3) {   // Room left for "]}"
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+            return ESP_FAIL;
+        }
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// Every motor the command names has a fresh measurement to close the loop on
+static bool rpm_measured(int motor)
+{
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        motor_rpm_status_t st;
+        motor_get_rpm_status(m, &st);
+        if ((motor == MOTOR_ALL || motor == m) && !st.measured) return false;
+    }
+    return true;
+}
+
+// HTTP POST handler for RPM setpoints and loop tuning
+// (JSON: {"rpm":8000,"motor":0} and/or {"kp":0.01,"ki":0.1,"kd":0,"rate_hz":1000}).
+// Tuning is saved only once the whole request has been applied.
+static esp_err_t motor_rpm_post_handler(httpd_req_t *req)
+{
+    char buf[160];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    const char *kp_str = json_find_value(buf, "kp");
+    const char *ki_str = json_find_value(buf, "ki");
+    const char *kd_str = json_find_value(buf, "kd");
+    const char *rate_str = json_find_value(buf, "rate_hz");
+    const char *rpm_str = json_find_value(buf, "rpm");
+    if (!kp_str && !ki_str && !kd_str && !rate_str && !rpm_str) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_OK;
+    }
+    
+    rpm_pid_config_t cfg, previous;
+    motor_get_rpm_tuning(&previous);
+    cfg = previous;
+    if (kp_str || ki_str || kd_str || rate_str) {
+        if (kp_str) cfg.kp_q16 = RPM_Q16(atof(kp_str));
+        if (ki_str) cfg.ki_q16 = RPM_Q16(atof(ki_str));
+        if (kd_str) cfg.kd_q16 = RPM_Q16(atof(kd_str));
+        if (rate_str) cfg.rate_hz = (uint32_t)atoi(rate_str);
+        esp_err_t err = motor_set_rpm_tuning(&cfg);
+        if (err != ESP_OK) {
+            send_command_error(req, err, "Invalid tuning");
+            return ESP_OK;
+        }
+        BLOGI("RPM loop: kp=%s ki=%s kd=%s rate=%lu Hz", kp_str ? "set" : "-",
+              ki_str ? "set" : "-", kd_str ? "set" : "-", cfg.rate_hz);
+    }
+    
+    if (rpm_str) {
+        motor_cmd_t cmd = { MOTOR_CMD_RPM, MOTOR_ALL, atoi(rpm_str) };
+        esp_err_t err = json_get_motor(buf, &cmd.motor) ? motor_apply_command(&cmd) : ESP_ERR_INVALID_ARG;
+        if (err != ESP_OK) {
+            // Tuning and setpoint go together; put back the gains the hold would have used
+            if (memcmp(&cfg, &previous, sizeof(cfg)) != 0) motor_set_rpm_tuning(&previous);
+            if (err == ESP_ERR_INVALID_STATE && !rpm_measured(cmd.motor)) {
+                httpd_resp_set_status(req, "409 Conflict");
+                httpd_resp_sendstr(req, "No RPM measurement for the motor");
+                return ESP_OK;
+            }
+            send_command_error(req, err, "Invalid motor or RPM");
+            return ESP_OK;
+        }
+        BLOGI("RPM hold: %ld RPM", cmd.value);
+    }
+    if (memcmp(&cfg, &previous, sizeof(cfg)) != 0) {
+        settings_set_rpm_tuning(&cfg);
+    }
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler for protocol change
+// (JSON: {"protocol": "standard"|"oneshot125"|"oneshot42"|"multishot", "preserve": true (optional)})
+static esp_err_t motor_protocol_handler(httpd_req_t *req)
+{
+    char buf[100];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    // Parse protocol from JSON
+    esc_protocol_t new_protocol = PROTOCOL_STANDARD;
+    if (strstr(buf, "oneshot125")) {
+        new_protocol = PROTOCOL_ONESHOT125;
+    } else if (strstr(buf, "oneshot42")) {
+        new_protocol = PROTOCOL_ONESHOT42;
+    } else if (strstr(buf, "multishot")) {
+        new_protocol = PROTOCOL_MULTISHOT;
+    } else if (strstr(buf, "standard")) {
+        new_protocol = PROTOCOL_STANDARD;
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown protocol");
+        return ESP_FAIL;
+    }
+    
+    // Switching protocol resets the motors to off unless their throttle is preserved
+    bool preserve = json_get_bool(buf, "preserve");
+    motor_cmd_t cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, (int32_t)(new_protocol | (preserve ? MOTOR_PROTOCOL_PRESERVE : 0)) };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err != ESP_OK) {
+        send_command_error(req, err, "Invalid protocol");
+        return ESP_OK;
+    }
+    settings_set_protocol(new_protocol);  // Restored at the next boot
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler for the protocol switch self-test
+// (JSON: {"from":"standard","to":"oneshot125","motor":0,"throttle":0,"preserve":true})
+static esp_err_t protocol_test_handler(httpd_req_t *req)
+{
+    char buf[160];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    char from_name[16], to_name[16];
+    esc_protocol_t from, to;
+    if (!json_get_string(buf, "from", from_name, sizeof(from_name)) || !motor_protocol_from_name(from_name, &from) ||
+        !json_get_string(buf, "to", to_name, sizeof(to_name)) || !motor_protocol_from_name(to_name, &to)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown protocol");
+        return ESP_OK;
+    }
+    const char *motor_str = json_find_value(buf, "motor");
+    const char *throttle_str = json_find_value(buf, "throttle");
+    bool preserve = json_find_value(buf, "preserve") ? json_get_bool(buf, "preserve") : true;
+    
+    protocol_switch_test_t r;
+    esp_err_t err = pwm_selftest_protocol_switch(from, to, motor_str ? atoi(motor_str) : 0,
+                                                 throttle_str ? atoi(throttle_str) : 0, preserve, &r);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
+    
+    char json[512];
+    snprintf(json, sizeof(json),
+        "{\"pass\":%s,\"from\":\"%s\",\"to\":\"%s\",\"motor\":%d,\"throttle\":%d,\"preserve\":%s,"
+        "\"pulses_before\":%u,\"pulses_after\":%u,\"malformed\":%u,\"lost_edges\":%u,"
+        "\"expected_before_us\":%.2f,\"expected_after_us\":%.2f,\"min_width_us\":%.2f,\"max_width_us\":%.2f,"
+        "\"switch_latency_us\":%lu,\"swap_latency_us\":%lu,\"boundary_wait_us\":%lu,\"gap_us\":%ld}",
+        r.pass ? "true" : "false", motor_protocol_name(from), motor_protocol_name(to), r.motor, r.throttle,
+        r.preserve ? "true" : "false", r.pulses_before, r.pulses_after, r.malformed, r.lost_edges,
+        r.expected_before_us, r.expected_after_us, r.min_width_us, r.max_width_us,
+        r.switch_latency_us, r.swap_latency_us, r.boundary_wait_us, r.gap_us);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+static int loopback_json(char *buf, size_t size, const pwm_loopback_test_t *r)
+{
+    int len = snprintf(buf, size,
+        "{\"pass\":%s,\"protocol\":\"%s\",\"pulses\":%u,\"periods\":%u,\"out_of_spec\":%u,\"lost_edges\":%u,"
+        "\"width_us\":{\"expected\":%.2f,\"tol\":%.2f,\"mean\":%.3f,\"min\":%.3f,\"max\":%.3f,\"jitter\":%.3f},"
+        "\"period_us\":{\"expected\":%.2f,\"tol\":%.2f,\"mean\":%.3f,\"min\":%.3f,\"max\":%.3f,\"jitter\":%.3f},"
+        "\"latency_us\":{\"samples\":%u,\"min\":%lu,\"avg\":%lu,\"max\":%lu,\"update_avg\":%lu,\"limit\":%lu}",
+        r->pass ? "true" : "false", motor_protocol_name(r->protocol), r->pulses, r->periods, r->out_of_spec,
+        r->lost_edges, r->expected_width_us, r->width_tol_us, r->mean_width_us, r->min_width_us, r->max_width_us,
+        r->width_jitter_us, r->expected_period_us, r->period_tol_us, r->mean_period_us, r->min_period_us,
+        r->max_period_us, r->period_jitter_us, r->latency_samples, r->latency_min_us, r->latency_avg_us,
+        r->latency_max_us, r->update_avg_us, r->latency_limit_us);
+    const char *names[2] = { "width_hist", "period_hist" };
+    const uint16_t *hists[2] = { r->width_hist, r->period_hist };
+    for (int h = 0; h < 2; h++) {
+        len += snprintf(buf + len, size - len, ",\"%s\":[", names[h]);
+        for (int i = 0; i < PWM_JITTER_BUCKETS; i++) {
+            len += snprintf(buf + len, size - len, "%s%u", i ? "," : "", hists[h][i]);
+        }
+        len += snprintf(buf + len, size - len, "]");
+    }
+    return len + snprintf(buf + len, size - len, "}");
+}
+
+// HTTP POST handler for the output loopback self-test; without a protocol every one is tested
+// (JSON: {"protocol":"oneshot125","motor":0,"throttle":500,"gpio":-1})
+static esp_err_t output_test_handler(httpd_req_t *req)
+{
+    char buf[160];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret > 0 ? ret : 0] = '\0';
+
+    char name[16];
+    esc_protocol_t first = PROTOCOL_STANDARD, last = PROTOCOL_MULTISHOT;
+    if (json_get_string(buf, "protocol", name, sizeof(name))) {
+        if (!motor_protocol_from_name(name, &first)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown protocol");
+            return ESP_OK;
+        }
+        last = first;
+    }
+    int8_t motor = 0;
+    if (json_find_value(buf, "motor") && (!json_get_motor(buf, &motor) || motor == MOTOR_ALL)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid motor");
+        return ESP_OK;
+    }
+    const char *v;
+    int throttle = (v = json_find_value(buf, "throttle")) ? atoi(v) : 500;
+    int gpio = (v = json_find_value(buf, "gpio")) ? atoi(v) : -1;
+
+    pwm_loopback_test_t results[PROTOCOL_MULTISHOT + 1];
+    int count = 0;
+    bool pass = true;
+    for (int p = first; p <= last; p++, count++) {
+        esp_err_t err = pwm_selftest_loopback((esc_protocol_t)p, motor, throttle, gpio, &results[count]);
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+            return ESP_OK;
+        }
+        pass &= results[count].pass;
+    }
+
+    static_assert((PROTOCOL_MULTISHOT + 1) * 640 + 128 <= MEM_MEDIUM_BLOCK, "loopback results outgrew their block");
+    size_t size = (PROTOCOL_MULTISHOT + 1) * 640 + 128;
+    char *json = (char *)mem_alloc(size);
+    if (json == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
+    int len = snprintf(json, size, "{\"pass\":%s,\"motor\":%d,\"throttle\":%d,\"gpio\":%d,\"results\":[",
+                       pass ? "true" : "false", motor, throttle, gpio);
+    for (int i = 0; i < count; i++) {
+        if (i) json[len++] = ',';
+        len += loopback_json(json + len, size - len, &results[i]);
+    }
+    snprintf(json + len, size - len, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    mem_free(json);
+    return ESP_OK;
+}
+
+// Appends at buf + len; once the buffer is full it only keeps len past it
+static int battery_step_json(char *buf, size_t size, int len, const char *key, const battery_step_fit_t *f)
+{
+    if (len >= (int)size) {
+        return len;
+    }
+    return len + snprintf(buf + len, size - len,
+        ",\"%s\":{\"valid\":%s,\"before_mv\":%ld,\"before_ma\":%ld,\"settled_mv\":%ld,\"settled_ma\":%ld,"
+        "\"peak_mv\":%ld,\"rise_us\":%lu,\"r0_uohm\":%ld,\"r1_uohm\":%ld,\"tau_us\":%lu,"
+        "\"pre_samples\":%u,\"post_samples\":%u,\"straddling\":%u}",
+        key, f->valid ? "true" : "false", f->before_mv, f->before_ma, f->settled_mv, f->settled_ma,
+        f->peak_mv, f->rise_us, f->r0_uohm, f->r1_uohm, f->tau_us,
+        f->pre_samples, f->post_samples, f->straddling);
+}
+
+// HTTP GET handler for the internal resistance test: progress, then the fit of both steps
+static esp_err_t battery_ir_get_handler(httpd_req_t *req)
+{
+    battery_ir_result_t r;
+    battery_test_ir_get_result(&r);
+    
+    char json[1280];
+    int len = snprintf(json, sizeof(json),
+        "{\"state\":\"%s\",\"error\":\"%s\",\"elapsed_ms\":%lu,\"pass\":%s,\"motor\":%d,\"low\":%d,\"high\":%d,"
+        "\"r0_uohm\":%ld,\"r1_uohm\":%ld,\"sag_mv\":%ld,\"conversion_us\":%lu,\"latch_us\":%lu,"
+        "\"samples\":%lu,\"gaps\":%lu",
+        battery_ir_state_name(r.state), r.err != ESP_OK ? esp_err_to_name(r.err) : "", r.elapsed_ms,
+        r.pass ? "true" : "false", r.config.motor, r.config.low_throttle, r.config.high_throttle,
+        r.r0_uohm, r.r1_uohm, r.sag_mv, r.conversion_us, r.latch_us, r.samples, r.gaps);
+    len = battery_step_json(json, sizeof(json), len, "load", &r.load);
+    len = battery_step_json(json, sizeof(json), len, "release", &r.release);
+    if (len > (int)sizeof(json) - 2) {   // Room left for "}"
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+        return ESP_FAIL;
+    }
+    len += snprintf(json + len, sizeof(json) - len, "}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, len);
+    return ESP_OK;
+}
+
+// HTTP POST handler to start the internal resistance test
+// (JSON: {"motor":0,"low":100,"high":600,"settle_ms":1000,"hold_ms":1500,"recover_ms":1500})
+static esp_err_t battery_ir_start_handler(httpd_req_t *req)
+{
+    char buf[192];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    battery_ir_config_t cfg = BATTERY_IR_DEFAULT_CONFIG;
+    const char *v;
+    if ((v = json_find_value(buf, "motor"))) cfg.motor = atoi(v);
+    if ((v = json_find_value(buf, "low"))) cfg.low_throttle = atoi(v);
+    if ((v = json_find_value(buf, "high"))) cfg.high_throttle = atoi(v);
+    if ((v = json_find_value(buf, "settle_ms"))) cfg.settle_ms = atoi(v);
+    if ((v = json_find_value(buf, "hold_ms"))) cfg.hold_ms = atoi(v);
+    if ((v = json_find_value(buf, "recover_ms"))) cfg.recover_ms = atoi(v);
+    
+    esp_err_t err = battery_test_ir_start(&cfg);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "IR test already running", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler to abort the internal resistance test
+static esp_err_t battery_ir_stop_handler(httpd_req_t *req)
+{
+    esp_err_t err = battery_test_ir_stop();
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No IR test running");
+        return ESP_OK;
+    }
+    
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP GET handler for the load cell reading and calibration
+static esp_err_t loadcell_get_handler(httpd_req_t *req)
+{
+    loadcell_reading_t r;
+    loadcell_cal_t cal;
+    loadcell_get_reading(&r);
+    loadcell_get_calibration(&cal);
+    
+    char json[320];
+    snprintf(json, sizeof(json),
+        "{\"hardware\":%s,\"t_us\":%lld,\"thrust_mg\":%ld,\"raw\":%ld,\"samples\":%lu,\"missed\":%lu,"
+        "\"sample_us\":%d,\"offset\":%ld,\"counts_per_kg\":%ld,\"calibrated\":%s,\"motor\":%u}",
+        r.hardware ? "true" : "false", r.time_us, r.thrust_mg, r.raw, r.samples, r.missed, LOADCELL_SAMPLE_US,
+        cal.offset, cal.counts_per_kg, cal.calibrated ? "true" : "false", cal.motor);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+// HTTP POST handler to zero the load cell (JSON, optional: {"motor":0} names the motor on the stand)
+static esp_err_t loadcell_tare_handler(httpd_req_t *req)
+{
+    char buf[64];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    loadcell_cal_t cal;
+    loadcell_get_calibration(&cal);
+    if (json_find_value(buf, "motor")) {
+        int8_t motor;
+        if (!json_get_motor(buf, &motor) || motor == MOTOR_ALL) {   // One motor sits on the stand
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid motor");
+            return ESP_OK;
+        }
+        cal.motor = (uint8_t)motor;
+        loadcell_set_calibration(&cal);
+    }
+    
+    esp_err_t err = loadcell_tare();
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
     }
+    loadcell_get_calibration(&cal);
+    settings_set_loadcell(&cal);
     
-    // Reconfigure LEDC timer with new settings
-    ledc_timer_config_t ledc_timer = {
-        .speed_mode       = LEDC_LOW_SPEED_MODE,
-        .duty_resolution  = pwm_resolution,
-        .timer_num        = MOTOR_PWM_TIMER,
-        .freq_hz          = pwm_frequency,
-        .clk_cfg          = LEDC_AUTO_CLK
-    };
-    ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
-}
-
-// Convert speed percentage (0-100%) to PWM duty cycle based on current protocol
-static uint32_t speed_to_pwm(int speed_percent) {
-    if (speed_percent < 0) speed_percent = 0;
-    if (speed_percent > 100) speed_percent = 100;
-    // Map 0-100% to protocol-specific min-max duty range
-    return pwm_min_duty + ((speed_percent * (pwm_max_duty - pwm_min_duty)) / 100);
-}
-
-// WiFi connection status tracking
-static bool wifi_connected = false;
-static char wifi_connected_ssid[33] = "";
-static char wifi_ip_address[16] = "";
-static char wifi_status_message[64] = "Not connected";
-static int wifi_retry_count = 0;
-static const int MAX_WIFI_RETRIES = 5;
-
-// HTTP GET handler for main page
-static esp_err_t root_handler(httpd_req_t *req)
-{
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    httpd_resp_send(req, (const char *)html_page_gz, html_page_gz_len);
+    char json[96];
+    snprintf(json, sizeof(json), "{\"status\":\"ok\",\"offset\":%ld,\"motor\":%u}", cal.offset, cal.motor);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
     return ESP_OK;
 }
 
-// HTTP GET handler for status API
-static esp_err_t status_handler(httpd_req_t *req)
+// HTTP POST handler to set the load cell scale from a known mass (JSON: {"mass_g":500})
+static esp_err_t loadcell_calibrate_handler(httpd_req_t *req)
 {
-    char json[200];
-    snprintf(json, sizeof(json), 
-        "{\"battery\":%.1f,\"rpm\":%d}",
-        battery_voltage, motor_rpm);
+    char buf[64];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    const char *v = json_find_value(buf, "mass_g");
+    if (!v) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing mass_g");
+        return ESP_OK;
+    }
+    esp_err_t err = loadcell_calibrate((uint32_t)atoi(v));
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
+    loadcell_cal_t cal;
+    loadcell_get_calibration(&cal);
+    settings_set_loadcell(&cal);
     
+    char json[96];
+    snprintf(json, sizeof(json), "{\"status\":\"ok\",\"counts_per_kg\":%ld}", cal.counts_per_kg);
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, json, strlen(json));
     return ESP_OK;
 }
 
-// HTTP GET handler for WiFi status API
-static esp_err_t wifi_status_handler(httpd_req_t *req)
+// HTTP GET handler for the thrust sweep: progress and the curve as columns, one entry per step
+static esp_err_t thrust_get_handler(httpd_req_t *req)
 {
-    char json[256];
-    snprintf(json, sizeof(json), 
-        "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\",\"message\":\"%s\"}",
-        wifi_connected ? "true" : "false",
-        wifi_connected_ssid,
-        wifi_ip_address,
-        wifi_status_message);
-    
+    static_assert(sizeof(thrust_result_t) <= MEM_SMALL_BLOCK, "thrust result outgrew its block");
+    thrust_result_t *r = (thrust_result_t *)mem_alloc(sizeof(thrust_result_t));
+    char *json = (char *)mem_alloc(3072);
+    if (r == NULL || json == NULL) {
+        mem_free(r);
+        mem_free(json);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
+    thrust_test_get_result(r);
+    const size_t size = 3072;
+    int n = r->completed;
+    
+    int len = snprintf(json, size,
+        "{\"state\":\"%s\",\"error\":\"%s\",\"motor\":%d,\"from\":%d,\"to\":%d,\"step\":%d,"
+        "\"settle_ms\":%lu,\"measure_ms\":%lu,\"steps\":%d,\"completed\":%d,\"elapsed_ms\":%lu",
+        thrust_state_name(r->state), r->err != ESP_OK ? esp_err_to_name(r->err) : "",
+        r->config.motor, r->config.from_throttle, r->config.to_throttle, r->config.step_throttle,
+        r->config.settle_ms, r->config.measure_ms, r->steps, n, r->elapsed_ms);
+    
+    // Columns grow with the step count; a chunk goes out before the next entry could overrun
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, strlen(json));
+    static const char *const columns[] = {
+        "throttle", "thrust_mg", "thrust_sd_mg", "rpm", "voltage_mv", "current_ma", "power_mw",
+        "mg_per_w", "thrust_samples", "power_samples"
+    };
+    for (int c = 0; c < (int)(sizeof(columns) / sizeof(columns[0])); c++) {
+        if (len > (int)size - 64) {
+            httpd_resp_send_chunk(req, json, len);
+            len = 0;
+        }
+        len += snprintf(json + len, size - len, ",\"%s\":[", columns[c]);
+        for (int i = 0; i < n; i++) {
+            const thrust_point_t *p = &r->points[i];
+            if (len > (int)size - 32) {
+                httpd_resp_send_chunk(req, json, len);
+                len = 0;
+            }
+            const long values[] = {
+                p->throttle, (long)p->thrust_mg, (long)p->thrust_sd_mg, (long)p->rpm, (long)p->bus_mv,
+                (long)p->current_ma, (long)p->power_mw, (long)p->mg_per_w, p->thrust_samples, p->power_samples
+            };
+            len += snprintf(json + len, size - len, "%s%ld", i ? "," : "", values[c]);
+        }
+        len += snprintf(json + len, size - len, "]");
+    }
+    if (len > (int)size - 64) {
+        httpd_resp_send_chunk(req, json, len);
+        len = 0;
+    }
+    len += snprintf(json + len, size - len, ",\"esc_rpm\":[");
+    for (int i = 0; i < n; i++) {
+        if (len > (int)size - 32) {
+            httpd_resp_send_chunk(req, json, len);
+            len = 0;
+        }
+        len += snprintf(json + len, size - len, "%s%s", i ? "," : "", r->points[i].esc_rpm ? "true" : "false");
+    }
+    len += snprintf(json + len, size - len, "]}");
+    httpd_resp_send_chunk(req, json, len);
+    httpd_resp_send_chunk(req, NULL, 0);
+    mem_free(json);
+    mem_free(r);
     return ESP_OK;
 }
 
-// HTTP POST handler for battery reset
-static esp_err_t battery_reset_handler(httpd_req_t *req)
+// HTTP POST handler to start a thrust sweep
+// (JSON: {"motor":0,"from":100,"to":1000,"step":100,"settle_ms":1500,"measure_ms":2000})
+static esp_err_t thrust_start_handler(httpd_req_t *req)
 {
-    battery_voltage = 12.6 + (rand() % 10) * 0.1;
-    ESP_LOGI(TAG, "Battery reset! Voltage: %.1fV", battery_voltage);
+    char buf[192];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+    
+    thrust_config_t cfg = THRUST_DEFAULT_CONFIG;
+    int8_t motor;
+    if (!json_get_motor(buf, &motor)) {   // Without one, the motor on the stand
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid motor");
+        return ESP_OK;
+    }
+    cfg.motor = motor;
+    const char *v;
+    if ((v = json_find_value(buf, "from"))) cfg.from_throttle = atoi(v);
+    if ((v = json_find_value(buf, "to"))) cfg.to_throttle = atoi(v);
+    if ((v = json_find_value(buf, "step"))) cfg.step_throttle = atoi(v);
+    if ((v = json_find_value(buf, "settle_ms"))) cfg.settle_ms = atoi(v);
+    if ((v = json_find_value(buf, "measure_ms"))) cfg.measure_ms = atoi(v);
+    
+    esp_err_t err = thrust_test_start(&cfg);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
     
     httpd_resp_send(req, "OK", 2);
     return ESP_OK;
 }
 
-// HTTP POST handler for motor start (default 50% speed)
-static esp_err_t motor_start_handler(httpd_req_t *req)
+// HTTP POST handler to abort a thrust sweep
+static esp_err_t thrust_stop_handler(httpd_req_t *req)
 {
-    motor_speed_percent = 50;
-    motor_rpm = (motor_speed_percent * 4000) / 100;
-    
-    uint32_t duty = speed_to_pwm(motor_speed_percent);
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL, duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL);
-    
-    ESP_LOGI(TAG, "Motor started: %d%% (%d RPM, PWM: %lu)", motor_speed_percent, motor_rpm, duty);
+    esp_err_t err = thrust_test_stop();
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No sweep running");
+        return ESP_OK;
+    }
     
     httpd_resp_send(req, "OK", 2);
     return ESP_OK;
 }
 
-// HTTP POST handler for motor stop
-static esp_err_t motor_stop_handler(httpd_req_t *req)
+// Vibration summary as JSON, shared by /api/vibration and the spectrum stream
+// Returns the length written, or -1 if the result does not fit
+static int vibration_result_json(char *buf, size_t size, const vibration_result_t *r)
 {
-    motor_speed_percent = 0;
-    motor_rpm = 0;
-    
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL, 0);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL);
-    
-    ESP_LOGI(TAG, "Motor stopped");
+    int len = snprintf(buf, size,
+        "{\"seq\":%lu,\"t_us\":%lld,\"rpm\":%ld,\"rpm_measured\":%s,\"rate_hz\":%lu,\"fft_size\":%u,\"bin_mhz\":%lu,"
+        "\"rotor_mhz\":%lu,\"amp_1x_ug\":%lu,\"amp_2x_ug\":%lu,\"amp_bpf_ug\":%lu,\"peaks\":[",
+        r->seq, r->time_us, r->rpm, r->rpm_measured ? "true" : "false", r->rate_hz, r->fft_size,
+        vib_dsp_bin_mhz(1, r->fft_size, r->rate_hz), r->orders.rotor_mhz, vibration_amp_ug(r->orders.amp_1x_q4),
+        vibration_amp_ug(r->orders.amp_2x_q4), vibration_amp_ug(r->orders.amp_bpf_q4));
+    for (int i = 0; i < r->peak_count && len <= (int)size - 3; i++) {
+        len += snprintf(buf + len, size - len,
+            "%s{\"freq_mhz\":%lu,\"amp_ug\":%lu,\"order_x100\":%u,\"harmonic\":%s}",
+            i ? "," : "", r->peaks[i].freq_mhz, vibration_amp_ug(r->peaks[i].amp_q4),
+            r->peaks[i].order_x100, r->peaks[i].harmonic ? "true" : "false");
+    }
+    if (len > (int)size - 3) {   // Room left for "]}"
+        return -1;
+    }
+    len += snprintf(buf + len, size - len, "]}");
+    return len;
+}
+
+static const char *vibration_axes_name(uint8_t axes, char *out)
+{
+    int n = 0;
+    if (axes & 0x1) out[n++] = 'x';
+    if (axes & 0x2) out[n++] = 'y';
+    if (axes & 0x4) out[n++] = 'z';
+    out[n] = '\0';
+    return out;
+}
+
+// HTTP GET handler for vibration settings, sampler health and the latest peaks
+static esp_err_t vibration_get_handler(httpd_req_t *req)
+{
+    vibration_config_t cfg;
+    vibration_get_config(&cfg);
+    vibration_stats_t st;
+    vibration_get_stats(&st);
+    vibration_result_t r;
+    bool valid = vibration_get_result(&r);
+    char axes[4];
+    
+    char json[1536];
+    int len = snprintf(json, sizeof(json),
+        "{\"enabled\":%s,\"sensor\":%s,\"rate_hz\":%lu,\"fft_size\":%u,\"axes\":\"%s\",\"motor\":%u,\"blades\":%u,"
+        "\"stats\":{\"samples\":%lu,\"fifo_overflows\":%lu,\"bus_errors\":%lu,\"frames\":%lu,"
+        "\"dsp_us\":{\"last\":%lu,\"max\":%lu,\"avg\":%lu}},\"result\":",
+        cfg.enabled ? "true" : "false", st.sensor_present ? "true" : "false", cfg.rate_hz, cfg.fft_size,
+        vibration_axes_name(cfg.axes, axes), cfg.motor, cfg.blades, st.samples, st.fifo_overflows,
+        st.bus_errors, st.frames, st.last_dsp_us, st.max_dsp_us, st.avg_dsp_us);
+    int result_len = -1;
+    if (len < (int)sizeof(json)) {
+        result_len = valid ? vibration_result_json(json + len, sizeof(json) - len, &r)
+                           : snprintf(json + len, sizeof(json) - len, "null");
+    }
+    if (result_len < 0 || len + result_len > (int)sizeof(json) - 2) {   // Room left for "}"
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+        return ESP_FAIL;
+    }
+    snprintf(json + len + result_len, sizeof(json) - len - result_len, "}");
     
-    httpd_resp_send(req, "OK", 2);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
     return ESP_OK;
 }
 
-// HTTP POST handler for motor speed control (JSON: {"speed": 0-100})
-static esp_err_t motor_speed_handler(httpd_req_t *req)
+// HTTP POST handler for vibration settings
+// (JSON: {"enabled":true,"rate_hz":4000,"fft_size":1024,"axes":"xyz","motor":0,"blades":2})
+static esp_err_t vibration_post_handler(httpd_req_t *req)
 {
-    char buf[100];
+    char buf[160];
     int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
     if (ret <= 0) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
@@ -200,66 +1219,346 @@ static esp_err_t motor_speed_handler(httpd_req_t *req)
     }
     buf[ret] = '\0';
     
-    // Parse JSON: {"speed":75}
-    char *speed_str = strstr(buf, "\"speed\":");
-    if (speed_str) {
-        speed_str += 8;  // Skip '"speed":'
-        motor_speed_percent = atoi(speed_str);
-        
-        if (motor_speed_percent < 0) motor_speed_percent = 0;
-        if (motor_speed_percent > 100) motor_speed_percent = 100;
-        
-        motor_rpm = (motor_speed_percent * 4000) / 100;
-        
-        uint32_t duty = speed_to_pwm(motor_speed_percent);
-        ledc_set_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL, duty);
-        ledc_update_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL);
-        
-        ESP_LOGI(TAG, "Motor speed set: %d%% (%d RPM, PWM: %lu)", motor_speed_percent, motor_rpm, duty);
-        
-        httpd_resp_send(req, "OK", 2);
+    vibration_config_t cfg;
+    vibration_get_config(&cfg);
+    const char *str;
+    if (json_find_value(buf, "enabled")) cfg.enabled = json_get_bool(buf, "enabled");
+    if ((str = json_find_value(buf, "rate_hz"))) cfg.rate_hz = (uint32_t)atoi(str);
+    if ((str = json_find_value(buf, "fft_size"))) cfg.fft_size = (uint16_t)atoi(str);
+    if ((str = json_find_value(buf, "blades"))) cfg.blades = (uint8_t)atoi(str);
+    if (json_find_value(buf, "motor")) {
+        int8_t motor;
+        if (!json_get_motor(buf, &motor) || motor == MOTOR_ALL) {   // Orders refer to one motor
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid motor");
+            return ESP_OK;
+        }
+        cfg.motor = (uint8_t)motor;
+    }
+    char axes[8];
+    if (json_get_string(buf, "axes", axes, sizeof(axes))) {
+        cfg.axes = (strchr(axes, 'x') ? 0x1 : 0) | (strchr(axes, 'y') ? 0x2 : 0) | (strchr(axes, 'z') ? 0x4 : 0);
+    }
+    
+    esp_err_t err = vibration_configure(&cfg);
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No IMU detected");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid vibration settings");
         return ESP_OK;
     }
+    ESP_LOGI(TAG, "Vibration %s: %lu Hz, %u-point FFT", cfg.enabled ? "on" : "off", cfg.rate_hz, cfg.fft_size);
     
-    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+    httpd_resp_send(req, "OK", 2);
     return ESP_OK;
 }
 
-// HTTP POST handler for protocol change (JSON: {"protocol": "standard"|"oneshot125"|"oneshot42"|"multishot"})
-static esp_err_t motor_protocol_handler(httpd_req_t *req)
+// HTTP GET handler recording raw accelerometer samples as CSV for host/vibration_bench.cpp
+// (/api/vibration/capture?samples=4096)
+static esp_err_t vibration_capture_handler(httpd_req_t *req)
 {
-    char buf[100];
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        return ESP_FAIL;
+    int count = 4096;
+    char query[32];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "samples", value, sizeof(value)) == ESP_OK) {
+        count = atoi(value);
+    }
+    vibration_config_t cfg;
+    vibration_get_config(&cfg);
+    if (!cfg.enabled) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Vibration sampling is off");
+        return ESP_OK;
+    }
+    if (count <= 0 || count > VIB_CAPTURE_MAX) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid sample count");
+        return ESP_OK;
     }
-    buf[ret] = '\0';
     
-    // Parse protocol from JSON
-    esc_protocol_t new_protocol = PROTOCOL_STANDARD;
-    if (strstr(buf, "oneshot125")) {
-        new_protocol = PROTOCOL_ONESHOT125;
-    } else if (strstr(buf, "oneshot42")) {
-        new_protocol = PROTOCOL_ONESHOT42;
-    } else if (strstr(buf, "multishot")) {
-        new_protocol = PROTOCOL_MULTISHOT;
-    } else if (strstr(buf, "standard")) {
-        new_protocol = PROTOCOL_STANDARD;
+    static_assert(sizeof(vib_sample_t) * VIB_CAPTURE_MAX <= MEM_BULK_BLOCK, "capture outgrew the bulk block");
+    vib_sample_t *samples = (vib_sample_t *)mem_alloc(sizeof(vib_sample_t) * count);
+    if (samples == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
+    motor_rpm_status_t st;
+    motor_get_rpm_status(cfg.motor, &st);
+    int recorded = vibration_capture(samples, count, count * 1000 / cfg.rate_hz + 1000);
+    
+    httpd_resp_set_type(req, "text/csv");
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "# rate_hz=%lu lsb_per_g=%d rpm=%ld rpm_source=%s\n", cfg.rate_hz,
+                       IMU_LSB_PER_G, st.measured ? st.measured_rpm : 0L, st.measured ? "measured" : "none");
+    for (int i = 0; i < recorded; i++) {
+        if (len > (int)sizeof(buf) - 24) {
+            httpd_resp_send_chunk(req, buf, len);
+            len = 0;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "%d,%d,%d\n", samples[i].x, samples[i].y, samples[i].z);
+    }
+    httpd_resp_send_chunk(req, buf, len);
+    httpd_resp_send_chunk(req, NULL, 0);
+    mem_free(samples);
+    return ESP_OK;
+}
+
+// Spectrum stream over WebSocket. The vibration task only queues work on the
+// httpd task; frames are built and sent there, at most one in flight.
+#define VIB_WS_MAX_CLIENTS  4
+#define VIB_WS_INTERVAL_US  (250 * 1000)
+#define VIB_WS_FRAME_SIZE   (1536 + (VIB_FFT_MAX / 2) * 9)    // Result, then up to 8 digits (16 g full scale) and a comma per bin
+
+static httpd_handle_t ws_server = NULL;
+static int ws_fds[VIB_WS_MAX_CLIENTS] = { -1, -1, -1, -1 };
+static portMUX_TYPE ws_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool ws_send_pending = false;
+static int64_t ws_last_send_us = 0;
+
+static void ws_remove_client(int fd)
+{
+    portENTER_CRITICAL(&ws_lock);
+    for (int i = 0; i < VIB_WS_MAX_CLIENTS; i++) {
+        if (ws_fds[i] == fd) ws_fds[i] = -1;
+    }
+    portEXIT_CRITICAL(&ws_lock);
+}
+
+static void vibration_ws_push(void *arg)
+{
+    static_assert(VIB_WS_FRAME_SIZE <= MEM_MEDIUM_BLOCK, "spectrum frame outgrew its block");
+    char *frame = (char *)mem_alloc(VIB_WS_FRAME_SIZE);
+    uint32_t *amp = (uint32_t *)mem_alloc(sizeof(uint32_t) * VIB_FFT_MAX / 2);
+    if (frame && amp) {
+        vibration_result_t r;
+        int bins = vibration_get_spectrum(amp, VIB_FFT_MAX / 2, &r);
+        int len = vibration_result_json(frame, VIB_WS_FRAME_SIZE, &r);
+        if (len > 0) {
+            len--;   // Reopen the object for the spectrum
+            len += snprintf(frame + len, VIB_WS_FRAME_SIZE - len, ",\"amp_ug\":[");
+            for (int k = 0; k < bins && len <= VIB_WS_FRAME_SIZE - 3; k++) {
+                len += snprintf(frame + len, VIB_WS_FRAME_SIZE - len, "%s%lu", k ? "," : "", vibration_amp_ug(amp[k]));
+            }
+        }
+        if (len < 0 || len > VIB_WS_FRAME_SIZE - 3) {
+            len = 0;   // Sized for the largest frame, so this is a bug; drop the frame
+        } else {
+            len += snprintf(frame + len, VIB_WS_FRAME_SIZE - len, "]}");
+        }
+        
+        httpd_ws_frame_t ws_frame = {};
+        ws_frame.type = HTTPD_WS_TYPE_TEXT;
+        ws_frame.payload = (uint8_t *)frame;
+        ws_frame.len = len;
+        for (int i = 0; i < VIB_WS_MAX_CLIENTS; i++) {
+            int fd = ws_fds[i];
+            if (fd < 0) continue;
+            if (httpd_ws_get_fd_info(ws_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+                httpd_ws_send_frame_async(ws_server, fd, &ws_frame) != ESP_OK) {
+                ws_remove_client(fd);
+            }
+        }
+    }
+    mem_free(amp);
+    mem_free(frame);
+    portENTER_CRITICAL(&ws_lock);
+    ws_send_pending = false;
+    portEXIT_CRITICAL(&ws_lock);
+}
+
+// Runs on the vibration task after every spectrum
+static void vibration_frame_ready(uint32_t seq)
+{
+    int64_t now = esp_timer_get_time();
+    bool send = false;
+    portENTER_CRITICAL(&ws_lock);
+    for (int i = 0; i < VIB_WS_MAX_CLIENTS; i++) {
+        send |= ws_fds[i] >= 0;
+    }
+    send = send && !ws_send_pending && now - ws_last_send_us >= VIB_WS_INTERVAL_US;
+    if (send) {
+        ws_send_pending = true;
+        ws_last_send_us = now;
+    }
+    portEXIT_CRITICAL(&ws_lock);
+    
+    if (send && httpd_queue_work(ws_server, vibration_ws_push, NULL) != ESP_OK) {
+        portENTER_CRITICAL(&ws_lock);
+        ws_send_pending = false;
+        portEXIT_CRITICAL(&ws_lock);
+    }
+}
+
+// WebSocket handler for /ws/vibration: the handshake subscribes, a close frame unsubscribes
+static esp_err_t vibration_ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+    if (req->method == HTTP_GET) {
+        bool added = false;
+        portENTER_CRITICAL(&ws_lock);
+        for (int i = 0; i < VIB_WS_MAX_CLIENTS && !added; i++) {
+            if (ws_fds[i] < 0 || ws_fds[i] == fd) {
+                ws_fds[i] = fd;
+                added = true;
+            }
+        }
+        portEXIT_CRITICAL(&ws_lock);
+        if (!added) {
+            ESP_LOGW(TAG, "Spectrum stream full, refusing client");
+            return ESP_FAIL;
+        }
+        return ESP_OK;
+    }
+    
+    // Clients are not expected to send anything but control frames
+    uint8_t payload[32];
+    httpd_ws_frame_t frame = {};
+    frame.payload = payload;
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, sizeof(payload));
+    if (err != ESP_OK || frame.type == HTTPD_WS_TYPE_CLOSE) {
+        ws_remove_client(fd);
+    }
+    return err;
+}
+
+#define BATCH_MAX_BODY 12288
+#define BATCH_TASK_STACK 3072
+#define BATCH_TASK_PRIORITY 5   // As httpd, whose work it takes over
+
+// A batch with waits runs for up to 10 s. It is carried out on its own task
+// with a copy of the request, so the server keeps answering, /api/motor/stop
+// included; a stop during a wait ends the batch.
+static TaskHandle_t batch_worker = NULL;
+MEM_TASK_STORAGE(batch_task, BATCH_TASK_STACK);
+static httpd_req_t *volatile batch_req = NULL;   // Set while a batch runs, owned by the batch task
+static motor_cmd_t *batch_cmds = NULL;
+static size_t batch_count = 0;
+
+static void send_batch_result(httpd_req_t *req, size_t count, const motor_batch_result_t *result)
+{
+    char json[224];
+    snprintf(json, sizeof(json),
+        "{\"ok\":%s,\"count\":%u,\"executed\":%u,\"failed_index\":%d,\"aborted\":%s,\"error\":\"%s\","
+        "\"elapsed_us\":%lu,\"apply_us\":%lu}",
+        result->err == ESP_OK ? "true" : "false",
+        (unsigned)count, result->executed, result->failed_index, result->aborted ? "true" : "false",
+        esp_err_to_name(result->err), result->elapsed_us, result->apply_us);
+    
+    if (result->aborted) {
+        BLOGW("Batch stopped in the wait at command %d", result->failed_index);
+        httpd_resp_set_status(req, "409 Conflict");
+    } else if (result->err == ESP_ERR_INVALID_STATE) {
+        BLOGW("Batch refused at command %d", result->failed_index);
+        httpd_resp_set_status(req, "409 Conflict");
+    } else if (result->err != ESP_OK) {
+        BLOGW("Batch rejected at command %d: %s", result->failed_index, esp_err_to_name(result->err));
+        httpd_resp_set_status(req, "400 Bad Request");
     } else {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown protocol");
+        BLOGI("Batch of %u commands applied in %lu us", (unsigned)count, result->apply_us);
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+}
+
+// Created on the first batch and parked between batches, so its stack can be static
+static void batch_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        motor_batch_result_t result = {};
+        motor_run_batch(batch_cmds, batch_count, &result);
+        send_batch_result(batch_req, batch_count, &result);
+        mem_free(batch_cmds);
+        httpd_req_t *req = batch_req;
+        batch_req = NULL;
+        httpd_req_async_handler_complete(req);
+    }
+}
+
+// HTTP POST handler for batched motor commands
+// (JSON: {"commands":[{"cmd":"speed","motor":0,"speed":40},{"cmd":"wait","ms":200},...]})
+static esp_err_t batch_handler(httpd_req_t *req)
+{
+    if (req->content_len == 0 || req->content_len > BATCH_MAX_BODY) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Batch body missing or too large");
         return ESP_FAIL;
     }
+    if (batch_req != NULL) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "Batch already running");
+        return ESP_OK;
+    }
     
-    configure_protocol(new_protocol);
+    static_assert(BATCH_MAX_BODY + 1 <= MEM_LARGE_BLOCK, "batch body outgrew the large block");
+    static_assert(sizeof(motor_cmd_t) * MOTOR_BATCH_MAX_COMMANDS <= MEM_SMALL_BLOCK,
+                  "batch commands outgrew their block");
+    char *body = (char *)mem_alloc(req->content_len + 1);
+    motor_cmd_t *cmds = (motor_cmd_t *)mem_alloc(sizeof(motor_cmd_t) * MOTOR_BATCH_MAX_COMMANDS);
+    if (body == NULL || cmds == NULL) {
+        mem_free(body);
+        mem_free(cmds);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
     
-    // Reset motor to off when changing protocol
-    motor_speed_percent = 0;
-    motor_rpm = 0;
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL, 0);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, MOTOR_PWM_CHANNEL);
+    int received = 0;
+    while (received < (int)req->content_len) {
+        int ret = httpd_req_recv(req, body + received, req->content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            mem_free(body);
+            mem_free(cmds);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    body[received] = '\0';
+    
+    // Walk the command array object by object (entries are flat, no nesting)
+    size_t count = 0;
+    int parse_error = -1;
+    char *p = strchr(body, '[');
+    while (p && (p = strchr(p, '{')) != NULL) {
+        char *end = strchr(p, '}');
+        if (end == NULL || count >= MOTOR_BATCH_MAX_COMMANDS) {
+            parse_error = count;
+            break;
+        }
+        *end = '\0';
+        if (!json_parse_motor_command(p + 1, &cmds[count])) {
+            parse_error = count;
+            break;
+        }
+        count++;
+        p = end + 1;
+    }
+    mem_free(body);
+    
+    if (parse_error >= 0) {
+        mem_free(cmds);
+        motor_batch_result_t result = {};
+        result.failed_index = parse_error;
+        result.err = ESP_ERR_INVALID_ARG;
+        send_batch_result(req, count, &result);
+        return ESP_OK;
+    }
     
-    httpd_resp_send(req, "OK", 2);
+    httpd_req_t *async = NULL;
+    if ((batch_worker == NULL &&
+         MEM_TASK_CREATE(batch_task, "batch", NULL, BATCH_TASK_PRIORITY, &batch_worker) != pdPASS) ||
+        httpd_req_async_handler_begin(req, &async) != ESP_OK) {
+        mem_free(cmds);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start batch");
+        return ESP_FAIL;
+    }
+    batch_cmds = cmds;
+    batch_count = count;
+    batch_req = async;
+    xTaskNotifyGive(batch_worker);
     return ESP_OK;
 }
 
@@ -268,21 +1567,16 @@ static esp_err_t wifi_clear_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Clearing WiFi credentials from NVS");
     
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("wifi", NVS_READWRITE, &nvs_handle);
+    settings_clear_wifi();
+    esp_err_t err = settings_flush();
     if (err == ESP_OK) {
-        nvs_erase_key(nvs_handle, "ssid");
-        nvs_erase_key(nvs_handle, "password");
-        nvs_commit(nvs_handle);
-        nvs_close(nvs_handle);
-        
         // Switch back to AP-only mode
-        esp_wifi_set_mode(WIFI_MODE_AP);
+        wifi_station_forget();
         
         ESP_LOGI(TAG, "WiFi credentials cleared, switched to AP mode");
         httpd_resp_sendstr(req, "WiFi credentials cleared! Device in AP-only mode.");
     } else {
-        ESP_LOGE(TAG, "Failed to open NVS");
+        ESP_LOGE(TAG, "Failed to write settings");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to clear credentials");
         return ESP_FAIL;
     }
@@ -291,9 +1585,10 @@ static esp_err_t wifi_clear_handler(httpd_req_t *req)
 }
 
 // HTTP POST handler for OTA update
+#define OTA_CHUNK 1024
+
 static esp_err_t ota_update_handler(httpd_req_t *req)
 {
-    char buf[1024];
     esp_ota_handle_t ota_handle;
     const esp_partition_t *update_partition = NULL;
     const esp_partition_t *configured = esp_ota_get_boot_partition();
@@ -323,15 +1618,24 @@ static esp_err_t ota_update_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
     
+    // From a pool block rather than the httpd stack
+    static_assert(OTA_CHUNK <= MEM_SMALL_BLOCK, "OTA chunk outgrew its pool block");
+    char *buf = (char *)mem_alloc(OTA_CHUNK);
+    if (buf == NULL) {
+        esp_ota_abort(ota_handle);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
     int remaining = req->content_len;
     int received = 0;
     
     while (remaining > 0) {
-        int recv_len = httpd_req_recv(req, buf, sizeof(buf) < remaining ? sizeof(buf) : remaining);
+        int recv_len = httpd_req_recv(req, buf, OTA_CHUNK < remaining ? OTA_CHUNK : remaining);
         if (recv_len <= 0) {
             if (recv_len == HTTPD_SOCK_ERR_TIMEOUT) {
                 continue;
             }
+            mem_free(buf);
             esp_ota_abort(ota_handle);
             httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive firmware");
             return ESP_FAIL;
@@ -339,6 +1643,7 @@ static esp_err_t ota_update_handler(httpd_req_t *req)
         
         err = esp_ota_write(ota_handle, buf, recv_len);
         if (err != ESP_OK) {
+            mem_free(buf);
             esp_ota_abort(ota_handle);
             ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
             httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA write failed");
@@ -352,39 +1657,176 @@ static esp_err_t ota_update_handler(httpd_req_t *req)
             ESP_LOGI(TAG, "Written %d / %d bytes", received, req->content_len);
         }
     }
+    mem_free(buf);
     
     ESP_LOGI(TAG, "Total written: %d bytes", received);
     
     err = esp_ota_end(ota_handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA end failed");
+        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA end failed");
+        return ESP_FAIL;
+    }
+    
+    err = esp_ota_set_boot_partition(update_partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Set boot partition failed");
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGI(TAG, "OTA update successful! Rebooting in 3 seconds...");
+    httpd_resp_sendstr(req, "Update successful! Device rebooting...");
+    
+    settings_flush();
+    vTaskDelay(3000 / portTICK_PERIOD_MS);
+    esp_restart();
+    
+    return ESP_OK;
+}
+
+static int firmware_image_json(char *buf, size_t size, fw_image_slot_t slot)
+{
+    fw_image_info_t info;
+    if (fw_share_get_image(slot, &info) != ESP_OK) {
+        return snprintf(buf, size, "null");
+    }
+    char hex[65];
+    fw_share_hex(info.sha256, hex);
+    return snprintf(buf, size, "{\"version\":\"%s\",\"project\":\"%s\",\"size\":%lu,\"sha256\":\"%s\"}",
+                    info.version, info.project, info.size, hex);
+}
+
+// HTTP GET handler for the images this bench holds and its last pull
+static esp_err_t firmware_handler(httpd_req_t *req)
+{
+    fw_share_status_t st;
+    fw_share_get_status(&st);
+
+    char json[640];
+    int len = snprintf(json, sizeof(json), "{\"running\":");
+    len += firmware_image_json(json + len, sizeof(json) - len, FW_IMAGE_RUNNING);
+    len += snprintf(json + len, sizeof(json) - len, ",\"staged\":");
+    len += firmware_image_json(json + len, sizeof(json) - len, FW_IMAGE_STAGED);
+    snprintf(json + len, sizeof(json) - len,
+             ",\"served\":%lu,\"serve_aborts\":%lu,\"pull\":{\"state\":\"%s\",\"peer\":\"%s\","
+             "\"bytes\":%lu,\"total\":%lu,\"elapsed_ms\":%lu,\"error\":\"%s\",\"pulls\":%lu}}",
+             st.served, st.serve_aborts, fw_pull_state_name(st.state), st.peer,
+             st.bytes, st.total, st.elapsed_ms, st.error, st.pulls);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, strlen(json));
+    return ESP_OK;
+}
+
+static esp_err_t firmware_send_chunk(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// HTTP GET handler streaming an image to a peer: the running one, or any held
+// image by hash (/api/firmware/image?sha256=<hex>). 304 if the peer lists its
+// hash in If-None-Match.
+static esp_err_t firmware_image_handler(httpd_req_t *req)
+{
+    uint8_t want[32];
+    bool by_hash = false;
+    char query[96];
+    char value[72];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "sha256", value, sizeof(value)) == ESP_OK) {
+        if (!fw_share_parse_hex(value, want)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid sha256");
+            return ESP_OK;
+        }
+        by_hash = true;
+    }
+
+    fw_image_slot_t slot;
+    fw_image_info_t info;
+    if (fw_share_find(by_hash ? want : NULL, &slot, &info) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such image");
+        return ESP_OK;
+    }
+
+    char hex[65], etag[68], size[12];
+    fw_share_hex(info.sha256, hex);
+    snprintf(etag, sizeof(etag), "\"%s\"", hex);
+    snprintf(size, sizeof(size), "%lu", info.size);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "X-Firmware-Version", info.version);
+    httpd_resp_set_hdr(req, "X-Firmware-Project", info.project);
+    httpd_resp_set_hdr(req, "X-Firmware-Size", size);
+
+    // Two quoted hashes and a separator, what a pulling bench sends
+    char if_none[144];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none, sizeof(if_none)) == ESP_OK &&
+        strstr(if_none, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    // The flash reads stall the control task like a pull's writes, and nothing
+    // else is served meanwhile; only stream with every output stopped
+    if (motor_hold_idle(true) != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "Outputs running");
+        return ESP_OK;
+    }
+    ESP_LOGI(TAG, "Serving %s image %s (%lu bytes)", slot == FW_IMAGE_RUNNING ? "running" : "staged",
+             info.version, info.size);
+    httpd_resp_set_type(req, "application/octet-stream");
+    esp_err_t err = fw_share_stream(slot, &info, firmware_send_chunk, req);
+    motor_hold_idle(false);
+    if (err != ESP_OK) {
+        // Headers are out; dropping the connection is all that is left
+        ESP_LOGW(TAG, "Image stream ended early: %s", esp_err_to_name(err));
         return ESP_FAIL;
     }
-    
-    err = esp_ota_set_boot_partition(update_partition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Set boot partition failed");
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+// HTTP POST handler pulling an image from a peer bench
+// (JSON: {"peer":"10.0.0.21","sha256":"<hex>","reboot":false}; without sha256 whatever the peer runs)
+static esp_err_t firmware_pull_handler(httpd_req_t *req)
+{
+    char buf[224];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
         return ESP_FAIL;
     }
-    
-    ESP_LOGI(TAG, "OTA update successful! Rebooting in 3 seconds...");
-    httpd_resp_sendstr(req, "Update successful! Device rebooting...");
-    
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    esp_restart();
-    
+    buf[ret] = '\0';
+
+    char peer[64];
+    char hex[72];
+    uint8_t sha[32];
+    bool by_hash = json_get_string(buf, "sha256", hex, sizeof(hex));
+    if (!json_get_string(buf, "peer", peer, sizeof(peer)) || (by_hash && !fw_share_parse_hex(hex, sha))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected peer and optional sha256");
+        return ESP_OK;
+    }
+    esp_err_t err = fw_share_pull(peer, by_hash ? sha : NULL, json_get_bool(buf, "reboot"));
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"state\":\"running\"}");
     return ESP_OK;
 }
 
+#define WIFI_SCAN_MAX_RESULTS 20
+
 // HTTP GET handler for WiFi scan
 static esp_err_t wifi_scan_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Starting WiFi scan...");
     
-    // Disconnect STA if it's trying to connect (this blocks scanning)
-    esp_wifi_disconnect();
+    // Pause connect attempts, they block scanning
+    wifi_station_suspend();
     vTaskDelay(200 / portTICK_PERIOD_MS);
     
     // Clear any previous scan results
@@ -406,6 +1848,7 @@ static esp_err_t wifi_scan_handler(httpd_req_t *req)
     };
     
     esp_err_t err = esp_wifi_scan_start(&scan_config, true);
+    wifi_station_resume();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "WiFi scan failed to start: %s", esp_err_to_name(err));
         httpd_resp_sendstr(req, "[]");
@@ -422,7 +1865,12 @@ static esp_err_t wifi_scan_handler(httpd_req_t *req)
         return ESP_OK;
     }
     
-    wifi_ap_record_t *ap_records = (wifi_ap_record_t *)malloc(sizeof(wifi_ap_record_t) * ap_count);
+    // Only the first WIFI_SCAN_MAX_RESULTS are reported; the driver drops the rest with the scan
+    static_assert(sizeof(wifi_ap_record_t) * WIFI_SCAN_MAX_RESULTS <= MEM_SMALL_BLOCK,
+                  "scan records outgrew their block");
+    uint16_t found = ap_count;
+    if (ap_count > WIFI_SCAN_MAX_RESULTS) ap_count = WIFI_SCAN_MAX_RESULTS;
+    wifi_ap_record_t *ap_records = (wifi_ap_record_t *)mem_alloc(sizeof(wifi_ap_record_t) * ap_count);
     if (ap_records == NULL) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
@@ -431,15 +1879,15 @@ static esp_err_t wifi_scan_handler(httpd_req_t *req)
     esp_wifi_scan_get_ap_records(&ap_count, ap_records);
     
     // Build JSON response
-    char *json = (char *)malloc(4096);
+    char *json = (char *)mem_alloc(4096);
     if (json == NULL) {
-        free(ap_records);
+        mem_free(ap_records);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
     
     int offset = sprintf(json, "[");
-    for (int i = 0; i < ap_count && i < 20; i++) {
+    for (int i = 0; i < ap_count; i++) {
         offset += sprintf(json + offset, "%s{\"ssid\":\"%s\",\"rssi\":%d}",
                          i > 0 ? "," : "",
                          ap_records[i].ssid,
@@ -450,103 +1898,13 @@ static esp_err_t wifi_scan_handler(httpd_req_t *req)
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, json, offset);
     
-    free(json);
-    free(ap_records);
+    mem_free(json);
+    mem_free(ap_records);
     
-    ESP_LOGI(TAG, "WiFi scan complete: %d networks found", ap_count);
+    ESP_LOGI(TAG, "WiFi scan complete: %d networks found", found);
     return ESP_OK;
 }
 
-// Event handler for WiFi station events
-static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                               int32_t event_id, void* event_data)
-{
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-        ESP_LOGI(TAG, "Station started, connecting...");
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        wifi_connected = false;
-        wifi_ip_address[0] = '\0';
-        wifi_event_sta_disconnected_t* disconn = (wifi_event_sta_disconnected_t*) event_data;
-        const char* reason_str = "Unknown";
-        
-        // Decode disconnection reason
-        switch(disconn->reason) {
-            case WIFI_REASON_UNSPECIFIED: reason_str = "Unspecified"; break;
-            case WIFI_REASON_AUTH_EXPIRE: reason_str = "Auth expired"; break;
-            case WIFI_REASON_AUTH_LEAVE: reason_str = "Auth leave"; break;
-            case WIFI_REASON_ASSOC_EXPIRE: reason_str = "Assoc expired"; break;
-            case WIFI_REASON_ASSOC_TOOMANY: reason_str = "Too many assoc"; break;
-            case WIFI_REASON_NOT_AUTHED: reason_str = "Not authenticated"; break;
-            case WIFI_REASON_NOT_ASSOCED: reason_str = "Not associated"; break;
-            case WIFI_REASON_ASSOC_LEAVE: reason_str = "Assoc leave"; break;
-            case WIFI_REASON_ASSOC_NOT_AUTHED: reason_str = "Assoc not authed"; break;
-            case WIFI_REASON_DISASSOC_PWRCAP_BAD: reason_str = "Bad power cap"; break;
-            case WIFI_REASON_DISASSOC_SUPCHAN_BAD: reason_str = "Bad sup channel"; break;
-            case WIFI_REASON_BSS_TRANSITION_DISASSOC: reason_str = "BSS transition"; break;
-            case WIFI_REASON_IE_INVALID: reason_str = "Invalid IE"; break;
-            case WIFI_REASON_MIC_FAILURE: reason_str = "MIC failure"; break;
-            case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT: reason_str = "4-way handshake timeout"; break;
-            case WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT: reason_str = "Group key timeout"; break;
-            case WIFI_REASON_IE_IN_4WAY_DIFFERS: reason_str = "IE differs in 4-way"; break;
-            case WIFI_REASON_GROUP_CIPHER_INVALID: reason_str = "Invalid group cipher"; break;
-            case WIFI_REASON_PAIRWISE_CIPHER_INVALID: reason_str = "Invalid pairwise cipher"; break;
-            case WIFI_REASON_AKMP_INVALID: reason_str = "Invalid AKMP"; break;
-            case WIFI_REASON_UNSUPP_RSN_IE_VERSION: reason_str = "Unsupported RSN IE version"; break;
-            case WIFI_REASON_INVALID_RSN_IE_CAP: reason_str = "Invalid RSN IE cap"; break;
-            case WIFI_REASON_802_1X_AUTH_FAILED: reason_str = "802.1X auth failed"; break;
-            case WIFI_REASON_CIPHER_SUITE_REJECTED: reason_str = "Cipher suite rejected"; break;
-            case WIFI_REASON_INVALID_PMKID: reason_str = "Invalid PMKID"; break;
-            case WIFI_REASON_BEACON_TIMEOUT: reason_str = "Beacon timeout"; break;
-            case WIFI_REASON_NO_AP_FOUND: reason_str = "No AP found"; break;
-            case WIFI_REASON_AUTH_FAIL: reason_str = "Authentication failed (wrong password?)"; break;
-            case WIFI_REASON_ASSOC_FAIL: reason_str = "Association failed"; break;
-            case WIFI_REASON_HANDSHAKE_TIMEOUT: reason_str = "Handshake timeout"; break;
-            case WIFI_REASON_CONNECTION_FAIL: reason_str = "Connection failed"; break;
-            case WIFI_REASON_AP_TSF_RESET: reason_str = "AP TSF reset"; break;
-            case WIFI_REASON_ROAMING: reason_str = "Roaming"; break;
-        }
-        
-        // Show SSID that failed
-        char failed_ssid[33] = "";
-        if (disconn->ssid_len > 0) {
-            snprintf(failed_ssid, sizeof(failed_ssid), "%.*s", disconn->ssid_len, disconn->ssid);
-            ESP_LOGW(TAG, "Disconnected from '%s' (reason: %d - %s)", failed_ssid, disconn->reason, reason_str);
-        } else {
-            ESP_LOGW(TAG, "Disconnected from AP (reason: %d - %s)", disconn->reason, reason_str);
-        }
-        
-        // Limit retry attempts to prevent infinite reconnection loops
-        wifi_retry_count++;
-        if (wifi_retry_count < MAX_WIFI_RETRIES) {
-            ESP_LOGI(TAG, "Retry %d/%d - Attempting to reconnect...", wifi_retry_count, MAX_WIFI_RETRIES);
-            snprintf(wifi_status_message, sizeof(wifi_status_message), 
-                     "Retry %d/%d: %s", wifi_retry_count, MAX_WIFI_RETRIES, reason_str);
-            esp_wifi_connect();
-        } else {
-            ESP_LOGW(TAG, "Max retries reached for '%s'. Giving up. AP Mode still active at 192.168.4.1", failed_ssid);
-            snprintf(wifi_status_message, sizeof(wifi_status_message), 
-                     "Failed after %d retries. Use web UI to try another network.", MAX_WIFI_RETRIES);
-            // Don't retry anymore - AP mode remains functional
-        }
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        wifi_connected = true;
-        wifi_retry_count = 0; // Reset retry counter on successful connection
-        snprintf(wifi_ip_address, sizeof(wifi_ip_address), IPSTR, IP2STR(&event->ip_info.ip));
-        snprintf(wifi_status_message, sizeof(wifi_status_message), 
-                 "✓ Connected! IP: %s", wifi_ip_address);
-        ESP_LOGI(TAG, "✓ Connected! Got IP: %s", wifi_ip_address);
-        
-        // Get the connected SSID
-        wifi_config_t wifi_config;
-        if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
-            strncpy(wifi_connected_ssid, (char*)wifi_config.sta.ssid, sizeof(wifi_connected_ssid) - 1);
-            wifi_connected_ssid[sizeof(wifi_connected_ssid) - 1] = '\0';
-        }
-    }
-}
-
 // HTTP POST handler for WiFi connect
 static esp_err_t wifi_connect_handler(httpd_req_t *req)
 {
@@ -594,39 +1952,14 @@ static esp_err_t wifi_connect_handler(httpd_req_t *req)
     
     ESP_LOGI(TAG, "Connecting to WiFi: %s", ssid);
     
-    // Save to NVS
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("wifi", NVS_READWRITE, &nvs_handle);
-    if (err == ESP_OK) {
-        nvs_set_str(nvs_handle, "ssid", ssid);
-        nvs_set_str(nvs_handle, "password", password);
-        nvs_commit(nvs_handle);
-        nvs_close(nvs_handle);
+    // Save right away instead of coalescing; a new network also forgets the cached AP
+    settings_set_wifi(ssid, password);
+    if (settings_flush() == ESP_OK) {
         ESP_LOGI(TAG, "WiFi credentials saved to NVS");
     }
     
-    // Reset retry counter for new connection attempt
-    wifi_retry_count = 0;
-    
-    // Configure WiFi station
-    wifi_config_t wifi_config = {};
-    strcpy((char*)wifi_config.sta.ssid, ssid);
-    strcpy((char*)wifi_config.sta.password, password);
-    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
-    
-    // Switch to AP+STA mode
-    esp_wifi_set_mode(WIFI_MODE_APSTA);
-    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
-    
-    // Register event handler if not already registered
-    static bool event_handler_registered = false;
-    if (!event_handler_registered) {
-        esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL);
-        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL);
-        event_handler_registered = true;
-    }
-    
-    esp_wifi_connect();
+    // Drops any current link and switches to AP+STA mode if needed
+    wifi_station_connect();
     
     httpd_resp_sendstr(req, "Connecting to WiFi... Check status in a few seconds");
     return ESP_OK;
@@ -639,9 +1972,12 @@ static httpd_handle_t start_webserver(void)
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.lru_purge_enable = true;
+    http_guard_configure(&config);  // Per-client budgets; also raises max_uri_handlers from the default of 8
 
     ESP_LOGI(TAG, "Starting HTTP server on port: %d", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
+        mem_task_track(xTaskGetHandle("httpd"), config.stack_size, NULL);   // Every handler runs on it
+        
         // Register URI handlers
         httpd_uri_t root_uri = {
             .uri = "/",
@@ -649,7 +1985,7 @@ static httpd_handle_t start_webserver(void)
             .handler = root_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &root_uri);
+        http_guard_register(server, &root_uri, CONN_COST_LIGHT);
 
         httpd_uri_t status_uri = {
             .uri = "/api/status",
@@ -657,7 +1993,7 @@ static httpd_handle_t start_webserver(void)
             .handler = status_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &status_uri);
+        http_guard_register(server, &status_uri, CONN_COST_LIGHT);
 
         httpd_uri_t battery_reset_uri = {
             .uri = "/api/battery/reset",
@@ -665,7 +2001,87 @@ static httpd_handle_t start_webserver(void)
             .handler = battery_reset_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &battery_reset_uri);
+        http_guard_register(server, &battery_reset_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t battery_ir_get_uri = {
+            .uri = "/api/battery/ir_test",
+            .method = HTTP_GET,
+            .handler = battery_ir_get_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &battery_ir_get_uri, CONN_COST_LIGHT);
+        
+        httpd_uri_t battery_ir_start_uri = {
+            .uri = "/api/battery/ir_test",
+            .method = HTTP_POST,
+            .handler = battery_ir_start_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &battery_ir_start_uri, CONN_COST_HEAVY);
+        
+        httpd_uri_t battery_ir_stop_uri = {
+            .uri = "/api/battery/ir_test/stop",
+            .method = HTTP_POST,
+            .handler = battery_ir_stop_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &battery_ir_stop_uri, CONN_COST_EXEMPT);
+
+        httpd_uri_t loadcell_uri = {
+            .uri = "/api/loadcell",
+            .method = HTTP_GET,
+            .handler = loadcell_get_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &loadcell_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t loadcell_tare_uri = {
+            .uri = "/api/loadcell/tare",
+            .method = HTTP_POST,
+            .handler = loadcell_tare_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &loadcell_tare_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t loadcell_calibrate_uri = {
+            .uri = "/api/loadcell/calibrate",
+            .method = HTTP_POST,
+            .handler = loadcell_calibrate_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &loadcell_calibrate_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t thrust_uri = {
+            .uri = "/api/thrust",
+            .method = HTTP_GET,
+            .handler = thrust_get_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &thrust_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t thrust_start_uri = {
+            .uri = "/api/thrust/start",
+            .method = HTTP_POST,
+            .handler = thrust_start_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &thrust_start_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t thrust_stop_uri = {
+            .uri = "/api/thrust/stop",
+            .method = HTTP_POST,
+            .handler = thrust_stop_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &thrust_stop_uri, CONN_COST_EXEMPT);
+
+        httpd_uri_t battery_uri = {
+            .uri = "/api/battery",
+            .method = HTTP_GET,
+            .handler = battery_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &battery_uri, CONN_COST_LIGHT);
 
         httpd_uri_t motor_start_uri = {
             .uri = "/api/motor/start",
@@ -673,7 +2089,7 @@ static httpd_handle_t start_webserver(void)
             .handler = motor_start_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &motor_start_uri);
+        http_guard_register(server, &motor_start_uri, CONN_COST_LIGHT);
 
         httpd_uri_t motor_stop_uri = {
             .uri = "/api/motor/stop",
@@ -681,7 +2097,7 @@ static httpd_handle_t start_webserver(void)
             .handler = motor_stop_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &motor_stop_uri);
+        http_guard_register(server, &motor_stop_uri, CONN_COST_EXEMPT);
 
         httpd_uri_t motor_speed_uri = {
             .uri = "/api/motor/speed",
@@ -689,7 +2105,7 @@ static httpd_handle_t start_webserver(void)
             .handler = motor_speed_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &motor_speed_uri);
+        http_guard_register(server, &motor_speed_uri, CONN_COST_LIGHT);
 
         httpd_uri_t motor_protocol_uri = {
             .uri = "/api/motor/protocol",
@@ -697,7 +2113,87 @@ static httpd_handle_t start_webserver(void)
             .handler = motor_protocol_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &motor_protocol_uri);
+        http_guard_register(server, &motor_protocol_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t motor_rpm_get_uri = {
+            .uri = "/api/motor/rpm",
+            .method = HTTP_GET,
+            .handler = motor_rpm_get_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &motor_rpm_get_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t motor_rpm_post_uri = {
+            .uri = "/api/motor/rpm",
+            .method = HTTP_POST,
+            .handler = motor_rpm_post_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &motor_rpm_post_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t protocol_test_uri = {
+            .uri = "/api/motor/protocol/test",
+            .method = HTTP_POST,
+            .handler = protocol_test_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &protocol_test_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t output_test_uri = {
+            .uri = "/api/motor/output/test",
+            .method = HTTP_POST,
+            .handler = output_test_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &output_test_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t batch_uri = {
+            .uri = "/api/batch",
+            .method = HTTP_POST,
+            .handler = batch_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &batch_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t udp_status_uri = {
+            .uri = "/api/udp/status",
+            .method = HTTP_GET,
+            .handler = udp_status_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &udp_status_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t http_stats_uri = {
+            .uri = "/api/http",
+            .method = HTTP_GET,
+            .handler = http_stats_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &http_stats_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t memory_uri = {
+            .uri = "/api/memory",
+            .method = HTTP_GET,
+            .handler = memory_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &memory_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t esc_telemetry_uri = {
+            .uri = "/api/esc",
+            .method = HTTP_GET,
+            .handler = esc_telemetry_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &esc_telemetry_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t motor_metrics_uri = {
+            .uri = "/api/motor/metrics",
+            .method = HTTP_GET,
+            .handler = motor_metrics_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &motor_metrics_uri, CONN_COST_LIGHT);
 
         httpd_uri_t ota_update_uri = {
             .uri = "/api/ota/update",
@@ -705,7 +2201,106 @@ static httpd_handle_t start_webserver(void)
             .handler = ota_update_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &ota_update_uri);
+        http_guard_register(server, &ota_update_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t firmware_uri = {
+            .uri = "/api/firmware",
+            .method = HTTP_GET,
+            .handler = firmware_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &firmware_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t firmware_image_uri = {
+            .uri = "/api/firmware/image",
+            .method = HTTP_GET,
+            .handler = firmware_image_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &firmware_image_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t firmware_pull_uri = {
+            .uri = "/api/firmware/pull",
+            .method = HTTP_POST,
+            .handler = firmware_pull_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &firmware_pull_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t boot_uri = {
+            .uri = "/api/boot",
+            .method = HTTP_GET,
+            .handler = boot_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &boot_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t log_uri = {
+            .uri = "/api/log",
+            .method = HTTP_GET,
+            .handler = log_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &log_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t settings_uri = {
+            .uri = "/api/settings",
+            .method = HTTP_GET,
+            .handler = settings_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &settings_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t power_uri = {
+            .uri = "/api/power",
+            .method = HTTP_GET,
+            .handler = power_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &power_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t history_uri = {
+            .uri = "/api/history",
+            .method = HTTP_GET,
+            .handler = history_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &history_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t vibration_get_uri = {
+            .uri = "/api/vibration",
+            .method = HTTP_GET,
+            .handler = vibration_get_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &vibration_get_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t vibration_post_uri = {
+            .uri = "/api/vibration",
+            .method = HTTP_POST,
+            .handler = vibration_post_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &vibration_post_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t vibration_capture_uri = {
+            .uri = "/api/vibration/capture",
+            .method = HTTP_GET,
+            .handler = vibration_capture_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &vibration_capture_uri, CONN_COST_HEAVY);
+
+        httpd_uri_t vibration_ws_uri = {
+            .uri = "/ws/vibration",
+            .method = HTTP_GET,
+            .handler = vibration_ws_handler,
+            .user_ctx = NULL,
+            .is_websocket = true
+        };
+        http_guard_register(server, &vibration_ws_uri, CONN_COST_LIGHT);
+        ws_server = server;
+        vibration_set_frame_callback(vibration_frame_ready);
 
         httpd_uri_t wifi_status_uri = {
             .uri = "/api/wifi/status",
@@ -713,7 +2308,15 @@ static httpd_handle_t start_webserver(void)
             .handler = wifi_status_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &wifi_status_uri);
+        http_guard_register(server, &wifi_status_uri, CONN_COST_LIGHT);
+
+        httpd_uri_t wifi_metrics_uri = {
+            .uri = "/api/wifi/metrics",
+            .method = HTTP_GET,
+            .handler = wifi_metrics_handler,
+            .user_ctx = NULL
+        };
+        http_guard_register(server, &wifi_metrics_uri, CONN_COST_LIGHT);
 
         httpd_uri_t wifi_scan_uri = {
             .uri = "/api/wifi/scan",
@@ -721,7 +2324,7 @@ static httpd_handle_t start_webserver(void)
             .handler = wifi_scan_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &wifi_scan_uri);
+        http_guard_register(server, &wifi_scan_uri, CONN_COST_HEAVY);
 
         httpd_uri_t wifi_connect_uri = {
             .uri = "/api/wifi/connect",
@@ -729,7 +2332,7 @@ static httpd_handle_t start_webserver(void)
             .handler = wifi_connect_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &wifi_connect_uri);
+        http_guard_register(server, &wifi_connect_uri, CONN_COST_LIGHT);
 
         httpd_uri_t wifi_clear_uri = {
             .uri = "/api/wifi/clear",
@@ -737,8 +2340,9 @@ static httpd_handle_t start_webserver(void)
             .handler = wifi_clear_handler,
             .user_ctx = NULL
         };
-        httpd_register_uri_handler(server, &wifi_clear_uri);
+        http_guard_register(server, &wifi_clear_uri, CONN_COST_LIGHT);
 
+        http_guard_start(server);
         return server;
     }
 
@@ -746,37 +2350,9 @@ static httpd_handle_t start_webserver(void)
     return NULL;
 }
 
-extern "C" void app_main(void)
+// Holding BOOT (GPIO9) at power-up clears the saved WiFi network
+static void check_boot_button(void)
 {
-    // Initialize NVS
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-
-    ESP_LOGI(TAG, "========================================");
-    ESP_LOGI(TAG, "ESP32-C6 Service Bench Starting (ESP-IDF)");
-    ESP_LOGI(TAG, "========================================");
-    
-    // Initialize PWM for ESC motor control - start with Standard PWM protocol
-    configure_protocol(PROTOCOL_STANDARD);
-    
-    ledc_channel_config_t ledc_channel = {
-        .gpio_num       = MOTOR_PWM_GPIO,
-        .speed_mode     = LEDC_LOW_SPEED_MODE,
-        .channel        = MOTOR_PWM_CHANNEL,
-        .intr_type      = LEDC_INTR_DISABLE,
-        .timer_sel      = MOTOR_PWM_TIMER,
-        .duty           = 0, // Start with motor off
-        .hpoint         = 0
-    };
-    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
-    
-    ESP_LOGI(TAG, "ESC control initialized on GPIO%d - use /api/motor/protocol to switch protocols", MOTOR_PWM_GPIO);
-    
-    // Check if BOOT button (GPIO9) is pressed at startup to clear WiFi credentials
     gpio_config_t io_conf = {};
     io_conf.intr_type = GPIO_INTR_DISABLE;
     io_conf.mode = GPIO_MODE_INPUT;
@@ -785,20 +2361,125 @@ extern "C" void app_main(void)
     io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
     gpio_config(&io_conf);
     
-    vTaskDelay(pdMS_TO_TICKS(100)); // Debounce
-    
+    // Only debounce when the pin already reads pressed, so normal boots do not wait
+    if (gpio_get_level(GPIO_NUM_9) != 0) {
+        return;
+    }
+    vTaskDelay(pdMS_TO_TICKS(30));
     if (gpio_get_level(GPIO_NUM_9) == 0) {  // Button pressed (active low)
         ESP_LOGW(TAG, "BOOT button pressed - Clearing WiFi credentials!");
-        nvs_handle_t nvs_handle;
-        if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK) {
-            nvs_erase_key(nvs_handle, "wifi_ssid");
-            nvs_erase_key(nvs_handle, "wifi_pass");
-            nvs_commit(nvs_handle);
-            nvs_close(nvs_handle);
+        settings_clear_wifi();
+        if (settings_flush() == ESP_OK) {
             ESP_LOGI(TAG, "WiFi credentials cleared!");
         }
-        vTaskDelay(pdMS_TO_TICKS(2000)); // Give user time to release button
     }
+}
+
+// Apply the saved protocol, RPM loop tuning and learned feed-forward maps
+static void restore_motor_settings(void)
+{
+    const settings_t *cfg = settings_get();
+    if (cfg->protocol != PROTOCOL_STANDARD) {
+        motor_cmd_t cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, cfg->protocol };
+        if (motor_apply_command(&cmd) == ESP_OK) {
+            ESP_LOGI(TAG, "Restored ESC protocol %s", motor_protocol_name((esc_protocol_t)cfg->protocol));
+        }
+    }
+    if (cfg->rpm_tuning.rate_hz != 0) {
+        motor_set_rpm_tuning(&cfg->rpm_tuning);
+    }
+    
+    bool learned = false;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        learned |= cfg->rpm_map[m].samples != 0;
+    }
+    if (learned) {
+        rpm_ff_map_t maps[MOTOR_COUNT];
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            if (cfg->rpm_map[m].samples != 0) {
+                maps[m] = cfg->rpm_map[m];
+            } else {
+                motor_get_rpm_map(m, &maps[m]);  // Keep the seeded map
+            }
+        }
+        motor_restore_rpm_maps(maps);
+    }
+}
+
+// Save a motor's learned feed-forward map once it has stopped. Runs on the
+// control task, which owns the map; settings only copy it and coalesce the
+// writes, so a stop/start burst costs one flash write.
+static void save_rpm_map(int motor)
+{
+    rpm_ff_map_t map;
+    if (motor_get_rpm_map(motor, &map) && map.samples != 0) {
+        settings_set_rpm_map(motor, &map);
+    }
+}
+
+// Brings up the ESC outputs and control task while app_main starts WiFi
+MEM_TASK_STORAGE(peripheral_init_task, 4096);
+
+static void peripheral_init_task(void *arg)
+{
+    ESP_ERROR_CHECK(motor_control_init());
+    boot_mark("motor");
+    ESP_LOGI(TAG, "ESC control initialized (%d outputs) - use /api/motor/protocol to switch protocols", MOTOR_COUNT);
+    
+    if (sensors_init() == ESP_OK) {
+        boot_mark("sensors");
+    } else {
+        ESP_LOGE(TAG, "Battery sensing failed to start");
+    }
+    
+    if (vibration_init() == ESP_OK) {
+        boot_mark("imu");
+    }
+    
+    if (esc_telemetry_init() == ESP_OK) {
+        boot_mark("esc_tlm");
+    }
+    
+    xEventGroupSetBits(init_events, INIT_PERIPHERALS_READY);
+    
+    // Probing waits for a first conversion, keep it off the boot path
+    if (loadcell_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Load cell failed to start");
+    }
+    mem_task_exit();
+    vTaskDelete(NULL);
+}
+
+extern "C" void app_main(void)
+{
+    boot_mark("app_main");
+    
+    // Logging leaves on USB-Serial-JTAG as binary records from here on
+    binlog_init();
+    
+    ESP_LOGI(TAG, "========================================");
+    ESP_LOGI(TAG, "ESP32-C6 Service Bench Starting (ESP-IDF)");
+    ESP_LOGI(TAG, "========================================");
+    
+    // DFS before anything that holds a power client
+    power_init();
+    
+    // Peripherals do not depend on NVS or WiFi, initialize them in parallel
+    init_events = xEventGroupCreateStatic(&init_events_buf);
+    MEM_TASK_CREATE(peripheral_init_task, "periph_init", NULL, 5, NULL);
+    
+    // Initialize NVS
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+    boot_mark("nvs");
+    
+    ESP_ERROR_CHECK(settings_init());
+    check_boot_button();
+    boot_mark("config");
     
     // Initialize WiFi
     ESP_ERROR_CHECK(esp_netif_init());
@@ -809,9 +2490,8 @@ extern "C" void app_main(void)
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    // Register event handler for WiFi events
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+    // Station state machine, joins the saved network as soon as the station starts
+    ESP_ERROR_CHECK(wifi_station_init());
 
     // Configure AP
     wifi_config_t wifi_config = {};
@@ -830,27 +2510,37 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    power_wifi_started();
+    boot_mark("wifi_start");
 
     ESP_LOGI(TAG, "WiFi AP Started Successfully!");
     ESP_LOGI(TAG, "SSID: ServiceBench");
     ESP_LOGI(TAG, "Password: tech1234");
     ESP_LOGI(TAG, "IP Address: 192.168.4.1");
+    
+    // Motor commands below need the control task
+    xEventGroupWaitBits(init_events, INIT_PERIPHERALS_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+    restore_motor_settings();
+    motor_set_stop_callback(save_rpm_map);
+    loadcell_set_calibration(&settings_get()->loadcell);
+
+    if (history_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Telemetry history not available");
+    }
 
     // Start web server
     httpd_handle_t server = start_webserver();
     if (server) {
+        boot_mark("httpd");
         ESP_LOGI(TAG, "Web server started!");
         ESP_LOGI(TAG, "Open http://192.168.4.1 in your browser");
     }
 
-    // Update sensor data periodically
-    while(1) {
-        // Simulate sensor readings
-        battery_voltage = 12.0 + (rand() % 15) * 0.1;
-        if (motor_rpm > 0) {
-            motor_rpm = 3000 + (rand() % 1000);
-        }
-        
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-    }
+#if UDP_CONTROL_ENABLED
+    // Low-latency throttle channel alongside the HTTP API
+    ESP_ERROR_CHECK(udp_control_start());
+    boot_mark("udp");
+#endif
+    boot_log_timeline();
+    // Everything runs on its own task from here; returning frees the main task
 }
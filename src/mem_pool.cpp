@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "mem_pool.h"
+
+static const char *TAG = "mem";
+
+typedef struct {
+    const char *name;
+    uint32_t block_bytes;
+    uint16_t blocks;
+    uint8_t *base;             // blocks * block_bytes in .bss, NULL on the heap
+    uint32_t used_mask;        // One bit per block
+    mem_pool_stats_t stats;
+} pool_t;
+
+#define POOL_BYTES (MEM_SMALL_BLOCK * MEM_SMALL_BLOCKS + MEM_MEDIUM_BLOCK * MEM_MEDIUM_BLOCKS + \
+                    MEM_LARGE_BLOCK * MEM_LARGE_BLOCKS + MEM_BULK_BLOCK * MEM_BULK_BLOCKS)
+static_assert(POOL_BYTES <= MEM_POOL_BUDGET, "buffer pools exceed MEM_POOL_BUDGET");
+static_assert(MEM_SMALL_BLOCK < MEM_MEDIUM_BLOCK && MEM_MEDIUM_BLOCK < MEM_LARGE_BLOCK &&
+              MEM_LARGE_BLOCK < MEM_BULK_BLOCK, "pools must be ordered by block size");
+static_assert(MEM_SMALL_BLOCK % 8 == 0 && MEM_MEDIUM_BLOCK % 8 == 0 && MEM_LARGE_BLOCK % 8 == 0 &&
+              MEM_BULK_BLOCK % 8 == 0, "blocks must keep 8-byte alignment");
+
+#if MEM_STATIC_ALLOCATION
+static uint8_t small_pool[MEM_SMALL_BLOCKS][MEM_SMALL_BLOCK] __attribute__((aligned(8)));
+static uint8_t medium_pool[MEM_MEDIUM_BLOCKS][MEM_MEDIUM_BLOCK] __attribute__((aligned(8)));
+static uint8_t large_pool[MEM_LARGE_BLOCKS][MEM_LARGE_BLOCK] __attribute__((aligned(8)));
+static uint8_t bulk_pool[MEM_BULK_BLOCKS][MEM_BULK_BLOCK] __attribute__((aligned(8)));
+#define POOL_BASE(p) (&(p)[0][0])
+#else
+#define POOL_BASE(p) NULL
+#endif
+
+static pool_t pools[MEM_POOL_COUNT] = {
+    { "small", MEM_SMALL_BLOCK, MEM_SMALL_BLOCKS, POOL_BASE(small_pool), 0, {} },
+    { "medium", MEM_MEDIUM_BLOCK, MEM_MEDIUM_BLOCKS, POOL_BASE(medium_pool), 0, {} },
+    { "large", MEM_LARGE_BLOCK, MEM_LARGE_BLOCKS, POOL_BASE(large_pool), 0, {} },
+    { "bulk", MEM_BULK_BLOCK, MEM_BULK_BLOCKS, POOL_BASE(bulk_pool), 0, {} },
+};
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    TaskHandle_t handle;       // NULL once the task exited
+    char name[16];
+    uint32_t stack_bytes;
+    uint32_t peak_bytes;
+} task_entry_t;
+
+static task_entry_t tasks[MEM_MAX_TASKS];
+static int task_count;
+
+#if !MEM_STATIC_ALLOCATION
+// Heap blocks carry their pool so frees are accounted to it
+typedef struct {
+    uint32_t pool;
+    uint32_t pad;              // Keeps the payload 8-byte aligned
+} heap_header_t;
+#endif
+
+void *mem_alloc(size_t size)
+{
+    void *ptr = NULL;
+    int first_fit = -1;
+    portENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < MEM_POOL_COUNT && ptr == NULL; i++) {
+        pool_t *p = &pools[i];
+        if (size > p->block_bytes) continue;
+        if (first_fit < 0) first_fit = i;
+        for (int b = 0; b < p->blocks; b++) {
+            if (p->used_mask & (1u << b)) continue;
+#if MEM_STATIC_ALLOCATION
+            ptr = p->base + (size_t)b * p->block_bytes;
+#else
+            ptr = p;   // Placeholder, the heap is not touched inside the critical section
+#endif
+            p->used_mask |= 1u << b;
+            p->stats.in_use++;
+            if (p->stats.in_use > p->stats.high_water) p->stats.high_water = p->stats.in_use;
+            p->stats.allocs++;
+            if (size > p->stats.largest_request) p->stats.largest_request = size;
+            first_fit = i;
+            break;
+        }
+    }
+    if (ptr == NULL && first_fit >= 0) {
+        pools[first_fit].stats.failures++;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (ptr == NULL) {
+        ESP_LOGW(TAG, "No block for %u bytes", (unsigned)size);
+        return NULL;
+    }
+#if !MEM_STATIC_ALLOCATION
+    // The pool still limits how many are out at once; the bytes come from the heap
+    pool_t *p = (pool_t *)ptr;
+    heap_header_t *h = (heap_header_t *)malloc(sizeof(heap_header_t) + size);
+    if (h == NULL) {
+        portENTER_CRITICAL(&pool_lock);
+        p->used_mask &= p->used_mask - 1;   // Any bit; only the count matters on the heap
+        p->stats.in_use--;
+        p->stats.failures++;
+        portEXIT_CRITICAL(&pool_lock);
+        return NULL;
+    }
+    h->pool = (uint32_t)(p - pools);
+    ptr = h + 1;
+#endif
+    return ptr;
+}
+
+void mem_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+#if MEM_STATIC_ALLOCATION
+    portENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < MEM_POOL_COUNT; i++) {
+        pool_t *p = &pools[i];
+        uint8_t *u = (uint8_t *)ptr;
+        if (u >= p->base && u < p->base + (size_t)p->blocks * p->block_bytes) {
+            int b = (int)((u - p->base) / p->block_bytes);
+            if (p->used_mask & (1u << b)) {
+                p->used_mask &= ~(1u << b);
+                p->stats.in_use--;
+            }
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pool_lock);
+#else
+    heap_header_t *h = (heap_header_t *)ptr - 1;
+    pool_t *p = &pools[h->pool];
+    free(h);
+    portENTER_CRITICAL(&pool_lock);
+    p->used_mask &= p->used_mask - 1;
+    p->stats.in_use--;
+    portEXIT_CRITICAL(&pool_lock);
+#endif
+}
+
+BaseType_t mem_task_track(TaskHandle_t handle, uint32_t stack_bytes, TaskHandle_t *out)
+{
+    if (out) {
+        *out = handle;
+    }
+    if (handle == NULL) {
+        return pdFAIL;
+    }
+    portENTER_CRITICAL(&pool_lock);
+    if (task_count < MEM_MAX_TASKS) {
+        task_entry_t *t = &tasks[task_count++];
+        t->handle = handle;
+        strncpy(t->name, pcTaskGetName(handle), sizeof(t->name) - 1);
+        t->stack_bytes = stack_bytes;
+        t->peak_bytes = 0;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    return pdPASS;
+}
+
+BaseType_t mem_task_create_dynamic(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *out)
+{
+    TaskHandle_t handle = NULL;
+    if (xTaskCreate(fn, name, stack_bytes, arg, priority, &handle) != pdPASS) {
+        handle = NULL;
+    }
+    return mem_task_track(handle, stack_bytes, out);
+}
+
+// Stack high water from FreeRTOS is the least free space, in bytes on ESP-IDF
+static void update_peak(task_entry_t *t)
+{
+    uint32_t free_bytes = uxTaskGetStackHighWaterMark(t->handle);
+    t->peak_bytes = free_bytes < t->stack_bytes ? t->stack_bytes - free_bytes : 0;
+}
+
+void mem_task_exit(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].handle == self) {
+            update_peak(&tasks[i]);
+            tasks[i].handle = NULL;
+        }
+    }
+}
+
+int mem_pool_get_stats(mem_pool_stats_t *out, int max)
+{
+    int n = 0;
+    portENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < MEM_POOL_COUNT && n < max; i++, n++) {
+        out[n] = pools[i].stats;
+        out[n].name = pools[i].name;
+        out[n].block_bytes = pools[i].block_bytes;
+        out[n].blocks = pools[i].blocks;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    return n;
+}
+
+int mem_task_get_stats(mem_task_stats_t *out, int max)
+{
+    int n = 0;
+    for (int i = 0; i < task_count && n < max; i++, n++) {
+        task_entry_t *t = &tasks[i];
+        if (t->handle) {
+            update_peak(t);
+        }
+        memcpy(out[n].name, t->name, sizeof(out[n].name));
+        out[n].stack_bytes = t->stack_bytes;
+        out[n].peak_bytes = t->peak_bytes;
+        out[n].running = t->handle != NULL;
+    }
+    return n;
+}
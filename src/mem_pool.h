@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Memory that a bench running for weeks can count on. With
+// MEM_STATIC_ALLOCATION every task stack is declared in .bss and every
+// buffer a request or test needs comes from fixed-block pools, all sized at
+// compile time; the heap is left to WiFi, lwIP and the HTTP server, so it
+// cannot fragment under our own churn. Turned off, the same calls use the
+// heap and are tracked all the same. mem_budget.py reports the static
+// footprint per subsystem from the linker map; GET /api/memory the high
+// water marks at run time.
+
+#define MEM_STATIC_ALLOCATION 1
+
+// Pools, smallest block first. An allocation takes one block of the first
+// pool it fits with one free; callers static_assert their worst case
+// against the block they expect. Allocation is safe from any task. The
+// counts cover the deepest nesting of one request on the httpd task (two
+// buffers) plus what workers hold for a whole run: the batch task its
+// command array (small), the IR test task its trace (bulk: a vibration
+// capture gets no block until the test is over). The firmware pull task
+// has a static buffer of its own.
+#define MEM_SMALL_BLOCK    3072     // JSON bodies, thrust result, batch commands, scan records, OTA and image chunks
+#define MEM_SMALL_BLOCKS   4
+#define MEM_MEDIUM_BLOCK   6400     // History points, spectrum frames, self-test edges, settings blob
+#define MEM_MEDIUM_BLOCKS  2
+#define MEM_LARGE_BLOCK    12352    // Batch request body
+#define MEM_LARGE_BLOCKS   1
+#define MEM_BULK_BLOCK     49152    // Vibration capture or IR test trace, one at a time
+#define MEM_BULK_BLOCKS    1
+#define MEM_POOL_COUNT     4
+
+#define MEM_POOL_BUDGET    (85 * 1024)   // Checked at compile time against the pools above (84.6 KB)
+#define MEM_MAX_TASKS      16
+
+// Tasks: MEM_TASK_STORAGE(task_function, bytes) at file scope, then
+// MEM_TASK_CREATE in place of xTaskCreate (same return). A task with static
+// storage must never be created twice; tasks that finish call
+// mem_task_exit() before deleting.
+#if MEM_STATIC_ALLOCATION
+#define MEM_TASK_STORAGE(fn, stack_bytes) \
+    static StackType_t fn##_stack[(stack_bytes) / sizeof(StackType_t)]; \
+    static StaticTask_t fn##_tcb
+#define MEM_TASK_CREATE(fn, name, arg, priority, handle) \
+    mem_task_track(xTaskCreateStatic(fn, (name), sizeof(fn##_stack) / sizeof(StackType_t), (arg), (priority), \
+                                     fn##_stack, &fn##_tcb), sizeof(fn##_stack), (handle))
+#else
+#define MEM_TASK_STORAGE(fn, stack_bytes) \
+    static const uint32_t fn##_stack_bytes = (stack_bytes)
+#define MEM_TASK_CREATE(fn, name, arg, priority, handle) \
+    mem_task_create_dynamic(fn, (name), fn##_stack_bytes, (arg), (priority), (handle))
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t block_bytes;
+    uint16_t blocks;
+    uint16_t in_use;
+    uint16_t high_water;
+    uint32_t allocs;
+    uint32_t failures;         // Nothing free that fits; counted on the smallest pool that would
+    uint32_t largest_request;
+} mem_pool_stats_t;
+
+typedef struct {
+    char name[16];
+    uint32_t stack_bytes;
+    uint32_t peak_bytes;       // Deepest stack use seen
+    bool running;
+} mem_task_stats_t;
+
+// One block, or NULL when none fits. Never blocks.
+void *mem_alloc(size_t size);
+void mem_free(void *ptr);      // NULL is ignored
+
+// Register a task for stack tracking, e.g. one the HTTP server created.
+// Returns pdPASS if handle is not NULL and writes it to out (may be NULL).
+BaseType_t mem_task_track(TaskHandle_t handle, uint32_t stack_bytes, TaskHandle_t *out);
+BaseType_t mem_task_create_dynamic(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *out);
+
+// Record the calling task's final stack use; call right before vTaskDelete(NULL)
+void mem_task_exit(void);
+
+int mem_pool_get_stats(mem_pool_stats_t *out, int max);
+int mem_task_get_stats(mem_task_stats_t *out, int max);
@@ -0,0 +1,938 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "motor_control.h"
+#include "power.h"
+#include "binlog.h"
+#include "mem_pool.h"
+
+static const char *TAG = "motor";
+
+// Motor PWM configuration - one LEDC channel per ESC, all sharing the active
+// timer. The other timer is the spare a new protocol is staged on.
+#define MOTOR_PWM_TIMER_A LEDC_TIMER_0
+#define MOTOR_PWM_TIMER_B LEDC_TIMER_1
+
+static const gpio_num_t motor_pwm_gpios[MOTOR_COUNT] = { GPIO_NUM_2, GPIO_NUM_21 };
+static const ledc_channel_t motor_pwm_channels[MOTOR_COUNT] = { LEDC_CHANNEL_0, LEDC_CHANNEL_1 };
+
+#define MOTOR_TASK_PRIORITY 10      // Above httpd (5) and UDP (8) so producers never preempt actuation
+#define MOTOR_TASK_STACK 3072
+#define MOTOR_RECORD_INPUTS 1       // Log every core input for host/control_replay.cpp
+
+MEM_TASK_STORAGE(motor_control_task, MOTOR_TASK_STACK);
+
+// Decisions and actuator state live in the core; this file is its hardware.
+// Only the control task applies inputs, other tasks read single fields.
+static motor_core_t core;
+static ledc_timer_t active_timer = MOTOR_PWM_TIMER_A;
+
+// Work handed to the control task; the sender, if any, is notified once it is applied
+typedef enum {
+    MOTOR_MSG_COMMAND,
+    MOTOR_MSG_BATCH,
+    MOTOR_MSG_FRAME,
+    MOTOR_MSG_DISARM,
+    MOTOR_MSG_RPM_TUNING,
+    MOTOR_MSG_RPM_MAPS,
+    MOTOR_MSG_HOLD_IDLE,
+    MOTOR_MSG_RPM_FEEDBACK   // Posted without a sender, nobody waits for it
+} motor_msg_kind_t;
+
+typedef struct {
+    const motor_cmd_t *cmds;
+    size_t count;
+    motor_batch_result_t *result;
+} motor_batch_job_t;
+
+typedef struct {
+    motor_msg_kind_t kind;
+    TaskHandle_t sender;
+    esp_err_t *status;       // The sender's, set before it is notified if the message was refused
+    int64_t enqueued_us;     // Start of the command-to-actuation latency measurement
+    union {
+        motor_cmd_t cmd;
+        motor_batch_job_t batch;
+        rpm_pid_config_t tuning;
+        const rpm_ff_map_t *maps;   // MOTOR_COUNT maps, owned by the waiting sender
+        bool hold;
+        struct {
+            uint8_t motor;
+            int32_t rpm;
+        } feedback;
+        struct {
+            uint16_t throttle[MOTOR_COUNT];
+            uint32_t failsafe_ms;
+        } frame;
+    };
+} motor_msg_t;
+
+// Bounded lock-free MPSC ring. Each slot carries a sequence number: producers
+// claim a slot with a CAS on enqueue_pos and publish it by bumping seq, the
+// control task is the only consumer and needs no atomics beyond the seq load.
+#define MOTOR_RING_LEN 16          // Must be a power of two
+#define MOTOR_SUBMIT_RETRIES 5     // Ticks a producer waits for a free slot
+#define CONTROL_TICK_MS 10         // Failsafe poll and motor model period while idle
+
+typedef struct {
+    std::atomic<uint32_t> seq;
+    motor_msg_t msg;
+} motor_ring_slot_t;
+
+static motor_ring_slot_t motor_ring[MOTOR_RING_LEN];
+static std::atomic<uint32_t> ring_enqueue_pos(0);
+static std::atomic<uint32_t> ring_dequeue_pos(0);   // Written by the control task only
+static std::atomic<uint32_t> ring_full_count(0);
+static std::atomic<uint32_t> ring_high_water(0);
+
+static TaskHandle_t control_task_handle = NULL;
+
+// Latency bookkeeping, written by the control task only
+static motor_metrics_t metrics;
+static uint64_t latency_sum_us = 0;
+static int64_t actuation_us = 0;   // First ledc_update_duty of the message being handled
+static int64_t handling_enqueued_us = 0;
+
+static bool outputs_powered = false;   // Holding the power client while any output pulses
+static uint32_t idle_holds = 0;        // motor_hold_idle() callers keeping every output stopped
+
+// Last duty change per output, read by other tasks to align measurements with it
+static motor_update_t output_updates[MOTOR_COUNT];
+static portMUX_TYPE update_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static motor_switch_stats_t switch_stats;
+static portMUX_TYPE switch_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// RPM loop pacing. The loop runs on the measurements esc_telemetry.cpp posts
+// with motor_submit_rpm_feedback().
+static esp_timer_handle_t rpm_loop_timer = NULL;
+static std::atomic<bool> rpm_tick_due(false);
+static uint32_t failsafe_trips_logged = 0;
+
+// Protocol switch in progress, control task only
+static ledc_timer_t switch_spare;
+static int64_t switch_wait_start_us;
+static int64_t switch_boundary_us;
+
+static std::atomic<uint32_t> record_drops(0);
+static motor_stop_cb_t stop_cb = NULL;   // Set during boot, before any motor runs
+
+// Configure an LEDC timer for a protocol; the PWM parameters are not touched
+static esp_err_t configure_timer(esc_protocol_t protocol, ledc_timer_t timer)
+{
+    motor_protocol_timing_t t;
+    motor_core_get_timing(protocol, &t);
+    ledc_timer_config_t ledc_timer = {
+        .speed_mode       = LEDC_LOW_SPEED_MODE,
+        .duty_resolution  = (ledc_timer_bit_t)t.resolution_bits,
+        .timer_num        = timer,
+        .freq_hz          = t.frequency_hz,
+        .clk_cfg          = LEDC_USE_PLL_DIV_CLK
+    };
+    return ledc_timer_config(&ledc_timer);
+}
+
+static void log_protocol(void)
+{
+    motor_protocol_timing_t t;
+    motor_core_get_timing((esc_protocol_t)core.s.protocol, &t);
+    ESP_LOGI(TAG, "Protocol: %s (%luHz, %lu-%luns, duty %lu-%lu)", motor_core_protocol_name((esc_protocol_t)core.s.protocol),
+             t.frequency_hz, t.min_pulse_ns, t.max_pulse_ns, core.s.pwm_min_duty, core.s.pwm_max_duty);
+}
+
+// Drive one output for the core; stopped outputs emit no pulses at all
+static void hw_output(void *ctx, int motor, uint32_t duty, bool changed)
+{
+    // Clocks must be at full speed before the first pulse, DFS may otherwise stop the LEDC source
+    if (duty != 0 && !outputs_powered) {
+        power_set_active(POWER_CLIENT_MOTOR, true);
+        outputs_powered = true;
+    }
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, motor_pwm_channels[motor], duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, motor_pwm_channels[motor]);
+    int64_t now = esp_timer_get_time();
+    if (actuation_us == 0) {
+        actuation_us = now;
+    }
+    if (changed) {
+        portENTER_CRITICAL(&update_lock);
+        output_updates[motor].update_us = now;
+        output_updates[motor].latch_us = 1000000 / core.s.pwm_frequency;
+        output_updates[motor].throttle = core.s.throttle[motor];
+        output_updates[motor].updates++;
+        portEXIT_CRITICAL(&update_lock);
+        if (duty == 0 && stop_cb) {
+            stop_cb(motor);
+        }
+    }
+}
+
+// Wait for the falling edge of a running output, then freeze the timer driving
+// it so every output stays low. Interrupts are masked for at most one pulse.
+static bool freeze_after_pulse(int motor, ledc_timer_t timer, uint32_t frequency)
+{
+    gpio_num_t gpio = motor_pwm_gpios[motor];
+    int64_t deadline = esp_timer_get_time() + 2 * 1000000LL / frequency + 1000;
+    bool ok = true;
+
+    while (gpio_get_level(gpio) == 0 && (ok = esp_timer_get_time() < deadline)) {
+    }
+    portENTER_CRITICAL(&switch_lock);
+    while (ok && gpio_get_level(gpio) == 1 && (ok = esp_timer_get_time() < deadline)) {
+    }
+    ledc_timer_pause(LEDC_LOW_SPEED_MODE, timer);
+    portEXIT_CRITICAL(&switch_lock);
+    return ok;
+}
+
+// Stage a protocol on the spare timer and freeze the running one between two
+// pulses, then bind every channel to the spare; the core sets the outputs
+// and hw_protocol_end starts the new period. No pulse is cut short or stretched.
+static bool hw_protocol_begin(void *ctx, esc_protocol_t protocol)
+{
+    ledc_timer_t old_timer = active_timer;
+    ledc_timer_t spare = old_timer == MOTOR_PWM_TIMER_A ? MOTOR_PWM_TIMER_B : MOTOR_PWM_TIMER_A;
+
+    // The spare is held at the start of a period until the swap
+    esp_err_t err = configure_timer(protocol, spare);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot stage %s: %s", motor_core_protocol_name(protocol), esp_err_to_name(err));
+        return false;
+    }
+    ledc_timer_pause(LEDC_LOW_SPEED_MODE, spare);
+    ledc_timer_rst(LEDC_LOW_SPEED_MODE, spare);
+
+    // Pulses all start at hpoint 0, so once the longest one has ended every output is low
+    int longest = -1;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (core.s.duty[m] > 0 && (longest < 0 || core.s.duty[m] > core.s.duty[longest])) longest = m;
+    }
+    switch_wait_start_us = esp_timer_get_time();
+    if (longest >= 0) {
+        if (!freeze_after_pulse(longest, old_timer, core.s.pwm_frequency)) {
+            switch_stats.boundary_timeouts++;
+            ESP_LOGW(TAG, "No pulse edge on GPIO%d, swapping without boundary", motor_pwm_gpios[longest]);
+        }
+    } else {
+        ledc_timer_pause(LEDC_LOW_SPEED_MODE, old_timer);
+    }
+    switch_boundary_us = esp_timer_get_time();
+
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        ledc_bind_channel_timer(LEDC_LOW_SPEED_MODE, motor_pwm_channels[m], spare);
+    }
+    switch_spare = spare;
+    return true;
+}
+
+static void hw_protocol_end(void *ctx)
+{
+    ledc_timer_resume(LEDC_LOW_SPEED_MODE, switch_spare);
+    active_timer = switch_spare;
+    log_protocol();
+
+    int64_t now = esp_timer_get_time();
+    switch_stats.switches++;
+    switch_stats.last_swap_us = now;
+    switch_stats.last_latency_us = (uint32_t)(now - handling_enqueued_us);
+    switch_stats.last_boundary_wait_us = (uint32_t)(switch_boundary_us - switch_wait_start_us);
+}
+
+// Core inputs go to the binary log with their time, see motor_core.h
+static void hw_record(void *ctx, int64_t now_us, const uint8_t *data, size_t len)
+{
+    blog_record_t r;
+    blog_record_begin(&r, BLOG_ID_REPLAY, (uint32_t)now_us);
+    blog_put_bytes(&r, data, len);
+    if (!binlog_submit(r.buf, r.len)) {
+        record_drops.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static const motor_core_io_t core_io = {
+    NULL, hw_output, hw_protocol_begin, hw_protocol_end, MOTOR_RECORD_INPUTS ? hw_record : NULL
+};
+
+static void apply_input(motor_input_t *in)
+{
+    in->now_us = esp_timer_get_time();
+    motor_core_apply(&core, in);
+}
+
+static esp_err_t validate_command(const motor_cmd_t *cmd)
+{
+    return motor_core_command_valid(cmd) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// An RPM setpoint for a motor with no fresh measurement would run the loop blind
+static bool rpm_unmeasured(const motor_cmd_t *cmd)
+{
+    if (cmd->type != MOTOR_CMD_RPM || cmd->value == 0) {
+        return false;
+    }
+    int first = cmd->motor == MOTOR_ALL ? 0 : cmd->motor;
+    int last = cmd->motor == MOTOR_ALL ? MOTOR_COUNT - 1 : cmd->motor;
+    int64_t now = esp_timer_get_time();
+    for (int m = first; m <= last; m++) {
+        if (!motor_core_rpm_fresh(&core, m, now)) return true;
+    }
+    return false;
+}
+
+static void apply_command(const motor_cmd_t *cmd)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_COMMAND;
+    in.cmd = *cmd;
+    apply_input(&in);
+}
+
+static void run_periodic_work(void);
+static bool ring_pop(motor_msg_t *msg);
+static void apply_feedback(const motor_msg_t *msg);
+
+// Messages that arrived during a batch wait, applied in order once it ends.
+// Every sender waits for its message, so there is at most one per task;
+// measurements have no sender and are applied as they arrive.
+static motor_msg_t batch_deferred[MOTOR_RING_LEN];
+static size_t batch_deferred_count = 0;
+
+// Messages that take the outputs away from a batch
+static bool ends_batch(const motor_msg_t *msg)
+{
+    return msg->kind == MOTOR_MSG_DISARM || msg->kind == MOTOR_MSG_FRAME ||
+           (msg->kind == MOTOR_MSG_COMMAND && msg->cmd.type == MOTOR_CMD_STOP);
+}
+
+// Wait inside a batch, keeping the failsafe, motor model and RPM loop
+// running. The ring is drained so a stop gets through: it ends the batch and
+// returns false; measurements are applied, anything else is held back until
+// the batch is over.
+static bool batch_wait(int64_t until_us)
+{
+    int64_t now;
+    while ((now = esp_timer_get_time()) < until_us) {
+        TickType_t ticks = pdMS_TO_TICKS((until_us - now) / 1000);
+        if (ticks < 1) ticks = 1;
+        if (ticks > pdMS_TO_TICKS(CONTROL_TICK_MS)) ticks = pdMS_TO_TICKS(CONTROL_TICK_MS);
+        ulTaskNotifyTake(pdTRUE, ticks);
+        while (batch_deferred_count < MOTOR_RING_LEN && ring_pop(&batch_deferred[batch_deferred_count])) {
+            const motor_msg_t *msg = &batch_deferred[batch_deferred_count];
+            if (msg->kind == MOTOR_MSG_RPM_FEEDBACK) {
+                apply_feedback(msg);
+                continue;
+            }
+            batch_deferred_count++;
+            if (ends_batch(msg)) {
+                return false;
+            }
+        }
+        run_periodic_work();
+    }
+    return true;
+}
+
+static void execute_batch(const motor_batch_job_t *job)
+{
+    motor_batch_result_t *result = job->result;
+    int64_t start = esp_timer_get_time();
+    int64_t waited = 0;
+
+    for (size_t i = 0; i < job->count; i++) {
+        const motor_cmd_t *cmd = &job->cmds[i];
+        if (cmd->type == MOTOR_CMD_WAIT) {
+            int64_t wait_start = esp_timer_get_time();
+            bool completed = batch_wait(wait_start + (int64_t)cmd->value * 1000);
+            waited += esp_timer_get_time() - wait_start;
+            if (!completed) {
+                result->aborted = true;
+                result->err = ESP_ERR_INVALID_STATE;
+                result->failed_index = (int16_t)i;
+                break;
+            }
+        } else if (rpm_unmeasured(cmd)) {
+            result->err = ESP_ERR_INVALID_STATE;
+            result->failed_index = (int16_t)i;
+            break;
+        } else {
+            apply_command(cmd);
+        }
+        result->executed++;
+    }
+
+    result->elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+    result->apply_us = (uint32_t)(result->elapsed_us - waited);
+}
+
+static bool ring_push(const motor_msg_t *msg)
+{
+    uint32_t pos = ring_enqueue_pos.load(std::memory_order_relaxed);
+    while (1) {
+        motor_ring_slot_t *slot = &motor_ring[pos & (MOTOR_RING_LEN - 1)];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (ring_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot->msg = *msg;
+                slot->seq.store(pos + 1, std::memory_order_release);
+                break;
+            }
+        } else if (diff < 0) {
+            return false;  // Slot still holds a message from the previous lap
+        } else {
+            pos = ring_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t depth = pos + 1 - ring_dequeue_pos.load(std::memory_order_relaxed);
+    uint32_t high = ring_high_water.load(std::memory_order_relaxed);
+    while (depth > high && !ring_high_water.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+// Control task only. Returns false if the next slot is empty or still being written.
+static bool ring_pop(motor_msg_t *msg)
+{
+    uint32_t pos = ring_dequeue_pos.load(std::memory_order_relaxed);
+    motor_ring_slot_t *slot = &motor_ring[pos & (MOTOR_RING_LEN - 1)];
+    if (slot->seq.load(std::memory_order_acquire) != pos + 1) {
+        return false;
+    }
+    *msg = slot->msg;
+    slot->seq.store(pos + MOTOR_RING_LEN, std::memory_order_release);
+    ring_dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+static void record_latency(uint32_t us)
+{
+    metrics.latency_last_us = us;
+    if (metrics.latency_min_us == 0 || us < metrics.latency_min_us) metrics.latency_min_us = us;
+    if (us > metrics.latency_max_us) metrics.latency_max_us = us;
+
+    int bucket = 0;
+    while (bucket < MOTOR_LATENCY_BUCKETS - 1 && us >= (MOTOR_LATENCY_BUCKET0_US << bucket)) {
+        bucket++;
+    }
+    metrics.latency_hist[bucket]++;
+    metrics.latency_samples++;
+    latency_sum_us += us;
+    metrics.latency_avg_us = (uint32_t)(latency_sum_us / metrics.latency_samples);
+}
+
+static bool command_drives(const motor_cmd_t *cmd)
+{
+    switch (cmd->type) {
+        case MOTOR_CMD_START:
+            return true;
+        case MOTOR_CMD_SPEED:
+        case MOTOR_CMD_THROTTLE:
+        case MOTOR_CMD_RPM:
+            return cmd->value != 0;
+        default:
+            return false;
+    }
+}
+
+// Index of the first command or frame value that would make an output pulse, -1 if none
+static int first_driving(const motor_msg_t *msg)
+{
+    switch (msg->kind) {
+        case MOTOR_MSG_COMMAND:
+            return command_drives(&msg->cmd) ? 0 : -1;
+        case MOTOR_MSG_BATCH:
+            for (size_t i = 0; i < msg->batch.count; i++) {
+                if (command_drives(&msg->batch.cmds[i])) return (int)i;
+            }
+            return -1;
+        case MOTOR_MSG_FRAME:
+            for (int m = 0; m < MOTOR_COUNT; m++) {
+                uint16_t t = msg->frame.throttle[m];
+                if (t != 0 && t != MOTOR_THROTTLE_UNCHANGED) return m;
+            }
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+static bool outputs_idle(void)
+{
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (core.s.duty[m] != 0) {
+            return false;
+        }
+    }
+    return !motor_core_any_hold(&core);
+}
+
+// Refused messages are not applied, so they leave no input for a replay
+static void refuse(const motor_msg_t *msg, int index)
+{
+    *msg->status = ESP_ERR_INVALID_STATE;
+    if (msg->kind == MOTOR_MSG_BATCH) {
+        msg->batch.result->err = ESP_ERR_INVALID_STATE;
+        msg->batch.result->failed_index = (int16_t)index;
+    }
+}
+
+// A measurement is not a command: it moves no output and is not timed, so it
+// can be applied in the middle of a batch without disturbing its bookkeeping
+static void apply_feedback(const motor_msg_t *msg)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_RPM;
+    in.feedback.motor = msg->feedback.motor;
+    in.feedback.rpm = msg->feedback.rpm;
+    apply_input(&in);
+}
+
+static void handle_message(const motor_msg_t *msg)
+{
+    if (msg->kind == MOTOR_MSG_RPM_FEEDBACK) {
+        apply_feedback(msg);
+        return;
+    }
+    actuation_us = 0;
+    handling_enqueued_us = msg->enqueued_us;
+    motor_input_t in = {};
+    int driving = idle_holds > 0 ? first_driving(msg) : -1;
+    if (driving >= 0) {
+        refuse(msg, driving);
+        metrics.commands++;
+        return;
+    }
+    switch (msg->kind) {
+        case MOTOR_MSG_COMMAND:
+            if (rpm_unmeasured(&msg->cmd)) {
+                refuse(msg, 0);
+                break;
+            }
+            apply_command(&msg->cmd);
+            break;
+        case MOTOR_MSG_BATCH:
+            execute_batch(&msg->batch);
+            break;
+        case MOTOR_MSG_FRAME:
+            in.kind = MOTOR_IN_FRAME;
+            memcpy(in.frame.throttle, msg->frame.throttle, sizeof(in.frame.throttle));
+            in.frame.failsafe_ms = msg->frame.failsafe_ms;
+            apply_input(&in);
+            break;
+        case MOTOR_MSG_DISARM:
+            in.kind = MOTOR_IN_DISARM;
+            apply_input(&in);
+            break;
+        case MOTOR_MSG_RPM_TUNING:
+            in.kind = MOTOR_IN_TUNING;
+            in.tuning = msg->tuning;
+            apply_input(&in);
+            if (esp_timer_is_active(rpm_loop_timer)) {
+                esp_timer_restart(rpm_loop_timer, 1000000 / core.s.rpm_config.rate_hz);
+            }
+            break;
+        case MOTOR_MSG_RPM_MAPS:
+            for (int m = 0; m < MOTOR_COUNT; m++) {
+                in.kind = MOTOR_IN_MAP;
+                in.map.motor = m;
+                in.map.map = msg->maps[m];
+                apply_input(&in);
+            }
+            break;
+        case MOTOR_MSG_HOLD_IDLE:
+            if (!msg->hold) {
+                if (idle_holds > 0) idle_holds--;
+            } else if (idle_holds > 0 || outputs_idle()) {
+                idle_holds++;
+            } else {
+                refuse(msg, 0);
+            }
+            break;
+        case MOTOR_MSG_RPM_FEEDBACK:   // Applied above
+            break;
+    }
+    metrics.commands++;
+    if (actuation_us != 0) {
+        record_latency((uint32_t)(actuation_us - msg->enqueued_us));
+    }
+}
+
+// Run the loop timer only while some motor is in RPM hold
+static void update_rpm_timer(void)
+{
+    bool any = motor_core_any_hold(&core);
+    bool active = esp_timer_is_active(rpm_loop_timer);
+    if (any && !active) {
+        esp_timer_start_periodic(rpm_loop_timer, 1000000 / core.s.rpm_config.rate_hz);
+    } else if (!any && active) {
+        esp_timer_stop(rpm_loop_timer);
+    }
+}
+
+// Failsafe, motor model and, when the loop timer fired, the RPM controllers
+static void run_periodic_work(void)
+{
+    motor_input_t in = {};
+    in.kind = MOTOR_IN_TICK;
+    in.rpm_due = rpm_tick_due.exchange(false, std::memory_order_relaxed);
+    apply_input(&in);
+    if (core.s.failsafe_trips != failsafe_trips_logged) {
+        failsafe_trips_logged = core.s.failsafe_trips;
+        ESP_LOGW(TAG, "Failsafe: no control frame for %lu ms, outputs stopped",
+                 (unsigned long)((in.now_us - core.s.failsafe_last_frame_us) / 1000));
+    }
+    update_rpm_timer();
+
+    // Let the clocks scale down once every output is stopped
+    if (outputs_powered) {
+        bool any = false;
+        for (int m = 0; m < MOTOR_COUNT; m++) any |= core.s.duty[m] != 0;
+        if (!any) {
+            power_set_active(POWER_CLIENT_MOTOR, false);
+            outputs_powered = false;
+        }
+    }
+}
+
+static void rpm_loop_timer_cb(void *arg)
+{
+    rpm_tick_due.store(true, std::memory_order_relaxed);
+    xTaskNotifyGive(control_task_handle);
+}
+
+// Control task - sole owner of the LEDC outputs and the core.
+// Drains the command ring in arrival order, then steps the motor model and,
+// when the loop timer fired, the RPM controllers.
+static void motor_control_task(void *arg)
+{
+    motor_msg_t msg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONTROL_TICK_MS));
+        while (ring_pop(&msg)) {
+            handle_message(&msg);
+            if (msg.sender) xTaskNotifyGive(msg.sender);
+            // Held back by a batch; they arrived before anything still in the ring
+            for (size_t i = 0; i < batch_deferred_count; i++) {
+                handle_message(&batch_deferred[i]);
+                xTaskNotifyGive(batch_deferred[i].sender);
+            }
+            batch_deferred_count = 0;
+        }
+        run_periodic_work();
+    }
+}
+
+// Queue a message and block until the control task has applied it
+static esp_err_t submit_and_wait(motor_msg_t *msg)
+{
+    esp_err_t status = ESP_OK;
+    msg->sender = xTaskGetCurrentTaskHandle();
+    msg->status = &status;
+    msg->enqueued_us = esp_timer_get_time();
+
+    int retries = 0;
+    while (!ring_push(msg)) {
+        ring_full_count.fetch_add(1, std::memory_order_relaxed);
+        if (++retries > MOTOR_SUBMIT_RETRIES) {
+            ESP_LOGW(TAG, "Command ring full, dropping message");
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
+    xTaskNotifyGive(control_task_handle);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return status;
+}
+
+esp_err_t motor_control_init(void)
+{
+    // Initialize PWM for ESC motor control - start with Standard PWM protocol
+    motor_core_init(&core, &core_io, esp_timer_get_time());
+    ESP_ERROR_CHECK(configure_timer(PROTOCOL_STANDARD, MOTOR_PWM_TIMER_A));
+    log_protocol();
+
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        ledc_channel_config_t ledc_channel = {
+            .gpio_num       = motor_pwm_gpios[m],
+            .speed_mode     = LEDC_LOW_SPEED_MODE,
+            .channel        = motor_pwm_channels[m],
+            .intr_type      = LEDC_INTR_DISABLE,
+            .timer_sel      = MOTOR_PWM_TIMER_A,
+            .duty           = 0, // Start with motor off
+            .hpoint         = 0
+        };
+        ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+        // Read the pad back to find pulse boundaries for protocol switches
+        gpio_input_enable(motor_pwm_gpios[m]);
+    }
+
+    for (uint32_t i = 0; i < MOTOR_RING_LEN; i++) {
+        motor_ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    const esp_timer_create_args_t rpm_timer_args = {
+        .callback = rpm_loop_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "rpm_loop",
+        .skip_unhandled_events = true
+    };
+    esp_err_t err = esp_timer_create(&rpm_timer_args, &rpm_loop_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (MEM_TASK_CREATE(motor_control_task, "motor_ctrl", NULL, MOTOR_TASK_PRIORITY,
+                        &control_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "%d ESC outputs initialized (GPIO%d first)", MOTOR_COUNT, motor_pwm_gpios[0]);
+    return ESP_OK;
+}
+
+esp_err_t motor_apply_command(const motor_cmd_t *cmd)
+{
+    esp_err_t err = validate_command(cmd);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (cmd->type == MOTOR_CMD_WAIT) {
+        return ESP_ERR_NOT_SUPPORTED;  // Only meaningful inside a batch
+    }
+
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_COMMAND;
+    msg.cmd = *cmd;
+    return submit_and_wait(&msg);
+}
+
+esp_err_t motor_run_batch(const motor_cmd_t *cmds, size_t count, motor_batch_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->failed_index = -1;
+
+    if (count == 0 || count > MOTOR_BATCH_MAX_COMMANDS) {
+        result->err = ESP_ERR_INVALID_SIZE;
+        return result->err;
+    }
+
+    // Validate everything up front so a batch is either applied in full or not at all
+    int32_t total_wait_ms = 0;
+    for (size_t i = 0; i < count; i++) {
+        esp_err_t err = validate_command(&cmds[i]);
+        if (err == ESP_OK && cmds[i].type == MOTOR_CMD_WAIT) {
+            total_wait_ms += cmds[i].value;
+            if (total_wait_ms > MOTOR_BATCH_MAX_WAIT_MS) {
+                err = ESP_ERR_INVALID_SIZE;
+            }
+        }
+        if (err != ESP_OK) {
+            result->err = err;
+            result->failed_index = (int16_t)i;
+            return err;
+        }
+    }
+
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_BATCH;
+    msg.batch = { cmds, count, result };
+    esp_err_t err = submit_and_wait(&msg);
+    if (err != ESP_OK) {
+        result->err = err;
+    }
+    return result->err;
+}
+
+esp_err_t motor_submit_frame(const uint16_t throttle[MOTOR_COUNT], uint32_t failsafe_ms)
+{
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_FRAME;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (throttle[m] != MOTOR_THROTTLE_UNCHANGED && throttle[m] > 1000) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        msg.frame.throttle[m] = throttle[m];
+    }
+    msg.frame.failsafe_ms = failsafe_ms;
+    return submit_and_wait(&msg);
+}
+
+esp_err_t motor_submit_disarm(void)
+{
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_DISARM;
+    return submit_and_wait(&msg);
+}
+
+esp_err_t motor_hold_idle(bool hold)
+{
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_HOLD_IDLE;
+    msg.hold = hold;
+    return submit_and_wait(&msg);
+}
+
+esp_err_t motor_submit_rpm_feedback(int motor, int32_t rpm)
+{
+    if (motor < 0 || motor >= MOTOR_COUNT || rpm < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_RPM_FEEDBACK;
+    msg.enqueued_us = esp_timer_get_time();
+    msg.feedback.motor = (uint8_t)motor;
+    msg.feedback.rpm = rpm;
+    // A full ring drops the measurement rather than stall the reader; the next
+    // one follows within a telemetry slot
+    if (!ring_push(&msg)) {
+        ring_full_count.fetch_add(1, std::memory_order_relaxed);
+        return ESP_ERR_TIMEOUT;
+    }
+    xTaskNotifyGive(control_task_handle);
+    return ESP_OK;
+}
+
+esp_err_t motor_set_rpm_tuning(const rpm_pid_config_t *cfg)
+{
+    if (cfg->kp_q16 < 0 || cfg->ki_q16 < 0 || cfg->kd_q16 < 0 ||
+        cfg->rate_hz < MOTOR_RPM_RATE_MIN_HZ || cfg->rate_hz > MOTOR_RPM_RATE_MAX_HZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_RPM_TUNING;
+    msg.tuning = *cfg;
+    return submit_and_wait(&msg);
+}
+
+void motor_get_rpm_tuning(rpm_pid_config_t *cfg)
+{
+    *cfg = core.s.rpm_config;
+}
+
+void motor_set_stop_callback(motor_stop_cb_t cb)
+{
+    stop_cb = cb;
+}
+
+esp_err_t motor_restore_rpm_maps(const rpm_ff_map_t maps[MOTOR_COUNT])
+{
+    motor_msg_t msg = {};
+    msg.kind = MOTOR_MSG_RPM_MAPS;
+    msg.maps = maps;
+    return submit_and_wait(&msg);
+}
+
+bool motor_get_rpm_map(int motor, rpm_ff_map_t *map)
+{
+    // The control task bumps samples after each update; single core, so an
+    // update that preempts this copy always completes before it resumes
+    const rpm_ff_map_t *live = &core.s.rpm_map[motor];
+    uint32_t before = __atomic_load_n(&live->samples, __ATOMIC_ACQUIRE);
+    *map = *live;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return __atomic_load_n(&live->samples, __ATOMIC_RELAXED) == before && map->samples == before;
+}
+
+void motor_get_rpm_status(int motor, motor_rpm_status_t *status)
+{
+    const motor_core_state_t *s = &core.s;
+    status->hold = s->rpm_hold[motor];
+    status->target_rpm = s->rpm_target[motor];
+    status->ff_throttle = rpm_ff_throttle_for(&s->rpm_map[motor], s->rpm_target[motor]);
+    status->map_samples = s->rpm_map[motor].samples;
+    status->step = s->rpm_step[motor];
+    status->measured = motor_core_rpm_fresh(&core, motor, esp_timer_get_time());
+    status->measured_rpm = s->rpm_measured[motor];
+}
+
+void motor_get_metrics(motor_metrics_t *out)
+{
+    *out = metrics;
+    out->queue_full = ring_full_count.load(std::memory_order_relaxed);
+    out->queue_high_water = ring_high_water.load(std::memory_order_relaxed);
+    out->recorded = core.recorded;
+    out->snapshots = core.snapshots;
+    out->record_drops = record_drops.load(std::memory_order_relaxed);
+}
+
+int motor_get_speed(int motor)
+{
+    return core.s.throttle[motor] / 10;
+}
+
+int motor_get_throttle(int motor)
+{
+    return core.s.throttle[motor];
+}
+
+int motor_get_rpm(int motor)
+{
+    return core.s.rpm[motor];
+}
+
+uint32_t motor_get_duty(int motor)
+{
+    return core.s.duty[motor];
+}
+
+esc_protocol_t motor_get_protocol(void)
+{
+    return (esc_protocol_t)core.s.protocol;
+}
+
+uint32_t motor_get_failsafe_trips(void)
+{
+    return core.s.failsafe_trips;
+}
+
+bool motor_failsafe_tripped(void)
+{
+    return core.s.failsafe_active;
+}
+
+void motor_get_last_update(int motor, motor_update_t *out)
+{
+    portENTER_CRITICAL(&update_lock);
+    *out = output_updates[motor];
+    portEXIT_CRITICAL(&update_lock);
+}
+
+void motor_get_switch_stats(motor_switch_stats_t *out)
+{
+    *out = switch_stats;
+}
+
+void motor_get_protocol_timing(esc_protocol_t protocol, motor_protocol_timing_t *timing)
+{
+    motor_core_get_timing(protocol, timing);
+}
+
+int motor_get_gpio(int motor)
+{
+    return motor_pwm_gpios[motor];
+}
+
+void motor_route_output(int motor)
+{
+    ledc_set_pin(motor_pwm_gpios[motor], LEDC_LOW_SPEED_MODE, motor_pwm_channels[motor]);
+    gpio_input_enable(motor_pwm_gpios[motor]);
+}
+
+const char *motor_protocol_name(esc_protocol_t protocol)
+{
+    return motor_core_protocol_name(protocol);
+}
+
+bool motor_protocol_from_name(const char *name, esc_protocol_t *protocol)
+{
+    return motor_core_protocol_from_name(name, protocol);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "motor_core.h"
+
+// Aggregated result of a command batch
+typedef struct {
+    esp_err_t err;          // ESP_OK if every command was applied
+    uint16_t executed;      // Commands applied (waits included)
+    int16_t failed_index;   // First rejected command, -1 if none
+    uint32_t elapsed_us;    // Wall time of the whole batch including waits
+    uint32_t apply_us;      // Time spent applying commands, waits excluded
+    bool aborted;           // Cut short in a wait by a stop, disarm or UDP frame (err is
+                            // ESP_ERR_INVALID_STATE, failed_index the wait)
+} motor_batch_result_t;
+
+#define MOTOR_BATCH_MAX_COMMANDS 256
+
+typedef struct {
+    bool hold;               // Motor is under RPM control
+    int32_t target_rpm;
+    int32_t ff_throttle;     // Learned feed-forward for the target, per mille
+    uint32_t map_samples;    // Steady-state samples the feed-forward map has learned from
+    rpm_step_t step;         // Response to the last setpoint change
+    bool measured;           // A measurement arrived within MOTOR_RPM_FEEDBACK_US
+    int32_t measured_rpm;    // Last measurement, stale unless measured
+} motor_rpm_status_t;
+
+// Protocol switches are staged on the spare LEDC timer and swapped between two
+// pulses: the old timer is frozen right after the longest pulse has ended, the
+// channels are moved over and the new timer starts a fresh period.
+typedef struct {
+    uint32_t switches;
+    uint32_t boundary_timeouts;   // No falling edge seen, swapped without waiting
+    int64_t last_swap_us;         // esp_timer time the new timer was started
+    uint32_t last_latency_us;     // Enqueue of the command to the swap
+    uint32_t last_boundary_wait_us;
+} motor_switch_stats_t;
+
+// Last change of an output's duty. LEDC latches a new duty at the end of the
+// running period, so the new pulse width is on the wire somewhere between
+// update_us and update_us + latch_us.
+typedef struct {
+    int64_t update_us;     // esp_timer time of the ledc_update_duty()
+    uint32_t latch_us;     // PWM period at that time
+    int throttle;          // Per mille after the change
+    uint32_t updates;      // Changes since boot
+} motor_update_t;
+
+// Control task health. Latency is measured from enqueue to the first
+// ledc_update_duty() the message caused.
+#define MOTOR_LATENCY_BUCKETS   8
+#define MOTOR_LATENCY_BUCKET0_US 32      // Bucket n counts latencies below 32us << n
+
+typedef struct {
+    uint32_t commands;           // Messages handled by the control task
+    uint32_t queue_full;         // Submissions that found the command ring full
+    uint32_t queue_high_water;   // Deepest ring occupancy seen
+    uint32_t latency_samples;
+    uint32_t latency_last_us;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint32_t latency_avg_us;
+    uint32_t latency_hist[MOTOR_LATENCY_BUCKETS];  // Last bucket catches everything slower
+    uint32_t recorded;           // Inputs written to the binary log for replay (motor_core.h)
+    uint32_t snapshots;          // State snapshots written with them
+    uint32_t record_drops;       // Records lost to a full log ring; a replay resyncs at the next snapshot
+} motor_metrics_t;
+
+// Configure LEDC outputs and start the control task. The control task is the
+// only writer of LEDC and motor state; every function below that changes an
+// output queues a message on a lock-free ring and may be called from any task.
+esp_err_t motor_control_init(void);
+
+// Queue a single command and wait until the control task has applied it
+esp_err_t motor_apply_command(const motor_cmd_t *cmd);
+
+// Validate a batch and execute it in order on the control task. No other
+// command is applied between the first and last command of the batch; a
+// stop, disarm or UDP frame arriving during a wait ends the batch there.
+// Blocks until the batch is complete.
+esp_err_t motor_run_batch(const motor_cmd_t *cmds, size_t count, motor_batch_result_t *result);
+
+// Apply one throttle value per motor (0-1000 per mille, MOTOR_THROTTLE_UNCHANGED
+// to keep an output as is) on the control task and wait until it is on the wire.
+// A non-zero failsafe_ms arms the link failsafe: if no further frame arrives
+// within that time the control task stops all outputs.
+esp_err_t motor_submit_frame(const uint16_t throttle[MOTOR_COUNT], uint32_t failsafe_ms);
+
+// Stop all outputs on the control task and disarm the link failsafe
+esp_err_t motor_submit_disarm(void);
+
+// Keep every output stopped, e.g. while flash is written and the control task
+// would stall. Holding is refused with ESP_ERR_INVALID_STATE unless all
+// outputs are stopped; until every holder has released, commands, batches and
+// frames that would make an output pulse fail with ESP_ERR_INVALID_STATE.
+// Stops and disarms still go through.
+esp_err_t motor_hold_idle(bool hold);
+
+int motor_get_speed(int motor);
+int motor_get_throttle(int motor);   // per mille
+int motor_get_rpm(int motor);
+uint32_t motor_get_duty(int motor);
+esc_protocol_t motor_get_protocol(void);
+uint32_t motor_get_failsafe_trips(void);
+bool motor_failsafe_tripped(void);
+void motor_get_metrics(motor_metrics_t *out);
+void motor_get_switch_stats(motor_switch_stats_t *out);
+void motor_get_last_update(int motor, motor_update_t *out);
+void motor_get_protocol_timing(esc_protocol_t protocol, motor_protocol_timing_t *timing);
+int motor_get_gpio(int motor);
+
+// Re-attach a motor's LEDC output to its pad with the input buffer enabled,
+// after a capture peripheral was routed to the same pad
+void motor_route_output(int motor);
+
+// Measured speed of a motor for the RPM loop, e.g. from ESC telemetry. Queued
+// without waiting; ESP_ERR_TIMEOUT if the command ring is full. RPM setpoints
+// on a motor without a fresh measurement fail with ESP_ERR_INVALID_STATE.
+esp_err_t motor_submit_rpm_feedback(int motor, int32_t rpm);
+
+// RPM loop gains and rate, applied on the control task without resetting the integrators
+esp_err_t motor_set_rpm_tuning(const rpm_pid_config_t *cfg);
+void motor_get_rpm_tuning(rpm_pid_config_t *cfg);
+void motor_get_rpm_status(int motor, motor_rpm_status_t *status);
+
+// Called on the control task right after a motor's output has stopped, e.g. to
+// save what its map learned. Keep it short: the RPM loop and failsafe wait on it.
+typedef void (*motor_stop_cb_t)(int motor);
+void motor_set_stop_callback(motor_stop_cb_t cb);
+
+// Replace the learned feed-forward maps, e.g. with the ones saved in settings
+esp_err_t motor_restore_rpm_maps(const rpm_ff_map_t maps[MOTOR_COUNT]);
+
+// Copy a learned map. The map is only learned while its motor runs; returns
+// false if learning touched it during the copy.
+bool motor_get_rpm_map(int motor, rpm_ff_map_t *map);
+
+const char *motor_protocol_name(esc_protocol_t protocol);
+bool motor_protocol_from_name(const char *name, esc_protocol_t *protocol);
@@ -0,0 +1,579 @@
+#include <string.h>
+#include "motor_core.h"
+
+static_assert(sizeof(motor_core_state_t) == MOTOR_CORE_STATE_SIZE, "state layout changed, update MOTOR_CORE_STATE_SIZE");
+
+#define MOTOR_START_SPEED 50        // Throttle used by MOTOR_CMD_START
+#define RPM_LEARN_MAX_SLEW 2000     // RPM/s between measurements below which one counts as steady state
+#define RPM_SIM_MAX_DT_US 100000
+
+// Pulse timing per protocol, indexed by esc_protocol_t. All timers share the
+// 80 MHz PLL clock (the C6 has one LEDC clock source for every timer), which
+// limits Multishot at 32kHz to 11 bits.
+static const motor_protocol_timing_t protocol_timing[] = {
+    { 50,    14, 1000000, 2000000 },  // Standard PWM: 50Hz, 1-2ms pulses
+    { 2000,  13, 125000,  250000 },   // OneShot125: 2kHz, 125-250µs pulses
+    { 8000,  13, 42000,   84000 },    // OneShot42: 8kHz, 42-84µs pulses
+    { 32000, 11, 5000,    25000 },    // Multishot: 32kHz, 5-25µs pulses
+};
+
+static const char *protocol_names[] = { "standard", "oneshot125", "oneshot42", "multishot" };
+
+static uint32_t pulse_to_duty(uint32_t pulse_ns, const motor_protocol_timing_t *t)
+{
+    return (uint32_t)(((uint64_t)pulse_ns * t->frequency_hz << t->resolution_bits) / 1000000000ULL);
+}
+
+// Make a protocol current and recalculate PWM parameters
+static void set_protocol_params(motor_core_state_t *s, esc_protocol_t protocol)
+{
+    const motor_protocol_timing_t *t = &protocol_timing[protocol];
+    s->protocol = protocol;
+    s->pwm_frequency = t->frequency_hz;
+    s->pwm_min_duty = pulse_to_duty(t->min_pulse_ns, t);
+    s->pwm_max_duty = pulse_to_duty(t->max_pulse_ns, t);
+}
+
+// Convert throttle (0-1000 per mille) to PWM duty cycle based on current protocol
+static uint32_t throttle_to_pwm(const motor_core_state_t *s, int throttle)
+{
+    if (throttle < 0) throttle = 0;
+    if (throttle > 1000) throttle = 1000;
+    // Map 0-1000 to protocol-specific min-max duty range
+    return s->pwm_min_duty + ((throttle * (s->pwm_max_duty - s->pwm_min_duty)) / 1000);
+}
+
+// Drive one output; stopped outputs emit no pulses at all
+static void set_motor_output(motor_core_t *c, int motor, int throttle, bool stopped)
+{
+    motor_core_state_t *s = &c->s;
+    uint32_t duty = stopped ? 0 : throttle_to_pwm(s, throttle);
+    bool changed = duty != s->duty[motor];
+
+    s->throttle[motor] = stopped ? 0 : throttle;
+    s->duty[motor] = duty;
+    if (c->io && c->io->output) {
+        c->io->output(c->io->ctx, motor, duty, changed);
+    }
+}
+
+void motor_core_init(motor_core_t *c, const motor_core_io_t *io, int64_t now_us)
+{
+    memset(c, 0, sizeof(*c));
+    c->io = io;
+    motor_core_state_t *s = &c->s;
+    set_protocol_params(s, PROTOCOL_STANDARD);
+    // No derivative: measurements arrive as frames, and the loop holds each
+    // one until the next, so a D term would only kick once per frame
+    s->rpm_config = { RPM_Q16(0.01f), RPM_Q16(0.1f), 0, MOTOR_RPM_DEFAULT_HZ };
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        rpm_pid_init(&s->rpm_pid[m], &s->rpm_config);
+        rpm_ff_init(&s->rpm_map[m], MOTOR_RPM_MAX);
+        rpm_sim_init(&s->rpm_sim[m], MOTOR_RPM_MAX);
+    }
+    s->sim_last_us = now_us;
+    c->quiet = true;
+}
+
+void motor_core_get_timing(esc_protocol_t protocol, motor_protocol_timing_t *timing)
+{
+    *timing = protocol_timing[protocol];
+}
+
+const char *motor_core_protocol_name(esc_protocol_t protocol)
+{
+    return protocol_names[protocol];
+}
+
+bool motor_core_protocol_from_name(const char *name, esc_protocol_t *protocol)
+{
+    for (int p = PROTOCOL_STANDARD; p <= PROTOCOL_MULTISHOT; p++) {
+        if (strcmp(name, protocol_names[p]) == 0) {
+            *protocol = (esc_protocol_t)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool motor_core_command_valid(const motor_cmd_t *cmd)
+{
+    if (cmd->motor != MOTOR_ALL && (cmd->motor < 0 || cmd->motor >= MOTOR_COUNT)) {
+        return false;
+    }
+
+    switch (cmd->type) {
+        case MOTOR_CMD_SPEED:
+            return cmd->value >= 0 && cmd->value <= 100;
+        case MOTOR_CMD_THROTTLE:
+            return cmd->value >= 0 && cmd->value <= 1000;
+        case MOTOR_CMD_PROTOCOL:
+            if (cmd->value & ~(MOTOR_PROTOCOL_MASK | MOTOR_PROTOCOL_PRESERVE)) return false;
+            return (cmd->value & MOTOR_PROTOCOL_MASK) <= PROTOCOL_MULTISHOT;
+        case MOTOR_CMD_WAIT:
+            return cmd->value >= 0 && cmd->value <= MOTOR_BATCH_MAX_WAIT_MS;
+        case MOTOR_CMD_RPM:
+            return cmd->value >= 0 && cmd->value <= MOTOR_RPM_MAX;
+        case MOTOR_CMD_START:
+        case MOTOR_CMD_STOP:
+            return true;
+    }
+    return false;
+}
+
+// Stage a protocol on the spare timer and move every output over between two pulses
+static void switch_protocol(motor_core_t *c, esc_protocol_t protocol, bool preserve)
+{
+    motor_core_state_t *s = &c->s;
+    if (c->io && c->io->protocol_begin && !c->io->protocol_begin(c->io->ctx, protocol)) {
+        c->aborted = true;
+        return;
+    }
+    set_protocol_params(s, protocol);
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (preserve && s->duty[m] > 0) {
+            set_motor_output(c, m, s->throttle[m], false);
+        } else {
+            s->rpm_hold[m] = false;
+            set_motor_output(c, m, 0, true);
+        }
+    }
+    if (c->io && c->io->protocol_end) {
+        c->io->protocol_end(c->io->ctx);
+    }
+}
+
+// Enter or retarget RPM hold; the feed-forward throttle goes out immediately
+static void start_rpm_hold(motor_core_t *c, int motor, int32_t target, int64_t now)
+{
+    motor_core_state_t *s = &c->s;
+    if (!s->rpm_hold[motor]) {
+        rpm_pid_reset(&s->rpm_pid[motor]);
+        s->rpm_hold[motor] = true;
+    }
+    s->rpm_target[motor] = target;
+    rpm_step_start(&s->rpm_step[motor], s->rpm_measured[motor], target, now);
+    set_motor_output(c, motor, rpm_ff_throttle_for(&s->rpm_map[motor], target), false);
+}
+
+static void apply_command(motor_core_t *c, const motor_cmd_t *cmd, int64_t now)
+{
+    motor_core_state_t *s = &c->s;
+    int first = cmd->motor == MOTOR_ALL ? 0 : cmd->motor;
+    int last = cmd->motor == MOTOR_ALL ? MOTOR_COUNT - 1 : cmd->motor;
+
+    // Open-loop commands take the motor out of RPM hold, protocol switches decide for themselves
+    if (cmd->type != MOTOR_CMD_RPM && cmd->type != MOTOR_CMD_WAIT && cmd->type != MOTOR_CMD_PROTOCOL) {
+        for (int m = first; m <= last; m++) s->rpm_hold[m] = false;
+    }
+
+    switch (cmd->type) {
+        case MOTOR_CMD_SPEED:
+            for (int m = first; m <= last; m++) set_motor_output(c, m, cmd->value * 10, false);
+            break;
+        case MOTOR_CMD_THROTTLE:
+            for (int m = first; m <= last; m++) set_motor_output(c, m, cmd->value, false);
+            break;
+        case MOTOR_CMD_START:
+            for (int m = first; m <= last; m++) set_motor_output(c, m, MOTOR_START_SPEED * 10, false);
+            break;
+        case MOTOR_CMD_STOP:
+            for (int m = first; m <= last; m++) set_motor_output(c, m, 0, true);
+            break;
+        case MOTOR_CMD_PROTOCOL:
+            // Applies to all motors; without PRESERVE they are reset to off
+            switch_protocol(c, (esc_protocol_t)(cmd->value & MOTOR_PROTOCOL_MASK),
+                            (cmd->value & MOTOR_PROTOCOL_PRESERVE) != 0);
+            break;
+        case MOTOR_CMD_RPM:
+            for (int m = first; m <= last; m++) {
+                if (cmd->value == 0) {
+                    s->rpm_hold[m] = false;
+                    set_motor_output(c, m, 0, true);
+                } else {
+                    start_rpm_hold(c, m, cmd->value, now);
+                }
+            }
+            break;
+        case MOTOR_CMD_WAIT:
+            break;
+    }
+}
+
+static void stop_all_outputs(motor_core_t *c)
+{
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        c->s.rpm_hold[m] = false;
+        set_motor_output(c, m, 0, true);
+    }
+}
+
+static void apply_frame(motor_core_t *c, const motor_input_t *in)
+{
+    motor_core_state_t *s = &c->s;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (in->frame.throttle[m] != MOTOR_THROTTLE_UNCHANGED) {
+            s->rpm_hold[m] = false;
+            set_motor_output(c, m, in->frame.throttle[m], false);
+        }
+    }
+
+    s->failsafe_timeout_ms = in->frame.failsafe_ms;
+    s->failsafe_last_frame_us = in->now_us;
+    s->failsafe_active = false;
+}
+
+// Zero every output once the armed link has been silent for longer than its timeout
+static void check_failsafe(motor_core_t *c, int64_t now)
+{
+    motor_core_state_t *s = &c->s;
+    if (s->failsafe_timeout_ms == 0) {
+        return;
+    }
+    if (now - s->failsafe_last_frame_us > (int64_t)s->failsafe_timeout_ms * 1000) {
+        stop_all_outputs(c);
+        s->failsafe_timeout_ms = 0;
+        s->failsafe_active = true;
+        s->failsafe_trips++;
+    }
+}
+
+// Advance the motor/prop model to now. Returns true if any model moved.
+static bool step_motor_models(motor_core_state_t *s, int64_t now)
+{
+    uint32_t dt = (uint32_t)(now - s->sim_last_us);
+    if (dt == 0) {
+        return false;
+    }
+    if (dt > RPM_SIM_MAX_DT_US) dt = RPM_SIM_MAX_DT_US;
+    s->sim_last_us = now;
+
+    bool moved = false;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        int64_t before_q8 = s->rpm_sim[m].rpm_q8;
+        s->rpm[m] = rpm_sim_step(&s->rpm_sim[m], s->throttle[m], dt);
+        moved |= s->rpm_sim[m].rpm_q8 != before_q8;
+    }
+    return moved;
+}
+
+bool motor_core_rpm_fresh(const motor_core_t *c, int motor, int64_t now_us)
+{
+    int64_t at = c->s.rpm_measured_us[motor];
+    return at != 0 && now_us - at <= MOTOR_RPM_FEEDBACK_US;
+}
+
+// Take a measurement; two in a row that agree on a steady speed teach the
+// feed-forward map what the current throttle does
+static void apply_feedback(motor_core_t *c, int motor, int32_t rpm, int64_t now)
+{
+    motor_core_state_t *s = &c->s;
+    if (motor >= MOTOR_COUNT) {
+        c->aborted = true;
+        return;
+    }
+    if (s->throttle[motor] > 0 && motor_core_rpm_fresh(c, motor, now) && now > s->rpm_measured_us[motor]) {
+        int64_t slew = (int64_t)(rpm - s->rpm_measured[motor]) * 1000000 / (now - s->rpm_measured_us[motor]);
+        if (slew < RPM_LEARN_MAX_SLEW && slew > -RPM_LEARN_MAX_SLEW) {
+            rpm_ff_learn(&s->rpm_map[motor], s->throttle[motor], rpm);
+        }
+    }
+    s->rpm_measured[motor] = rpm;
+    s->rpm_measured_us[motor] = now;
+}
+
+static void rpm_loop_tick(motor_core_t *c, int64_t now)
+{
+    motor_core_state_t *s = &c->s;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (!s->rpm_hold[m]) {
+            continue;
+        }
+        // Without measurements the loop would drive blind
+        if (!motor_core_rpm_fresh(c, m, now)) {
+            s->rpm_hold[m] = false;
+            s->rpm_feedback_lost++;
+            set_motor_output(c, m, 0, true);
+            continue;
+        }
+        int32_t rpm = s->rpm_measured[m];
+        int32_t ff = rpm_ff_throttle_for(&s->rpm_map[m], s->rpm_target[m]);
+        set_motor_output(c, m, rpm_pid_update(&s->rpm_pid[m], s->rpm_target[m], rpm, ff, 0, 1000), false);
+        rpm_step_update(&s->rpm_step[m], rpm, now);
+    }
+}
+
+bool motor_core_any_hold(const motor_core_t *c)
+{
+    bool any = false;
+    for (int m = 0; m < MOTOR_COUNT; m++) any |= c->s.rpm_hold[m];
+    return any;
+}
+
+// Nothing driven, nothing armed: ticks can only settle the models
+static bool outputs_idle(const motor_core_state_t *s)
+{
+    if (s->failsafe_timeout_ms != 0) {
+        return false;
+    }
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        if (s->duty[m] != 0 || s->rpm_hold[m]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// FNV-1a over the fields a divergence shows up in first
+static uint32_t fnv_u32(uint32_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        h = (h ^ ((v >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t motor_core_check(const motor_core_state_t *s)
+{
+    uint32_t h = 2166136261u;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        h = fnv_u32(h, (uint32_t)s->throttle[m]);
+        h = fnv_u32(h, s->duty[m]);
+        h = fnv_u32(h, (uint32_t)s->rpm_sim[m].rpm_q8);
+        h = fnv_u32(h, s->rpm_hold[m] ? (uint32_t)s->rpm_target[m] : 0);
+        h = fnv_u32(h, (uint32_t)s->rpm_pid[m].integ_q16);
+        h = fnv_u32(h, s->rpm_map[m].samples);
+        h = fnv_u32(h, (uint32_t)s->rpm_measured[m]);
+    }
+    h = fnv_u32(h, s->protocol);
+    h = fnv_u32(h, s->failsafe_timeout_ms);
+    h = fnv_u32(h, s->rpm_feedback_lost);
+    return fnv_u32(h, s->failsafe_trips);
+}
+
+static void emit(motor_core_t *c, int64_t now, const uint8_t *data, size_t len)
+{
+    c->io->record(c->io->ctx, now, data, len);
+    c->seq++;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static void record_snapshot(motor_core_t *c, int64_t now)
+{
+    uint8_t rec[MOTOR_REC_MAX];
+    const uint8_t *state = (const uint8_t *)&c->s;
+    uint32_t check = motor_core_check(&c->s);
+    for (size_t ofs = 0; ofs < sizeof(c->s); ofs += MOTOR_REC_CHUNK) {
+        size_t n = sizeof(c->s) - ofs < MOTOR_REC_CHUNK ? sizeof(c->s) - ofs : MOTOR_REC_CHUNK;
+        rec[0] = MOTOR_REC_SNAPSHOT;
+        put_u16(rec + 1, c->seq);
+        put_u32(rec + 3, check);
+        put_u16(rec + 7, (uint16_t)sizeof(c->s));
+        put_u16(rec + 9, (uint16_t)ofs);
+        memcpy(rec + 11, state + ofs, n);
+        emit(c, now, rec, 11 + n);
+    }
+    c->snapshot_us = now;
+    c->snapshots++;
+}
+
+void motor_core_apply(motor_core_t *c, const motor_input_t *in)
+{
+    motor_core_state_t *s = &c->s;
+    bool recording = c->io && c->io->record;
+    int64_t now = in->now_us;
+    bool moved = false;
+
+    // Ticks, and measurements while quiet, leave a quiet bench quiet. The
+    // measurements are still recorded: the next command may need them fresh.
+    bool passive = in->kind == MOTOR_IN_TICK || (c->quiet && in->kind == MOTOR_IN_RPM);
+    if (recording && c->snapshots == 0 && in->kind != MOTOR_IN_TICK) {
+        passive = false;   // The first record after boot needs a state to replay from
+    }
+
+    // A wake-up from quiet starts with the state it wakes up in. The models
+    // were at rest since the last recorded tick, so restarting their clock
+    // here changes nothing but keeps the unrecorded ticks out of the state.
+    if (c->quiet && !passive) {
+        s->sim_last_us = now;
+        if (recording) {
+            record_snapshot(c, now);
+        }
+    }
+
+    c->aborted = false;
+    switch (in->kind) {
+        case MOTOR_IN_TICK:
+            check_failsafe(c, now);
+            moved = step_motor_models(s, now);
+            if (in->rpm_due) {
+                rpm_loop_tick(c, now);
+            }
+            break;
+        case MOTOR_IN_COMMAND:
+            apply_command(c, &in->cmd, now);
+            break;
+        case MOTOR_IN_FRAME:
+            apply_frame(c, in);
+            break;
+        case MOTOR_IN_DISARM:
+            stop_all_outputs(c);
+            s->failsafe_timeout_ms = 0;
+            s->failsafe_active = false;   // A deliberate disarm ends the tripped state too
+            break;
+        case MOTOR_IN_TUNING:
+            s->rpm_config = in->tuning;
+            for (int m = 0; m < MOTOR_COUNT; m++) s->rpm_pid[m].cfg = s->rpm_config;
+            break;
+        case MOTOR_IN_MAP:
+            if (in->map.motor < MOTOR_COUNT) s->rpm_map[in->map.motor] = in->map.map;
+            break;
+        case MOTOR_IN_RPM:
+            apply_feedback(c, in->feedback.motor, in->feedback.rpm, now);
+            break;
+    }
+
+    if (!recording) {
+        // Nothing to write, quiet is kept all the same so a replay wakes up like the bench
+    } else if (in->kind == MOTOR_IN_TICK && c->quiet) {
+        // Settling after a stop; the state it came to rest in goes out instead of the ticks
+        if (moved) {
+            record_snapshot(c, now);
+        }
+    } else if (!c->aborted) {
+        uint8_t rec[MOTOR_REC_MAX];
+        size_t len = motor_rec_encode(in, c->seq, motor_core_check(s), rec);
+        emit(c, now, rec, len);
+        c->recorded++;
+        if (!c->quiet && now - c->snapshot_us >= MOTOR_CORE_SNAPSHOT_US) {
+            record_snapshot(c, now);
+        }
+    }
+    // Quiet once a tick finds everything stopped and the models at rest
+    c->quiet = passive && !moved && outputs_idle(s);
+}
+
+size_t motor_rec_encode(const motor_input_t *in, uint16_t seq, uint32_t check, uint8_t *out)
+{
+    uint8_t *p = out + MOTOR_REC_HEADER;
+    out[0] = (uint8_t)in->kind;
+    put_u16(out + 1, seq);
+    put_u32(out + 3, check);
+    switch (in->kind) {
+        case MOTOR_IN_TICK:
+            *p++ = in->rpm_due;
+            break;
+        case MOTOR_IN_COMMAND:
+            *p++ = (uint8_t)in->cmd.type;
+            *p++ = (uint8_t)in->cmd.motor;
+            put_u32(p, (uint32_t)in->cmd.value);
+            p += 4;
+            break;
+        case MOTOR_IN_FRAME:
+            for (int m = 0; m < MOTOR_COUNT; m++, p += 2) put_u16(p, in->frame.throttle[m]);
+            put_u32(p, in->frame.failsafe_ms);
+            p += 4;
+            break;
+        case MOTOR_IN_DISARM:
+            break;
+        case MOTOR_IN_TUNING:
+            put_u32(p, (uint32_t)in->tuning.kp_q16);
+            put_u32(p + 4, (uint32_t)in->tuning.ki_q16);
+            put_u32(p + 8, (uint32_t)in->tuning.kd_q16);
+            put_u32(p + 12, in->tuning.rate_hz);
+            p += 16;
+            break;
+        case MOTOR_IN_MAP:
+            *p++ = in->map.motor;
+            for (int i = 0; i < RPM_MAP_POINTS; i++, p += 4) put_u32(p, (uint32_t)in->map.map.rpm_q4[i]);
+            put_u32(p, in->map.map.samples);
+            p += 4;
+            break;
+        case MOTOR_IN_RPM:
+            *p++ = in->feedback.motor;
+            put_u32(p, (uint32_t)in->feedback.rpm);
+            p += 4;
+            break;
+    }
+    return (size_t)(p - out);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool motor_rec_decode(const uint8_t *data, size_t len, motor_rec_t *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    if (len < MOTOR_REC_HEADER) {
+        return false;
+    }
+    rec->kind = data[0];
+    rec->seq = get_u16(data + 1);
+    rec->check = get_u32(data + 3);
+    const uint8_t *p = data + MOTOR_REC_HEADER;
+    size_t n = len - MOTOR_REC_HEADER;
+    motor_input_t *in = &rec->input;
+    in->kind = (motor_input_kind_t)rec->kind;
+
+    switch (rec->kind) {
+        case MOTOR_REC_SNAPSHOT:
+            if (n < 4) return false;
+            rec->state_size = get_u16(p);
+            rec->offset = get_u16(p + 2);
+            rec->chunk = p + 4;
+            rec->chunk_len = n - 4;
+            return true;
+        case MOTOR_IN_TICK:
+            in->rpm_due = n >= 1 && p[0];
+            return n == 1;
+        case MOTOR_IN_COMMAND:
+            if (n != 6) return false;
+            in->cmd.type = (motor_cmd_type_t)p[0];
+            in->cmd.motor = (int8_t)p[1];
+            in->cmd.value = (int32_t)get_u32(p + 2);
+            return true;
+        case MOTOR_IN_FRAME:
+            if (n != 2 * MOTOR_COUNT + 4) return false;
+            for (int m = 0; m < MOTOR_COUNT; m++) in->frame.throttle[m] = get_u16(p + 2 * m);
+            in->frame.failsafe_ms = get_u32(p + 2 * MOTOR_COUNT);
+            return true;
+        case MOTOR_IN_DISARM:
+            return n == 0;
+        case MOTOR_IN_TUNING:
+            if (n != 16) return false;
+            in->tuning.kp_q16 = (int32_t)get_u32(p);
+            in->tuning.ki_q16 = (int32_t)get_u32(p + 4);
+            in->tuning.kd_q16 = (int32_t)get_u32(p + 8);
+            in->tuning.rate_hz = get_u32(p + 12);
+            return true;
+        case MOTOR_IN_MAP:
+            if (n != 1 + 4 * RPM_MAP_POINTS + 4) return false;
+            in->map.motor = p[0];
+            for (int i = 0; i < RPM_MAP_POINTS; i++) in->map.map.rpm_q4[i] = (int32_t)get_u32(p + 1 + 4 * i);
+            in->map.map.samples = get_u32(p + 1 + 4 * RPM_MAP_POINTS);
+            return true;
+        case MOTOR_IN_RPM:
+            if (n != 5) return false;
+            in->feedback.motor = p[0];
+            in->feedback.rpm = (int32_t)get_u32(p + 1);
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "rpm_control.h"
+
+// Decision logic of the motor control task: commands, UDP frames, the link
+// failsafe, RPM hold and the motor model, driven by timestamped inputs. The
+// task in motor_control.cpp owns the hardware and feeds this core; every
+// input the core applies can be recorded and replayed on a Linux host
+// (host/control_replay.cpp) through the same code with a virtual clock.
+
+// Number of ESC outputs on the bench (GPIOs are listed in motor_control.cpp)
+#define MOTOR_COUNT 2
+#define MOTOR_ALL   -1
+
+// ESC Protocol types
+typedef enum {
+    PROTOCOL_STANDARD,   // Standard PWM: 50Hz, 1-2ms pulses
+    PROTOCOL_ONESHOT125, // OneShot125: 125-250µs pulses at motor update rate
+    PROTOCOL_ONESHOT42,  // OneShot42: 42-84µs pulses
+    PROTOCOL_MULTISHOT   // Multishot: 5-25µs pulses
+} esc_protocol_t;
+
+// Pulse timing of a protocol
+typedef struct {
+    uint32_t frequency_hz;
+    uint8_t resolution_bits;
+    uint32_t min_pulse_ns;   // Zero throttle
+    uint32_t max_pulse_ns;   // Full throttle
+} motor_protocol_timing_t;
+
+// Commands applied by the motor control task
+typedef enum {
+    MOTOR_CMD_SPEED,     // Set throttle, value = 0-100%
+    MOTOR_CMD_THROTTLE,  // Set throttle, value = 0-1000 per mille
+    MOTOR_CMD_START,     // Spin up at the default 50% throttle
+    MOTOR_CMD_STOP,      // Stop output pulses
+    MOTOR_CMD_PROTOCOL,  // Switch ESC protocol, value = esc_protocol_t (stops all motors
+                         // unless MOTOR_PROTOCOL_PRESERVE is or'ed in)
+    MOTOR_CMD_WAIT,      // Hold the current outputs, value = milliseconds
+    MOTOR_CMD_RPM        // Closed-loop RPM hold, value = target RPM (0 stops the motor)
+} motor_cmd_type_t;
+
+// Keep running motors at their throttle across a protocol switch
+#define MOTOR_PROTOCOL_PRESERVE 0x100
+#define MOTOR_PROTOCOL_MASK     0xFF
+
+typedef struct {
+    motor_cmd_type_t type;
+    int8_t motor;        // Motor index or MOTOR_ALL
+    int32_t value;
+} motor_cmd_t;
+
+#define MOTOR_BATCH_MAX_WAIT_MS  10000   // Sum of all waits in one batch
+#define MOTOR_THROTTLE_UNCHANGED 0xFFFF  // Frame slot that keeps an output as is
+
+// Closed-loop RPM hold. The loop closes around measured speed, fed in as
+// MOTOR_IN_RPM (ESC telemetry on the bench); it only starts on a motor whose
+// last measurement is younger than MOTOR_RPM_FEEDBACK_US, and a hold whose
+// measurements stop for that long is ended and the motor stopped. Any
+// open-loop command (speed, throttle, start, stop, protocol, UDP frame,
+// failsafe) on a motor ends its RPM hold as well.
+#define MOTOR_RPM_MAX          20000   // Setpoint limit, also the simulated motor's full-throttle RPM
+#define MOTOR_RPM_RATE_MIN_HZ  50
+#define MOTOR_RPM_RATE_MAX_HZ  2000
+#define MOTOR_RPM_DEFAULT_HZ   1000
+#define MOTOR_RPM_FEEDBACK_US  250000
+
+// Everything the core decides from. Plain data without pointers, laid out
+// the same on the ESP32-C6 and 64-bit hosts, so a snapshot taken on the
+// bench loads into a replay. Change MOTOR_CORE_STATE_SIZE with the layout.
+typedef struct {
+    int32_t throttle[MOTOR_COUNT];     // Per mille, 0 while stopped
+    int32_t rpm[MOTOR_COUNT];          // Motor model; neither the loop nor the maps use it
+    uint32_t duty[MOTOR_COUNT];        // LEDC duty on the wire, 0 = no pulses
+    uint32_t protocol;                 // esc_protocol_t
+    uint32_t pwm_frequency;
+    uint32_t pwm_min_duty;
+    uint32_t pwm_max_duty;
+
+    bool rpm_hold[MOTOR_COUNT];
+    int32_t rpm_target[MOTOR_COUNT];
+    rpm_pid_config_t rpm_config;
+    rpm_pid_t rpm_pid[MOTOR_COUNT];
+    rpm_ff_map_t rpm_map[MOTOR_COUNT];
+    rpm_step_t rpm_step[MOTOR_COUNT];
+    rpm_sim_motor_t rpm_sim[MOTOR_COUNT];
+    int64_t sim_last_us;
+    int64_t rpm_measured_us[MOTOR_COUNT];  // Time of the last measurement, 0 = none yet
+    int32_t rpm_measured[MOTOR_COUNT];
+    uint32_t rpm_feedback_lost;        // Holds ended because measurements stopped
+
+    uint32_t failsafe_timeout_ms;      // Armed by frames, 0 = off
+    int64_t failsafe_last_frame_us;
+    bool failsafe_active;
+    uint32_t failsafe_trips;
+} motor_core_state_t;
+
+#define MOTOR_CORE_STATE_SIZE 496
+
+// Inputs, each stamped with the time it is applied at
+typedef enum {
+    MOTOR_IN_TICK,       // Periodic work: failsafe, motor model, RPM loop if due
+    MOTOR_IN_COMMAND,    // A validated command other than MOTOR_CMD_WAIT
+    MOTOR_IN_FRAME,      // UDP throttle frame
+    MOTOR_IN_DISARM,     // Stop everything and disarm the failsafe
+    MOTOR_IN_TUNING,     // RPM loop gains and rate
+    MOTOR_IN_MAP,        // Replace one motor's feed-forward map
+    MOTOR_IN_RPM         // Measured speed of one motor
+} motor_input_kind_t;
+
+typedef struct {
+    motor_input_kind_t kind;
+    int64_t now_us;
+    union {
+        bool rpm_due;                  // Tick: the loop timer fired since the last tick
+        motor_cmd_t cmd;
+        struct {
+            uint16_t throttle[MOTOR_COUNT];
+            uint32_t failsafe_ms;
+        } frame;
+        rpm_pid_config_t tuning;
+        struct {
+            uint8_t motor;
+            rpm_ff_map_t map;
+        } map;
+        struct {
+            uint8_t motor;
+            int32_t rpm;
+        } feedback;
+    };
+} motor_input_t;
+
+// Hardware behind the core; any hook may be NULL, as in a replay
+typedef struct {
+    void *ctx;
+    // Put a duty on the wire. Called for every output the core sets, changed or not.
+    void (*output)(void *ctx, int motor, uint32_t duty, bool changed);
+    // Stage protocol and stop the old timer between pulses. Returning false
+    // aborts the switch; nothing has changed and the input is not recorded.
+    bool (*protocol_begin)(void *ctx, esc_protocol_t protocol);
+    void (*protocol_end)(void *ctx);
+    // A record to keep, see below
+    void (*record)(void *ctx, int64_t now_us, const uint8_t *data, size_t len);
+} motor_core_io_t;
+
+typedef struct {
+    motor_core_state_t s;
+    const motor_core_io_t *io;
+    // Recording, not part of the state
+    bool quiet;                        // Stopped and settled: ticks change nothing and are not recorded
+    bool aborted;                      // The input being applied did nothing
+    uint16_t seq;
+    int64_t snapshot_us;
+    uint32_t recorded;
+    uint32_t snapshots;
+} motor_core_t;
+
+void motor_core_init(motor_core_t *c, const motor_core_io_t *io, int64_t now_us);
+bool motor_core_command_valid(const motor_cmd_t *cmd);
+void motor_core_apply(motor_core_t *c, const motor_input_t *in);
+bool motor_core_any_hold(const motor_core_t *c);
+// A measurement of the motor arrived within MOTOR_RPM_FEEDBACK_US of now
+bool motor_core_rpm_fresh(const motor_core_t *c, int motor, int64_t now_us);
+void motor_core_get_timing(esc_protocol_t protocol, motor_protocol_timing_t *timing);
+const char *motor_core_protocol_name(esc_protocol_t protocol);
+bool motor_core_protocol_from_name(const char *name, esc_protocol_t *protocol);
+
+// Digest of the outputs, RPM loop and failsafe, carried by every record so a
+// replay can tell the first input where it went a different way
+uint32_t motor_core_check(const motor_core_state_t *s);
+
+// Records. Each applied input becomes one record: kind, u16 sequence, u32
+// check of the state after it, then the input's fields, little-endian. While
+// the bench is quiet, ticks are not recorded; a snapshot of the whole state
+// goes out before the first input that wakes it, and every
+// MOTOR_CORE_SNAPSHOT_US while busy, so a capture can start at any time.
+#define MOTOR_REC_SNAPSHOT     0x80    // u16 state size, u16 offset, up to MOTOR_REC_CHUNK bytes
+#define MOTOR_REC_HEADER       7
+#define MOTOR_REC_CHUNK        96
+#define MOTOR_REC_MAX          (MOTOR_REC_HEADER + 4 + MOTOR_REC_CHUNK)
+#define MOTOR_CORE_SNAPSHOT_US 10000000
+
+typedef struct {
+    uint8_t kind;                      // motor_input_kind_t or MOTOR_REC_SNAPSHOT
+    uint16_t seq;
+    uint32_t check;
+    motor_input_t input;               // now_us is left 0, the time travels with the record
+    uint16_t state_size;               // Snapshot chunks
+    uint16_t offset;
+    const uint8_t *chunk;              // Points into the record
+    size_t chunk_len;
+} motor_rec_t;
+
+size_t motor_rec_encode(const motor_input_t *in, uint16_t seq, uint32_t check, uint8_t *out);
+bool motor_rec_decode(const uint8_t *data, size_t len, motor_rec_t *rec);
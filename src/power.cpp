@@ -0,0 +1,172 @@
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_private/esp_clk.h"
+#include "power.h"
+
+static const char *TAG = "power";
+
+// Power-save changes go through the event loop so clients never wait on the WiFi driver
+ESP_EVENT_DECLARE_BASE(POWER_EVENT);
+ESP_EVENT_DEFINE_BASE(POWER_EVENT);
+#define POWER_EVENT_ACTIVITY 0
+
+static const char *client_names[POWER_CLIENT_COUNT] = { "motor", "selftest", "vibration" };
+
+// One CPU and one APB lock per client so clients never share a reference count
+static esp_pm_lock_handle_t cpu_locks[POWER_CLIENT_COUNT];
+static esp_pm_lock_handle_t apb_locks[POWER_CLIENT_COUNT];
+static bool pm_enabled = false;
+static bool wifi_started = false;
+
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool client_active[POWER_CLIENT_COUNT];
+static int64_t client_since_us[POWER_CLIENT_COUNT];
+static uint64_t client_total_us[POWER_CLIENT_COUNT];
+static int active_count = 0;
+static int64_t busy_since_us = 0;
+static uint64_t busy_total_us = 0;
+static bool modem_sleep = false;
+
+static void apply_power_save(void)
+{
+    portENTER_CRITICAL(&power_lock);
+    bool busy = active_count > 0;
+    portEXIT_CRITICAL(&power_lock);
+
+    // Modem sleep adds up to a beacon interval of receive latency; UDP control needs it off
+    bool sleep = !busy;
+    if (sleep != modem_sleep && esp_wifi_set_ps(sleep ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE) == ESP_OK) {
+        modem_sleep = sleep;
+        ESP_LOGD(TAG, "Modem sleep %s", sleep ? "on" : "off");
+    }
+}
+
+static void power_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    apply_power_save();
+}
+
+esp_err_t power_init(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {};
+    pm_config.max_freq_mhz = POWER_CPU_MAX_MHZ;
+    pm_config.min_freq_mhz = POWER_CPU_MIN_MHZ;
+    pm_config.light_sleep_enable = false;   // Light sleep would stop the LEDC timers
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "DFS not available: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int c = 0; c < POWER_CLIENT_COUNT; c++) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, client_names[c], &cpu_locks[c]);
+        if (err == ESP_OK) err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, client_names[c], &apb_locks[c]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    pm_enabled = true;
+    ESP_LOGI(TAG, "DFS %d-%d MHz", POWER_CPU_MIN_MHZ, POWER_CPU_MAX_MHZ);
+#else
+    ESP_LOGI(TAG, "CONFIG_PM_ENABLE is off, running at a fixed CPU frequency");
+#endif
+    return ESP_OK;
+}
+
+void power_wifi_started(void)
+{
+    esp_event_handler_register(POWER_EVENT, POWER_EVENT_ACTIVITY, &power_event_handler, NULL);
+    wifi_started = true;
+    apply_power_save();
+}
+
+void power_set_active(power_client_t client, bool active)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&power_lock);
+    bool changed = client_active[client] != active;
+    bool edge = false;   // Bench went from idle to busy or back
+    if (changed) {
+        client_active[client] = active;
+        if (active) {
+            client_since_us[client] = now;
+            edge = active_count++ == 0;
+            if (edge) busy_since_us = now;
+        } else {
+            client_total_us[client] += now - client_since_us[client];
+            edge = --active_count == 0;
+            if (edge) busy_total_us += now - busy_since_us;
+        }
+    }
+    portEXIT_CRITICAL(&power_lock);
+
+    if (!changed) {
+        return;
+    }
+    if (pm_enabled) {
+        if (active) {
+            esp_pm_lock_acquire(cpu_locks[client]);
+            esp_pm_lock_acquire(apb_locks[client]);
+        } else {
+            esp_pm_lock_release(apb_locks[client]);
+            esp_pm_lock_release(cpu_locks[client]);
+        }
+    }
+    if (edge && wifi_started) {
+        esp_event_post(POWER_EVENT, POWER_EVENT_ACTIVITY, NULL, 0, 0);
+    }
+}
+
+void power_get_stats(power_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+    for (int c = 0; c < POWER_CLIENT_COUNT; c++) {
+        out->active[c] = client_active[c];
+        uint64_t total = client_total_us[c];
+        if (client_active[c]) total += now - client_since_us[c];
+        out->active_ms[c] = total / 1000;
+    }
+    uint64_t busy_us = busy_total_us;
+    if (active_count > 0) busy_us += now - busy_since_us;
+    bool busy = active_count > 0;
+    portEXIT_CRITICAL(&power_lock);
+
+    out->pm_enabled = pm_enabled;
+    out->modem_sleep = modem_sleep;
+    out->cpu_mhz = esp_clk_cpu_freq() / 1000000;
+    out->busy_ms = busy_us / 1000;
+    out->idle_ms = (uint64_t)now / 1000 - out->busy_ms;
+
+    wifi_mode_t mode = WIFI_MODE_NULL;
+    esp_wifi_get_mode(&mode);
+    out->ap_running = mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA;
+
+    // Modem sleep only applies to a station on its own; the AP keeps the receiver on
+    uint32_t radio_ma = 0;
+    if (mode != WIFI_MODE_NULL) {
+        radio_ma = (out->ap_running || !modem_sleep) ? POWER_EST_RADIO_ON_MA : POWER_EST_RADIO_SLEEP_MA;
+    }
+    uint32_t idle_cpu_ma = pm_enabled ? POWER_EST_CPU_MIN_MA : POWER_EST_CPU_MAX_MA;
+    out->est_ma = (busy ? POWER_EST_CPU_MAX_MA : idle_cpu_ma) + radio_ma;
+
+    uint64_t total_ms = out->busy_ms + out->idle_ms;
+    if (total_ms > 0) {
+        out->est_avg_ma = (uint32_t)((out->busy_ms * POWER_EST_CPU_MAX_MA + out->idle_ms * idle_cpu_ma) / total_ms)
+                          + radio_ma;
+    }
+}
+
+const char *power_client_name(power_client_t client)
+{
+    return client < POWER_CLIENT_COUNT ? client_names[client] : "unknown";
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Power management: the CPU scales between POWER_CPU_MIN_MHZ and
+// POWER_CPU_MAX_MHZ and the station uses modem sleep while the bench is idle.
+// Anything with timing on the wire marks itself active, which holds the
+// clocks at full speed and keeps the radio awake until it is done.
+//
+// The INA226 and HX711 samplers are not clients. Both convert on their own
+// oscillators and signal ready on a pin whose interrupt is stamped with
+// esp_timer, which runs from the XTAL whatever the CPU does. The I2C driver
+// clocks the INA226 bus from the XTAL, and the HX711 clock pulses come from
+// esp_rom_delay_us, which follows the current CPU frequency. The fast INA226
+// trace only runs inside the IR test, with the motor client active.
+
+#define POWER_CPU_MAX_MHZ 160
+#define POWER_CPU_MIN_MHZ 40     // XTAL, lowest frequency WiFi allows
+
+// Rough figures from the ESP32-C6 datasheet, for the estimate only
+#define POWER_EST_CPU_MAX_MA     30   // CPU at max frequency
+#define POWER_EST_CPU_MIN_MA     12   // CPU scaled down, mostly idle
+#define POWER_EST_RADIO_ON_MA    60   // Receiver always on (AP running or no modem sleep)
+#define POWER_EST_RADIO_SLEEP_MA 10   // Station in modem sleep, averaged over beacon wakeups
+
+typedef enum {
+    POWER_CLIENT_MOTOR,      // An ESC output is generating pulses
+    POWER_CLIENT_SELFTEST,   // Output capture running
+    POWER_CLIENT_VIBRATION,  // IMU sampler enabled: FIFO drain and FFT at up to 8 kHz, WebSocket stream
+    POWER_CLIENT_COUNT
+} power_client_t;
+
+typedef struct {
+    bool pm_enabled;                            // DFS configured (CONFIG_PM_ENABLE)
+    bool modem_sleep;                           // Station power save requested
+    bool ap_running;                            // The service AP keeps the radio awake
+    uint32_t cpu_mhz;                           // Current CPU frequency
+    bool active[POWER_CLIENT_COUNT];
+    uint64_t active_ms[POWER_CLIENT_COUNT];     // Total time each client held the clocks
+    uint64_t busy_ms;                           // Time with any client active
+    uint64_t idle_ms;
+    uint32_t est_ma;                            // Estimated draw right now
+    uint32_t est_avg_ma;                        // Estimated average since boot
+} power_stats_t;
+
+// Configure DFS and create the PM locks. Call early, before any client.
+esp_err_t power_init(void);
+
+// Apply the idle power-save mode once WiFi is started
+void power_wifi_started(void);
+
+// Mark a client active or idle. Cheap and callable from any task; going active
+// raises the clocks before it returns.
+void power_set_active(power_client_t client, bool active);
+
+void power_get_stats(power_stats_t *stats);
+const char *power_client_name(power_client_t client);
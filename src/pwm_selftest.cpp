@@ -0,0 +1,565 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "driver/gpio.h"
+#include "driver/mcpwm_cap.h"
+#include "pwm_selftest.h"
+#include "power.h"
+#include "mem_pool.h"
+
+static const char *TAG = "selftest";
+
+#define CAPTURE_EDGES        400
+#define CAPTURE_PRE_EDGES    24        // Edges of the old protocol captured before the switch
+#define CAPTURE_PRE_TIMEOUT_MS  500
+#define CAPTURE_POST_TIMEOUT_MS 400
+#define LOOPBACK_CAPTURE_MS     500       // Or CAPTURE_EDGES, whichever comes first
+#define LOOPBACK_ISR_SLACK_US   200       // Edge times come from the capture ISR
+
+typedef struct {
+    uint32_t ticks;
+    bool rising;
+    int64_t time_us;
+} capture_edge_t;
+
+// Filled by the capture ISR up to capture_limit
+static capture_edge_t *capture_edges = NULL;
+static volatile uint32_t capture_count = 0;
+static volatile uint32_t capture_limit = 0;
+
+static mcpwm_cap_timer_handle_t cap_timer = NULL;
+static mcpwm_cap_channel_handle_t cap_channel = NULL;
+static bool test_running = false;
+
+static bool capture_cb(mcpwm_cap_channel_handle_t chan, const mcpwm_capture_event_data_t *edata, void *arg)
+{
+    uint32_t n = capture_count;
+    if (n < capture_limit) {
+        capture_edges[n].ticks = edata->cap_value;
+        capture_edges[n].rising = edata->cap_edge == MCPWM_CAP_EDGE_POS;
+        capture_edges[n].time_us = esp_timer_get_time();
+        capture_count = n + 1;
+    }
+    return false;
+}
+
+static void capture_delete(void)
+{
+    if (cap_channel) {
+        mcpwm_capture_channel_disable(cap_channel);
+        mcpwm_del_capture_channel(cap_channel);
+        cap_channel = NULL;
+    }
+    if (cap_timer) {
+        mcpwm_capture_timer_disable(cap_timer);
+        mcpwm_del_capture_timer(cap_timer);
+        cap_timer = NULL;
+    }
+}
+
+// Route a motor pad into a capture channel. Taking the pad over detaches the
+// LEDC output, so call this while the motor is stopped and re-route it after.
+// With a jumper the capture reads input_gpio and the motor pad is left alone.
+static esp_err_t capture_create(int motor, int input_gpio)
+{
+    mcpwm_capture_timer_config_t timer_config = {};
+    timer_config.group_id = 0;
+    timer_config.clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT;
+    esp_err_t err = mcpwm_new_capture_timer(&timer_config, &cap_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    mcpwm_capture_channel_config_t chan_config = {};
+    chan_config.gpio_num = input_gpio >= 0 ? input_gpio : motor_get_gpio(motor);
+    chan_config.prescale = 1;
+    chan_config.flags.pos_edge = true;
+    chan_config.flags.neg_edge = true;
+    chan_config.flags.io_loop_back = input_gpio < 0;
+    err = mcpwm_new_capture_channel(cap_timer, &chan_config, &cap_channel);
+    if (err != ESP_OK) {
+        capture_delete();
+        return err;
+    }
+    if (input_gpio < 0) {
+        motor_route_output(motor);
+    }
+
+    mcpwm_capture_event_callbacks_t cbs = {};
+    cbs.on_cap = capture_cb;
+    err = mcpwm_capture_channel_register_event_callbacks(cap_channel, &cbs, NULL);
+    if (err == ESP_OK) err = mcpwm_capture_channel_enable(cap_channel);
+    if (err == ESP_OK) err = mcpwm_capture_timer_enable(cap_timer);
+    if (err != ESP_OK) {
+        capture_delete();
+    }
+    return err;
+}
+
+static void wait_for_edges(uint32_t count, uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (capture_count < count && esp_timer_get_time() < deadline) {
+        vTaskDelay(1);
+    }
+}
+
+// Expected pulse width and tolerance for a throttle, in ns
+static void expected_pulse(esc_protocol_t protocol, int throttle, uint32_t *width_ns, uint32_t *tol_ns)
+{
+    motor_protocol_timing_t t;
+    motor_get_protocol_timing(protocol, &t);
+    *width_ns = t.min_pulse_ns + (uint32_t)((uint64_t)(t.max_pulse_ns - t.min_pulse_ns) * throttle / 1000);
+
+    // 2% of the pulse, but never below two LEDC steps or the capture/ISR jitter floor
+    uint32_t step_ns = (uint32_t)(1000000000ULL / ((uint64_t)t.frequency_hz << t.resolution_bits));
+    *tol_ns = *width_ns / 50;
+    if (*tol_ns < 2 * step_ns) *tol_ns = 2 * step_ns;
+    if (*tol_ns < 300) *tol_ns = 300;
+}
+
+static bool width_matches(uint32_t width_ns, uint32_t expected_ns, uint32_t tol_ns)
+{
+    return width_ns + tol_ns >= expected_ns && width_ns <= expected_ns + tol_ns;
+}
+
+static void analyze_capture(uint32_t pre_edges, uint32_t total_edges, uint32_t resolution_hz,
+                            int64_t request_us, protocol_switch_test_t *r)
+{
+    uint32_t old_ns, old_tol, new_ns = 0, new_tol = 0;
+    expected_pulse(r->from, r->throttle, &old_ns, &old_tol);
+    if (r->preserve) {
+        expected_pulse(r->to, r->throttle, &new_ns, &new_tol);
+    }
+    r->expected_before_us = old_ns / 1000.0f;
+    r->expected_after_us = new_ns / 1000.0f;
+
+    bool seen_new = false;
+    int rise = -1;
+    uint32_t last_old_fall = 0;
+    bool have_old_fall = false;
+    uint32_t min_ns = UINT32_MAX, max_ns = 0;
+
+    for (uint32_t i = 0; i < total_edges; i++) {
+        const capture_edge_t *e = &capture_edges[i];
+        if (i == pre_edges) {
+            rise = -1;  // Edges between the two capture phases were not recorded
+        }
+        if (e->rising) {
+            if (rise >= 0) r->lost_edges++;
+            rise = (int)i;
+            continue;
+        }
+        if (rise < 0) {
+            if (i != 0 && i != pre_edges) r->lost_edges++;  // A capture may start mid-pulse
+            continue;
+        }
+
+        const capture_edge_t *start = &capture_edges[rise];
+        rise = -1;
+        uint32_t width_ns = (uint32_t)((uint64_t)(e->ticks - start->ticks) * 1000000000ULL / resolution_hz);
+        if (width_ns < min_ns) min_ns = width_ns;
+        if (width_ns > max_ns) max_ns = width_ns;
+
+        bool is_old = width_matches(width_ns, old_ns, old_tol);
+        bool is_new = r->preserve && width_matches(width_ns, new_ns, new_tol);
+        bool pre = i < pre_edges;
+
+        if (!seen_new && is_old) {
+            r->pulses_before++;
+            last_old_fall = e->ticks;
+            have_old_fall = true;
+        } else if (!pre && is_new) {
+            if (!seen_new) {
+                seen_new = true;
+                r->switch_latency_us = (uint32_t)(start->time_us - request_us);
+                if (have_old_fall) {
+                    r->gap_us = (int32_t)((int64_t)(int32_t)(start->ticks - last_old_fall) * 1000000 / resolution_hz);
+                }
+            }
+            r->pulses_after++;
+        } else {
+            r->malformed++;
+            ESP_LOGW(TAG, "Malformed pulse %.2fus at edge %lu (expected %.2f/%.2fus)",
+                     width_ns / 1000.0f, i, r->expected_before_us, r->expected_after_us);
+        }
+    }
+
+    r->min_width_us = min_ns == UINT32_MAX ? 0 : min_ns / 1000.0f;
+    r->max_width_us = max_ns / 1000.0f;
+    r->pass = r->malformed == 0 && r->pulses_before > 0 && (!r->preserve || r->pulses_after > 0);
+}
+
+esp_err_t pwm_selftest_protocol_switch(esc_protocol_t from, esc_protocol_t to, int motor,
+                                       int throttle, bool preserve, protocol_switch_test_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->from = from;
+    result->to = to;
+    result->preserve = preserve;
+    result->motor = motor;
+    result->throttle = throttle;
+
+    if (motor < 0 || motor >= MOTOR_COUNT || throttle < 0 || throttle > 1000 || from == to) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (test_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    test_running = true;
+
+    static_assert(sizeof(capture_edge_t) * CAPTURE_EDGES <= MEM_MEDIUM_BLOCK, "edge buffer outgrew its block");
+    capture_edges = (capture_edge_t *)mem_alloc(sizeof(capture_edge_t) * CAPTURE_EDGES);
+    if (capture_edges == NULL) {
+        test_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    power_set_active(POWER_CLIENT_SELFTEST, true);   // Capture timestamps need a fixed clock
+
+    // Start from a known state: the old protocol with every motor stopped
+    motor_cmd_t cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, from };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err == ESP_OK) err = capture_create(motor, -1);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Capture setup failed: %s", esp_err_to_name(err));
+        mem_free(capture_edges);
+        capture_edges = NULL;
+        power_set_active(POWER_CLIENT_SELFTEST, false);
+        test_running = false;
+        return err;
+    }
+
+    cmd = { MOTOR_CMD_THROTTLE, (int8_t)motor, throttle };
+    motor_apply_command(&cmd);
+    vTaskDelay(pdMS_TO_TICKS(50));   // Let the output settle for a few periods
+
+    uint32_t resolution_hz = 0;
+    mcpwm_capture_timer_get_resolution(cap_timer, &resolution_hz);
+    capture_count = 0;
+    capture_limit = CAPTURE_PRE_EDGES;
+    mcpwm_capture_timer_start(cap_timer);
+    wait_for_edges(CAPTURE_PRE_EDGES, CAPTURE_PRE_TIMEOUT_MS);
+    uint32_t pre_edges = capture_count;
+
+    // Pulses between here and the swap are still old-protocol pulses
+    capture_limit = CAPTURE_EDGES;
+    int64_t request_us = esp_timer_get_time();
+    cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, (int32_t)(to | (preserve ? MOTOR_PROTOCOL_PRESERVE : 0)) };
+    err = motor_apply_command(&cmd);
+    wait_for_edges(CAPTURE_EDGES, CAPTURE_POST_TIMEOUT_MS);
+    capture_limit = 0;
+    mcpwm_capture_timer_stop(cap_timer);
+    uint32_t total_edges = capture_count;
+
+    capture_delete();
+    motor_route_output(motor);
+
+    if (err == ESP_OK) {
+        motor_switch_stats_t stats;
+        motor_get_switch_stats(&stats);
+        result->swap_latency_us = (uint32_t)(stats.last_swap_us - request_us);
+        result->boundary_wait_us = stats.last_boundary_wait_us;
+        analyze_capture(pre_edges, total_edges, resolution_hz, request_us, result);
+
+        ESP_LOGI(TAG, "Switch %s -> %s: %u+%u pulses, %u malformed, %u lost edges, latency %luus, %s",
+                 motor_protocol_name(from), motor_protocol_name(to), result->pulses_before,
+                 result->pulses_after, result->malformed, result->lost_edges,
+                 result->switch_latency_us, result->pass ? "PASS" : "FAIL");
+    }
+
+    mem_free(capture_edges);
+    capture_edges = NULL;
+    power_set_active(POWER_CLIENT_SELFTEST, false);
+    test_running = false;
+    return err;
+}
+
+// Period and tolerance of a protocol, in ns: 1%, but never below the capture/ISR jitter floor
+static void expected_period(esc_protocol_t protocol, uint32_t *period_ns, uint32_t *tol_ns)
+{
+    motor_protocol_timing_t t;
+    motor_get_protocol_timing(protocol, &t);
+    *period_ns = 1000000000u / t.frequency_hz;
+    *tol_ns = *period_ns / 100;
+    if (*tol_ns < 300) *tol_ns = 300;
+}
+
+// Walk the captured edges as pulses, rising edge to the falling edge after it
+typedef struct {
+    uint32_t next;
+    uint32_t total;
+    uint16_t lost_edges;
+} pulse_walk_t;
+
+static bool next_pulse(pulse_walk_t *w, const capture_edge_t **rise, const capture_edge_t **fall)
+{
+    const capture_edge_t *r = NULL;
+    while (w->next < w->total) {
+        const capture_edge_t *e = &capture_edges[w->next++];
+        if (e->rising) {
+            if (r) w->lost_edges++;
+            r = e;
+        } else if (r) {
+            *rise = r;
+            *fall = e;
+            return true;
+        } else if (w->next != 1) {
+            w->lost_edges++;   // The capture may start mid-pulse
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    uint32_t count;
+    int64_t sum_dev_ns;        // Deviations from the expected value keep the squares in range
+    uint64_t sum_sq_ns;
+    uint32_t min_ns;
+    uint32_t max_ns;
+} timing_stats_t;
+
+static void stats_add(timing_stats_t *st, uint32_t value_ns, uint32_t expected_ns)
+{
+    int64_t d = (int64_t)value_ns - expected_ns;
+    if (st->count == 0 || value_ns < st->min_ns) st->min_ns = value_ns;
+    if (value_ns > st->max_ns) st->max_ns = value_ns;
+    st->count++;
+    st->sum_dev_ns += d;
+    st->sum_sq_ns += (uint64_t)(d * d);
+}
+
+static float stats_mean_ns(const timing_stats_t *st, uint32_t expected_ns)
+{
+    return st->count ? expected_ns + (float)st->sum_dev_ns / st->count : 0;
+}
+
+static float stats_stddev_ns(const timing_stats_t *st)
+{
+    if (st->count < 2) {
+        return 0;
+    }
+    float mean = (float)st->sum_dev_ns / st->count;
+    float var = (float)st->sum_sq_ns / st->count - mean * mean;
+    return var > 0 ? sqrtf(var) : 0;
+}
+
+static void hist_add(uint16_t *hist, float deviation_ns)
+{
+    uint32_t dev = (uint32_t)fabsf(deviation_ns);
+    int b = 0;
+    while (b < PWM_JITTER_BUCKETS - 1 && dev >= ((uint32_t)PWM_JITTER_BUCKET0_NS << b)) b++;
+    hist[b]++;
+}
+
+static uint32_t ticks_to_ns(uint32_t ticks, uint32_t resolution_hz)
+{
+    return (uint32_t)((uint64_t)ticks * 1000000000ULL / resolution_hz);
+}
+
+static void analyze_loopback(uint32_t total_edges, uint32_t resolution_hz, pwm_loopback_test_t *r)
+{
+    uint32_t width_ns, width_tol, period_ns, period_tol;
+    expected_pulse(r->protocol, r->throttle, &width_ns, &width_tol);
+    expected_period(r->protocol, &period_ns, &period_tol);
+    r->expected_width_us = width_ns / 1000.0f;
+    r->width_tol_us = width_tol / 1000.0f;
+    r->expected_period_us = period_ns / 1000.0f;
+    r->period_tol_us = period_tol / 1000.0f;
+
+    // Periods only between pulses with no edge lost in between
+    timing_stats_t ws = {}, ps = {};
+    pulse_walk_t walk = { 0, total_edges, 0 };
+    const capture_edge_t *rise, *fall, *prev_rise = NULL;
+    uint16_t lost_at_prev = 0;
+    while (next_pulse(&walk, &rise, &fall)) {
+        uint32_t w = ticks_to_ns(fall->ticks - rise->ticks, resolution_hz);
+        stats_add(&ws, w, width_ns);
+        if (!width_matches(w, width_ns, width_tol)) r->out_of_spec++;
+        if (prev_rise && walk.lost_edges == lost_at_prev) {
+            uint32_t p = ticks_to_ns(rise->ticks - prev_rise->ticks, resolution_hz);
+            stats_add(&ps, p, period_ns);
+            if (!width_matches(p, period_ns, period_tol)) r->out_of_spec++;
+        }
+        prev_rise = rise;
+        lost_at_prev = walk.lost_edges;
+    }
+    r->pulses = ws.count;
+    r->periods = ps.count;
+    r->lost_edges = walk.lost_edges;
+
+    float mean_w = stats_mean_ns(&ws, width_ns), mean_p = stats_mean_ns(&ps, period_ns);
+    r->mean_width_us = mean_w / 1000.0f;
+    r->min_width_us = ws.min_ns / 1000.0f;
+    r->max_width_us = ws.max_ns / 1000.0f;
+    r->width_jitter_us = stats_stddev_ns(&ws) / 1000.0f;
+    r->mean_period_us = mean_p / 1000.0f;
+    r->min_period_us = ps.min_ns / 1000.0f;
+    r->max_period_us = ps.max_ns / 1000.0f;
+    r->period_jitter_us = stats_stddev_ns(&ps) / 1000.0f;
+
+    // Second pass for the histograms around the means
+    walk = { 0, total_edges, 0 };
+    prev_rise = NULL;
+    lost_at_prev = 0;
+    while (next_pulse(&walk, &rise, &fall)) {
+        hist_add(r->width_hist, ticks_to_ns(fall->ticks - rise->ticks, resolution_hz) - mean_w);
+        if (prev_rise && walk.lost_edges == lost_at_prev) {
+            hist_add(r->period_hist, ticks_to_ns(rise->ticks - prev_rise->ticks, resolution_hz) - mean_p);
+        }
+        prev_rise = rise;
+        lost_at_prev = walk.lost_edges;
+    }
+}
+
+// Change the throttle at a random phase of the PWM period and time the
+// first pulse at the new width. Returns false if none showed up.
+static bool measure_latency(int motor, int throttle, esc_protocol_t protocol, uint32_t period_us,
+                            uint32_t *latency_us, uint32_t *update_us)
+{
+    uint32_t want_ns, tol_ns;
+    expected_pulse(protocol, throttle, &want_ns, &tol_ns);
+    vTaskDelay(pdMS_TO_TICKS(2 + esp_random() % (period_us / 1000 + 1)));
+    esp_rom_delay_us(esp_random() % (period_us < 1000 ? period_us : 1000));
+
+    capture_limit = 0;
+    capture_count = 0;
+    capture_limit = CAPTURE_EDGES;
+    int64_t request_us = esp_timer_get_time();
+    motor_cmd_t cmd = { MOTOR_CMD_THROTTLE, (int8_t)motor, throttle };
+    esp_err_t err = motor_apply_command(&cmd);
+    motor_update_t u;
+    motor_get_last_update(motor, &u);
+    wait_for_edges(CAPTURE_EDGES, 3 * period_us / 1000 + 20);
+    capture_limit = 0;
+    if (err != ESP_OK) {
+        return false;
+    }
+
+    uint32_t resolution_hz = 0;
+    mcpwm_capture_timer_get_resolution(cap_timer, &resolution_hz);
+    pulse_walk_t walk = { 0, capture_count, 0 };
+    const capture_edge_t *rise, *fall;
+    while (next_pulse(&walk, &rise, &fall)) {
+        if (rise->time_us >= request_us &&
+            width_matches(ticks_to_ns(fall->ticks - rise->ticks, resolution_hz), want_ns, tol_ns)) {
+            *latency_us = (uint32_t)(rise->time_us - request_us);
+            *update_us = (uint32_t)(u.update_us - request_us);
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t pwm_selftest_loopback(esc_protocol_t protocol, int motor, int throttle, int capture_gpio,
+                                pwm_loopback_test_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->protocol = protocol;
+    result->motor = motor;
+    result->throttle = throttle;
+    result->capture_gpio = capture_gpio;
+
+    if (motor < 0 || motor >= MOTOR_COUNT || throttle < 0 || throttle > 1000 || protocol > PROTOCOL_MULTISHOT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (capture_gpio >= 0) {
+        if (!GPIO_IS_VALID_GPIO(capture_gpio)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int m = 0; m < MOTOR_COUNT; m++) {
+            if (capture_gpio == motor_get_gpio(m)) return ESP_ERR_INVALID_ARG;   // That is the loopback
+        }
+    }
+    if (test_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    test_running = true;
+
+    static_assert(sizeof(capture_edge_t) * CAPTURE_EDGES <= MEM_MEDIUM_BLOCK, "edge buffer outgrew its block");
+    capture_edges = (capture_edge_t *)mem_alloc(sizeof(capture_edge_t) * CAPTURE_EDGES);
+    if (capture_edges == NULL) {
+        test_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    power_set_active(POWER_CLIENT_SELFTEST, true);
+
+    esc_protocol_t previous = motor_get_protocol();
+    motor_cmd_t cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, protocol };
+    esp_err_t err = motor_apply_command(&cmd);
+    if (err == ESP_OK) err = capture_create(motor, capture_gpio);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Capture setup failed: %s", esp_err_to_name(err));
+        mem_free(capture_edges);
+        capture_edges = NULL;
+        power_set_active(POWER_CLIENT_SELFTEST, false);
+        test_running = false;
+        return err;
+    }
+
+    uint32_t period_ns, period_tol;
+    expected_period(protocol, &period_ns, &period_tol);
+    uint32_t period_us = period_ns / 1000;
+    cmd = { MOTOR_CMD_THROTTLE, (int8_t)motor, throttle };
+    motor_apply_command(&cmd);
+    vTaskDelay(pdMS_TO_TICKS(50 + 3 * period_us / 1000));
+
+    // Width and period at a steady throttle
+    uint32_t resolution_hz = 0;
+    mcpwm_capture_timer_get_resolution(cap_timer, &resolution_hz);
+    capture_count = 0;
+    capture_limit = CAPTURE_EDGES;
+    mcpwm_capture_timer_start(cap_timer);
+    wait_for_edges(CAPTURE_EDGES, LOOPBACK_CAPTURE_MS);
+    capture_limit = 0;
+    analyze_loopback(capture_count, resolution_hz, result);
+
+    // Command to edge, stepping between two throttles
+    int other = throttle >= 500 ? throttle - 250 : throttle + 250;
+    uint64_t latency_sum = 0, update_sum = 0;
+    for (int i = 0; i < PWM_LATENCY_SAMPLES; i++) {
+        uint32_t latency_us, update_us;
+        if (!measure_latency(motor, i % 2 == 0 ? other : throttle, protocol, period_us, &latency_us, &update_us)) {
+            continue;
+        }
+        if (result->latency_samples == 0 || latency_us < result->latency_min_us) result->latency_min_us = latency_us;
+        if (latency_us > result->latency_max_us) result->latency_max_us = latency_us;
+        latency_sum += latency_us;
+        update_sum += update_us;
+        result->latency_samples++;
+    }
+    if (result->latency_samples) {
+        result->latency_avg_us = (uint32_t)(latency_sum / result->latency_samples);
+        result->update_avg_us = (uint32_t)(update_sum / result->latency_samples);
+    }
+    result->latency_limit_us = PWM_LATENCY_BUDGET_US + period_us + LOOPBACK_ISR_SLACK_US;
+
+    mcpwm_capture_timer_stop(cap_timer);
+    capture_delete();
+    if (capture_gpio < 0) {
+        motor_route_output(motor);
+    }
+    cmd = { MOTOR_CMD_PROTOCOL, MOTOR_ALL, previous };
+    motor_apply_command(&cmd);
+
+    // Every width and period inside its tolerance covers the means too
+    result->pass = result->pulses > 1 && result->periods > 0 && result->out_of_spec == 0 &&
+                   result->lost_edges == 0 && result->latency_samples == PWM_LATENCY_SAMPLES && result->latency_max_us <= result->latency_limit_us;
+
+    ESP_LOGI(TAG, "Loopback %s: %u pulses %.2f/%.2fus (jitter %.3fus), period %.2f/%.2fus (jitter %.3fus), "
+             "%u out of spec, latency %lu-%luus, %s",
+             motor_protocol_name(protocol), result->pulses, result->mean_width_us, result->expected_width_us,
+             result->width_jitter_us, result->mean_period_us, result->expected_period_us, result->period_jitter_us,
+             result->out_of_spec, result->latency_min_us, result->latency_max_us, result->pass ? "PASS" : "FAIL");
+
+    mem_free(capture_edges);
+    capture_edges = NULL;
+    power_set_active(POWER_CLIENT_SELFTEST, false);
+    test_running = false;
+    return ESP_OK;
+}
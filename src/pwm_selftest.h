@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "motor_control.h"
+
+// Bench self-tests that read the ESC outputs back with MCPWM capture. The
+// capture input is taken from the output pad itself, no wiring is needed;
+// the loopback test can also read a jumpered GPIO to cover the board trace.
+// Tests drive the motors: remove props first.
+
+typedef struct {
+    esc_protocol_t from;
+    esc_protocol_t to;
+    bool preserve;
+    int motor;
+    int throttle;
+    uint16_t pulses_before;       // Pulses matching the old protocol
+    uint16_t pulses_after;        // Pulses matching the new protocol
+    uint16_t malformed;           // Pulses matching neither, or out of order
+    uint16_t lost_edges;          // Capture overruns, not counted as malformed
+    float expected_before_us;
+    float expected_after_us;
+    float min_width_us;
+    float max_width_us;
+    uint32_t switch_latency_us;   // Request to the first new-protocol rising edge
+    uint32_t swap_latency_us;     // Request to the timer swap on the control task
+    uint32_t boundary_wait_us;    // Time the control task waited for the pulse to end
+    int32_t gap_us;               // Last old falling edge to first new rising edge
+    bool pass;
+} protocol_switch_test_t;
+
+// Run one motor at `throttle` on `from`, switch to `to` while capturing its
+// output and check every captured pulse. Leaves the bench on `to`.
+esp_err_t pwm_selftest_protocol_switch(esc_protocol_t from, esc_protocol_t to, int motor,
+                                       int throttle, bool preserve, protocol_switch_test_t *result);
+
+// Pulse timing of one protocol on the wire against its spec. Jitter
+// histograms count deviations from the mean: bucket n holds those below
+// PWM_JITTER_BUCKET0_NS << n, the last one everything larger.
+#define PWM_JITTER_BUCKETS      8
+#define PWM_JITTER_BUCKET0_NS   25
+#define PWM_LATENCY_SAMPLES     8
+#define PWM_LATENCY_BUDGET_US   1000      // motor_apply_command to ledc_update_duty on the control task
+
+typedef struct {
+    esc_protocol_t protocol;
+    int motor;
+    int throttle;
+    int capture_gpio;             // -1 when looped back from the output pad
+    uint16_t pulses;
+    uint16_t periods;
+    uint16_t out_of_spec;         // Pulses or periods outside their tolerance
+    uint16_t lost_edges;
+    float expected_width_us;
+    float width_tol_us;
+    float mean_width_us;
+    float min_width_us;
+    float max_width_us;
+    float width_jitter_us;        // Standard deviation
+    float expected_period_us;
+    float period_tol_us;
+    float mean_period_us;
+    float min_period_us;
+    float max_period_us;
+    float period_jitter_us;
+    uint16_t width_hist[PWM_JITTER_BUCKETS];
+    uint16_t period_hist[PWM_JITTER_BUCKETS];
+    // Command to edge: from motor_apply_command, the call the HTTP and UDP
+    // handlers make, to the rising edge of the first pulse at the new width
+    uint8_t latency_samples;      // Of PWM_LATENCY_SAMPLES, the rest never showed the new width
+    uint32_t latency_min_us;
+    uint32_t latency_avg_us;
+    uint32_t latency_max_us;
+    uint32_t update_avg_us;       // Part of it until ledc_update_duty, the rest is LEDC latching the duty
+    uint32_t latency_limit_us;    // Budget plus one PWM period
+    bool pass;
+} pwm_loopback_test_t;
+
+// Run one motor at `throttle` on `protocol`, capture its output from the pad
+// (capture_gpio -1) or a jumpered input, and check width, period, jitter and
+// command-to-edge latency against the protocol. Leaves the bench on the
+// protocol it was on, with every motor stopped.
+esp_err_t pwm_selftest_loopback(esc_protocol_t protocol, int motor, int throttle, int capture_gpio,
+                                pwm_loopback_test_t *result);
@@ -0,0 +1,218 @@
+#include <string.h>
+#include "rpm_control.h"
+
+#define RPM_INTEG_LIMIT_Q16 ((int64_t)1000 << 16)
+#define RPM_INTEG_ZONE      400    // RPM of error beyond which the integrator holds
+#define RPM_D_FILTER_SHIFT  2      // Derivative low-pass, 1/4 of the new sample per step
+#define RPM_LEARN_DIV       8      // LMS step size of the feed-forward map
+
+static int32_t clamp_i32(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void rpm_pid_init(rpm_pid_t *pid, const rpm_pid_config_t *cfg)
+{
+    memset(pid, 0, sizeof(*pid));
+    pid->cfg = *cfg;
+    if (pid->cfg.rate_hz == 0) {
+        pid->cfg.rate_hz = 1;
+    }
+}
+
+void rpm_pid_reset(rpm_pid_t *pid)
+{
+    pid->integ_q16 = 0;
+    pid->d_filt = 0;
+    pid->primed = false;
+}
+
+int32_t rpm_pid_update(rpm_pid_t *pid, int32_t target_rpm, int32_t rpm,
+                       int32_t ff, int32_t out_min, int32_t out_max)
+{
+    int32_t err = target_rpm - rpm;
+    if (!pid->primed) {
+        pid->prev_rpm = rpm;
+        pid->primed = true;
+    }
+
+    int32_t p = (int32_t)(((int64_t)pid->cfg.kp_q16 * err) >> 16);
+
+    // Derivative on measurement so setpoint steps do not kick the output
+    int64_t rate = (int64_t)(rpm - pid->prev_rpm) * pid->cfg.rate_hz;
+    int32_t d_raw = (int32_t)(-((int64_t)pid->cfg.kd_q16 * rate) >> 16);
+    pid->d_filt += (d_raw - pid->d_filt) >> RPM_D_FILTER_SHIFT;
+    pid->prev_rpm = rpm;
+
+    int32_t u = ff + p + (int32_t)(pid->integ_q16 >> 16) + pid->d_filt;
+
+    // Conditional integration: hold the integrator while saturated in the error
+    // direction, and while far from target, where feed-forward and P do the work
+    bool saturated = (u >= out_max && err > 0) || (u <= out_min && err < 0);
+    if (!saturated && err < RPM_INTEG_ZONE && err > -RPM_INTEG_ZONE) {
+        pid->integ_q16 += (int64_t)pid->cfg.ki_q16 * err / (int64_t)pid->cfg.rate_hz;
+        if (pid->integ_q16 > RPM_INTEG_LIMIT_Q16) pid->integ_q16 = RPM_INTEG_LIMIT_Q16;
+        if (pid->integ_q16 < -RPM_INTEG_LIMIT_Q16) pid->integ_q16 = -RPM_INTEG_LIMIT_Q16;
+    }
+
+    u = ff + p + (int32_t)(pid->integ_q16 >> 16) + pid->d_filt;
+    return clamp_i32(u, out_min, out_max);
+}
+
+void rpm_ff_init(rpm_ff_map_t *map, int32_t max_rpm)
+{
+    // rpm = max * x * (2 - x) for x = throttle / 1000
+    const int32_t n = RPM_MAP_POINTS - 1;
+    for (int i = 0; i < RPM_MAP_POINTS; i++) {
+        map->rpm_q4[i] = (int32_t)((int64_t)max_rpm * i * (2 * n - i) / (n * n)) << 4;
+    }
+    map->samples = 0;
+}
+
+// Segment index and position (0-100) of a throttle value
+static void ff_segment(int32_t throttle, int *index, int32_t *frac)
+{
+    throttle = clamp_i32(throttle, 0, 1000);
+    int i = throttle / 100;
+    if (i >= RPM_MAP_POINTS - 1) {
+        i = RPM_MAP_POINTS - 2;
+    }
+    *index = i;
+    *frac = throttle - i * 100;
+}
+
+static int32_t ff_rpm_q4(const rpm_ff_map_t *map, int32_t throttle)
+{
+    int i;
+    int32_t f;
+    ff_segment(throttle, &i, &f);
+    return map->rpm_q4[i] + (map->rpm_q4[i + 1] - map->rpm_q4[i]) * f / 100;
+}
+
+int32_t rpm_ff_rpm_at(const rpm_ff_map_t *map, int32_t throttle)
+{
+    return ff_rpm_q4(map, throttle) >> 4;
+}
+
+int32_t rpm_ff_throttle_for(const rpm_ff_map_t *map, int32_t rpm)
+{
+    if (rpm <= 0) {
+        return 0;
+    }
+    int32_t r = rpm << 4;
+    for (int i = 0; i < RPM_MAP_POINTS - 1; i++) {
+        if (r <= map->rpm_q4[i + 1]) {
+            int32_t span = map->rpm_q4[i + 1] - map->rpm_q4[i];
+            if (span <= 0) {
+                return i * 100;
+            }
+            return clamp_i32(i * 100 + (r - map->rpm_q4[i]) * 100 / span, i * 100, (i + 1) * 100);
+        }
+    }
+    return 1000;
+}
+
+void rpm_ff_learn(rpm_ff_map_t *map, int32_t throttle, int32_t rpm)
+{
+    int i;
+    int32_t f;
+    ff_segment(throttle, &i, &f);
+
+    int32_t err_q4 = (rpm << 4) - ff_rpm_q4(map, throttle);
+    map->rpm_q4[i] += err_q4 * (100 - f) / (100 * RPM_LEARN_DIV);
+    map->rpm_q4[i + 1] += err_q4 * f / (100 * RPM_LEARN_DIV);
+
+    // Keep the map monotonic so the inverse lookup stays well defined
+    if (map->rpm_q4[0] < 0) map->rpm_q4[0] = 0;
+    for (int j = 1; j < RPM_MAP_POINTS; j++) {
+        if (map->rpm_q4[j] < map->rpm_q4[j - 1]) {
+            map->rpm_q4[j] = map->rpm_q4[j - 1];
+        }
+    }
+    map->samples++;
+}
+
+void rpm_step_start(rpm_step_t *step, int32_t from_rpm, int32_t to_rpm, int64_t now_us)
+{
+    memset(step, 0, sizeof(*step));
+    step->from_rpm = from_rpm;
+    step->to_rpm = to_rpm;
+    step->peak_rpm = from_rpm;
+    step->start_us = now_us;
+    step->t10_us = -1;
+    step->t90_us = -1;
+    step->complete = (from_rpm == to_rpm);
+}
+
+void rpm_step_update(rpm_step_t *step, int32_t rpm, int64_t now_us)
+{
+    if (step->complete) {
+        return;
+    }
+
+    int32_t dir = step->to_rpm >= step->from_rpm ? 1 : -1;
+    int32_t size = (step->to_rpm - step->from_rpm) * dir;
+    int32_t progress = (rpm - step->from_rpm) * dir;
+
+    if (step->t10_us < 0 && progress * 10 >= size) {
+        step->t10_us = now_us;
+    }
+    if (step->t90_us < 0 && progress * 10 >= size * 9) {
+        step->t90_us = now_us;
+        step->rise_us = (uint32_t)(step->t90_us - step->t10_us);
+    }
+
+    if ((rpm - step->peak_rpm) * dir > 0) {
+        step->peak_rpm = rpm;
+        int32_t beyond = (step->peak_rpm - step->to_rpm) * dir;
+        step->overshoot_permille = beyond > 0 ? (int32_t)((int64_t)beyond * 1000 / size) : 0;
+    }
+
+    int32_t band = size * RPM_STEP_BAND_PERMILLE / 1000;
+    if (band < RPM_STEP_BAND_MIN_RPM) band = RPM_STEP_BAND_MIN_RPM;
+    int32_t off = rpm - step->to_rpm;
+    if (off <= band && off >= -band) {
+        if (!step->in_band) {
+            step->in_band = true;
+            step->band_enter_us = now_us;
+        }
+        if (now_us - step->band_enter_us >= RPM_STEP_HOLD_US) {
+            step->settle_us = (uint32_t)(step->band_enter_us - step->start_us);
+            step->complete = true;
+        }
+    } else {
+        step->in_band = false;
+    }
+
+    if (!step->complete && now_us - step->start_us >= RPM_STEP_TIMEOUT_US) {
+        step->complete = true;
+        step->timed_out = true;
+    }
+}
+
+void rpm_sim_init(rpm_sim_motor_t *sim, int32_t max_rpm)
+{
+    sim->max_rpm = max_rpm;
+    sim->idle_throttle = 50;
+    sim->tau_up_us = 60000;
+    sim->tau_down_us = 150000;
+    sim->rpm_q8 = 0;
+}
+
+int32_t rpm_sim_steady_rpm(const rpm_sim_motor_t *sim, int32_t throttle)
+{
+    if (throttle <= sim->idle_throttle) {
+        return 0;
+    }
+    // Prop load grows with RPM^2, so RPM flattens out towards full throttle
+    int64_t x = (int64_t)(throttle - sim->idle_throttle) * 1000 / (1000 - sim->idle_throttle);
+    return (int32_t)(sim->max_rpm * x * (2000 - x) / 1000000);
+}
+
+int32_t rpm_sim_step(rpm_sim_motor_t *sim, int32_t throttle, uint32_t dt_us)
+{
+    int64_t target_q8 = (int64_t)rpm_sim_steady_rpm(sim, throttle) << 8;
+    uint32_t tau = target_q8 > sim->rpm_q8 ? sim->tau_up_us : sim->tau_down_us;
+    sim->rpm_q8 += (target_q8 - sim->rpm_q8) * dt_us / ((int64_t)tau + dt_us);
+    return (int32_t)(sim->rpm_q8 >> 8);
+}
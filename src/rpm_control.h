@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Closed-loop RPM building blocks: fixed-point PID, learned throttle->RPM
+// feed-forward map, step-response metrics and a motor/prop model.
+// Throttle is in per mille (0-1000) throughout, time in microseconds, always
+// passed in; host/bench_sim.cpp and host/rpm_step_test.cpp run the same loop.
+
+#define RPM_Q16(x) ((int32_t)((x) * 65536.0f))
+
+typedef struct {
+    int32_t kp_q16;      // per mille throttle per RPM of error
+    int32_t ki_q16;      // per mille per RPM-second
+    int32_t kd_q16;      // per mille per RPM/s, on measurement
+    uint32_t rate_hz;    // Loop rate the gains are evaluated at
+} rpm_pid_config_t;
+
+typedef struct {
+    rpm_pid_config_t cfg;
+    int64_t integ_q16;   // Integrator, per mille in Q16.16
+    int32_t prev_rpm;
+    int32_t d_filt;      // Low-passed derivative term, per mille
+    bool primed;
+} rpm_pid_t;
+
+void rpm_pid_init(rpm_pid_t *pid, const rpm_pid_config_t *cfg);
+void rpm_pid_reset(rpm_pid_t *pid);
+
+// One loop iteration. ff is the feed-forward throttle for target; the result
+// is clamped to [out_min, out_max]. The integrator only runs within a few
+// hundred RPM of target, and stops winding up while the output is saturated
+// in the direction of the error.
+int32_t rpm_pid_update(rpm_pid_t *pid, int32_t target_rpm, int32_t rpm,
+                       int32_t ff, int32_t out_min, int32_t out_max);
+
+// Piecewise-linear throttle->RPM map with breakpoints every 100 per mille,
+// refined online from steady-state samples (LMS on the two nearest points)
+#define RPM_MAP_POINTS 11
+
+typedef struct {
+    int32_t rpm_q4[RPM_MAP_POINTS];   // RPM << 4 at throttle = i * 100
+    uint32_t samples;
+} rpm_ff_map_t;
+
+// Seed with a prop-load curve reaching max_rpm at full throttle. Without an
+// idle threshold it promises a little more RPM per throttle than a motor
+// gives, so steps on a fresh map come in from below rather than overshoot.
+void rpm_ff_init(rpm_ff_map_t *map, int32_t max_rpm);
+int32_t rpm_ff_rpm_at(const rpm_ff_map_t *map, int32_t throttle);
+int32_t rpm_ff_throttle_for(const rpm_ff_map_t *map, int32_t rpm);
+void rpm_ff_learn(rpm_ff_map_t *map, int32_t throttle, int32_t rpm);
+
+// Step response of one setpoint change
+typedef struct {
+    int32_t from_rpm;
+    int32_t to_rpm;
+    int32_t peak_rpm;            // Furthest excursion in the step direction
+    int32_t overshoot_permille;  // Beyond target, relative to the step size
+    uint32_t rise_us;            // 10% to 90% of the step, 0 until reached
+    uint32_t settle_us;          // From the step until it stayed inside the band
+    bool complete;
+    bool timed_out;              // Never held the band within RPM_STEP_TIMEOUT_US
+    // Tracking state
+    int64_t start_us;
+    int64_t t10_us;
+    int64_t t90_us;
+    int64_t band_enter_us;
+    bool in_band;
+} rpm_step_t;
+
+#define RPM_STEP_BAND_PERMILLE 20      // Settled within 2% of the step...
+#define RPM_STEP_BAND_MIN_RPM  50      // ...but never tighter than this
+#define RPM_STEP_HOLD_US       300000  // Time inside the band that counts as settled
+#define RPM_STEP_TIMEOUT_US    5000000
+
+void rpm_step_start(rpm_step_t *step, int32_t from_rpm, int32_t to_rpm, int64_t now_us);
+void rpm_step_update(rpm_step_t *step, int32_t rpm, int64_t now_us);
+
+// First-order motor/prop model: concave throttle->RPM curve above the ESC
+// idle threshold, faster spin-up than spin-down (no active braking)
+typedef struct {
+    int32_t max_rpm;        // At full throttle
+    int32_t idle_throttle;  // Below this the motor does not turn
+    uint32_t tau_up_us;
+    uint32_t tau_down_us;
+    int64_t rpm_q8;         // State, RPM << 8
+} rpm_sim_motor_t;
+
+void rpm_sim_init(rpm_sim_motor_t *sim, int32_t max_rpm);
+int32_t rpm_sim_steady_rpm(const rpm_sim_motor_t *sim, int32_t throttle);
+int32_t rpm_sim_step(rpm_sim_motor_t *sim, int32_t throttle, uint32_t dt_us);
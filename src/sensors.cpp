@@ -0,0 +1,392 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "motor_control.h"
+#include "ina2xx.h"
+#include "ina2xx_sim.h"
+#include "sensors.h"
+#include "mem_pool.h"
+
+static const char *TAG = "sensors";
+
+#define SENSORS_I2C_PORT      I2C_NUM_0
+#define SENSORS_PIN_SDA       GPIO_NUM_22
+#define SENSORS_PIN_SCL       GPIO_NUM_23
+#define SENSORS_PIN_ALERT     GPIO_NUM_7    // INA226 ALERT, open drain, active low
+#define SENSORS_I2C_HZ        400000
+#define SENSORS_I2C_TIMEOUT   pdMS_TO_TICKS(10)
+#define INA226_ADDR           0x40
+
+#define SENSORS_SHUNT_UOHM    500           // 0.5 mOhm bench shunt
+#define SENSORS_MAX_CURRENT_MA 80000
+#define SENSORS_AVG           INA2XX_AVG_16
+#define SENSORS_CT            INA2XX_CT_1100US   // 16 x (1.1 + 1.1) ms = 35.2 ms per conversion
+#define SENSORS_TRACE_AVG     INA2XX_AVG_4
+#define SENSORS_TRACE_CT      INA2XX_CT_140US    // 4 x (0.14 + 0.14) ms = 1.12 ms per conversion
+
+#define SENSORS_TASK_PRIORITY 4
+#define SENSORS_TASK_STACK    3072
+
+// Simulated load: bench electronics plus up to 20 A per motor at full throttle
+#define SENSORS_SIM_IDLE_MA   150
+#define SENSORS_SIM_MA_PER_PERMILLE 20
+
+MEM_TASK_STORAGE(sensors_task, SENSORS_TASK_STACK);
+static ina2xx_t ina;
+static ina2xx_bus_t i2c_bus;
+static ina2xx_sim_t sim;
+static bool hardware = false;
+static TaskHandle_t sensors_task_handle = NULL;
+static volatile int64_t alert_us = 0;
+static volatile uint32_t alert_count = 0;
+static volatile bool recharge_requested = false;
+static int32_t sim_applied_ma = SENSORS_SIM_IDLE_MA;   // Load up to the latest output update
+
+// High-rate trace. Mode changes are requested here and applied by the task,
+// which owns the bus.
+typedef enum { TRACE_OFF, TRACE_START, TRACE_RUNNING, TRACE_STOP } trace_state_t;
+static volatile trace_state_t trace_state = TRACE_OFF;
+static battery_sample_t *trace_buf = NULL;
+static size_t trace_capacity = 0;
+static size_t trace_count = 0;
+static int64_t trace_start_us = 0;
+
+static portMUX_TYPE sensors_lock = portMUX_INITIALIZER_UNLOCKED;
+static sensors_power_t power;
+static sensors_sample_cb_t sample_cb = NULL;
+static ina2xx_totals_t totals;        // Integration restarts after a reset
+
+static bool i2c_read_reg(void *ctx, uint8_t reg, uint16_t *value)
+{
+    uint8_t data[2];
+    if (i2c_master_write_read_device(SENSORS_I2C_PORT, INA226_ADDR, &reg, 1, data, 2, SENSORS_I2C_TIMEOUT) != ESP_OK) {
+        return false;
+    }
+    *value = (uint16_t)((data[0] << 8) | data[1]);
+    return true;
+}
+
+static bool i2c_write_reg(void *ctx, uint8_t reg, uint16_t value)
+{
+    uint8_t data[3] = { reg, (uint8_t)(value >> 8), (uint8_t)value };
+    return i2c_master_write_to_device(SENSORS_I2C_PORT, INA226_ADDR, data, sizeof(data), SENSORS_I2C_TIMEOUT) == ESP_OK;
+}
+
+static void IRAM_ATTR alert_isr(void *arg)
+{
+    alert_us = esp_timer_get_time();
+    alert_count = alert_count + 1;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(sensors_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static int32_t sim_load_ma(void)
+{
+    int32_t load = SENSORS_SIM_IDLE_MA;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        load += motor_get_throttle(m) * SENSORS_SIM_MA_PER_PERMILLE;
+    }
+    return load;
+}
+
+// Latest duty change of any output; the simulated load steps there
+static int64_t sim_last_update_us(void)
+{
+    int64_t latest = 0;
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        motor_update_t u;
+        motor_get_last_update(m, &u);
+        if (u.update_us > latest) latest = u.update_us;
+    }
+    return latest;
+}
+
+// Trapezoidal integration between completed conversions
+static void publish_sample(const ina2xx_sample_t *s, int64_t t_us)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    ina2xx_totals_add(&totals, s, t_us);
+    power.charge_uah = totals.charge_uah;
+    power.energy_uwh = totals.energy_uwh;
+    power.integrated_ms = totals.integrated_us / 1000;
+    power.bus_mv = s->bus_mv;
+    power.current_ma = s->current_ma;
+    power.power_mw = s->power_mw;
+    power.time_us = t_us;
+    power.conversions++;
+    if (trace_state == TRACE_RUNNING && trace_count < trace_capacity && t_us > trace_start_us) {
+        battery_sample_t *e = &trace_buf[trace_count++];
+        e->t_us = (uint32_t)(t_us - trace_start_us);
+        e->bus_mv = s->bus_mv;
+        e->current_ma = s->current_ma;
+    }
+    sensors_power_t p = power;
+    sensors_sample_cb_t cb = sample_cb;
+    portEXIT_CRITICAL(&sensors_lock);
+    if (cb) {
+        cb(&p);
+    }
+}
+
+static void count_error(uint32_t *counter)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&sensors_lock);
+}
+
+// Read one completed conversion and publish it with its completion time
+static void read_conversion(int64_t t_us)
+{
+    bool ready = false;
+    ina2xx_sample_t s;
+    if (!ina2xx_conversion_ready(&ina, &ready)) {
+        count_error(&power.bus_errors);
+        return;
+    }
+    if (!ready) {
+        return;
+    }
+    if (!ina2xx_read(&ina, &s)) {
+        count_error(&power.bus_errors);
+        return;
+    }
+    if (t_us == 0) {
+        t_us = esp_timer_get_time();
+    }
+    publish_sample(&s, t_us);
+}
+
+// Switch between the normal and the trace conversion rate. Writing the
+// configuration restarts conversion, so the trace starts after the write.
+static void apply_trace_request(void)
+{
+    trace_state_t state = trace_state;
+    if (state != TRACE_START && state != TRACE_STOP) {
+        return;
+    }
+    bool fast = state == TRACE_START;
+    bool ready;
+    if (!ina2xx_configure(&ina, fast ? SENSORS_TRACE_AVG : SENSORS_AVG, fast ? SENSORS_TRACE_CT : SENSORS_CT) ||
+        !ina2xx_conversion_ready(&ina, &ready)) {   // Drop a result of the old rate
+        count_error(&power.bus_errors);
+    }
+    portENTER_CRITICAL(&sensors_lock);
+    power.conversion_us = ina2xx_conversion_us(ina.config);
+    trace_start_us = esp_timer_get_time();
+    trace_state = fast ? TRACE_RUNNING : TRACE_OFF;
+    portEXIT_CRITICAL(&sensors_lock);
+}
+
+// Step the simulated sensor to now, one conversion at a time, so every
+// conversion gets its own completion time as on the device. The load changes
+// exactly at the latest output update.
+static void run_simulation(int64_t *sim_us)
+{
+    if (recharge_requested) {
+        recharge_requested = false;
+        ina2xx_sim_recharge(&sim);
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t edge_us = sim_last_update_us();
+    int32_t before = sim_applied_ma;
+    sim_applied_ma = sim_load_ma();
+
+    while (*sim_us < now) {
+        int64_t next = *sim_us + ina2xx_sim_until_conversion_us(&sim);
+        if (next > now) next = now;
+        if (edge_us > *sim_us && edge_us < next) next = edge_us;
+        ina2xx_sim_set_load(&sim, *sim_us >= edge_us ? sim_applied_ma : before);
+        bool done = ina2xx_sim_advance(&sim, (uint32_t)(next - *sim_us));
+        *sim_us = next;
+        if (done) {
+            read_conversion(next);
+        }
+    }
+}
+
+static void sensors_task(void *arg)
+{
+    int64_t sim_us = esp_timer_get_time();
+    uint32_t alerts_seen = 0;
+
+    while (1) {
+        apply_trace_request();
+        uint32_t period_us = ina2xx_conversion_us(ina.config);
+        TickType_t period = pdMS_TO_TICKS(period_us / 1000);
+
+        if (hardware) {
+            // Only completed conversions are read; the alert says when one is ready.
+            // Trace requests wake the task too, so only a new alert carries a time.
+            bool woken = ulTaskNotifyTake(pdTRUE, period * 2 + 1) != 0;
+            int64_t t_us = 0;
+            portENTER_CRITICAL(&sensors_lock);
+            if (alert_count != alerts_seen) {
+                alerts_seen = alert_count;
+                t_us = alert_us;
+            }
+            portEXIT_CRITICAL(&sensors_lock);
+            if (t_us == 0 && !woken) {
+                count_error(&power.missed_alerts);   // Fall through and poll the flag
+            }
+            read_conversion(t_us);
+        } else {
+            ulTaskNotifyTake(pdTRUE, period > 0 ? period : 1);
+            run_simulation(&sim_us);
+        }
+    }
+}
+
+static bool probe_hardware(void)
+{
+    i2c_config_t conf = {};
+    conf.mode = I2C_MODE_MASTER;
+    conf.sda_io_num = SENSORS_PIN_SDA;
+    conf.scl_io_num = SENSORS_PIN_SCL;
+    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.master.clk_speed = SENSORS_I2C_HZ;
+    if (i2c_param_config(SENSORS_I2C_PORT, &conf) != ESP_OK ||
+        i2c_driver_install(SENSORS_I2C_PORT, conf.mode, 0, 0, 0) != ESP_OK) {
+        return false;
+    }
+
+    i2c_bus.read = i2c_read_reg;
+    i2c_bus.write = i2c_write_reg;
+    i2c_bus.ctx = NULL;
+    if (ina2xx_init(&ina, &i2c_bus, SENSORS_SHUNT_UOHM, SENSORS_MAX_CURRENT_MA)) {
+        return true;
+    }
+    i2c_driver_delete(SENSORS_I2C_PORT);
+    return false;
+}
+
+esp_err_t sensors_init(void)
+{
+    hardware = probe_hardware();
+    if (!hardware) {
+        const ina2xx_sim_pack_t pack = INA2XX_SIM_DEFAULT_PACK;
+        ina2xx_sim_init(&sim, &pack, SENSORS_SHUNT_UOHM);
+        if (!ina2xx_init(&ina, &sim.bus, SENSORS_SHUNT_UOHM, SENSORS_MAX_CURRENT_MA)) {
+            return ESP_FAIL;
+        }
+        ESP_LOGW(TAG, "No INA226 at 0x%02x, simulating the battery", INA226_ADDR);
+    }
+    if (!ina2xx_configure(&ina, SENSORS_AVG, SENSORS_CT)) {
+        return ESP_FAIL;
+    }
+    power.hardware = hardware;
+    power.conversion_us = ina2xx_conversion_us(ina.config);
+
+    if (MEM_TASK_CREATE(sensors_task, "sensors", NULL, SENSORS_TASK_PRIORITY,
+                        &sensors_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (hardware) {
+        gpio_config_t io_conf = {};
+        io_conf.intr_type = GPIO_INTR_NEGEDGE;
+        io_conf.mode = GPIO_MODE_INPUT;
+        io_conf.pin_bit_mask = 1ULL << SENSORS_PIN_ALERT;
+        io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+        gpio_config(&io_conf);
+        esp_err_t err = gpio_install_isr_service(0);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            return err;
+        }
+        gpio_isr_handler_add(SENSORS_PIN_ALERT, alert_isr, NULL);
+        ESP_LOGI(TAG, "INA226 on I2C, conversion every %lu us", power.conversion_us);
+    }
+    return ESP_OK;
+}
+
+float sensors_get_battery_voltage(void)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    int32_t mv = power.bus_mv;
+    portEXIT_CRITICAL(&sensors_lock);
+    return mv / 1000.0f;
+}
+
+void sensors_get_power(sensors_power_t *out)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    *out = power;
+    portEXIT_CRITICAL(&sensors_lock);
+}
+
+void sensors_set_sample_callback(sensors_sample_cb_t cb)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    sample_cb = cb;
+    portEXIT_CRITICAL(&sensors_lock);
+}
+
+esp_err_t sensors_start_trace(battery_sample_t *buf, size_t capacity, int64_t *start_us, uint32_t *conversion_us)
+{
+    if (sensors_task_handle == NULL || buf == NULL || capacity == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&sensors_lock);
+    bool idle = trace_state == TRACE_OFF;
+    if (idle) {
+        trace_buf = buf;
+        trace_capacity = capacity;
+        trace_count = 0;
+        trace_state = TRACE_START;
+    }
+    portEXIT_CRITICAL(&sensors_lock);
+    if (!idle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xTaskNotifyGive(sensors_task_handle);
+    for (int i = 0; i < 20 && trace_state == TRACE_START; i++) {
+        vTaskDelay(1);
+    }
+    portENTER_CRITICAL(&sensors_lock);
+    bool running = trace_state == TRACE_RUNNING;
+    if (!running) {
+        trace_state = TRACE_OFF;
+    }
+    *start_us = trace_start_us;
+    *conversion_us = power.conversion_us;
+    portEXIT_CRITICAL(&sensors_lock);
+    return running ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+size_t sensors_stop_trace(void)
+{
+    portENTER_CRITICAL(&sensors_lock);
+    bool running = trace_state == TRACE_RUNNING;
+    size_t count = trace_count;
+    if (running) {
+        trace_state = TRACE_STOP;   // The buffer is not written from here on
+    }
+    portEXIT_CRITICAL(&sensors_lock);
+    if (running) {
+        xTaskNotifyGive(sensors_task_handle);
+    }
+    return count;
+}
+
+float sensors_reset_battery(void)
+{
+    if (!hardware) {
+        recharge_requested = true;
+    }
+    portENTER_CRITICAL(&sensors_lock);
+    memset(&totals, 0, sizeof(totals));
+    power.charge_uah = 0;
+    power.energy_uwh = 0;
+    power.integrated_ms = 0;
+    int32_t mv = power.bus_mv;
+    portEXIT_CRITICAL(&sensors_lock);
+    return mv / 1000.0f;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "battery_fit.h"
+
+// Bench sensor readings. Battery voltage, current and power come from an
+// INA226 on I2C; a sampler task reads each completed conversion when the
+// sensor's alert pin signals it and integrates charge and energy. Without the
+// sensor the same driver runs against a simulated pack (ina2xx_sim.h) loaded
+// by the motor throttles.
+
+typedef struct {
+    bool hardware;             // INA226 found, otherwise simulated
+    int32_t bus_mv;
+    int32_t current_ma;
+    int32_t power_mw;
+    int64_t time_us;           // Completion of the last conversion
+    uint32_t conversion_us;    // Time between completed conversions
+    uint32_t conversions;
+    uint32_t missed_alerts;    // Waits that ended without a conversion ready alert
+    uint32_t bus_errors;
+    int64_t charge_uah;        // Integrated since the last reset
+    int64_t energy_uwh;
+    uint64_t integrated_ms;    // Time covered by the integrators
+} sensors_power_t;
+
+// Called on the sampler task after every conversion; time_us and
+// conversion_us give the window the readings average over
+typedef void (*sensors_sample_cb_t)(const sensors_power_t *power);
+
+// Probe the power monitor and start the sampler task
+esp_err_t sensors_init(void);
+
+float sensors_get_battery_voltage(void);
+void sensors_get_power(sensors_power_t *power);
+void sensors_set_sample_callback(sensors_sample_cb_t cb);
+
+// Zero the charge and energy integrators, e.g. after swapping the battery.
+// The simulated bench also swaps in a charged pack. Returns the battery voltage.
+float sensors_reset_battery(void);
+
+// High-rate trace for step tests: 4 averages of 140 us conversions
+#define SENSORS_TRACE_CONVERSION_US 1120
+
+// Switch to trace conversions and record every one of them into buf until it
+// is full or the trace is stopped. The integrators keep running. Returns the
+// esp_timer time the trace starts at and the conversion time in use.
+esp_err_t sensors_start_trace(battery_sample_t *buf, size_t capacity, int64_t *start_us, uint32_t *conversion_us);
+
+// Return to the normal rate. Returns the number of samples recorded; buf is
+// no longer written once this returns.
+size_t sensors_stop_trace(void);
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "settings.h"
+#include "mem_pool.h"
+
+static const char *TAG = "settings";
+
+#define SETTINGS_NAMESPACE "bench"
+#define SETTINGS_KEY       "settings"
+
+// v1 layout, read once for migration and then erased
+#define LEGACY_WIFI_NAMESPACE  "wifi"
+#define LEGACY_BENCH_NAMESPACE "bench"
+
+#define SETTINGS_TASK_STACK    3072
+#define SETTINGS_TASK_PRIORITY 2
+
+// Stored blob: header followed by settings_t as of header.version
+typedef struct {
+    uint16_t version;
+    uint16_t size;       // Bytes of settings data following the header
+} settings_header_t;
+
+typedef struct {
+    settings_header_t header;
+    settings_t data;
+} settings_blob_t;
+
+MEM_TASK_STORAGE(settings_task, SETTINGS_TASK_STACK);
+static settings_t current;          // Authoritative copy, guarded by settings_lock
+static settings_t saved;            // Contents of the last blob written or loaded
+static settings_blob_t write_buf;   // Snapshot being written, guarded by write_lock
+static portMUX_TYPE settings_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t write_lock = NULL;
+static StaticSemaphore_t write_lock_buf;
+static TaskHandle_t settings_task_handle = NULL;
+
+static bool dirty = false;
+static bool rewrite_layout = false;    // Stored blob is in an older layout, write even if unchanged
+static uint32_t pending_changes = 0;   // Changes since the last write
+static settings_stats_t stats;
+
+static void settings_defaults(settings_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->protocol = PROTOCOL_STANDARD;
+    s->loadcell.counts_per_kg = LOADCELL_DEFAULT_COUNTS_PER_KG;
+}
+
+// Repair anything a corrupt or foreign blob could have left out of range
+static void settings_sanitize(settings_t *s)
+{
+    s->wifi.ssid[sizeof(s->wifi.ssid) - 1] = '\0';
+    s->wifi.password[sizeof(s->wifi.password) - 1] = '\0';
+    if (s->protocol > PROTOCOL_MULTISHOT) {
+        s->protocol = PROTOCOL_STANDARD;
+    }
+    if (s->rpm_tuning.rate_hz != 0 &&
+        (s->rpm_tuning.rate_hz < MOTOR_RPM_RATE_MIN_HZ || s->rpm_tuning.rate_hz > MOTOR_RPM_RATE_MAX_HZ)) {
+        memset(&s->rpm_tuning, 0, sizeof(s->rpm_tuning));
+    }
+    if (s->loadcell.counts_per_kg == 0 || s->loadcell.motor >= MOTOR_COUNT) {
+        memset(&s->loadcell, 0, sizeof(s->loadcell));
+        s->loadcell.counts_per_kg = LOADCELL_DEFAULT_COUNTS_PER_KG;
+    }
+}
+
+static esp_err_t write_blob(const settings_blob_t *blob)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, SETTINGS_KEY, blob, sizeof(*blob));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// Read the blob over the defaults. Older versions are shorter and leave the
+// newer fields at their defaults; newer ones (after a rollback) are truncated.
+static bool load_blob(settings_t *s)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t len = 0;
+    bool loaded = false;
+    if (nvs_get_blob(nvs_handle, SETTINGS_KEY, NULL, &len) == ESP_OK && len >= sizeof(settings_header_t)) {
+        static_assert(sizeof(settings_header_t) + sizeof(settings_t) <= MEM_MEDIUM_BLOCK,
+                      "settings outgrew their block");
+        uint8_t *buf = (uint8_t *)mem_alloc(len);   // NULL for a blob too large to be ours
+        if (buf && nvs_get_blob(nvs_handle, SETTINGS_KEY, buf, &len) == ESP_OK) {
+            settings_header_t header;
+            memcpy(&header, buf, sizeof(header));
+            size_t size = header.size;
+            if (size > len - sizeof(header)) size = len - sizeof(header);
+            if (size > sizeof(*s)) size = sizeof(*s);
+            memcpy(s, buf + sizeof(header), size);
+            stats.loaded_version = header.version;
+            loaded = true;
+
+            if (header.version != SETTINGS_VERSION) {
+                ESP_LOGI(TAG, "Settings blob v%u (%u bytes) loaded into v%d", header.version,
+                         header.size, SETTINGS_VERSION);
+            }
+        }
+        mem_free(buf);
+    }
+    nvs_close(nvs_handle);
+    return loaded;
+}
+
+// v1 kept WiFi credentials, the cached AP and the protocol as separate keys
+static bool load_legacy(settings_t *s)
+{
+    bool found = false;
+    nvs_handle_t nvs_handle;
+    if (nvs_open(LEGACY_WIFI_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        size_t len = sizeof(s->wifi.ssid);
+        if (nvs_get_str(nvs_handle, "ssid", s->wifi.ssid, &len) == ESP_OK) {
+            found = true;
+            len = sizeof(s->wifi.password);
+            if (nvs_get_str(nvs_handle, "password", s->wifi.password, &len) != ESP_OK) {
+                s->wifi.password[0] = '\0';
+            }
+        } else {
+            s->wifi.ssid[0] = '\0';
+        }
+        len = sizeof(s->wifi.bssid);
+        if (nvs_get_blob(nvs_handle, "bssid", s->wifi.bssid, &len) != ESP_OK ||
+            nvs_get_u8(nvs_handle, "channel", &s->wifi.channel) != ESP_OK) {
+            memset(s->wifi.bssid, 0, sizeof(s->wifi.bssid));
+            s->wifi.channel = 0;
+        }
+        nvs_close(nvs_handle);
+    }
+    if (nvs_open(LEGACY_BENCH_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        if (nvs_get_u8(nvs_handle, "protocol", &s->protocol) == ESP_OK) {
+            found = true;
+        }
+        nvs_close(nvs_handle);
+    }
+    return found;
+}
+
+static void erase_legacy(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(LEGACY_WIFI_NAMESPACE, NVS_READWRITE, &nvs_handle) == ESP_OK) {
+        nvs_erase_key(nvs_handle, "ssid");
+        nvs_erase_key(nvs_handle, "password");
+        nvs_erase_key(nvs_handle, "bssid");
+        nvs_erase_key(nvs_handle, "channel");
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    if (nvs_open(LEGACY_BENCH_NAMESPACE, NVS_READWRITE, &nvs_handle) == ESP_OK) {
+        nvs_erase_key(nvs_handle, "protocol");
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+}
+
+// Writes the blob once no change has arrived for SETTINGS_COMMIT_DELAY_MS,
+// or SETTINGS_COMMIT_MAX_MS after the first change of a continuous burst.
+// A failed write keeps the changes dirty and is retried after another quiet time.
+static void settings_task(void *arg)
+{
+    bool retry = false;
+    while (1) {
+        if (!retry) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        int64_t first_change = esp_timer_get_time();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTINGS_COMMIT_DELAY_MS)) != 0 &&
+               esp_timer_get_time() - first_change < (int64_t)SETTINGS_COMMIT_MAX_MS * 1000) {
+        }
+        retry = settings_flush() != ESP_OK;
+    }
+}
+
+esp_err_t settings_init(void)
+{
+    write_lock = xSemaphoreCreateMutexStatic(&write_lock_buf);
+    if (write_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    settings_defaults(&current);
+    if (!load_blob(&current)) {
+        settings_defaults(&current);
+        stats.migrated = load_legacy(&current);
+    }
+    settings_sanitize(&current);
+    saved = current;
+
+    // Rewrite older layouts right away; v1 keys are erased only once the blob is safe
+    if (stats.migrated || (stats.loaded_version != 0 && stats.loaded_version < SETTINGS_VERSION)) {
+        dirty = true;
+        rewrite_layout = true;
+        if (settings_flush() == ESP_OK && stats.migrated) {
+            erase_legacy();
+            ESP_LOGI(TAG, "Migrated v1 settings to blob v%d", SETTINGS_VERSION);
+        }
+    }
+
+    if (MEM_TASK_CREATE(settings_task, "settings", NULL, SETTINGS_TASK_PRIORITY,
+                        &settings_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Settings v%d loaded (%u bytes)", SETTINGS_VERSION, (unsigned)sizeof(settings_t));
+    return ESP_OK;
+}
+
+const settings_t *settings_get(void)
+{
+    return &current;
+}
+
+void settings_snapshot(settings_t *out)
+{
+    portENTER_CRITICAL(&settings_lock);
+    *out = current;
+    portEXIT_CRITICAL(&settings_lock);
+}
+
+// Copy a value into the RAM copy and schedule a write if it changed
+static void settings_update(void *field, const void *value, size_t len)
+{
+    portENTER_CRITICAL(&settings_lock);
+    bool changed = memcmp(field, value, len) != 0;
+    if (changed) {
+        memcpy(field, value, len);
+        dirty = true;
+        pending_changes++;
+        stats.changes++;
+    }
+    portEXIT_CRITICAL(&settings_lock);
+
+    if (changed && settings_task_handle) {
+        xTaskNotifyGive(settings_task_handle);
+    }
+}
+
+void settings_set_wifi(const char *ssid, const char *password)
+{
+    settings_wifi_t wifi = {};
+    strncpy(wifi.ssid, ssid, sizeof(wifi.ssid) - 1);
+    strncpy(wifi.password, password, sizeof(wifi.password) - 1);
+    settings_update(&current.wifi, &wifi, sizeof(wifi));
+}
+
+void settings_set_ap(const uint8_t bssid[6], uint8_t channel)
+{
+    // Read-modify-write of the whole WiFi entry so it cannot mix with a concurrent settings_set_wifi
+    settings_wifi_t wifi;
+    portENTER_CRITICAL(&settings_lock);
+    wifi = current.wifi;
+    portEXIT_CRITICAL(&settings_lock);
+    memcpy(wifi.bssid, bssid, sizeof(wifi.bssid));
+    wifi.channel = channel;
+    settings_update(&current.wifi, &wifi, sizeof(wifi));
+}
+
+void settings_clear_wifi(void)
+{
+    settings_wifi_t wifi = {};
+    settings_update(&current.wifi, &wifi, sizeof(wifi));
+}
+
+void settings_set_protocol(esc_protocol_t protocol)
+{
+    uint8_t value = (uint8_t)protocol;
+    settings_update(&current.protocol, &value, sizeof(value));
+}
+
+void settings_set_rpm_tuning(const rpm_pid_config_t *cfg)
+{
+    settings_update(&current.rpm_tuning, cfg, sizeof(*cfg));
+}
+
+void settings_set_rpm_map(int motor, const rpm_ff_map_t *map)
+{
+    if (motor < 0 || motor >= MOTOR_COUNT) {
+        return;
+    }
+    settings_update(&current.rpm_map[motor], map, sizeof(*map));
+}
+
+void settings_set_loadcell(const loadcell_cal_t *cal)
+{
+    // Built field by field so the padding compares equal
+    loadcell_cal_t value;
+    memset(&value, 0, sizeof(value));
+    value.offset = cal->offset;
+    value.counts_per_kg = cal->counts_per_kg;
+    value.motor = cal->motor;
+    value.calibrated = cal->calibrated;
+    settings_update(&current.loadcell, &value, sizeof(value));
+}
+
+esp_err_t settings_flush(void)
+{
+    if (write_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(write_lock, portMAX_DELAY);
+
+    portENTER_CRITICAL(&settings_lock);
+    bool was_dirty = dirty;
+    uint32_t changes = pending_changes;
+    if (was_dirty) {
+        write_buf.data = current;
+        dirty = false;
+        pending_changes = 0;
+    }
+    portEXIT_CRITICAL(&settings_lock);
+
+    esp_err_t err = ESP_OK;
+    if (was_dirty) {
+        if (!rewrite_layout && memcmp(&write_buf.data, &saved, sizeof(saved)) == 0) {
+            stats.writes_avoided += changes;
+        } else {
+            write_buf.header.version = SETTINGS_VERSION;
+            write_buf.header.size = sizeof(settings_t);
+            err = write_blob(&write_buf);
+            if (err == ESP_OK) {
+                saved = write_buf.data;
+                rewrite_layout = false;
+                stats.flash_writes++;
+                if (changes > 1) stats.writes_avoided += changes - 1;
+                ESP_LOGD(TAG, "Settings written (%lu changes)", changes);
+            } else {
+                stats.write_errors++;
+                ESP_LOGE(TAG, "Settings write failed: %s", esp_err_to_name(err));
+                portENTER_CRITICAL(&settings_lock);
+                dirty = true;
+                pending_changes += changes;
+                portEXIT_CRITICAL(&settings_lock);
+            }
+        }
+    }
+
+    xSemaphoreGive(write_lock);
+    return err;
+}
+
+void settings_get_stats(settings_stats_t *out)
+{
+    portENTER_CRITICAL(&settings_lock);
+    *out = stats;
+    out->dirty = dirty;
+    portEXIT_CRITICAL(&settings_lock);
+}
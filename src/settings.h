@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "motor_control.h"
+#include "rpm_control.h"
+#include "loadcell.h"
+
+// Persistent bench settings: one typed struct kept in RAM and stored in NVS
+// as a single versioned blob. Reads go straight to the RAM copy; setters
+// update it and a background task writes the blob once changes stop arriving.
+//
+// Schema changes: append fields to the end of settings_t, give them a default
+// in settings.cpp and bump SETTINGS_VERSION. Older blobs are loaded over the
+// defaults, so fields they do not have keep their default values.
+
+#define SETTINGS_VERSION 3   // v1 was the per-key layout in namespaces "wifi" and "bench", v3 added loadcell
+
+#define SETTINGS_COMMIT_DELAY_MS 2000    // Quiet time after the last change before writing
+#define SETTINGS_COMMIT_MAX_MS   10000   // Longest a change stays unwritten during a burst
+
+typedef struct {
+    char ssid[33];            // Empty if no network has been saved
+    char password[65];
+    uint8_t bssid[6];         // AP the bench last associated with
+    uint8_t channel;          // 0 if unknown
+} settings_wifi_t;
+
+typedef struct {
+    settings_wifi_t wifi;
+    uint8_t protocol;                    // esc_protocol_t restored at boot
+    rpm_pid_config_t rpm_tuning;         // rate_hz 0 until tuned, firmware defaults apply
+    rpm_ff_map_t rpm_map[MOTOR_COUNT];   // Learned feed-forward maps, samples 0 if never learned
+    loadcell_cal_t loadcell;             // Thrust stand tare and scale
+} settings_t;
+
+typedef struct {
+    uint32_t changes;          // Setter calls that modified a value
+    uint32_t flash_writes;     // Blob writes
+    uint32_t writes_avoided;   // Changes folded into another write or reverted before it
+    uint32_t write_errors;
+    bool dirty;                // RAM copy differs from what was last written
+    bool migrated;             // Loaded from the v1 per-key layout this boot
+    uint16_t loaded_version;   // Version of the blob found at boot, 0 if none
+} settings_stats_t;
+
+// Load the blob (or migrate older layouts) and start the commit task. Needs NVS.
+esp_err_t settings_init(void);
+
+// Authoritative RAM copy. Single fields can be read at any time without
+// locking; copy the struct with settings_snapshot() for a consistent view.
+const settings_t *settings_get(void);
+void settings_snapshot(settings_t *out);
+
+// New credentials forget the cached BSSID/channel
+void settings_set_wifi(const char *ssid, const char *password);
+void settings_set_ap(const uint8_t bssid[6], uint8_t channel);
+void settings_clear_wifi(void);
+void settings_set_protocol(esc_protocol_t protocol);
+void settings_set_rpm_tuning(const rpm_pid_config_t *cfg);
+void settings_set_rpm_map(int motor, const rpm_ff_map_t *map);
+void settings_set_loadcell(const loadcell_cal_t *cal);
+
+// Write pending changes now, e.g. before a restart or for credentials
+esp_err_t settings_flush(void);
+
+void settings_get_stats(settings_stats_t *stats);
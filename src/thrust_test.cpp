@@ -0,0 +1,278 @@
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "motor_control.h"
+#include "loadcell.h"
+#include "sensors.h"
+#include "thrust_test.h"
+#include "mem_pool.h"
+
+static const char *TAG = "thrust_test";
+
+#define THRUST_TASK_PRIORITY 3
+#define THRUST_TASK_STACK    3072
+#define THRUST_MAX_SETTLE_MS 10000
+#define THRUST_MIN_MEASURE_MS 200
+#define THRUST_MAX_MEASURE_MS 10000
+#define THRUST_DRAIN_MS      100     // Conversions ending at the window close: 35.2 ms power, 12.5 ms load cell
+
+// Sums of the conversions inside the open window. Written by the sampler
+// callbacks, read by the sweep task once the window has closed.
+typedef struct {
+    bool open;
+    int64_t start_us;
+    int64_t end_us;
+    int64_t thrust_sum;
+    int64_t thrust_sq;
+    int64_t rpm_sum;          // Over the samples with a measured RPM
+    uint32_t thrust_n;
+    uint32_t esc_rpm_n;       // Samples whose RPM came from ESC telemetry
+    int64_t mv_sum;
+    int64_t ma_sum;
+    int64_t mw_sum;
+    uint32_t power_n;
+} thrust_window_t;
+
+static portMUX_TYPE thrust_lock = portMUX_INITIALIZER_UNLOCKED;
+static thrust_window_t window;
+static thrust_result_t result;
+static TaskHandle_t thrust_task_handle = NULL;   // The sweep task while a sweep runs
+static TaskHandle_t sweep_worker = NULL;
+MEM_TASK_STORAGE(thrust_task, THRUST_TASK_STACK);
+static volatile bool abort_requested = false;
+
+static void loadcell_sample(const loadcell_reading_t *r)
+{
+    // The measured speed is the ESC's; the motor model has no place in a thrust curve
+    motor_rpm_status_t st;
+    motor_get_rpm_status(result.config.motor, &st);
+
+    portENTER_CRITICAL(&thrust_lock);
+    if (window.open && r->time_us - LOADCELL_SAMPLE_US >= window.start_us && r->time_us <= window.end_us) {
+        window.thrust_sum += r->thrust_mg;
+        window.thrust_sq += (int64_t)r->thrust_mg * r->thrust_mg;
+        window.thrust_n++;
+        if (st.measured) {
+            window.rpm_sum += st.measured_rpm;
+            window.esc_rpm_n++;
+        }
+    }
+    portEXIT_CRITICAL(&thrust_lock);
+}
+
+static void power_sample(const sensors_power_t *p)
+{
+    portENTER_CRITICAL(&thrust_lock);
+    if (window.open && p->time_us - p->conversion_us >= window.start_us && p->time_us <= window.end_us) {
+        window.mv_sum += p->bus_mv;
+        window.ma_sum += p->current_ma;
+        window.mw_sum += p->power_mw;
+        window.power_n++;
+    }
+    portEXIT_CRITICAL(&thrust_lock);
+}
+
+// Sleep unless the sweep is aborted; returns true on abort
+static bool wait_ms(uint32_t ms)
+{
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+    return abort_requested;
+}
+
+static void open_window(uint32_t measure_ms)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&thrust_lock);
+    memset(&window, 0, sizeof(window));
+    window.start_us = now;
+    window.end_us = now + (int64_t)measure_ms * 1000;
+    window.open = true;
+    portEXIT_CRITICAL(&thrust_lock);
+}
+
+static void close_window(int throttle, thrust_point_t *pt)
+{
+    portENTER_CRITICAL(&thrust_lock);
+    window.open = false;
+    thrust_window_t w = window;
+    portEXIT_CRITICAL(&thrust_lock);
+
+    memset(pt, 0, sizeof(*pt));
+    pt->throttle = (int16_t)throttle;
+    pt->thrust_samples = (uint16_t)w.thrust_n;
+    pt->power_samples = (uint16_t)w.power_n;
+    if (w.thrust_n > 0) {
+        pt->thrust_mg = (int32_t)(w.thrust_sum / w.thrust_n);
+        int64_t var = w.thrust_sq / w.thrust_n - (int64_t)pt->thrust_mg * pt->thrust_mg;
+        pt->thrust_sd_mg = var > 0 ? (int32_t)sqrtf((float)var) : 0;
+        pt->esc_rpm = w.esc_rpm_n * 2 > w.thrust_n;
+        pt->rpm = pt->esc_rpm ? (int32_t)(w.rpm_sum / w.esc_rpm_n) : 0;
+    }
+    if (w.power_n > 0) {
+        pt->bus_mv = (int32_t)(w.mv_sum / w.power_n);
+        pt->current_ma = (int32_t)(w.ma_sum / w.power_n);
+        pt->power_mw = (int32_t)(w.mw_sum / w.power_n);
+    }
+    if (pt->power_mw > 0) {
+        pt->mg_per_w = (int32_t)((int64_t)pt->thrust_mg * 1000 / pt->power_mw);
+    }
+}
+
+static void finish(thrust_state_t state, esp_err_t err)
+{
+    portENTER_CRITICAL(&thrust_lock);
+    result.state = state;
+    result.err = err;
+    result.elapsed_ms = (uint32_t)((esp_timer_get_time() - result.start_us) / 1000);
+    thrust_task_handle = NULL;
+    portEXIT_CRITICAL(&thrust_lock);
+}
+
+static void run_sweep(void)
+{
+    thrust_config_t cfg = result.config;
+    int steps = result.steps;
+    esp_err_t err = ESP_OK;
+    loadcell_set_sample_callback(loadcell_sample);
+    sensors_set_sample_callback(power_sample);
+
+    for (int i = 0; i < steps && !abort_requested; i++) {
+        int throttle = cfg.from_throttle + i * cfg.step_throttle;
+        motor_cmd_t cmd = { MOTOR_CMD_THROTTLE, (int8_t)cfg.motor, throttle };
+        err = motor_apply_command(&cmd);
+        if (err != ESP_OK || wait_ms(cfg.settle_ms)) {
+            break;
+        }
+        open_window(cfg.measure_ms);
+        if (wait_ms(cfg.measure_ms + THRUST_DRAIN_MS)) {
+            break;
+        }
+
+        thrust_point_t pt;
+        close_window(throttle, &pt);
+        if (pt.thrust_samples == 0) {
+            err = ESP_ERR_TIMEOUT;          // Load cell stopped converting
+            break;
+        }
+        if (motor_get_throttle(cfg.motor) != throttle) {
+            err = ESP_ERR_INVALID_STATE;    // Another command took the motor over
+            break;
+        }
+        portENTER_CRITICAL(&thrust_lock);
+        result.points[i] = pt;
+        result.completed = i + 1;
+        portEXIT_CRITICAL(&thrust_lock);
+        ESP_LOGI(TAG, "Step %d/%d: %d%% %ld g %ld rpm %ld mW %ld mg/W (%u/%u samples)", i + 1, steps,
+                 throttle / 10, pt.thrust_mg / 1000, pt.rpm, pt.power_mw, pt.mg_per_w,
+                 pt.thrust_samples, pt.power_samples);
+    }
+
+    loadcell_set_sample_callback(NULL);
+    sensors_set_sample_callback(NULL);
+    portENTER_CRITICAL(&thrust_lock);
+    window.open = false;
+    portEXIT_CRITICAL(&thrust_lock);
+    motor_cmd_t stop = { MOTOR_CMD_STOP, (int8_t)cfg.motor, 0 };
+    motor_apply_command(&stop);
+
+    thrust_state_t state = err != ESP_OK ? THRUST_FAILED : abort_requested ? THRUST_ABORTED : THRUST_DONE;
+    finish(state, err);
+    ESP_LOGI(TAG, "Sweep %s after %d of %d steps%s%s", thrust_state_name(state), result.completed, steps,
+             err != ESP_OK ? ": " : "", err != ESP_OK ? esp_err_to_name(err) : "");
+}
+
+// Created on the first sweep and parked between sweeps, so its stack can be static
+static void thrust_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        portENTER_CRITICAL(&thrust_lock);
+        bool start = thrust_task_handle != NULL;
+        portEXIT_CRITICAL(&thrust_lock);
+        if (start) {   // Else a stop that came in as the last sweep ended
+            run_sweep();
+        }
+    }
+}
+
+esp_err_t thrust_test_start(const thrust_config_t *cfg)
+{
+    thrust_config_t c = *cfg;
+    if (c.motor == -1) {
+        loadcell_cal_t cal;
+        loadcell_get_calibration(&cal);
+        c.motor = cal.motor;
+    }
+    if (c.motor < 0 || c.motor >= MOTOR_COUNT || c.from_throttle < 0 || c.to_throttle > 1000 ||
+        c.from_throttle > c.to_throttle || c.step_throttle <= 0 ||
+        (c.to_throttle - c.from_throttle) / c.step_throttle + 1 > THRUST_MAX_STEPS ||
+        c.settle_ms > THRUST_MAX_SETTLE_MS ||
+        c.measure_ms < THRUST_MIN_MEASURE_MS || c.measure_ms > THRUST_MAX_MEASURE_MS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (sweep_worker == NULL &&
+        MEM_TASK_CREATE(thrust_task, "thrust", NULL, THRUST_TASK_PRIORITY, &sweep_worker) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&thrust_lock);
+    bool busy = thrust_task_handle != NULL;
+    if (!busy) {
+        memset(&result, 0, sizeof(result));
+        result.state = THRUST_RUNNING;
+        result.config = c;
+        result.steps = (c.to_throttle - c.from_throttle) / c.step_throttle + 1;
+        result.start_us = esp_timer_get_time();
+        abort_requested = false;
+        thrust_task_handle = sweep_worker;
+    }
+    portEXIT_CRITICAL(&thrust_lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(sweep_worker);
+    ESP_LOGI(TAG, "Sweep motor %d from %d to %d per mille in %d steps", c.motor, c.from_throttle,
+             c.to_throttle, result.steps);
+    return ESP_OK;
+}
+
+esp_err_t thrust_test_stop(void)
+{
+    portENTER_CRITICAL(&thrust_lock);
+    TaskHandle_t handle = thrust_task_handle;
+    if (handle) {
+        abort_requested = true;
+    }
+    portEXIT_CRITICAL(&thrust_lock);
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotifyGive(handle);
+    return ESP_OK;
+}
+
+void thrust_test_get_result(thrust_result_t *out)
+{
+    portENTER_CRITICAL(&thrust_lock);
+    *out = result;
+    portEXIT_CRITICAL(&thrust_lock);
+    if (out->state == THRUST_RUNNING) {
+        out->elapsed_ms = (uint32_t)((esp_timer_get_time() - out->start_us) / 1000);
+    }
+}
+
+const char *thrust_state_name(thrust_state_t state)
+{
+    switch (state) {
+        case THRUST_IDLE:    return "idle";
+        case THRUST_RUNNING: return "running";
+        case THRUST_DONE:    return "done";
+        case THRUST_ABORTED: return "aborted";
+        case THRUST_FAILED:  return "failed";
+    }
+    return "unknown";
+}
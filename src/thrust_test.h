@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Thrust stand characterization. A task steps one motor through a throttle
+// sweep; at every step it waits for the rotor to settle and then opens a
+// measurement window. The load cell and power monitor sampler callbacks add
+// every conversion that lies entirely inside the window, each sample paired
+// with the RPM at its completion, so the averages of one step all cover the
+// same span of time.
+
+typedef struct {
+    int motor;                // Motor on the stand, -1 for the one in the load cell calibration
+    int from_throttle;        // Per mille, first step
+    int to_throttle;          // Last step, inclusive
+    int step_throttle;
+    uint32_t settle_ms;       // After each throttle change
+    uint32_t measure_ms;      // Averaging window of each step
+} thrust_config_t;
+
+#define THRUST_DEFAULT_CONFIG { -1, 100, 1000, 100, 1500, 2000 }
+#define THRUST_MAX_STEPS      32
+
+typedef struct {
+    int16_t throttle;
+    bool esc_rpm;             // Most samples had fresh ESC telemetry; rpm is 0 otherwise
+    int32_t thrust_mg;        // Means over the window
+    int32_t thrust_sd_mg;     // Standard deviation of the load cell samples
+    int32_t rpm;
+    int32_t bus_mv;
+    int32_t current_ma;
+    int32_t power_mw;
+    int32_t mg_per_w;         // Thrust per electrical watt drawn from the battery
+    uint16_t thrust_samples;
+    uint16_t power_samples;
+} thrust_point_t;
+
+typedef enum {
+    THRUST_IDLE,
+    THRUST_RUNNING,
+    THRUST_DONE,
+    THRUST_ABORTED,
+    THRUST_FAILED
+} thrust_state_t;
+
+typedef struct {
+    thrust_state_t state;
+    thrust_config_t config;
+    esp_err_t err;            // Why the run failed
+    int steps;                // Planned
+    int completed;
+    int64_t start_us;
+    uint32_t elapsed_ms;
+    thrust_point_t points[THRUST_MAX_STEPS];
+} thrust_result_t;
+
+// Validate the sweep and start it on its own task. The motor is stopped when
+// the sweep ends, fails or is aborted.
+esp_err_t thrust_test_start(const thrust_config_t *cfg);
+
+// Abort a running sweep
+esp_err_t thrust_test_stop(void);
+
+// Progress and the points measured so far
+void thrust_test_get_result(thrust_result_t *result);
+
+const char *thrust_state_name(thrust_state_t state);
@@ -0,0 +1,175 @@
+#include <errno.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "motor_control.h"
+#include "sensors.h"
+#include "esc_telemetry.h"
+#include "udp_control.h"
+#include "mem_pool.h"
+
+static const char *TAG = "udp";
+
+#define UDP_TASK_PRIORITY 8     // Below the control task, above httpd
+#define UDP_TASK_STACK 3072
+
+// Layout is shared with udp_client.py and the host tools
+static_assert(sizeof(udp_control_packet_t) == 22, "control packet layout changed");
+static_assert(sizeof(udp_telemetry_packet_t) == 64, "telemetry packet layout changed");
+
+MEM_TASK_STORAGE(udp_control_task, UDP_TASK_STACK);
+static udp_control_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;   // Written here, read by httpd
+
+// Count one event under the lock so udp_control_get_stats never sees a torn update
+static void count(uint32_t *counter)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    (*counter)++;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void fill_telemetry(udp_telemetry_packet_t *tlm, const udp_control_packet_t *pkt,
+                           uint32_t apply_us, bool rejected)
+{
+    memset(tlm, 0, sizeof(*tlm));
+    tlm->magic = UDP_CONTROL_MAGIC;
+    tlm->version = UDP_CONTROL_VERSION;
+    tlm->flags = (motor_failsafe_tripped() ? UDP_TLM_FAILSAFE : 0) | (rejected ? UDP_TLM_REJECTED : 0);
+    tlm->seq = pkt->seq;
+    tlm->host_time_us = pkt->host_time_us;
+    tlm->bench_time_us = (uint32_t)esp_timer_get_time();
+    tlm->apply_us = apply_us > 0xFFFF ? 0xFFFF : apply_us;
+    tlm->battery_mv = (uint16_t)(sensors_get_battery_voltage() * 1000);
+    for (int m = 0; m < MOTOR_COUNT && m < UDP_MAX_MOTORS; m++) {
+        tlm->throttle[m] = motor_get_throttle(m);
+        tlm->rpm[m] = motor_get_rpm(m);
+
+        esc_telemetry_t esc;
+        esc_telemetry_get(m, &esc);
+        if (esc.fresh) {
+            tlm->flags |= UDP_TLM_ESC_FRESH(m);
+            tlm->rpm[m] = esc.rpm > 0xFFFF ? 0xFFFF : esc.rpm;
+            tlm->esc_temp_c[m] = (int8_t)esc.temp_c;
+            tlm->esc_voltage_cv[m] = (uint16_t)(esc.voltage_mv / 10);
+            tlm->esc_current_ca[m] = (uint16_t)(esc.current_ma / 10);
+        }
+    }
+    tlm->failsafe_trips = motor_get_failsafe_trips();
+    tlm->rejected = stats.stale + stats.malformed + stats.refused;
+}
+
+// Apply a validated packet through the control task. ESP_ERR_INVALID_ARG for
+// a throttle out of range, anything else is the control task refusing it.
+static esp_err_t apply_packet(const udp_control_packet_t *pkt)
+{
+    if (pkt->flags & UDP_FLAG_DISARM) {
+        return motor_submit_disarm();
+    }
+
+    uint16_t throttle[MOTOR_COUNT];
+    for (int m = 0; m < MOTOR_COUNT; m++) {
+        throttle[m] = m < UDP_MAX_MOTORS ? pkt->throttle[m] : MOTOR_THROTTLE_UNCHANGED;
+    }
+    return motor_submit_frame(throttle, pkt->failsafe_ms);
+}
+
+static void udp_control_task(void *arg)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        mem_task_exit();
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(UDP_CONTROL_PORT);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind port %d: errno %d", UDP_CONTROL_PORT, errno);
+        close(sock);
+        mem_task_exit();
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(TAG, "UDP control listening on port %d", UDP_CONTROL_PORT);
+
+    udp_control_packet_t pkt;
+    udp_telemetry_packet_t tlm;
+    uint32_t last_seq = 0;
+    bool have_seq = false;
+
+    while (1) {
+        struct sockaddr_in src;
+        socklen_t src_len = sizeof(src);
+        int len = recvfrom(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&src, &src_len);
+        if (len < 0) {
+            continue;
+        }
+        int64_t rx_us = esp_timer_get_time();
+        count(&stats.received);
+
+        if (len != sizeof(pkt) || pkt.magic != UDP_CONTROL_MAGIC || pkt.version != UDP_CONTROL_VERSION) {
+            count(&stats.malformed);
+            continue;  // Not ours, do not answer
+        }
+
+        // Monitors (host/fleet_aggregator.cpp) only read, whoever is in control
+        if (pkt.flags & UDP_FLAG_MONITOR) {
+            count(&stats.monitored);
+            fill_telemetry(&tlm, &pkt, (uint32_t)(esp_timer_get_time() - rx_us), false);
+            sendto(sock, &tlm, sizeof(tlm), 0, (struct sockaddr *)&src, src_len);
+            continue;
+        }
+
+        // Drop reordered or duplicated packets so an old setpoint never overrides a newer one
+        bool rejected = false;
+        esp_err_t err;
+        if (have_seq && !(pkt.flags & UDP_FLAG_RESET_SEQ) && (int32_t)(pkt.seq - last_seq) <= 0) {
+            count(&stats.stale);
+            rejected = true;
+        } else if ((err = apply_packet(&pkt)) != ESP_OK) {
+            count(err == ESP_ERR_INVALID_ARG ? &stats.malformed : &stats.refused);
+            rejected = true;
+        } else {
+            last_seq = pkt.seq;
+            have_seq = true;
+        }
+
+        uint32_t apply_us = (uint32_t)(esp_timer_get_time() - rx_us);
+        if (!rejected) {
+            taskENTER_CRITICAL(&stats_lock);
+            stats.applied++;
+            stats.last_apply_us = apply_us;
+            if (apply_us > stats.max_apply_us) stats.max_apply_us = apply_us;
+            taskEXIT_CRITICAL(&stats_lock);
+        }
+
+        if (!(pkt.flags & UDP_FLAG_NO_REPLY)) {
+            fill_telemetry(&tlm, &pkt, apply_us, rejected);
+            sendto(sock, &tlm, sizeof(tlm), 0, (struct sockaddr *)&src, src_len);
+        }
+    }
+}
+
+esp_err_t udp_control_start(void)
+{
+    if (MEM_TASK_CREATE(udp_control_task, "udp_ctrl", NULL, UDP_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void udp_control_get_stats(udp_control_stats_t *out)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
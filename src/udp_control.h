@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "udp_protocol.h"
+
+// Optional low-latency control channel; udp_client.py is the host side
+#define UDP_CONTROL_ENABLED 1
+#define UDP_CONTROL_PORT    4210
+
+typedef struct {
+    uint32_t received;
+    uint32_t applied;
+    uint32_t stale;
+    uint32_t malformed;
+    uint32_t refused;                   // Well-formed frames the control task refused (held idle, ring full)
+    uint32_t monitored;                 // UDP_FLAG_MONITOR requests answered
+    uint32_t last_apply_us;
+    uint32_t max_apply_us;
+} udp_control_stats_t;
+
+// Start the UDP listener task
+esp_err_t udp_control_start(void);
+
+void udp_control_get_stats(udp_control_stats_t *stats);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wire format of the UDP control channel, included as is by the host tools
+// that speak it (host/bench_sim.cpp, host/fleet_aggregator.cpp).
+
+#define UDP_CONTROL_MAGIC   0x4455  // "UD"
+#define UDP_CONTROL_VERSION 3   // 2: ESC telemetry appended to the reply, 3: UDP_FLAG_MONITOR
+#define UDP_MAX_MOTORS      4       // Throttle slots on the wire, independent of MOTOR_COUNT
+
+// Control packet flags
+#define UDP_FLAG_RESET_SEQ  0x01    // Accept this sequence number as the new baseline
+#define UDP_FLAG_DISARM     0x02    // Stop all outputs and disarm the failsafe
+#define UDP_FLAG_NO_REPLY   0x04    // Apply without sending telemetry back
+#define UDP_FLAG_MONITOR    0x08    // Only report telemetry: nothing is applied, the sequence is not checked
+
+// Telemetry flags
+#define UDP_TLM_FAILSAFE    0x01    // Outputs were stopped by the failsafe
+#define UDP_TLM_REJECTED    0x02    // Packet was stale or invalid and not applied
+#define UDP_TLM_ESC_FRESH(m) (0x10 << (m))  // ESC telemetry of motor m is fresh; its rpm is measured
+
+// Host -> bench, all fields little-endian (22 bytes)
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t seq;
+    uint32_t host_time_us;              // Echoed back for round-trip measurement
+    uint16_t failsafe_ms;               // Stop outputs after this much silence, 0 = off
+    uint16_t throttle[UDP_MAX_MOTORS];  // 0-1000 per mille, 0xFFFF = unchanged
+} udp_control_packet_t;
+
+// Bench -> host reply, sent once the packet has been applied (64 bytes)
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t seq;                       // Sequence number of the packet answered
+    uint32_t host_time_us;
+    uint32_t bench_time_us;             // Low 32 bits of esp_timer_get_time() when the reply was filled
+    uint16_t apply_us;                  // Receive-to-applied time on the bench (to the reply for monitors);
+                                        // bench_time_us - apply_us is when the packet arrived
+    uint16_t battery_mv;
+    uint16_t throttle[UDP_MAX_MOTORS];
+    uint16_t rpm[UDP_MAX_MOTORS];
+    uint32_t failsafe_trips;
+    uint32_t rejected;                  // Stale, malformed and refused packets so far
+    int8_t esc_temp_c[UDP_MAX_MOTORS];  // ESC telemetry, valid while UDP_TLM_ESC_FRESH
+    uint16_t esc_voltage_cv[UDP_MAX_MOTORS];   // 10 mV
+    uint16_t esc_current_ca[UDP_MAX_MOTORS];   // 10 mA
+} udp_telemetry_packet_t;
@@ -0,0 +1,291 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "motor_control.h"
+#include "power.h"
+#include "vibration.h"
+#include "mem_pool.h"
+
+static const char *TAG = "vibration";
+
+#define VIB_TASK_PRIORITY 3      // Below httpd; the sensor FIFO absorbs the latency
+#define VIB_TASK_STACK    3072
+#define VIB_POLL_TICKS    1      // One tick (10 ms) is 80 samples at 8 kHz, the FIFO holds 256
+
+MEM_TASK_STORAGE(vibration_task, VIB_TASK_STACK);
+static TaskHandle_t vib_task_handle = NULL;
+static portMUX_TYPE vib_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t result_mutex = NULL;
+static StaticSemaphore_t result_mutex_buf;
+
+// Guarded by vib_lock
+static vibration_config_t config = {
+    false, VIB_DEFAULT_RATE_HZ, VIB_DEFAULT_FFT, 0x7, 0, VIB_DEFAULT_BLADES
+};
+static bool config_pending = false;
+static vibration_stats_t stats;
+static vibration_frame_cb_t frame_cb = NULL;
+static vib_sample_t *capture_dst = NULL;
+static int capture_len = 0;
+static int capture_fill = 0;
+static SemaphoreHandle_t capture_done = NULL;
+static SemaphoreHandle_t capture_mutex = NULL;   // One capture at a time
+static StaticSemaphore_t capture_done_buf, capture_mutex_buf;
+
+// Owned by the vibration task
+static vib_sample_t window[VIB_FFT_MAX];
+static uint32_t work_amp[VIB_FFT_MAX / 2];
+
+// Guarded by result_mutex
+static uint32_t spectrum[VIB_FFT_MAX / 2];
+static vibration_result_t result;
+static bool have_result = false;
+
+static void apply_config(vibration_config_t *active)
+{
+    portENTER_CRITICAL(&vib_lock);
+    *active = config;
+    config_pending = false;
+    portEXIT_CRITICAL(&vib_lock);
+
+    // The sensor paces the samples, but at 40 MHz a frame's FFT takes four
+    // times as long against a FIFO that holds 32 ms at 8 kHz, and modem sleep
+    // would hold stream frames for a beacon interval
+    power_set_active(POWER_CLIENT_VIBRATION, active->enabled);
+    if (active->enabled) {
+        vib_dsp_init(active->fft_size);
+        if (imu_set_rate(active->rate_hz) != ESP_OK) {
+            ESP_LOGW(TAG, "IMU rate change failed");
+        }
+    } else {
+        imu_stop();
+    }
+}
+
+static void record_capture(const vib_sample_t *samples, int count)
+{
+    bool done = false;
+    portENTER_CRITICAL(&vib_lock);
+    if (capture_dst != NULL) {
+        int take = capture_len - capture_fill;
+        if (take > count) take = count;
+        memcpy(&capture_dst[capture_fill], samples, take * sizeof(vib_sample_t));
+        capture_fill += take;
+        if (capture_fill == capture_len) {
+            capture_dst = NULL;
+            done = true;
+        }
+    }
+    portEXIT_CRITICAL(&vib_lock);
+    if (done) {
+        xSemaphoreGive(capture_done);
+    }
+}
+
+static void process_window(const vibration_config_t *active)
+{
+    int64_t start = esp_timer_get_time();
+    int n = active->fft_size;
+    vib_peak_t peaks[VIB_MAX_PEAKS];
+    vib_orders_t orders;
+
+    // Orders are labelled only against a measured speed; the commanded one
+    // says nothing about a rotor the ESC has not spun up or lost sync on
+    motor_rpm_status_t st;
+    motor_get_rpm_status(active->motor, &st);
+    int32_t rpm = st.measured ? st.measured_rpm : 0;
+    vib_dsp_spectrum(window, n, active->axes, work_amp);
+    int count = vib_dsp_find_peaks(work_amp, n, active->rate_hz, peaks, VIB_MAX_PEAKS);
+    vib_dsp_match_orders(work_amp, n, active->rate_hz, rpm > 0 ? (uint32_t)rpm * 1000 / 60 : 0,
+                         active->blades, peaks, count, &orders);
+    int64_t now = esp_timer_get_time();
+    uint32_t dsp_us = (uint32_t)(now - start);
+
+    xSemaphoreTake(result_mutex, portMAX_DELAY);
+    memcpy(spectrum, work_amp, sizeof(work_amp[0]) * (n / 2));
+    result.seq++;
+    result.time_us = now;
+    result.rate_hz = active->rate_hz;
+    result.fft_size = n;
+    result.rpm = rpm;
+    result.rpm_measured = st.measured;
+    result.orders = orders;
+    result.peak_count = count;
+    memcpy(result.peaks, peaks, sizeof(peaks[0]) * count);
+    have_result = true;
+    uint32_t seq = result.seq;
+    xSemaphoreGive(result_mutex);
+
+    portENTER_CRITICAL(&vib_lock);
+    stats.frames++;
+    stats.last_dsp_us = dsp_us;
+    if (dsp_us > stats.max_dsp_us) stats.max_dsp_us = dsp_us;
+    stats.avg_dsp_us = stats.frames == 1 ? dsp_us : (stats.avg_dsp_us * 7 + dsp_us) / 8;
+    vibration_frame_cb_t cb = frame_cb;
+    portEXIT_CRITICAL(&vib_lock);
+
+    if (cb) {
+        cb(seq);
+    }
+}
+
+static void vibration_task(void *arg)
+{
+    vibration_config_t active;
+    apply_config(&active);
+    int fill = 0;
+
+    while (1) {
+        if (config_pending) {
+            apply_config(&active);
+            fill = 0;
+        }
+        if (!active.enabled) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        int want = active.fft_size - fill;
+        bool overflow = false;
+        int got = imu_read_fifo(&window[fill], want, &overflow);
+
+        portENTER_CRITICAL(&vib_lock);
+        if (got < 0) stats.bus_errors++;
+        else stats.samples += got;
+        if (overflow) stats.fifo_overflows++;
+        portEXIT_CRITICAL(&vib_lock);
+
+        if (got > 0) {
+            record_capture(&window[fill], got);
+            fill += got;
+        }
+        if (overflow) {
+            fill = 0;   // Samples were lost, the window is no longer contiguous
+        }
+        if (fill == active.fft_size) {
+            process_window(&active);
+            // 50% overlap: the second half starts the next window
+            memmove(window, &window[fill / 2], sizeof(window[0]) * (fill / 2));
+            fill /= 2;
+        }
+        if (got < want) {
+            vTaskDelay(VIB_POLL_TICKS);
+        }
+    }
+}
+
+esp_err_t vibration_init(void)
+{
+    result_mutex = xSemaphoreCreateMutexStatic(&result_mutex_buf);
+    capture_mutex = xSemaphoreCreateMutexStatic(&capture_mutex_buf);
+    capture_done = xSemaphoreCreateBinaryStatic(&capture_done_buf);
+    if (!result_mutex || !capture_mutex || !capture_done) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = imu_init(config.rate_hz);
+    stats.sensor_present = err == ESP_OK;
+    if (stats.sensor_present) {
+        imu_stop();
+    } else {
+        ESP_LOGW(TAG, "Vibration analysis unavailable: %s", esp_err_to_name(err));
+    }
+
+    if (MEM_TASK_CREATE(vibration_task, "vibration", NULL, VIB_TASK_PRIORITY, &vib_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t vibration_configure(const vibration_config_t *cfg)
+{
+    if (cfg->enabled && !stats.sensor_present) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    bool rate_ok = cfg->rate_hz == 1000 || cfg->rate_hz == 2000 || cfg->rate_hz == 4000 || cfg->rate_hz == 8000;
+    if (!rate_ok) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cfg->fft_size < VIB_FFT_MIN || cfg->fft_size > VIB_FFT_MAX || (cfg->fft_size & (cfg->fft_size - 1)) != 0 ||
+        (cfg->axes & 0x7) == 0 || cfg->motor >= MOTOR_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&vib_lock);
+    config = *cfg;
+    config.axes &= 0x7;
+    config_pending = true;
+    portEXIT_CRITICAL(&vib_lock);
+    xTaskNotifyGive(vib_task_handle);
+    return ESP_OK;
+}
+
+void vibration_get_config(vibration_config_t *cfg)
+{
+    portENTER_CRITICAL(&vib_lock);
+    *cfg = config;
+    portEXIT_CRITICAL(&vib_lock);
+}
+
+void vibration_get_stats(vibration_stats_t *out)
+{
+    portENTER_CRITICAL(&vib_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&vib_lock);
+}
+
+void vibration_set_frame_callback(vibration_frame_cb_t cb)
+{
+    portENTER_CRITICAL(&vib_lock);
+    frame_cb = cb;
+    portEXIT_CRITICAL(&vib_lock);
+}
+
+bool vibration_get_result(vibration_result_t *out)
+{
+    xSemaphoreTake(result_mutex, portMAX_DELAY);
+    *out = result;
+    bool valid = have_result;
+    xSemaphoreGive(result_mutex);
+    return valid;
+}
+
+int vibration_get_spectrum(uint32_t *amp_q4, int max_bins, vibration_result_t *out)
+{
+    xSemaphoreTake(result_mutex, portMAX_DELAY);
+    int bins = have_result ? result.fft_size / 2 : 0;
+    if (bins > max_bins) bins = max_bins;
+    memcpy(amp_q4, spectrum, sizeof(spectrum[0]) * bins);
+    *out = result;
+    xSemaphoreGive(result_mutex);
+    return bins;
+}
+
+int vibration_capture(vib_sample_t *out, int count, uint32_t timeout_ms)
+{
+    if (count <= 0 || count > VIB_CAPTURE_MAX) {
+        return 0;
+    }
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    xSemaphoreTake(capture_done, 0);   // Stale completion from a capture that timed out
+
+    portENTER_CRITICAL(&vib_lock);
+    capture_dst = out;
+    capture_len = count;
+    capture_fill = 0;
+    portEXIT_CRITICAL(&vib_lock);
+
+    xSemaphoreTake(capture_done, pdMS_TO_TICKS(timeout_ms));
+
+    // Stop recording into the caller's buffer whether or not it filled up
+    portENTER_CRITICAL(&vib_lock);
+    capture_dst = NULL;
+    int recorded = capture_fill;
+    portEXIT_CRITICAL(&vib_lock);
+
+    xSemaphoreGive(capture_mutex);
+    return recorded;
+}
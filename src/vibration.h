@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "imu.h"
+#include "vibration_dsp.h"
+
+// Vibration analysis: a task drains the IMU FIFO into a window, computes a
+// spectrum every half window (50% overlap) and labels its peaks with the
+// order of the measured rotor speed. Off until configured.
+
+#define VIB_DEFAULT_RATE_HZ 4000
+#define VIB_DEFAULT_FFT     1024
+#define VIB_DEFAULT_BLADES  2
+#define VIB_CAPTURE_MAX     8192   // Raw samples in one capture
+
+typedef struct {
+    bool enabled;
+    uint32_t rate_hz;      // IMU output data rate, 1000/2000/4000/8000
+    uint16_t fft_size;     // VIB_FFT_MIN..VIB_FFT_MAX, power of two
+    uint8_t axes;          // Bit 0 = x, 1 = y, 2 = z
+    uint8_t motor;         // Motor whose RPM orders refer to
+    uint8_t blades;        // For the blade pass frequency
+} vibration_config_t;
+
+typedef struct {
+    uint32_t seq;          // Spectra computed since boot
+    int64_t time_us;       // End of the window
+    uint32_t rate_hz;
+    uint16_t fft_size;
+    int32_t rpm;           // Measured rotor speed, 0 without a fresh measurement
+    bool rpm_measured;     // False: no orders, peaks are unlabelled
+    vib_orders_t orders;
+    int peak_count;
+    vib_peak_t peaks[VIB_MAX_PEAKS];
+} vibration_result_t;
+
+typedef struct {
+    bool sensor_present;
+    uint32_t samples;
+    uint32_t fifo_overflows;   // Sensor FIFO filled up, the window was restarted
+    uint32_t bus_errors;
+    uint32_t frames;
+    uint32_t last_dsp_us;      // Spectrum and peak search of one frame
+    uint32_t max_dsp_us;
+    uint32_t avg_dsp_us;
+} vibration_stats_t;
+
+// Called on the vibration task after every new spectrum
+typedef void (*vibration_frame_cb_t)(uint32_t seq);
+
+// Probe the IMU and start the task. Without a sensor the task still runs and
+// vibration_configure() refuses to enable.
+esp_err_t vibration_init(void);
+
+esp_err_t vibration_configure(const vibration_config_t *cfg);
+void vibration_get_config(vibration_config_t *cfg);
+void vibration_get_stats(vibration_stats_t *stats);
+void vibration_set_frame_callback(vibration_frame_cb_t cb);
+
+// Latest spectrum summary, false before the first one
+bool vibration_get_result(vibration_result_t *result);
+
+// Latest amplitude spectrum (fft_size / 2 bins, Q4 of IMU counts). Returns the bin count.
+int vibration_get_spectrum(uint32_t *amp_q4, int max_bins, vibration_result_t *result);
+
+// Record the next count raw samples (up to VIB_CAPTURE_MAX). Blocks until done
+// or timeout, returns the number of samples recorded.
+int vibration_capture(vib_sample_t *out, int count, uint32_t timeout_ms);
+
+// Amplitude in micro-g
+static inline uint32_t vibration_amp_ug(uint32_t amp_q4)
+{
+    return (uint32_t)((uint64_t)amp_q4 * 1000000 / (16 * IMU_LSB_PER_G));
+}
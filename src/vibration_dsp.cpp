@@ -0,0 +1,286 @@
+#include <math.h>
+#include <string.h>
+#include "vibration_dsp.h"
+
+#ifdef ESP_PLATFORM
+#include "dsps_fft2r.h"
+#endif
+
+#define VIB_NOISE_FACTOR 4    // Peaks must stand this far above the median bin
+#define VIB_ORDER_TOL_PCT 3   // Order match tolerance, percent of the rotor frequency
+
+static int fft_n = 0;
+static int16_t window_q15[VIB_FFT_MAX];
+static int16_t fft_buf[2 * VIB_FFT_MAX] __attribute__((aligned(16)));   // Interleaved re/im
+static uint64_t power_q8[VIB_FFT_MAX / 2];
+static uint32_t scratch[VIB_FFT_MAX / 2];
+
+#ifdef ESP_PLATFORM
+
+static bool fft_tables_init(void)
+{
+    static bool ready = false;
+    if (!ready) {
+        ready = dsps_fft2r_init_sc16(NULL, VIB_FFT_MAX) == ESP_OK;
+    }
+    return ready;
+}
+
+// esp-dsp scales by 1/2 per stage, 1/n overall, and leaves the output bit-reversed
+static void fft_sc16(int16_t *data, int n)
+{
+    dsps_fft2r_sc16(data, n);
+    dsps_bit_rev_sc16_ansi(data, n);
+}
+
+#else
+
+static int16_t twiddle_cos[VIB_FFT_MAX / 2];
+static int16_t twiddle_sin[VIB_FFT_MAX / 2];
+
+static bool fft_tables_init(void)
+{
+    for (int k = 0; k < VIB_FFT_MAX / 2; k++) {
+        double a = 2.0 * M_PI * k / VIB_FFT_MAX;
+        twiddle_cos[k] = (int16_t)lrint(cos(a) * 32767.0);
+        twiddle_sin[k] = (int16_t)lrint(sin(a) * 32767.0);
+    }
+    return true;
+}
+
+// Radix-2 decimation in frequency with the same 1/2 per stage scaling as esp-dsp
+static void fft_sc16(int16_t *data, int n)
+{
+    for (int len = n; len >= 2; len >>= 1) {
+        int half = len / 2;
+        int step = VIB_FFT_MAX / len;
+        for (int start = 0; start < n; start += len) {
+            for (int j = 0; j < half; j++) {
+                int16_t *a = &data[2 * (start + j)];
+                int16_t *b = &data[2 * (start + j + half)];
+                int32_t dr = ((int32_t)a[0] - b[0]) >> 1;
+                int32_t di = ((int32_t)a[1] - b[1]) >> 1;
+                a[0] = (int16_t)(((int32_t)a[0] + b[0]) >> 1);
+                a[1] = (int16_t)(((int32_t)a[1] + b[1]) >> 1);
+                int32_t c = twiddle_cos[j * step];
+                int32_t s = twiddle_sin[j * step];
+                b[0] = (int16_t)((dr * c + di * s + (1 << 14)) >> 15);
+                b[1] = (int16_t)((di * c - dr * s + (1 << 14)) >> 15);
+            }
+        }
+    }
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            int16_t re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+}
+
+#endif
+
+static inline int32_t axis_value(const vib_sample_t *s, int axis)
+{
+    return axis == 0 ? s->x : (axis == 1 ? s->y : s->z);
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+bool vib_dsp_init(int n)
+{
+    if (n < VIB_FFT_MIN || n > VIB_FFT_MAX || (n & (n - 1)) != 0) {
+        return false;
+    }
+    if (!fft_tables_init()) {
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        window_q15[i] = (int16_t)lrintf((0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / n)) * 32767.0f);
+    }
+    fft_n = n;
+    return true;
+}
+
+void vib_dsp_spectrum(const vib_sample_t *samples, int n, uint8_t axes, uint32_t *amp_q4)
+{
+    int bins = n / 2;
+    memset(power_q8, 0, sizeof(power_q8[0]) * bins);
+    if (n != fft_n) {
+        memset(amp_q4, 0, sizeof(amp_q4[0]) * bins);
+        return;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (!(axes & (1 << axis))) continue;
+        int32_t sum = 0;
+        for (int i = 0; i < n; i++) sum += axis_value(&samples[i], axis);
+        int32_t mean = sum / n;
+        int32_t peak = 0;
+        for (int i = 0; i < n; i++) {
+            int32_t d = axis_value(&samples[i], axis) - mean;
+            if (d < 0) d = -d;
+            if (d > peak) peak = d;
+        }
+
+        // Block floating point: use all 16 bits going into the FFT, undo it on the power
+        int shift = 0;
+        while (shift < 14 && peak > 0 && (peak << (shift + 1)) <= 32767) shift++;
+        for (int i = 0; i < n; i++) {
+            int32_t d = (axis_value(&samples[i], axis) - mean) << shift;
+            if (d > 32767) d = 32767;
+            if (d < -32768) d = -32768;
+            fft_buf[2 * i] = (int16_t)((d * window_q15[i] + (1 << 14)) >> 15);
+            fft_buf[2 * i + 1] = 0;
+        }
+
+        fft_sc16(fft_buf, n);
+
+        for (int k = 0; k < bins; k++) {
+            int32_t re = fft_buf[2 * k], im = fft_buf[2 * k + 1];
+            uint64_t p = (uint64_t)(re * re) + (uint64_t)(im * im);
+            power_q8[k] += (p << 8) >> (2 * shift);
+        }
+    }
+
+    // One-sided spectrum (x2) of a Hann window (coherent gain 0.5): amplitude = 4 |X|
+    for (int k = 0; k < bins; k++) {
+        amp_q4[k] = isqrt64(power_q8[k]) * 4;
+    }
+}
+
+// k-th smallest of scratch[0..count), partially reorders scratch
+static uint32_t select_kth(uint32_t *a, int count, int k)
+{
+    int lo = 0, hi = count - 1;
+    while (lo < hi) {
+        uint32_t pivot = a[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) {
+                uint32_t t = a[i];
+                a[i] = a[j];
+                a[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return a[k];
+}
+
+uint32_t vib_dsp_bin_mhz(int bin, int n, uint32_t rate_hz)
+{
+    return (uint32_t)((uint64_t)bin * rate_hz * 1000 / n);
+}
+
+int vib_dsp_find_peaks(const uint32_t *amp_q4, int n, uint32_t rate_hz, vib_peak_t *peaks, int max_peaks)
+{
+    int bins = n / 2;
+    memcpy(scratch, &amp_q4[1], sizeof(scratch[0]) * (bins - 1));
+    uint32_t floor_q4 = select_kth(scratch, bins - 1, (bins - 1) / 2);
+    uint32_t threshold = floor_q4 * VIB_NOISE_FACTOR;
+    if (threshold < 16) threshold = 16;   // At least one input unit
+
+    int count = 0;
+    for (int k = 2; k < bins - 1; k++) {
+        uint32_t a = amp_q4[k - 1], b = amp_q4[k], c = amp_q4[k + 1];
+        if (b <= threshold || b < a || b <= c) continue;
+        if (count == max_peaks && b <= peaks[count - 1].amp_q4) continue;
+
+        // Parabolic interpolation between the neighbouring bins, Q8 of a bin
+        int64_t denom = (int64_t)a - 2 * (int64_t)b + c;
+        int32_t delta_q8 = denom != 0 ? (int32_t)(((int64_t)a - c) * 128 / denom) : 0;
+        if (delta_q8 > 128) delta_q8 = 128;
+        if (delta_q8 < -128) delta_q8 = -128;
+
+        vib_peak_t p = {};
+        p.bin = (uint16_t)k;
+        p.amp_q4 = b;
+        p.freq_mhz = (uint32_t)(((int64_t)k * 256 + delta_q8) * rate_hz * 1000 / (256 * (int64_t)n));
+
+        // Insert sorted, strongest first
+        int i = count < max_peaks ? count++ : max_peaks - 1;
+        while (i > 0 && peaks[i - 1].amp_q4 < p.amp_q4) {
+            peaks[i] = peaks[i - 1];
+            i--;
+        }
+        peaks[i] = p;
+    }
+    return count;
+}
+
+// Largest amplitude within a bin of a frequency
+static uint32_t amp_at(const uint32_t *amp_q4, int n, uint32_t rate_hz, uint64_t freq_mhz)
+{
+    int bin = (int)((freq_mhz * n + rate_hz * 500) / ((uint64_t)rate_hz * 1000));
+    if (bin < 1 || bin >= n / 2 - 1) {
+        return 0;
+    }
+    uint32_t best = amp_q4[bin];
+    if (amp_q4[bin - 1] > best) best = amp_q4[bin - 1];
+    if (amp_q4[bin + 1] > best) best = amp_q4[bin + 1];
+    return best;
+}
+
+void vib_dsp_match_orders(const uint32_t *amp_q4, int n, uint32_t rate_hz, uint32_t rotor_mhz,
+                          int blades, vib_peak_t *peaks, int count, vib_orders_t *orders)
+{
+    memset(orders, 0, sizeof(*orders));
+    orders->rotor_mhz = rotor_mhz;
+    if (rotor_mhz == 0) {
+        for (int i = 0; i < count; i++) {
+            peaks[i].order_x100 = 0;
+            peaks[i].harmonic = false;
+        }
+        return;
+    }
+
+    uint32_t tol = rotor_mhz * VIB_ORDER_TOL_PCT / 100;
+    uint32_t bin_mhz = vib_dsp_bin_mhz(1, n, rate_hz);
+    if (tol < bin_mhz) tol = bin_mhz;
+
+    for (int i = 0; i < count; i++) {
+        uint64_t f = peaks[i].freq_mhz;
+        uint64_t order_x100 = (f * 100 + rotor_mhz / 2) / rotor_mhz;
+        peaks[i].order_x100 = order_x100 > 0xFFFF ? 0xFFFF : (uint16_t)order_x100;
+        uint64_t order = (f + rotor_mhz / 2) / rotor_mhz;
+        int64_t err = (int64_t)f - (int64_t)(order * rotor_mhz);
+        if (err < 0) err = -err;
+        peaks[i].harmonic = order >= 1 && err <= tol;
+    }
+
+    orders->amp_1x_q4 = amp_at(amp_q4, n, rate_hz, rotor_mhz);
+    orders->amp_2x_q4 = amp_at(amp_q4, n, rate_hz, 2 * (uint64_t)rotor_mhz);
+    if (blades > 0) {
+        orders->amp_bpf_q4 = amp_at(amp_q4, n, rate_hz, (uint64_t)blades * rotor_mhz);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+// Vibration spectrum pipeline, integer only. The FFT kernels come from esp-dsp
+// on the bench; elsewhere a portable radix-2 kernel with the same scaling
+// stands in, and host/vibration_bench.cpp replays recorded accelerometer data
+// through it.
+
+#define VIB_FFT_MIN  256
+#define VIB_FFT_MAX  1024
+#define VIB_MAX_PEAKS 8
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} vib_sample_t;
+
+typedef struct {
+    uint32_t freq_mhz;     // Interpolated peak frequency, millihertz
+    uint32_t amp_q4;       // Amplitude in input units, Q4
+    uint16_t bin;
+    uint16_t order_x100;   // Multiple of the rotor frequency x100, 0 without RPM
+    bool harmonic;         // Within tolerance of an integer order
+} vib_peak_t;
+
+// Amplitudes at the orders imbalance and blade damage show up at
+typedef struct {
+    uint32_t rotor_mhz;    // 1x, from the measured RPM
+    uint32_t amp_1x_q4;    // Imbalance
+    uint32_t amp_2x_q4;    // Misalignment, loose mount
+    uint32_t amp_bpf_q4;   // Blade pass frequency (blades x 1x)
+} vib_orders_t;
+
+// Build the window and FFT tables for n points (power of two, VIB_FFT_MIN..VIB_FFT_MAX)
+bool vib_dsp_init(int n);
+
+// Combined amplitude spectrum over the enabled axes (bit 0 = x, 1 = y, 2 = z).
+// Removes DC, applies a Hann window and scales each axis to the full int16
+// range before the FFT. Writes n / 2 bins.
+void vib_dsp_spectrum(const vib_sample_t *samples, int n, uint8_t axes, uint32_t *amp_q4);
+
+// Strongest local maxima above the noise floor, strongest first. Returns the count.
+int vib_dsp_find_peaks(const uint32_t *amp_q4, int n, uint32_t rate_hz, vib_peak_t *peaks, int max_peaks);
+
+// Label peaks with their rotor order and measure 1x / 2x / blade pass
+void vib_dsp_match_orders(const uint32_t *amp_q4, int n, uint32_t rate_hz, uint32_t rotor_mhz,
+                          int blades, vib_peak_t *peaks, int count, vib_orders_t *orders);
+
+// Frequency of a bin in millihertz
+uint32_t vib_dsp_bin_mhz(int bin, int n, uint32_t rate_hz);
@@ -0,0 +1,450 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "binlog.h"
+#include "boot_profile.h"
+#include "settings.h"
+#include "wifi_station.h"
+
+static const char *TAG = "wifi_sta";
+
+// Commands and the retry timer are posted to the default event loop, so the
+// state machine only ever runs on the event task
+ESP_EVENT_DECLARE_BASE(WIFI_STATION_EVENT);
+ESP_EVENT_DEFINE_BASE(WIFI_STATION_EVENT);
+
+enum {
+    WIFI_STATION_TIMER,
+    WIFI_STATION_CMD_CONNECT,
+    WIFI_STATION_CMD_FORGET,
+    WIFI_STATION_CMD_SUSPEND,
+    WIFI_STATION_CMD_RESUME
+};
+
+// Event task only
+static wifi_sta_state_t state = WIFI_STA_IDLE;
+static bool attempt_fast = false;      // Current attempt probes only the cached BSSID/channel
+static bool leaving = false;           // Next disconnect was requested by us
+static bool suspended = false;         // Attempts held off, e.g. during a scan
+static esp_timer_handle_t retry_timer = NULL;
+static int64_t timer_deadline_us = 0;  // 0 while the timer is not armed
+static int64_t attempt_start_us = 0;
+static int64_t outage_start_us = 0;
+static int64_t link_up_us = 0;
+static uint64_t reconnect_sum_ms = 0;
+
+// Copied out by the getters on other tasks
+static wifi_station_status_t status = { WIFI_STA_IDLE, false, "", "", "Not connected" };
+static wifi_station_metrics_t metrics;
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+const char *wifi_reason_name(uint8_t reason)
+{
+    switch (reason) {
+        case WIFI_REASON_UNSPECIFIED: return "Unspecified";
+        case WIFI_REASON_AUTH_EXPIRE: return "Auth expired";
+        case WIFI_REASON_AUTH_LEAVE: return "Auth leave";
+        case WIFI_REASON_ASSOC_EXPIRE: return "Assoc expired";
+        case WIFI_REASON_ASSOC_TOOMANY: return "Too many assoc";
+        case WIFI_REASON_NOT_AUTHED: return "Not authenticated";
+        case WIFI_REASON_NOT_ASSOCED: return "Not associated";
+        case WIFI_REASON_ASSOC_LEAVE: return "Assoc leave";
+        case WIFI_REASON_ASSOC_NOT_AUTHED: return "Assoc not authed";
+        case WIFI_REASON_DISASSOC_PWRCAP_BAD: return "Bad power cap";
+        case WIFI_REASON_DISASSOC_SUPCHAN_BAD: return "Bad sup channel";
+        case WIFI_REASON_BSS_TRANSITION_DISASSOC: return "BSS transition";
+        case WIFI_REASON_IE_INVALID: return "Invalid IE";
+        case WIFI_REASON_MIC_FAILURE: return "MIC failure";
+        case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT: return "4-way handshake timeout";
+        case WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT: return "Group key timeout";
+        case WIFI_REASON_IE_IN_4WAY_DIFFERS: return "IE differs in 4-way";
+        case WIFI_REASON_GROUP_CIPHER_INVALID: return "Invalid group cipher";
+        case WIFI_REASON_PAIRWISE_CIPHER_INVALID: return "Invalid pairwise cipher";
+        case WIFI_REASON_AKMP_INVALID: return "Invalid AKMP";
+        case WIFI_REASON_UNSUPP_RSN_IE_VERSION: return "Unsupported RSN IE version";
+        case WIFI_REASON_INVALID_RSN_IE_CAP: return "Invalid RSN IE cap";
+        case WIFI_REASON_802_1X_AUTH_FAILED: return "802.1X auth failed";
+        case WIFI_REASON_CIPHER_SUITE_REJECTED: return "Cipher suite rejected";
+        case WIFI_REASON_INVALID_PMKID: return "Invalid PMKID";
+        case WIFI_REASON_BEACON_TIMEOUT: return "Beacon timeout";
+        case WIFI_REASON_NO_AP_FOUND: return "No AP found";
+        case WIFI_REASON_AUTH_FAIL: return "Authentication failed (wrong password?)";
+        case WIFI_REASON_ASSOC_FAIL: return "Association failed";
+        case WIFI_REASON_HANDSHAKE_TIMEOUT: return "Handshake timeout";
+        case WIFI_REASON_CONNECTION_FAIL: return "Connection failed";
+        case WIFI_REASON_AP_TSF_RESET: return "AP TSF reset";
+        case WIFI_REASON_ROAMING: return "Roaming";
+        default: return "Unknown";
+    }
+}
+
+const char *wifi_station_state_name(wifi_sta_state_t s)
+{
+    switch (s) {
+        case WIFI_STA_IDLE: return "idle";
+        case WIFI_STA_CONNECTING: return "connecting";
+        case WIFI_STA_CONNECTED: return "connected";
+        case WIFI_STA_BACKOFF: return "backoff";
+    }
+    return "unknown";
+}
+
+static void set_state(wifi_sta_state_t s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void set_state(wifi_sta_state_t s, const char *fmt, ...)
+{
+    state = s;
+    char message[sizeof(status.message)];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    portENTER_CRITICAL(&status_lock);
+    status.state = s;
+    strcpy(status.message, message);
+    portEXIT_CRITICAL(&status_lock);
+}
+
+static void retry_timer_cb(void *arg)
+{
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_TIMER, NULL, 0, 0);
+}
+
+static void arm_timer(uint32_t ms)
+{
+    esp_timer_stop(retry_timer);
+    timer_deadline_us = esp_timer_get_time() + (int64_t)ms * 1000;
+    esp_timer_start_once(retry_timer, (uint64_t)ms * 1000);
+}
+
+static void disarm_timer(void)
+{
+    esp_timer_stop(retry_timer);
+    timer_deadline_us = 0;
+}
+
+// Equal jitter: half the exponential delay plus a random share of the other
+// half, so benches that lost the same AP do not retry in lockstep
+static uint32_t backoff_delay(uint32_t round)
+{
+    uint32_t shift = round > 1 ? round - 1 : 0;
+    if (shift > 16) shift = 16;
+    uint32_t delay = WIFI_BACKOFF_BASE_MS << shift;
+    if (delay > WIFI_BACKOFF_MAX_MS) delay = WIFI_BACKOFF_MAX_MS;
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+// Station config for the saved network. A fast attempt probes the cached
+// BSSID on its channel instead of scanning every channel.
+static void start_attempt(bool fast)
+{
+    settings_t cfg;
+    settings_snapshot(&cfg);
+    if (cfg.wifi.ssid[0] == '\0') {
+        set_state(WIFI_STA_IDLE, "Not connected");
+        return;
+    }
+
+    wifi_config_t wifi_config = {};
+    strncpy((char*)wifi_config.sta.ssid, cfg.wifi.ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char*)wifi_config.sta.password, cfg.wifi.password, sizeof(wifi_config.sta.password));
+    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+
+    attempt_fast = fast && cfg.wifi.channel != 0;
+    if (attempt_fast) {
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, cfg.wifi.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = cfg.wifi.channel;
+    } else {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+
+    attempt_start_us = esp_timer_get_time();
+    portENTER_CRITICAL(&status_lock);
+    metrics.attempts++;
+    if (attempt_fast) metrics.fast_attempts++;
+    portEXIT_CRITICAL(&status_lock);
+
+    set_state(WIFI_STA_CONNECTING, "Connecting to %s%s...", cfg.wifi.ssid, attempt_fast ? " (cached AP)" : "");
+    BLOGI("Connecting to '%s'%s", cfg.wifi.ssid, attempt_fast ? " via cached AP" : "");
+    esp_wifi_connect();
+    arm_timer(WIFI_ATTEMPT_TIMEOUT_MS);
+}
+
+// A failed fast attempt falls through to a full scan straight away; a failed
+// scan ends the round and the next one starts after the backoff
+static void attempt_failed(const char *reason)
+{
+    if (attempt_fast) {
+        BLOGI("Cached AP not reachable, scanning all channels");
+        start_attempt(false);
+        return;
+    }
+
+    portENTER_CRITICAL(&status_lock);
+    metrics.rounds++;
+    metrics.backoff_ms = backoff_delay(metrics.rounds);
+    uint32_t delay = metrics.backoff_ms;
+    uint32_t round = metrics.rounds;
+    portEXIT_CRITICAL(&status_lock);
+
+    BLOGI("Round %lu failed (%s), retrying in %lu ms", round, reason, delay);
+    set_state(WIFI_STA_BACKOFF, "Retry in %lu ms: %s", delay, reason);
+    if (!suspended) {
+        arm_timer(delay);
+    }
+}
+
+// Abort whatever the station is doing; the disconnect event that follows is ours
+static void leave(void)
+{
+    disarm_timer();
+    if (state == WIFI_STA_CONNECTED || state == WIFI_STA_CONNECTING) {
+        leaving = true;
+        esp_wifi_disconnect();
+    }
+}
+
+static void link_down(int64_t now)
+{
+    if (state == WIFI_STA_CONNECTED) {
+        portENTER_CRITICAL(&status_lock);
+        metrics.uptime_ms += (now - link_up_us) / 1000;
+        metrics.link_up_ms = 0;
+        status.connected = false;
+        status.ip[0] = '\0';
+        portEXIT_CRITICAL(&status_lock);
+    }
+}
+
+static void on_disconnected(const wifi_event_sta_disconnected_t *disconn)
+{
+    int64_t now = esp_timer_get_time();
+    const char *reason_str = wifi_reason_name(disconn->reason);
+    if (disconn->ssid_len > 0) {
+        char ssid[sizeof(disconn->ssid) + 1];   // Not terminated in the event
+        size_t ssid_len = disconn->ssid_len < sizeof(disconn->ssid) ? disconn->ssid_len : sizeof(disconn->ssid);
+        memcpy(ssid, disconn->ssid, ssid_len);
+        ssid[ssid_len] = '\0';
+        BLOGW("Disconnected from '%s' (reason: %d - %s)", ssid, disconn->reason, reason_str);
+    } else {
+        BLOGW("Disconnected from AP (reason: %d - %s)", disconn->reason, reason_str);
+    }
+    portENTER_CRITICAL(&status_lock);
+    metrics.last_reason = disconn->reason;
+    portEXIT_CRITICAL(&status_lock);
+
+    if (leaving) {
+        leaving = false;
+        return;
+    }
+
+    switch (state) {
+        case WIFI_STA_CONNECTED:
+            // Rejoin right away through the cached AP, usually a single-channel probe
+            link_down(now);
+            outage_start_us = now;
+            portENTER_CRITICAL(&status_lock);
+            metrics.link_losses++;
+            portEXIT_CRITICAL(&status_lock);
+            if (suspended) {
+                set_state(WIFI_STA_BACKOFF, "Link lost: %s", reason_str);
+            } else {
+                start_attempt(true);
+            }
+            break;
+        case WIFI_STA_CONNECTING:
+            disarm_timer();
+            attempt_failed(reason_str);
+            break;
+        default:
+            break;
+    }
+}
+
+static void on_got_ip(const ip_event_got_ip_t *event)
+{
+    if (state == WIFI_STA_IDLE) {
+        return;  // Network was forgotten while this attempt was in flight
+    }
+    int64_t now = esp_timer_get_time();
+    disarm_timer();
+    link_up_us = now;
+
+    settings_t cfg;
+    settings_snapshot(&cfg);
+
+    uint32_t reconnect_ms = (uint32_t)((now - outage_start_us) / 1000);
+    portENTER_CRITICAL(&status_lock);
+    metrics.connects++;
+    if (attempt_fast) metrics.fast_connects++;
+    metrics.rounds = 0;
+    metrics.last_reconnect_ms = reconnect_ms;
+    if (reconnect_ms > metrics.max_reconnect_ms) metrics.max_reconnect_ms = reconnect_ms;
+    reconnect_sum_ms += reconnect_ms;
+    metrics.avg_reconnect_ms = (uint32_t)(reconnect_sum_ms / metrics.connects);
+    metrics.last_attempt_ms = (uint32_t)((now - attempt_start_us) / 1000);
+    status.connected = true;
+    snprintf(status.ip, sizeof(status.ip), IPSTR, IP2STR(&event->ip_info.ip));
+    strncpy(status.ssid, cfg.wifi.ssid, sizeof(status.ssid) - 1);
+    portEXIT_CRITICAL(&status_lock);
+
+    set_state(WIFI_STA_CONNECTED, "✓ Connected! IP: %s", status.ip);
+    BLOGI("✓ Connected! Got IP: %s in %lu ms%s", status.ip, reconnect_ms,
+          attempt_fast ? " (cached AP)" : "");
+    boot_mark("got_ip");
+
+    // Cache the AP so the next reconnect or boot can skip the scan
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        settings_set_ap(ap_info.bssid, ap_info.primary);
+    }
+}
+
+static void on_command(int32_t id)
+{
+    int64_t now = esp_timer_get_time();
+    switch (id) {
+        case WIFI_STATION_TIMER:
+            if (timer_deadline_us == 0 || now < timer_deadline_us || suspended) {
+                break;  // Stale, the timer was re-armed or stopped after it fired
+            }
+            timer_deadline_us = 0;
+            if (state == WIFI_STA_CONNECTING) {
+                portENTER_CRITICAL(&status_lock);
+                metrics.timeouts++;
+                portEXIT_CRITICAL(&status_lock);
+                leaving = true;
+                esp_wifi_disconnect();
+                attempt_failed("Attempt timed out");
+            } else if (state == WIFI_STA_BACKOFF) {
+                start_attempt(true);
+            }
+            break;
+
+        case WIFI_STATION_CMD_CONNECT: {
+            leave();
+            link_down(now);
+            portENTER_CRITICAL(&status_lock);
+            metrics.rounds = 0;
+            portEXIT_CRITICAL(&status_lock);
+            outage_start_us = now;
+
+            wifi_mode_t mode;
+            if (esp_wifi_get_mode(&mode) == ESP_OK && mode == WIFI_MODE_AP) {
+                // The attempt starts on WIFI_EVENT_STA_START
+                set_state(WIFI_STA_CONNECTING, "Starting station...");
+                esp_wifi_set_mode(WIFI_MODE_APSTA);
+            } else {
+                start_attempt(true);
+            }
+            break;
+        }
+
+        case WIFI_STATION_CMD_FORGET:
+            leave();
+            leaving = false;
+            link_down(now);
+            set_state(WIFI_STA_IDLE, "Not connected");
+            esp_wifi_set_mode(WIFI_MODE_AP);
+            break;
+
+        case WIFI_STATION_CMD_SUSPEND:
+            suspended = true;
+            if (state == WIFI_STA_CONNECTING) {
+                leave();
+                set_state(WIFI_STA_BACKOFF, "Paused for scan");
+            } else if (state == WIFI_STA_BACKOFF) {
+                disarm_timer();
+            }
+            break;
+
+        case WIFI_STATION_CMD_RESUME:
+            suspended = false;
+            if (state == WIFI_STA_BACKOFF) {
+                start_attempt(true);
+            }
+            break;
+    }
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        boot_mark("sta_start");
+        if (settings_get()->wifi.ssid[0] != '\0' && !suspended) {
+            outage_start_us = esp_timer_get_time();
+            start_attempt(true);
+        }
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        on_disconnected((const wifi_event_sta_disconnected_t *)event_data);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        on_got_ip((const ip_event_got_ip_t *)event_data);
+    } else if (event_base == WIFI_STATION_EVENT) {
+        on_command(event_id);
+    }
+}
+
+esp_err_t wifi_station_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_retry",
+        .skip_unhandled_events = true
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &retry_timer);
+    if (err == ESP_OK) err = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL);
+    if (err == ESP_OK) err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL);
+    if (err == ESP_OK) err = esp_event_handler_register(WIFI_STATION_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL);
+    return err;
+}
+
+void wifi_station_connect(void)
+{
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_CMD_CONNECT, NULL, 0, portMAX_DELAY);
+}
+
+void wifi_station_forget(void)
+{
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_CMD_FORGET, NULL, 0, portMAX_DELAY);
+}
+
+void wifi_station_suspend(void)
+{
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_CMD_SUSPEND, NULL, 0, portMAX_DELAY);
+}
+
+void wifi_station_resume(void)
+{
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_CMD_RESUME, NULL, 0, portMAX_DELAY);
+}
+
+void wifi_station_get_status(wifi_station_status_t *out)
+{
+    portENTER_CRITICAL(&status_lock);
+    *out = status;
+    portEXIT_CRITICAL(&status_lock);
+}
+
+void wifi_station_get_metrics(wifi_station_metrics_t *out)
+{
+    portENTER_CRITICAL(&status_lock);
+    *out = metrics;
+    if (status.connected) {
+        out->link_up_ms = (uint32_t)((esp_timer_get_time() - link_up_us) / 1000);
+        out->uptime_ms += out->link_up_ms;
+    }
+    portEXIT_CRITICAL(&status_lock);
+}
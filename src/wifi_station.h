@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Station link to the saved network. A state machine on the default event
+// loop reconnects after every link loss without giving up: first against the
+// cached BSSID/channel, then with a full scan, then again after a jittered
+// exponential backoff. The AP side is not affected.
+
+#define WIFI_BACKOFF_BASE_MS     500     // Delay before the second round of attempts
+#define WIFI_BACKOFF_MAX_MS      30000
+#define WIFI_ATTEMPT_TIMEOUT_MS  15000   // Attempt without GOT_IP or a disconnect counts as failed
+
+typedef enum {
+    WIFI_STA_IDLE,          // No saved network
+    WIFI_STA_CONNECTING,
+    WIFI_STA_CONNECTED,     // Associated and has an IP
+    WIFI_STA_BACKOFF        // Waiting before the next round of attempts
+} wifi_sta_state_t;
+
+typedef struct {
+    wifi_sta_state_t state;
+    bool connected;
+    char ssid[33];
+    char ip[16];
+    char message[64];
+} wifi_station_status_t;
+
+typedef struct {
+    uint32_t attempts;
+    uint32_t fast_attempts;       // Attempts against the cached BSSID/channel
+    uint32_t connects;            // Attempts that got an IP
+    uint32_t fast_connects;       // ...of which were fast attempts
+    uint32_t link_losses;         // Disconnects of an established link
+    uint32_t timeouts;
+    uint32_t rounds;              // Consecutive failed rounds, resets on connect
+    uint32_t backoff_ms;          // Last backoff delay chosen
+    uint32_t last_reconnect_ms;   // Link loss (or first attempt) to IP
+    uint32_t max_reconnect_ms;
+    uint32_t avg_reconnect_ms;
+    uint32_t last_attempt_ms;     // Start of the successful attempt to IP
+    uint64_t uptime_ms;           // Total time with an IP since boot
+    uint32_t link_up_ms;          // Current link, 0 while down
+    uint8_t last_reason;          // Last disconnect reason code
+} wifi_station_metrics_t;
+
+// Register the event handlers and pick up the saved network. Call after
+// esp_wifi_init() and before esp_wifi_start().
+esp_err_t wifi_station_init(void);
+
+// The saved network changed: drop the current link and connect to it now
+void wifi_station_connect(void);
+
+// The saved network was cleared: stop connecting and return to AP-only mode
+void wifi_station_forget(void);
+
+// Hold off connect attempts while the radio is needed for a scan. An
+// established link is kept.
+void wifi_station_suspend(void);
+void wifi_station_resume(void);
+
+void wifi_station_get_status(wifi_station_status_t *status);
+void wifi_station_get_metrics(wifi_station_metrics_t *metrics);
+const char *wifi_station_state_name(wifi_sta_state_t state);
+const char *wifi_reason_name(uint8_t reason);
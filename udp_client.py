@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+ESP32-C6 Service Bench UDP control client
+Sends compact binary throttle packets and decodes the telemetry replies
+(wire format defined in src/udp_protocol.h)
+"""
+
+import socket
+import struct
+import time
+from collections import namedtuple
+
+DEFAULT_PORT = 4210
+MAGIC = 0x4455
+VERSION = 3
+MAX_MOTORS = 4
+UNCHANGED = 0xFFFF
+
+FLAG_RESET_SEQ = 0x01
+FLAG_DISARM = 0x02
+FLAG_NO_REPLY = 0x04
+FLAG_MONITOR = 0x08
+
+TLM_FAILSAFE = 0x01
+TLM_REJECTED = 0x02
+TLM_ESC_FRESH = 0x10                  # Shifted left by the motor index
+
+CONTROL_FORMAT = '<HBBIIH4H'          # 22 bytes
+TELEMETRY_FORMAT = '<HBBIIIHH4H4HII4b4H4H'  # 64 bytes
+
+Telemetry = namedtuple('Telemetry', [
+    'seq', 'rtt_us', 'apply_us', 'bench_time_us', 'battery_v',
+    'throttle', 'rpm', 'failsafe', 'rejected', 'failsafe_trips', 'rejected_total',
+    'esc_fresh', 'esc_temp_c', 'esc_voltage_v', 'esc_current_a'])
+
+
+def now_us():
+    """Host timestamp carried in each packet (wraps at 32 bits)"""
+    return int(time.perf_counter() * 1e6) & 0xFFFFFFFF
+
+
+class BenchUdpClient:
+    """Throttle control over the bench's UDP channel"""
+
+    def __init__(self, host, port=DEFAULT_PORT, timeout=0.2, failsafe_ms=250):
+        self.addr = (host, port)
+        self.failsafe_ms = failsafe_ms
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+        self.seq = 0
+        self.first = True
+
+    def _send(self, flags, throttle, failsafe_ms):
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        if self.first and not flags & FLAG_MONITOR:
+            flags |= FLAG_RESET_SEQ
+            self.first = False
+        slots = list(throttle)[:MAX_MOTORS]
+        slots += [UNCHANGED] * (MAX_MOTORS - len(slots))
+        packet = struct.pack(CONTROL_FORMAT, MAGIC, VERSION, flags, self.seq,
+                             now_us(), failsafe_ms, *slots)
+        self.sock.sendto(packet, self.addr)
+        return self.seq
+
+    def _receive(self, seq):
+        """Wait for the reply to seq, skipping late replies to earlier packets"""
+        while True:
+            try:
+                data, _ = self.sock.recvfrom(128)
+            except socket.timeout:
+                return None
+            received_us = now_us()
+            if len(data) != struct.calcsize(TELEMETRY_FORMAT):
+                continue
+            fields = struct.unpack(TELEMETRY_FORMAT, data)
+            magic, version, flags, reply_seq, host_time_us, bench_time_us, apply_us, battery_mv = fields[:8]
+            if magic != MAGIC or version != VERSION or reply_seq != seq:
+                continue
+            return Telemetry(
+                seq=reply_seq,
+                rtt_us=(received_us - host_time_us) & 0xFFFFFFFF,
+                apply_us=apply_us,
+                bench_time_us=bench_time_us,
+                battery_v=battery_mv / 1000.0,
+                throttle=list(fields[8:12]),
+                rpm=list(fields[12:16]),
+                failsafe=bool(flags & TLM_FAILSAFE),
+                rejected=bool(flags & TLM_REJECTED),
+                failsafe_trips=fields[16],
+                rejected_total=fields[17],
+                esc_fresh=[bool(flags & (TLM_ESC_FRESH << m)) for m in range(MAX_MOTORS)],
+                esc_temp_c=list(fields[18:22]),
+                esc_voltage_v=[v / 100.0 for v in fields[22:26]],
+                esc_current_a=[c / 100.0 for c in fields[26:30]])
+
+    def send_throttle(self, throttle, failsafe_ms=None, reply=True):
+        """Set per-motor throttle (0-1000 per mille, None = unchanged).
+        Returns Telemetry, or None if no reply was requested or it timed out."""
+        values = [UNCHANGED if t is None else int(t) for t in throttle]
+        if failsafe_ms is None:
+            failsafe_ms = self.failsafe_ms
+        seq = self._send(0 if reply else FLAG_NO_REPLY, values, failsafe_ms)
+        return self._receive(seq) if reply else None
+
+    def monitor(self):
+        """Read telemetry without applying anything or touching the sequence"""
+        seq = self._send(FLAG_MONITOR, [UNCHANGED] * MAX_MOTORS, 0)
+        return self._receive(seq)
+
+    def disarm(self):
+        """Stop all outputs and disarm the failsafe"""
+        seq = self._send(FLAG_DISARM, [UNCHANGED] * MAX_MOTORS, 0)
+        return self._receive(seq)
+
+    def close(self):
+        self.sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.disarm()
+        self.close()
+
+
+if __name__ == '__main__':
+    import sys
+    host = sys.argv[1] if len(sys.argv) > 1 else '192.168.4.1'
+    with BenchUdpClient(host) as bench:
+        tlm = bench.send_throttle([0, 0])
+        if tlm is None:
+            print(f"❌ No reply from {host}:{DEFAULT_PORT}")
+            sys.exit(1)
+        print(f"✅ {host}: battery {tlm.battery_v:.2f}V, RTT {tlm.rtt_us} µs, apply {tlm.apply_us} µs")